@@ -21,6 +21,14 @@
 #include "dataSet.h"
 #include "types.h"
 #include "timer.h"
+#include "preproccache.h"
+#include "taskgraph.h"
+#include "manifest.h"
+#include "brickfile.h"
+#include "licengine.h"
+#include "licraycast.h"
+#include "offscreen.h"
+#include "batchscript.h"
 #include "parseArg.h"
 #include "3DLIC.h"
 
@@ -90,9 +98,22 @@ void displayTest(void)
 }
 
 
+// the macro cells are only classified again if the transfer function
+// held by the textures changed
+void updateMacroCellTF(void)
+{
+	MacroCellGrid *cells = vd.getMacroCells();
+
+	if (cells)
+		cells->setTransferFunction(tfEdit.getTextureTFData(), tfEdit.getNumEntries(),
+			tfEdit.getTextureRGB()->width);
+}
+
+
 void display(void)
 {
 	char fpsStr[10];
+	int lod = renderer.getLevelOfDetail();
 
 	fpsCounter.frameStart();
 
@@ -100,7 +121,17 @@ void display(void)
 
 	//double timetest = timer();
 
+	updateMacroCellTF();
 	renderer.render(updateScene || updateSceneCont);
+	if (renderer.getLevelOfDetail() != lod)
+		updateHUD();
+	// the progressive refinement continues until something changes
+	if (renderer.isProgressiveEnabled())
+	{
+		updateScene = false;
+		if (renderer.isRefining())
+			glutPostRedisplay();
+	}
 
 	//std::cout << "cost for render" << timetest - timer() << std::endl;
 	//updateScene = true;
@@ -126,7 +157,9 @@ void display(void)
 }
 
 
-void idle(void)
+// advance the animation, with wait == true the next key frame is
+// loaded instead of holding the current frame
+void updateTimeStep(bool wait)
 {
 	//Move volume data to next time step
 	int idx = vd.getCurTimeStep();
@@ -135,16 +168,37 @@ void idle(void)
 	//vd.getVolumeData()->newData = vd.getVolumeData()->dataSets[vd.NextTimeStep()];
 
 	//vd.createTexture("VectorData_Tex", GL_TEXTURE2_ARB, true);
-	if(animationMode && (renderTechnique == VOLIC_SLICING || renderTechnique == VOLIC_RAYCAST || renderTechnique == VOLIC_LICVOLUME))
-		vd.createTextureIterp("VectorData_Tex", GL_TEXTURE2_ARB, true);
-	if(animationMode && renderTechnique == VOLIC_LICVOLUME)
-		renderer.updateLICVolume();
-	vd.checkInterpolateStage();
+	// hold the current frame instead of stalling while the next key frame
+	// is still being loaded in the background
+	bool keyFrameReady = wait || vd.isKeyFrameReady();
+	if(animationMode && keyFrameReady && (renderTechnique == VOLIC_VOLUME || renderTechnique == VOLIC_SLICING || renderTechnique == VOLIC_RAYCAST || renderTechnique == VOLIC_LICVOLUME))
+	{
+		if (vd.hasKeyFrameTextures())
+		{
+			// only the blend weight changes, key frames stay on the GPU
+			vd.updateKeyFrameTextures();
+			renderer.setKeyFrameWeight(vd.getKeyFrameWeight());
+		}
+		else
+			vd.createTextureIterp("VectorData_Tex", GL_TEXTURE2_ARB, true);
+	}
+	if(animationMode && keyFrameReady && renderTechnique == VOLIC_LICVOLUME)
+		renderer.updateLICVolume(vd.getTextureWeight());
+	if (animationMode && keyFrameReady)
+		updateScene = true;
+	if (keyFrameReady)
+		vd.checkInterpolateStage();
 
 	//renderer.setDataTex(vd.getTextureSetRef(idx));
 
 	//Update Render Animation source
 	renderer.setVolumeData(vd.getVolumeData());
+}
+
+
+void idle(void)
+{
+	updateTimeStep(false);
 
 	// check whether to change to high res rendering
 	if (requestHighRes && renderer.isLowResEnabled())
@@ -196,7 +250,7 @@ void resize(int width, int height)
 		clipPlanes[i].setWindow(width, height);
 
 	tfEdit.resize(width, height);
-	hud.SetViewport(viewport, true);
+	hud.SetViewport(viewport, !headless);
 	CHECK_FOR_OGL_ERROR();
 
 	aspect = (float)width / height;
@@ -209,6 +263,7 @@ void updateHUD(bool forceUpdate)
 {
 	char buf[1024];
 	char technique[30];
+	char lod[30] = "";
 
 	switch (renderTechnique)
 	{
@@ -226,15 +281,20 @@ void updateHUD(bool forceUpdate)
 		break;
 	}
 
+	if (vd.getPyramidLevels() > 1)
+		snprintf(lod, 30, " LOD %d%s", renderer.getLevelOfDetail(),
+			(renderer.isLevelOfDetailEnabled() ? "" : " (off)"));
+
 	snprintf(buf, 1024, "%s%s   Samp. Dist: %.6f   LIC Params: %.4f  %d/%d\n"
-		"Gradient Scale: %.1f   Freqency Scale: %.1f   Illum Scale: %.2f  %s%s",
+		"Gradient Scale: %.1f   Freqency Scale: %.1f   Illum Scale: %.2f  %s%s%s%s",
 		technique, (renderer.isFBOenabled() ? " (FBO)" : ""),
 		licParams.stepSizeVol, licParams.stepSizeLIC,
 		licParams.stepsForward, licParams.stepsBackward,
 		licParams.gradientScale, licParams.freqScale,
 		licParams.illumScale,
 		(updateSceneCont ? "cont" : ""),
-		(renderer.isLowResEnabled() ? " lowRes" : ""));
+		(renderer.isLowResEnabled() ? " lowRes" : ""),
+		(renderer.isProgressiveEnabled() ? " prog" : ""), lod);
 
 	hud.SetText(buf, forceUpdate);
 }
@@ -297,6 +357,38 @@ void keyboard(unsigned char key, int x, int y)
 		updateScene = true;
 		updateHUD();
 		break;
+	case 'o': // level of detail of the vector field
+		renderer.enableLevelOfDetail(!renderer.isLevelOfDetailEnabled());
+		updateScene = true;
+		updateHUD();
+		break;
+	case 'e': // empty space skipping
+		renderer.enableEmptySpaceSkipping(!renderer.isEmptySpaceSkippingEnabled());
+		if (renderer.isEmptySpaceSkippingEnabled() && vd.getMacroCells())
+			std::cout << "Empty space skipping on, visible macro cells: "
+				<< 100.0f * vd.getMacroCells()->getVisibleFraction(0) << "% (magnitude), "
+				<< 100.0f * vd.getMacroCells()->getVisibleFraction(1) << "% (LIC)"
+				<< std::endl;
+		else
+			std::cout << "Empty space skipping off" << std::endl;
+		updateScene = true;
+		break;
+	case 'i': // pre-integrated transfer function
+		renderer.enablePreIntegration(!renderer.isPreIntegrationEnabled());
+		renderer.reloadGLSLShader();
+		std::cout << "Pre-integrated transfer function "
+			<< (renderer.isPreIntegrationEnabled() ? "on" : "off") << std::endl;
+		updateScene = true;
+		break;
+	case 'P': // progressive refinement, averaged in the FBO
+		renderer.enableProgressive(!renderer.isProgressiveEnabled());
+		if (renderer.isProgressiveEnabled())
+			renderer.enableFBO(true);
+		std::cout << "Progressive refinement "
+			<< (renderer.isProgressiveEnabled() ? "on" : "off") << std::endl;
+		updateHUD();
+		updateScene = true;
+		break;
 	case 'I': // switch idle redrawing
 		useIdle = !useIdle;
 		if (useIdle)
@@ -659,6 +751,17 @@ void initGL(void)
 	glEnable(GL_DEPTH_TEST);
 	glClearColor(1.0f, 1.0f, 1.0f, 0.0f);
 
+	renderer.enableKeyFrameInterpolation(arguments.getKeyFrameFlag());
+	renderer.enablePreIntegration(arguments.getPreIntFlag());
+	renderer.enableLICBricks(arguments.getLICBricksFlag());
+	renderer.enableLayeredLIC(arguments.getLayeredFlag());
+	if (arguments.getProgressiveFrames() > 0)
+	{
+		// the frames are averaged in the FBO
+		renderer.enableProgressive(true);
+		renderer.setProgressiveFrames(arguments.getProgressiveFrames());
+		renderer.enableFBO(true);
+	}
 	renderer.init();
 
 	if (!hud.Init())
@@ -674,6 +777,91 @@ void initGL(void)
 }
 
 
+// load the data sets like init() without creating any texture and
+// compute the LIC volume on the CPU
+bool bakeLIC(void)
+{
+	int size = arguments.getLicVolumeSize();
+
+	if (arguments.getCacheFlag() && arguments.getCacheDirectory())
+	{
+		PreprocCache::getInstance().setDirectory(arguments.getCacheDirectory());
+		PreprocCache::getInstance().enable(true);
+	}
+
+	if (!vd.loadData(arguments.getVolFileName()))
+	{
+		std::cerr << "Could not load data ..." << std::endl;
+		return false;
+	}
+	vd.enableMemoryMapping(arguments.getMemoryMappingFlag());
+	if (!vd.loadKeyFrames(vd.getCurTimeStep(), vd.NextTimeStep()))
+	{
+		std::cerr << "Could not load time steps ..." << std::endl;
+		return false;
+	}
+
+	noise.loadData(arguments.getNoiseFileName());
+	if (!scalar.loadData(SCALAR_FILE_NAME))
+		std::cerr << "Could not load scalar data ... using the whole volume"
+			<< std::endl;
+	if (!licFilter.loadData(arguments.getLicFilterFileName()))
+	{
+		std::cerr << "could not load lic filter kernel ... using box filter"
+			<< std::endl;
+		licFilter.createBoxFilter();
+	}
+
+	return bakeLICVolume(arguments.getCpuLicFileName(), &vd, &noise, &scalar,
+		&licFilter, &licParams, (size > 0) ? size : LIC_VOLUME_SIZE);
+}
+
+
+bool renderPreview(void)
+{
+	if (arguments.getCacheFlag() && arguments.getCacheDirectory())
+	{
+		PreprocCache::getInstance().setDirectory(arguments.getCacheDirectory());
+		PreprocCache::getInstance().enable(true);
+	}
+
+	if (!vd.loadData(arguments.getVolFileName()))
+	{
+		std::cerr << "Could not load data ..." << std::endl;
+		return false;
+	}
+	vd.enableMemoryMapping(arguments.getMemoryMappingFlag());
+	if (!vd.loadKeyFrames(vd.getCurTimeStep(), vd.NextTimeStep()))
+	{
+		std::cerr << "Could not load time steps ..." << std::endl;
+		return false;
+	}
+	if (arguments.getTfFileName() && !tfEdit.loadTF(arguments.getTfFileName()))
+		std::cerr << "Could not load transfer function ..." << std::endl;
+
+	// the LIC volume is only computed if none is given
+	if (!arguments.getLicVolumeFileName())
+	{
+		noise.loadData(arguments.getNoiseFileName());
+		if (!scalar.loadData(SCALAR_FILE_NAME))
+			std::cerr << "Could not load scalar data ... using the whole volume"
+				<< std::endl;
+		if (!licFilter.loadData(arguments.getLicFilterFileName()))
+		{
+			std::cerr << "could not load lic filter kernel ... using box filter"
+				<< std::endl;
+			licFilter.createBoxFilter();
+		}
+	}
+
+	int size = arguments.getLicVolumeSize();
+	return renderLICPreview(arguments.getCpuRenderFileName(),
+		arguments.getLicVolumeFileName(), &vd, &noise, &scalar, &licFilter,
+		&tfEdit, &cam, &licParams, WINDOW_WIDTH, WINDOW_HEIGHT,
+		(size > 0) ? size : LIC_VOLUME_SIZE);
+}
+
+
 void init(void)
 {
 	VolumeData *volumeData = NULL;
@@ -683,70 +871,169 @@ void init(void)
 	renderer.setLight(&light);
 	renderer.setCamera(&cam);
 
-	// load data set    
-	if (!vd.loadData(arguments.getVolFileName()))
+	// gradients, textures and tables of earlier runs are reused if a
+	// cache directory was given
+	if (arguments.getCacheFlag() && arguments.getCacheDirectory())
 	{
-		std::cerr << "Could not load data ..." << std::endl;
-		exit(1);
+		PreprocCache::getInstance().setDirectory(arguments.getCacheDirectory());
+		PreprocCache::getInstance().enable(true);
 	}
-	//for (int i = vd.getTimeStepBegin(); i <= vd.getTimeStepEnd(); i++)
-	//{
-	//	void* datap = vd.loadTimeStep(vd.getCurTimeStep());
-	//	vd.getVolumeData()->dataSets.push_back(datap);
-	//	vd.getNextTimeStep();
-	//}
-	
-	//vd.getVolumeData()->data = vd.getVolumeData()->dataSets[vd.getCurTimeStep()];
-	//vd.getVolumeData()->newData = vd.getVolumeData()->dataSets[vd.NextTimeStep()];
-	vd.getVolumeData()->data = vd.loadTimeStep(vd.getCurTimeStep());
-	vd.getVolumeData()->newData = vd.loadTimeStep(vd.NextTimeStep());
-	//vd.createTextures("VectorData_Tex", vd.getVolumeData()->dataSets.size(), GL_TEXTURE2_ARB, true);
-	// Set Interpolation step size
-	vd.setInterpolateSize(10);
-	//vd.createTexture("VectorData_Tex", GL_TEXTURE2_ARB, true);
-	vd.createTextureIterp("VectorData_Tex", GL_TEXTURE2_ARB, true);
-	vd.checkInterpolateStage();
 
-	// load noise data
-	noise.loadData(arguments.getNoiseFileName());
-	noise.enableGradient(arguments.getGradientsFlag());
-	noise.createTexture("Noise_Tex", GL_TEXTURE3_ARB);
-	std::cout << std::endl;
+	// stages without OpenGL calls run concurrently on worker threads,
+	// their textures are created on this thread once they are done
+	TaskGraph startup;
+	bool tfLoaded = true;
+
+	// load data set
+	int vecLoad = startup.addTask("vector data", [&]
+	{
+		if (!vd.loadData(arguments.getVolFileName()))
+		{
+			std::cerr << "Could not load data ..." << std::endl;
+			return false;
+		}
+		vd.enableMemoryMapping(arguments.getMemoryMappingFlag());
+		vd.enablePrefetch(arguments.getPrefetchDepth());
+		vd.setMemoryLimit((size_t)arguments.getMemoryLimit() * 1024 * 1024);
+		vd.enableOutOfCore((size_t)arguments.getOutOfCoreBudget() * 1024 * 1024,
+			arguments.getBrickSize());
+		vd.enablePyramid(arguments.getLODFlag());
+		vd.enableMacroCells(arguments.getSkipFlag());
+		if (!vd.loadKeyFrames(vd.getCurTimeStep(), vd.NextTimeStep()))
+		{
+			std::cerr << "Could not load time steps ..." << std::endl;
+			return false;
+		}
+		return true;
+	});
+
+	// load noise data and compute its gradients
+	int noiseLoad = startup.addTask("noise and gradients", [&]
+	{
+		noise.loadData(arguments.getNoiseFileName());
+		noise.enableGradient(arguments.getGradientsFlag());
+		return noise.computeTextureData();
+	});
 
 	// load secondary scalar volume data
-	if (!scalar.loadData("..\\data\\outputraw\\out_64_0_temperature.dat"))
+	int scalarLoad = startup.addTask("scalar data", [&]
 	{
-		std::cerr << "Could not load data ..." << std::endl;
-		exit(1);
-	}
-	scalar.createTexture("Scalar_Tex", GL_TEXTURE4_ARB);
+		if (!scalar.loadData(SCALAR_FILE_NAME))
+		{
+			std::cerr << "Could not load data ..." << std::endl;
+			return false;
+		}
+		return true;
+	});
 
 	// load LIC filter kernel
-	if (!licFilter.loadData(arguments.getLicFilterFileName()))
+	int filterLoad = startup.addTask("LIC filter", [&]
 	{
-		std::cerr << "could not load lic filter kernel ... using box filter"
-			<< std::endl;
-		licFilter.createBoxFilter();
-	}
-	licFilter.createTexture("LIC_kernel_Tex", GL_TEXTURE5_ARB);
+		if (!licFilter.loadData(arguments.getLicFilterFileName()))
+		{
+			std::cerr << "could not load lic filter kernel ... using box filter"
+				<< std::endl;
+			licFilter.createBoxFilter();
+		}
+		return true;
+	});
 
-	// create illumination textures for Zoeckler and Mallo
-	//illum.setDebugMode(true);
-	illum.createIllumTextures(true, true, true);
-	glLightf(GL_LIGHT0, GL_SPOT_EXPONENT, illum.getSpecularExp());
-	std::cout << std::endl;
+	// compute illumination tables for Zoeckler and Mallo
+	int illumCompute = startup.addTask("illumination tables", [&]
+	{
+		//illum.setDebugMode(true);
+		illum.computeIllumTables(true, true);
+		return true;
+	});
+
+	int tfLoad = startup.addTask("transfer function", [&]
+	{
+		if (arguments.getTfFileName())
+			tfLoaded = tfEdit.loadTF(arguments.getTfFileName());
+		return true;
+	});
+
+	int histogram = startup.addTask("histogram", [&]
+	{
+		// the manifest holds the histogram of every time step
+		const TimeStepInfo *info = vd.getTimeStepInfo(vd.getCurTimeStep());
+		if (info)
+			tfEdit.setHistogram(info->histogram);
+		else if (vd.isOutOfCore())
+		{
+			std::vector<int> counts(tfEdit.getNumEntries());
+			if (vd.computeHistogram(vd.getCurTimeStep(), &counts[0], tfEdit.getNumEntries()))
+				tfEdit.setHistogram(&counts[0]);
+		}
+		else
+			tfEdit.computeHistogram(vd.getVolumeData());
+		return true;
+	});
+	startup.addDependency(histogram, vecLoad);
+
+	// texture uploads in the order of the original startup
+	int vecTex = startup.addTask("vector textures", [&]
+	{
+		// Set Interpolation step size
+		vd.setInterpolateSize(10);
+		if (arguments.getKeyFrameFlag())
+			vd.createKeyFrameTextures("VectorData_Tex", GL_TEXTURE2_ARB, GL_TEXTURE6_ARB, true);
+		else
+			vd.createTextureIterp("VectorData_Tex", GL_TEXTURE2_ARB, true, true);
+		return true;
+	}, true);
+	startup.addDependency(vecTex, vecLoad);
 
-	if (arguments.getTfFileName())
+	int noiseTex = startup.addTask("noise texture", [&]
 	{
-		if (!tfEdit.loadTF(arguments.getTfFileName()))
+		noise.createTexture("Noise_Tex", GL_TEXTURE3_ARB);
+		return true;
+	}, true);
+	startup.addDependency(noiseTex, noiseLoad);
+
+	int scalarTex = startup.addTask("scalar texture", [&]
+	{
+		scalar.createTexture("Scalar_Tex", GL_TEXTURE4_ARB);
+		return true;
+	}, true);
+	startup.addDependency(scalarTex, scalarLoad);
+
+	int filterTex = startup.addTask("LIC filter texture", [&]
+	{
+		licFilter.createTexture("LIC_kernel_Tex", GL_TEXTURE5_ARB);
+		return true;
+	}, true);
+	startup.addDependency(filterTex, filterLoad);
+
+	int illumTex = startup.addTask("illumination textures", [&]
+	{
+		illum.createIllumTextures(true, true, true);
+		glLightf(GL_LIGHT0, GL_SPOT_EXPONENT, illum.getSpecularExp());
+		return true;
+	}, true);
+	startup.addDependency(illumTex, illumCompute);
+
+	int tfTex = startup.addTask("transfer function textures", [&]
+	{
+		if (!tfLoaded)
 		{
 			std::cerr << "could not load transfer function"
 				<< std::endl;
 		}
-	}
-	updateScene = tfEdit.isSceneUpdateNeeded();
-	tfEdit.updateTextures();
-	tfEdit.computeHistogram(vd.getVolumeData());
+		updateScene = tfEdit.isSceneUpdateNeeded();
+		tfEdit.updateTextures();
+		return true;
+	}, true);
+	startup.addDependency(tfTex, tfLoad);
+
+	if (!startup.run())
+		exit(1);
+	std::cout << std::endl;
+	startup.printTimings("Startup");
+	std::cout << std::endl;
+
+	// the key frames may only be switched after the histogram was computed
+	vd.checkInterpolateStage();
 	CHECK_FOR_OGL_ERROR();
 
 	if (!hud.Init())
@@ -784,10 +1071,22 @@ void init(void)
 	renderer.setLICFilter(&licFilter);
 
 	renderer.setDataTex(vd.getTextureRef());
+	if (vd.hasKeyFrameTextures())
+		renderer.setDataTex2(vd.getKeyFrameTextureRef());
+	renderer.setDataLevels(vd.getPyramidLevels());
+	renderer.setLODBias(arguments.getLODBias());
 	renderer.setScalarTex(scalar.getTextureRef());
+	if (vd.getMacroCells())
+	{
+		// freqSampling() reads the scalar volume only if it was loaded
+		vd.getMacroCells()->setTexUnit(GL_TEXTURE11_ARB);
+		vd.getMacroCells()->setScalarField(scalar.isLoaded() ? scalar.getVolumeData() : NULL);
+		renderer.setMacroCells(vd.getMacroCells());
+	}
 	renderer.setNoiseTex(noise.getTextureRef());
 	renderer.setTFrgbTex(tfEdit.getTextureRGB());
 	renderer.setTFalphaOpacTex(tfEdit.getTextureAlphaOpac());
+	renderer.setTFPreIntTex(tfEdit.getTexturePreInt());
 	renderer.setIllumZoecklerTex(illum.getTexZoeckler());
 	renderer.setIllumMalloDiffTex(illum.getTexMalloDiffuse());
 	renderer.setIllumMalloSpecTex(illum.getTexMalloSpecular());
@@ -796,8 +1095,224 @@ void init(void)
 
 	renderer.updateLightPos();
 	renderer.updateSlices();
+
+	PreprocCache::getInstance().printStatistics();
+}
+
+// create the offscreen context, load the OpenGL entry points and
+// initialize the renderer for --headless and --benchlic
+bool initOffscreen(OffscreenContext &context)
+{
+	if (!context.create(WINDOW_WIDTH, WINDOW_HEIGHT))
+		return false;
+
+	GLenum err = glewInit();
+#ifndef _WIN32
+	// a GLX build of GLEW loads the OpenGL entry points before it fails
+	// on the missing GLX display of an EGL or OSMesa context
+	if ((GLEW_ERROR_GLX_VERSION_11_ONLY == err)
+# ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		|| (GLEW_ERROR_NO_GLX_DISPLAY == err)
+# endif
+		)
+		err = GLEW_OK;
+#endif
+	if (GLEW_OK != err)
+	{
+		fprintf(stderr, "GLEW error:  %s\n", glewGetErrorString(err));
+		return false;
+	}
+
+	// the composited image stays in the FBO instead of the default framebuffer
+	headless = true;
+	renderer.enableFBO(true);
+	renderer.enableOffscreen(true);
+	initGL();
+	init();
+	resize(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+	return true;
 }
 
+// render the frames with an offscreen context into the FBO and write
+// them as PNG files, no window and no display server are needed
+// with --script the camera, time steps and LIC parameters are taken from
+// the batch script, otherwise --frames steps of the animation are rendered
+bool renderHeadless(void)
+{
+	OffscreenContext context;
+	BatchScript script;
+	const char *scriptFileName = arguments.getScriptFileName();
+	char fileName[1024];
+	int numFrames = arguments.getNumFrames();
+	int numTimeFrames;
+	int numReused = 0;
+	bool hasCamera = false;
+	Quaternion q, prevQ;
+	float dist, prevDist = 0.0f;
+	double startTime, frameTime, totalTime = 0.0;
+
+	if (scriptFileName)
+	{
+		if (!script.load(scriptFileName))
+			return false;
+		numFrames = script.getNumFrames();
+		// the technique is passed to the renderer by init()
+		script.getTechnique(renderTechnique);
+	}
+
+	if (!initOffscreen(context))
+		return false;
+
+	// frames which show a new point in time, the last one is held afterwards
+	numTimeFrames = numFrames;
+	animationMode = (numFrames > 1);
+	if (scriptFileName)
+	{
+		script.applyLICParams(&licParams);
+		animationMode = script.hasTimeRange();
+		numTimeFrames = script.getNumTimeFrames();
+	}
+	renderer.setAnimationFlag(animationMode);
+
+	if (scriptFileName && script.hasTimeRange())
+	{
+		vd.setInterpolateSize(script.getStepsPerTimeStep());
+		if (!vd.setTimeStep(script.getFirstTimeStep()))
+			return false;
+		updateTimeStep(true);
+	}
+	else if (renderTechnique == VOLIC_LICVOLUME)
+	{
+		// computed once, only a new time step requires a new LIC volume
+		renderer.updateLICVolume();
+	}
+
+	for (int i = 0; i < numFrames; ++i)
+	{
+		bool timeChanged = false;
+		bool viewChanged = false;
+
+		startTime = timer();
+
+		// each frame shows the next step, the loader is waited for
+		if (animationMode && (i > 0) && (i < numTimeFrames))
+		{
+			updateTimeStep(true);
+			timeChanged = true;
+		}
+
+		if (scriptFileName && script.getCamera(i, q, dist))
+		{
+			viewChanged = !hasCamera || (dist != prevDist) || (q.x != prevQ.x)
+				|| (q.y != prevQ.y) || (q.z != prevQ.z) || (q.w != prevQ.w);
+			cam.setQuaternion(q);
+			cam.setDistance(dist);
+			prevQ = q;
+			prevDist = dist;
+			hasCamera = true;
+		}
+
+		// the image of the previous frame is reused if nothing changed
+		bool update = (i == 0) || timeChanged || viewChanged;
+		if (update && (renderTechnique == VOLIC_SLICING))
+			renderer.updateSlices();
+		if (!update)
+			++numReused;
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		updateMacroCellTF();
+		renderer.render(update);
+		// every output frame shows the completely refined image
+		while (renderer.isRefining())
+			renderer.render(false);
+		glFinish();
+		CHECK_FOR_OGL_ERROR();
+
+		frameTime = timer() - startTime;
+		totalTime += frameTime;
+
+		if (renderer.isVideoOutputOpen())
+		{
+			snprintf(fileName, sizeof(fileName), "%s", arguments.getVideoFileName());
+			if (!renderer.streamFrame(i))
+				return false;
+		}
+		else
+		{
+			snprintf(fileName, sizeof(fileName), "%s%05d.%s", arguments.getOutputPrefix(), i,
+				arguments.getCaptureFormat());
+			if (!renderer.saveFrame(fileName))
+				return false;
+		}
+
+		std::cout << "Frame " << i << ":  " << fileName << ", "
+			<< std::fixed << std::setprecision(2) << frameTime << " ms" << std::endl;
+	}
+
+	// the files are written by the encoder threads of the renderer
+	if (!renderer.finishCapture())
+		return false;
+
+	std::cout << numFrames << " frames rendered in " << std::fixed
+		<< std::setprecision(2) << totalTime << " ms ("
+		<< totalTime / numFrames << " ms per frame, "
+		<< numReused << " reused)" << std::endl;
+
+	return true;
+}
+
+
+// time --benchlic updates of the whole LIC volume (of the given size) with
+// layered rendering and with one attachment per slice in an offscreen
+// context, nothing is written
+bool benchmarkLICVolume(void)
+{
+	OffscreenContext context;
+	const char *pathName[] = { "layered", "per slice" };
+	int runs = arguments.getLICBenchRuns();
+	double updateTime[2] = { -1.0, -1.0 };
+
+	if (arguments.getLICBenchSize() > 0)
+		renderer.setLICVolumeSize(arguments.getLICBenchSize());
+	if (!initOffscreen(context))
+		return false;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		renderer.enableLayeredLIC(i == 0);
+		if (!renderer.isLayeredLICActive() && (i == 0))
+		{
+			std::cout << "LIC volume:  layered rendering is not supported" << std::endl;
+			continue;
+		}
+
+		// the first update is not timed, it validates the shaders
+		renderer.updateLICVolume();
+		glFinish();
+
+		double startTime = timer();
+		for (int j = 0; j < runs; ++j)
+			renderer.updateLICVolume();
+		glFinish();
+		updateTime[i] = (timer() - startTime) / runs;
+		CHECK_FOR_OGL_ERROR();
+
+		std::cout << "LIC volume " << renderer.getLICVolumeSize() << "^3, " << pathName[i] << ":  "
+			<< std::fixed << std::setprecision(2) << updateTime[i]
+			<< " ms per update (" << runs << " updates)" << std::endl;
+	}
+	if ((updateTime[0] > 0.0) && (updateTime[1] > 0.0))
+	{
+		std::cout << "LIC volume:  layered rendering is " << std::fixed
+			<< std::setprecision(2) << updateTime[1] / updateTime[0]
+			<< " times as fast" << std::endl;
+	}
+
+	return true;
+}
+
+
 void SelectFromMenu(int idCommand)
 {
 	switch (idCommand)
@@ -851,6 +1366,84 @@ int main(int argc, char **argv)
 		exit(1);
 	}
 
+	setPNGOptions(arguments.getPNGOptions());
+	arguments.getScalarWindow(&licParams.scalarMin, &licParams.scalarMax);
+	renderer.setSnapshotFormat(arguments.getCaptureFormat());
+	if (arguments.getVideoFileName()
+		&& !renderer.setVideoOutput(arguments.getVideoFileName(),
+			arguments.getRawVideoFlag() ? VideoSink::VIDEO_RGB : VideoSink::VIDEO_Y4M,
+			arguments.getVideoFrameRate()))
+	{
+		exit(1);
+	}
+
+	// only write the manifest of the time series
+	if (arguments.getManifestFlag())
+	{
+		if (!arguments.getVolFileName())
+		{
+			arguments.printUsage();
+			exit(1);
+		}
+		exit(writeManifest(arguments.getVolFileName()) ? 0 : 1);
+	}
+
+	// only convert the data set into brick files
+	if (arguments.getBrickFileName())
+	{
+		if (!arguments.getVolFileName())
+		{
+			arguments.printUsage();
+			exit(1);
+		}
+		exit(writeBrickedDataSet(arguments.getVolFileName(), arguments.getBrickFileName(),
+			arguments.getBrickSize(), arguments.getBrickLevel()) ? 0 : 1);
+	}
+
+	// only compute the LIC volume on the CPU, no window is opened
+	if (arguments.getCpuLicFileName())
+	{
+		if (!arguments.getVolFileName())
+		{
+			arguments.printUsage();
+			exit(1);
+		}
+		exit(bakeLIC() ? 0 : 1);
+	}
+
+	// only raycast the LIC volume on the CPU, no window is opened
+	if (arguments.getCpuRenderFileName())
+	{
+		if (!arguments.getVolFileName())
+		{
+			arguments.printUsage();
+			exit(1);
+		}
+		exit(renderPreview() ? 0 : 1);
+	}
+
+	// only time the updates of the LIC volume, no window is opened
+	if (arguments.getLICBenchRuns() > 0)
+	{
+		if (!arguments.getVolFileName())
+		{
+			arguments.printUsage();
+			exit(1);
+		}
+		exit(benchmarkLICVolume() ? 0 : 1);
+	}
+
+	// render into PNG files with an offscreen context, no window is opened
+	if (arguments.getHeadlessFlag() || arguments.getScriptFileName())
+	{
+		if (!arguments.getVolFileName())
+		{
+			arguments.printUsage();
+			exit(1);
+		}
+		exit(renderHeadless() ? 0 : 1);
+	}
+
 	glutInit(&argc, argv);
 	glutInitWindowPosition(390, 20);
 	glutInitWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
@@ -50,10 +50,21 @@ double lowResTimer = 0.0;
 
 RenderTechnique renderTechnique = VOLIC_VOLUME;
 bool animationMode = false;
+// no window, the HUD text is not rendered (needs GLUT)
+bool headless = false;
 MouseMode mouseMode;
 LICParams licParams;
 
+// secondary scalar volume, the LIC is restricted to a range of it
+#define SCALAR_FILE_NAME "..\\data\\outputraw\\out_64_0_temperature.dat"
+
+void updateMacroCellTF(void);
 void display(void);
 void resize(int width, int height);
 void updateHUD(bool forceUpdate = false);
-void keyboard(unsigned char key, int x, int y);
\ No newline at end of file
+void keyboard(unsigned char key, int x, int y);
+bool bakeLIC(void);
+bool renderPreview(void);
+void updateTimeStep(bool wait);
+bool renderHeadless(void);
+bool benchmarkLICVolume(void);
\ No newline at end of file
@@ -341,14 +341,18 @@ char* GLSLShader::loadSource(char *fileName, int *size)
 GLSLParamsLIC::GLSLParamsLIC(void) : viewport(-1),texMax(-1),scaleVol(-1),
                                      scaleVolInv(-1),stepSize(-1),gradient(-1),
                                      licParams(-1),licKernel(-1),numIterations(-1),
-                                     alphaCorrection(-1),volumeSampler(-1),scalarSampler(-1),
+                                     alphaCorrection(-1),timeStep(-1),
+                                     scalarWindow(-1),macroCellScale(-1),
+                                     macroCellInvCount(-1),rayJitter(-1),
+                                     layerRange(-1),
+                                     volumeSampler(-1),volumeSampler2(-1),scalarSampler(-1),
 									 licVolumeSampler(-1), licVolumeSamplerOld(-1),
                                      noiseSampler(-1),mcOffsetSampler(-1),
                                      transferRGBASampler(-1),
-                                     transferAlphaOpacSampler(-1),
+                                     transferAlphaOpacSampler(-1),preIntSampler(-1),
                                      licKernelSampler(-1),malloDiffSampler(-1),
                                      malloSpecSampler(-1),zoecklerSampler(-1),
-                                     imageFBOSampler(-1)
+                                     macroCellSampler(-1),imageFBOSampler(-1)
 {
 }
 
@@ -360,6 +364,7 @@ void GLSLParamsLIC::getMemoryLocations(GLhandleARB programObj, bool printList)
     GLenum arrayType;
     int arraySize;
     int len;
+    int location;
 
     viewport = -1;
     texMax = -1;
@@ -371,19 +376,28 @@ void GLSLParamsLIC::getMemoryLocations(GLhandleARB programObj, bool printList)
     licKernel = -1;
     numIterations = -1;
     alphaCorrection = -1;
+    timeStep = -1;
+    scalarWindow = -1;
+    macroCellScale = -1;
+    macroCellInvCount = -1;
+    rayJitter = -1;
+    layerRange = -1;
 
     volumeSampler = -1;
+    volumeSampler2 = -1;
 	scalarSampler = -1;
     noiseSampler = -1;
     mcOffsetSampler = -1;
     transferRGBASampler = -1;
     transferAlphaOpacSampler = -1;
+    preIntSampler = -1;
     licKernelSampler = -1;
     malloDiffSampler = -1;
     malloSpecSampler = -1;
     zoecklerSampler = -1;
 	licVolumeSampler = -1;
 	licVolumeSamplerOld = -1;
+    macroCellSampler = -1;
 
     imageFBOSampler = -1;
 
@@ -394,6 +408,8 @@ void GLSLParamsLIC::getMemoryLocations(GLhandleARB programObj, bool printList)
     {
         glGetActiveUniformARB(programObj, i, 50, &len, 
             &arraySize, &arrayType, buf);
+        // the index of an active uniform is not necessarily its location
+        location = glGetUniformLocationARB(programObj, buf);
 
         if (printList)
         {
@@ -407,95 +423,131 @@ void GLSLParamsLIC::getMemoryLocations(GLhandleARB programObj, bool printList)
 
         if (strcmp(buf, "viewport") == 0)
         {
-            viewport = i;
+            viewport = location;
         }
         else if (strcmp(buf, "texMax") == 0)
         {
-            texMax = i;
+            texMax = location;
         }
         else if (strcmp(buf, "scaleVol") == 0)
         {
-            scaleVol = i;
+            scaleVol = location;
         }
         else if (strcmp(buf, "scaleVolInv") == 0)
         {
-            scaleVolInv = i;
+            scaleVolInv = location;
         }
         else if (strcmp(buf, "stepSize") == 0)
         {
-            stepSize = i;
+            stepSize = location;
         }
         else if (strcmp(buf, "gradient") == 0)
         {
-            gradient = i;
+            gradient = location;
         }
         else if (strcmp(buf, "licParams") == 0)
         {
-            licParams = i;
+            licParams = location;
         }
         else if (strcmp(buf, "licKernel") == 0)
         {
-            licKernel = i;
+            licKernel = location;
         }
         else if (strcmp(buf, "numIterations") == 0)
         {
-            numIterations = i;
+            numIterations = location;
         }
         else if (strcmp(buf, "alphaCorrection") == 0)
         {
-            alphaCorrection = i;
+            alphaCorrection = location;
+        }
+        else if (strcmp(buf, "timeStep") == 0)
+        {
+            timeStep = location;
+        }
+        else if (strcmp(buf, "scalarWindow") == 0)
+        {
+            scalarWindow = location;
+        }
+        else if (strcmp(buf, "macroCellScale") == 0)
+        {
+            macroCellScale = location;
+        }
+        else if (strcmp(buf, "macroCellInvCount") == 0)
+        {
+            macroCellInvCount = location;
+        }
+        else if (strcmp(buf, "rayJitter") == 0)
+        {
+            rayJitter = location;
+        }
+        else if (strcmp(buf, "layerRange") == 0)
+        {
+            layerRange = location;
         }
         else if (strcmp(buf, "volumeSampler") == 0)
         {
-            volumeSampler = i;
+            volumeSampler = location;
+        }
+        else if (strcmp(buf, "volumeSampler2") == 0)
+        {
+            volumeSampler2 = location;
         }
 		else if (strcmp(buf, "licVolumeSampler") == 0)
 		{
-			licVolumeSampler = i;
+			licVolumeSampler = location;
 		}
 		else if (strcmp(buf, "licVolumeSamplerOld") == 0)
 		{
-			licVolumeSamplerOld = i;
+			licVolumeSamplerOld = location;
 		}
 		else if (strcmp(buf, "scalarSampler") == 0)
 		{
-			scalarSampler = i;
+			scalarSampler = location;
 		}
         else if (strcmp(buf, "noiseSampler") == 0)
         {
-            noiseSampler = i;
+            noiseSampler = location;
         }
         else if (strcmp(buf, "mcOffsetSampler") == 0)
         {
-            mcOffsetSampler = i;
+            mcOffsetSampler = location;
         }
         else if (strcmp(buf, "transferRGBASampler") == 0)
         {
-            transferRGBASampler = i;
+            transferRGBASampler = location;
         }
         else if (strcmp(buf, "transferAlphaOpacSampler") == 0)
         {
-            transferAlphaOpacSampler = i;
+            transferAlphaOpacSampler = location;
+        }
+        else if (strcmp(buf, "preIntSampler") == 0)
+        {
+            preIntSampler = location;
         }
         else if (strcmp(buf, "licKernelSampler") == 0)
         {
-            licKernelSampler = i;
+            licKernelSampler = location;
         }
         else if (strcmp(buf, "malloDiffSampler") == 0)
         {
-            malloDiffSampler = i;
+            malloDiffSampler = location;
         }
         else if (strcmp(buf, "malloSpecSampler") == 0)
         {
-            malloSpecSampler = i;
+            malloSpecSampler = location;
         }
         else if (strcmp(buf, "zoecklerSampler") == 0)
         {
-            zoecklerSampler = i;
+            zoecklerSampler = location;
+        }
+        else if (strcmp(buf, "macroCellSampler") == 0)
+        {
+            macroCellSampler = location;
         }
         else if (strcmp(buf, "imageFBOSampler") == 0)
         {
-            imageFBOSampler = i;
+            imageFBOSampler = location;
         }
         /*
         else if (strcmp(buf, "") == 0)
@@ -528,6 +580,7 @@ void GLSLParamsBackground::getMemoryLocations(GLhandleARB programObj, bool print
     GLenum arrayType;
     int arraySize;
     int len;
+    int location;
 
     viewport = -1;
     bgColor = -1;
@@ -540,6 +593,8 @@ void GLSLParamsBackground::getMemoryLocations(GLhandleARB programObj, bool print
     {
         glGetActiveUniformARB(programObj, i, 50, &len, 
             &arraySize, &arrayType, buf);
+        // the index of an active uniform is not necessarily its location
+        location = glGetUniformLocationARB(programObj, buf);
 
         if (printList)
         {
@@ -554,15 +609,15 @@ void GLSLParamsBackground::getMemoryLocations(GLhandleARB programObj, bool print
 
         if (strcmp(buf, "viewport") == 0)
         {
-            viewport = i;
+            viewport = location;
         }
         else if (strcmp(buf, "bgColor") == 0)
         {
-            bgColor = i;
+            bgColor = location;
         }
         else if (strcmp(buf, "imageFBOSampler") == 0)
         {
-            imageFBOSampler = i;
+            imageFBOSampler = location;
         }
         else
         {
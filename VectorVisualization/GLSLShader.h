@@ -77,19 +77,28 @@ struct GLSLParamsLIC
     GLint licKernel;
     GLint numIterations;
     GLint alphaCorrection;
+    GLint timeStep;
+    GLint scalarWindow;
+    GLint macroCellScale;
+    GLint macroCellInvCount;
+    GLint rayJitter;
+    GLint layerRange;
 
     GLint volumeSampler;
+    GLint volumeSampler2;
 	GLint scalarSampler;
     GLint noiseSampler;
     GLint mcOffsetSampler;
     GLint transferRGBASampler;
     GLint transferAlphaOpacSampler;
+    GLint preIntSampler;
     GLint licKernelSampler;
     GLint malloDiffSampler;
     GLint malloSpecSampler;
     GLint zoecklerSampler;
 	GLint licVolumeSampler;
 	GLint licVolumeSamplerOld;
+    GLint macroCellSampler;
 
     GLint imageFBOSampler;
 };
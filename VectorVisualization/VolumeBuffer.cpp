@@ -4,9 +4,11 @@
 
 VolumeBuffer::VolumeBuffer(GLint format, int width, int height, int depth, int layers)
 	:_width(width), _height(height), _depth(depth), _maxlayers(layers), _layer(0),
-	_interpSize(0), _curIntepStep(0), animationFlag(false)
+	_interpSize(0), _curIntepStep(0)
 {
+#ifdef _WIN32
 	glGenFramebuffersEXT = (PFNGLGENFRAMEBUFFERSEXTPROC)wglGetProcAddress("glGenFramebuffersEXT");
+#endif
 	_frambufferId = 0;
 	glGenFramebuffersEXT(1, &_frambufferId);
 	_tex = new Texture[_maxlayers];
@@ -56,15 +58,6 @@ GLuint VolumeBuffer::create3dTexture(GLint internalformat, int w, int h, int d)
 	return tex;
 }
 
-void VolumeBuffer::restoreOldLayer()
-{
-	if (_tex[0].id > 0)
-	{
-		glBindTexture(GL_TEXTURE_3D, _tex[0].id);
-		glCopyTexSubImage3D(_tex[1].id, 0, 0, 0, 0, 0, 0, _tex[0].width, _tex[0].height);
-	}
-}
-
 void VolumeBuffer::bind()
 {
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _frambufferId);
@@ -80,6 +73,11 @@ void VolumeBuffer::attachLayer(int layer, int zSlice)
 	attachTexture(GL_TEXTURE_3D, GL_COLOR_ATTACHMENT0_EXT, _tex[layer].id, 0, zSlice);
 }
 
+void VolumeBuffer::attachLayered(int layer)
+{
+	glFramebufferTexture(GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT, _tex[layer].id, 0);
+}
+
 void VolumeBuffer::attachTexture(GLenum texTarget, GLenum attachment, GLuint texId, int mipLevel, int zSlice)
 {
 	if (texTarget == GL_TEXTURE_1D) {
@@ -105,4 +103,36 @@ void VolumeBuffer::drawSlice(float z)
 	glTexCoord3f(1.0f, 1.0f, z); glVertex2f(1.0f, 1.0f);
 	glTexCoord3f(0.0f, 1.0f, z); glVertex2f(-1.0f, 1.0f);
 	glEnd();
+}
+
+void VolumeBuffer::drawSlice(float z, const float rect[4])
+{
+	float x0 = 2.0f * rect[0] - 1.0f;
+	float y0 = 2.0f * rect[1] - 1.0f;
+	float x1 = 2.0f * rect[2] - 1.0f;
+	float y1 = 2.0f * rect[3] - 1.0f;
+
+	glBegin(GL_QUADS);
+	glTexCoord3f(rect[0], rect[1], z); glVertex2f(x0, y0);
+	glTexCoord3f(rect[2], rect[1], z); glVertex2f(x1, y0);
+	glTexCoord3f(rect[2], rect[3], z); glVertex2f(x1, y1);
+	glTexCoord3f(rect[0], rect[3], z); glVertex2f(x0, y1);
+	glEnd();
+}
+
+void VolumeBuffer::drawLayered(int count, const float rect[4])
+{
+	const float vertices[] = { rect[0], rect[1], rect[2], rect[1],
+		rect[2], rect[3], rect[0], rect[3] };
+
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 0, vertices);
+	glDrawArraysInstancedARB(GL_QUADS, 0, 4, count);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+bool VolumeBuffer::isLayeredSupported()
+{
+	return GLEW_ARB_draw_instanced && GLEW_AMD_vertex_shader_layer
+		&& glFramebufferTexture && glDrawArraysInstancedARB;
 }
\ No newline at end of file
@@ -13,9 +13,17 @@ public:
 	void bind();
 	void unbind();
 	void attachLayer(int layer, int zSlice);
+	// attach all slices of the layer, they are selected by gl_Layer
+	void attachLayered(int layer);
 	void attachTexture(GLenum texTarget, GLenum attachment, GLuint texId, int mipLevel, int zSlice);
 	void drawSlice(float z);
-	void restoreOldLayer();
+	// only the part rect (x0, y0, x1, y1 in [0,1]) of the slice
+	void drawSlice(float z, const float rect[4]);
+	// count instances of the part rect of a slice, the vertex shader
+	// places instance i into its slice (lic3d_volume_vertex.glsl)
+	void drawLayered(int count, const float rect[4]);
+	// layered rendering from the vertex shader is available
+	static bool isLayeredSupported();
 
 	Texture* getCurrentLayer() { return &(_tex[0]); }
 	Texture* getOldLayer() { return &(_tex[1]); }
@@ -27,14 +35,11 @@ public:
 		_interpSize = size;
 	}
 
-	bool isAnimation() { return animationFlag; }
-	void animationOn() { animationFlag = true; }
 private:
 	int _width, _height, _depth;
 	int _maxlayers;
 	int _layer;
 
-	bool animationFlag;
 	int _interpSize;
 	int _curIntepStep;
 
@@ -0,0 +1,250 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "batchscript.h"
+
+
+// interpolation steps between two time steps, like the interactive mode
+#define BATCH_DEFAULT_STEPS  10
+
+
+// members of LICParams which can be overridden, either floatMember or
+// intMember is set
+struct LICParamEntry
+{
+	const char *name;
+	float LICParams::*floatMember;
+	int LICParams::*intMember;
+};
+
+static const LICParamEntry licParamTable[] = {
+	{ "stepSizeVol",   &LICParams::stepSizeVol,   NULL },
+	{ "gradientScale", &LICParams::gradientScale, NULL },
+	{ "illumScale",    &LICParams::illumScale,    NULL },
+	{ "freqScale",     &LICParams::freqScale,     NULL },
+	{ "numIterations", NULL, &LICParams::numIterations },
+	{ "stepsForward",  NULL, &LICParams::stepsForward },
+	{ "stepsBackward", NULL, &LICParams::stepsBackward },
+	{ "stepSizeLIC",   &LICParams::stepSizeLIC,   NULL },
+	{ "scalarMin",     &LICParams::scalarMin,     NULL },
+	{ "scalarMax",     &LICParams::scalarMax,     NULL } };
+static const int numLicParams = sizeof(licParamTable) / sizeof(licParamTable[0]);
+
+
+BatchScript::BatchScript(void) : _numFrames(1), _technique(-1),
+	_firstTimeStep(-1), _lastTimeStep(-1), _stepsPerTimeStep(BATCH_DEFAULT_STEPS)
+{
+}
+
+
+BatchScript::~BatchScript(void)
+{
+}
+
+
+bool BatchScript::load(const char *fileName)
+{
+	FILE *fp;
+	char line[1024];
+	char name[64];
+	char *cp;
+	int lineNum = 0;
+	int numFrames = 0;
+	bool error = false;
+
+	_numFrames = 1;
+	_technique = -1;
+	_firstTimeStep = _lastTimeStep = -1;
+	_stepsPerTimeStep = BATCH_DEFAULT_STEPS;
+	_cameraKeys.clear();
+	_licOverrides.clear();
+
+	if (!(fp = fopen(fileName, "r")))
+	{
+		fprintf(stderr, "BatchScript:  Could not open \"%s\".\n", fileName);
+		return false;
+	}
+
+	while (!error && fgets(line, sizeof(line), fp))
+	{
+		++lineNum;
+		if ((line[0] == '#') || (strspn(line, " \t\r\n") == strlen(line)))
+			continue;
+		if (!(cp = strchr(line, ':')))
+		{
+			error = true;
+			break;
+		}
+		++cp;
+
+		if (strncmp(line, "Technique", 9) == 0)
+		{
+			if (sscanf(cp, "%63s", name) != 1)
+				error = true;
+			else if (strcmp(name, "volume") == 0)
+				_technique = VOLIC_VOLUME;
+			else if (strcmp(name, "raycast") == 0)
+				_technique = VOLIC_RAYCAST;
+			else if (strcmp(name, "slicing") == 0)
+				_technique = VOLIC_SLICING;
+			else if (strcmp(name, "licvolume") == 0)
+				_technique = VOLIC_LICVOLUME;
+			else
+				error = true;
+		}
+		else if (strncmp(line, "TimeSteps", 9) == 0)
+		{
+			error = (sscanf(cp, "%i %i", &_firstTimeStep, &_lastTimeStep) != 2)
+				|| (_firstTimeStep < 0) || (_lastTimeStep < _firstTimeStep);
+		}
+		else if (strncmp(line, "StepsPerTimeStep", 16) == 0)
+		{
+			error = (sscanf(cp, "%i", &_stepsPerTimeStep) != 1)
+				|| (_stepsPerTimeStep < 1);
+		}
+		else if (strncmp(line, "Frames", 6) == 0)
+		{
+			error = (sscanf(cp, "%i", &numFrames) != 1) || (numFrames < 1);
+		}
+		else if (strncmp(line, "Camera", 6) == 0)
+		{
+			CameraKey key;
+			if ((sscanf(cp, "%i %f %f %f %f %f", &key.frame, &key.q.x, &key.q.y,
+				&key.q.z, &key.q.w, &key.distance) != 6) || (key.frame < 0))
+			{
+				error = true;
+			}
+			else
+			{
+				Quaternion_normalize(&key.q);
+				_cameraKeys.push_back(key);
+			}
+		}
+		else if (strncmp(line, "LIC", 3) == 0)
+		{
+			LICOverride o;
+			if (!parseLICParam(cp, o))
+				error = true;
+			else
+				_licOverrides.push_back(o);
+		}
+		else
+		{
+			fprintf(stderr, "BatchScript:  Skipping line %s", line);
+		}
+	}
+	fclose(fp);
+
+	if (error)
+	{
+		fprintf(stderr, "BatchScript:  Error in line %d of \"%s\".\n", lineNum, fileName);
+		return false;
+	}
+
+	std::stable_sort(_cameraKeys.begin(), _cameraKeys.end(),
+		[](const CameraKey &a, const CameraKey &b) { return a.frame < b.frame; });
+
+	// render everything in the script once if no length is given
+	if (numFrames > 0)
+		_numFrames = numFrames;
+	else
+	{
+		_numFrames = std::max(1, getNumTimeFrames());
+		if (!_cameraKeys.empty())
+			_numFrames = std::max(_numFrames, _cameraKeys.back().frame + 1);
+	}
+
+	fprintf(stdout, "BatchScript:  %d frames, %d camera key frames", _numFrames,
+		static_cast<int>(_cameraKeys.size()));
+	if (hasTimeRange())
+		fprintf(stdout, ", time steps %d-%d", _firstTimeStep, _lastTimeStep);
+	fprintf(stdout, "\n");
+
+	return true;
+}
+
+
+bool BatchScript::getTechnique(RenderTechnique &technique)
+{
+	if (_technique < 0)
+		return false;
+	technique = static_cast<RenderTechnique>(_technique);
+	return true;
+}
+
+
+int BatchScript::getNumTimeFrames(void)
+{
+	if (!hasTimeRange())
+		return 0;
+	return (_lastTimeStep - _firstTimeStep) * _stepsPerTimeStep + 1;
+}
+
+
+bool BatchScript::getCamera(int frame, Quaternion &q, float &distance)
+{
+	size_t i;
+
+	if (_cameraKeys.empty())
+		return false;
+
+	// find the key frames around frame
+	for (i = 0; (i < _cameraKeys.size()) && (_cameraKeys[i].frame <= frame); ++i)
+		;
+
+	if (i == 0)
+	{
+		q = _cameraKeys.front().q;
+		distance = _cameraKeys.front().distance;
+	}
+	else if (i == _cameraKeys.size())
+	{
+		q = _cameraKeys.back().q;
+		distance = _cameraKeys.back().distance;
+	}
+	else
+	{
+		const CameraKey &k0 = _cameraKeys[i - 1];
+		const CameraKey &k1 = _cameraKeys[i];
+		float t = static_cast<float>(frame - k0.frame) / (k1.frame - k0.frame);
+
+		q = Quaternion_slerp(k0.q, k1.q, t);
+		distance = k0.distance + t * (k1.distance - k0.distance);
+	}
+
+	return true;
+}
+
+
+void BatchScript::applyLICParams(LICParams *params)
+{
+	for (size_t i = 0; i < _licOverrides.size(); ++i)
+	{
+		const LICParamEntry &e = licParamTable[_licOverrides[i].param];
+		float v = _licOverrides[i].value;
+
+		if (e.floatMember)
+			params->*e.floatMember = v;
+		else
+			params->*e.intMember = static_cast<int>(v);
+	}
+}
+
+
+bool BatchScript::parseLICParam(const char *line, LICOverride &o)
+{
+	char name[64];
+
+	if (sscanf(line, "%63s %f", name, &o.value) != 2)
+		return false;
+
+	for (o.param = 0; o.param < numLicParams; ++o.param)
+	{
+		if (strcmp(name, licParamTable[o.param].name) == 0)
+			return true;
+	}
+
+	fprintf(stderr, "BatchScript:  Unknown LIC parameter \"%s\".\n", name);
+	return false;
+}
@@ -0,0 +1,84 @@
+#ifndef _BATCHSCRIPT_H_
+#define _BATCHSCRIPT_H_
+
+#include <vector>
+
+#include "mmath.h"
+#include "types.h"
+
+
+// Script of the --script batch mode. Text file with one entry per line,
+// lines starting with '#' are ignored:
+//
+//   Technique: volume | raycast | slicing | licvolume
+//   TimeSteps: <first> <last>
+//   StepsPerTimeStep: <n>
+//   Frames: <n>
+//   Camera: <frame> <x> <y> <z> <w> <distance>
+//   LIC: <parameter> <value>
+//
+// Camera entries are key frames with the rotation of the Camera as
+// quaternion (x, y, z, w) and its distance. In between, the rotation is
+// interpolated spherically and the distance linearly, before the first
+// and after the last key frame the camera stays. Without TimeSteps the
+// current time step is rendered, otherwise each frame advances the
+// animation by 1/n of a time step from <first> until <last> is reached.
+// LIC overrides one member of LICParams by its name (e.g. stepSizeVol,
+// stepsForward). Without Frames, all key frames and time steps are
+// rendered once.
+class BatchScript
+{
+public:
+	BatchScript(void);
+	~BatchScript(void);
+
+	// returns false on a syntax error
+	bool load(const char *fileName);
+
+	int getNumFrames(void) { return _numFrames; }
+
+	// technique of the script, false if none is given
+	bool getTechnique(RenderTechnique &technique);
+
+	bool hasTimeRange(void) { return _firstTimeStep >= 0; }
+	int getFirstTimeStep(void) { return _firstTimeStep; }
+	int getLastTimeStep(void) { return _lastTimeStep; }
+	int getStepsPerTimeStep(void) { return _stepsPerTimeStep; }
+	// frames which show a new point in time, the last time step is held
+	// afterwards
+	int getNumTimeFrames(void);
+
+	// camera at frame, false if the script has no camera key frames
+	bool getCamera(int frame, Quaternion &q, float &distance);
+
+	// overwrite the parameters given in the script
+	void applyLICParams(LICParams *params);
+
+private:
+	struct CameraKey
+	{
+		int frame;
+		Quaternion q;
+		float distance;
+	};
+
+	struct LICOverride
+	{
+		int param;        // index into the table of LIC parameters
+		float value;
+	};
+
+	bool parseLICParam(const char *line, LICOverride &o);
+
+	int _numFrames;
+	int _technique;
+	int _firstTimeStep;
+	int _lastTimeStep;
+	int _stepsPerTimeStep;
+
+	// sorted by frame
+	std::vector<CameraKey> _cameraKeys;
+	std::vector<LICOverride> _licOverrides;
+};
+
+#endif // _BATCHSCRIPT_H_
@@ -0,0 +1,111 @@
+#ifndef _BOUNDEDQUEUE_H_
+#define _BOUNDEDQUEUE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <memory>
+
+
+// Lock-free queue of fixed capacity for any number of producers and
+// consumers (bounded MPMC queue by D. Vyukov). Every cell carries a
+// sequence number which tells whether it may be written or read in the
+// current round, so push and pop only need one compare-and-swap.
+// The capacity is rounded up to a power of two.
+template<typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity)
+	{
+		size_t n = 2;
+
+		while (n < capacity)
+			n <<= 1;
+		_cells.reset(new Cell[n]);
+		_mask = n - 1;
+		for (size_t i = 0; i < n; ++i)
+			_cells[i].seq.store(i, std::memory_order_relaxed);
+		_enqueuePos.store(0, std::memory_order_relaxed);
+		_dequeuePos.store(0, std::memory_order_relaxed);
+	}
+
+	// false if the queue is full
+	bool push(const T &value)
+	{
+		size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+		Cell *cell;
+
+		for (;;)
+		{
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos);
+
+			if (diff == 0)
+			{
+				if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false;
+			else
+				pos = _enqueuePos.load(std::memory_order_relaxed);
+		}
+		cell->data = value;
+		cell->seq.store(pos + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	// false if the queue is empty
+	bool pop(T &value)
+	{
+		size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+		Cell *cell;
+
+		for (;;)
+		{
+			cell = &_cells[pos & _mask];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			ptrdiff_t diff = static_cast<ptrdiff_t>(seq) - static_cast<ptrdiff_t>(pos + 1);
+
+			if (diff == 0)
+			{
+				if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			}
+			else if (diff < 0)
+				return false;
+			else
+				pos = _dequeuePos.load(std::memory_order_relaxed);
+		}
+		value = cell->data;
+		cell->seq.store(pos + _mask + 1, std::memory_order_release);
+
+		return true;
+	}
+
+	size_t capacity(void) { return _mask + 1; }
+
+private:
+	BoundedQueue(const BoundedQueue&);
+	BoundedQueue& operator=(const BoundedQueue&);
+
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T data;
+	};
+
+	std::unique_ptr<Cell[]> _cells;
+	size_t _mask;
+
+	// producers and consumers on separate cache lines
+	char _pad0[64];
+	std::atomic<size_t> _enqueuePos;
+	char _pad1[64];
+	std::atomic<size_t> _dequeuePos;
+	char _pad2[64];
+};
+
+#endif // _BOUNDEDQUEUE_H_
@@ -0,0 +1,394 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#  include <sys/types.h>
+#endif
+
+#include "brickcache.h"
+#include "threadpool.h"
+
+
+// open files kept for the time steps accessed last
+#define BRICKCACHE_MAX_SOURCES  4
+
+
+static int seekFile(FILE *fp, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, static_cast<__int64>(offset), SEEK_SET);
+#else
+	return fseeko(fp, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+
+BrickCache::BrickCache(void) : _datFile(NULL), _bricked(false),
+	_dataType(DATRAW_NONE), _dataDim(0), _voxelSize(0), _brickSize(0),
+	_budget(0), _resident(0), _hits(0), _misses(0), _evictions(0),
+	_overBudget(false)
+{
+	_sizes[0] = _sizes[1] = _sizes[2] = 0;
+	_numBricks[0] = _numBricks[1] = _numBricks[2] = 0;
+}
+
+
+BrickCache::~BrickCache(void)
+{
+	release();
+}
+
+
+bool BrickCache::init(DatFile *datFile, size_t budget, int brickSize)
+{
+	release();
+	if (!datFile || (brickSize < 1))
+		return false;
+
+	// bricked data sets are paged in the bricks of their files
+	if (datFile->isBricked())
+	{
+		BrickFile file;
+		if (!datFile->openBrickFile(datFile->getTimeStepBegin(), &file))
+			return false;
+		brickSize = file.getBrickSize();
+	}
+
+	_datFile = datFile;
+	_bricked = datFile->isBricked();
+	_dataType = datFile->getDataType();
+	_dataDim = datFile->getDataDimension();
+	_voxelSize = getDataTypeSize(_dataType) * (size_t)_dataDim;
+	_brickSize = brickSize;
+	for (int i = 0; i < 3; ++i)
+	{
+		_sizes[i] = datFile->getDataSizes()[i];
+		_numBricks[i] = (_sizes[i] + brickSize - 1) / brickSize;
+	}
+	_budget = budget;
+	_hits = _misses = _evictions = 0;
+	_overBudget = false;
+
+	fprintf(stdout, "BrickCache:  %d x %d x %d bricks of %d^3 voxels, budget %.1f MB\n",
+		_numBricks[0], _numBricks[1], _numBricks[2], _brickSize,
+		budget / (1024.0 * 1024.0));
+
+	return true;
+}
+
+
+void BrickCache::release(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_entries.clear();
+	_lru.clear();
+	_sources.clear();
+	_magnitudes.clear();
+	_resident = 0;
+	_datFile = NULL;
+}
+
+
+void BrickCache::setBudget(size_t budget)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_budget = budget;
+	evict(0, NULL);
+}
+
+
+size_t BrickCache::getResidentBytes(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	return _resident;
+}
+
+
+void BrickCache::getBrickBox(int index, int origin[3], int extent[3])
+{
+	int b[3];
+
+	b[0] = index % _numBricks[0];
+	b[1] = (index / _numBricks[0]) % _numBricks[1];
+	b[2] = index / (_numBricks[0] * _numBricks[1]);
+	for (int i = 0; i < 3; ++i)
+	{
+		origin[i] = b[i] * _brickSize;
+		extent[i] = std::min(_brickSize, _sizes[i] - origin[i]);
+	}
+}
+
+
+size_t BrickCache::getBrickBytes(int index)
+{
+	int origin[3], extent[3];
+
+	getBrickBox(index, origin, extent);
+	return _voxelSize * extent[0] * extent[1] * extent[2];
+}
+
+
+const void* BrickCache::pin(int timeStep, int index)
+{
+	const uint64_t key = makeKey(timeStep, index);
+	std::unique_lock<std::mutex> lock(_mutex);
+	std::vector<unsigned char> buffer;
+	std::shared_ptr<Source> source;
+	size_t size;
+	bool ok;
+
+	if (!_datFile || (index < 0) || (index >= getBrickCount()))
+		return NULL;
+
+	for (;;)
+	{
+		auto it = _entries.find(key);
+		if (it == _entries.end())
+			break;
+
+		Entry &entry = it->second;
+		// another thread is reading the brick, it is looked up again as
+		// it is removed if reading fails
+		if (entry.loading)
+		{
+			_loaded.wait(lock);
+			continue;
+		}
+		if ((entry.pins++ == 0) && entry.inLRU)
+		{
+			_lru.erase(entry.lru);
+			entry.inLRU = false;
+		}
+		++_hits;
+		return &entry.data[0];
+	}
+
+	// reserve the entry, the brick is read without holding the lock
+	Entry &entry = _entries[key];
+	entry.loading = true;
+	entry.pins = 1;
+	size = getBrickBytes(index);
+	evict(size, &buffer);
+	_resident += size;
+	++_misses;
+	source = getSource(timeStep);
+	lock.unlock();
+
+	buffer.resize(size);
+	ok = source && readBrick(*source, index, &buffer[0]);
+
+	float minLen, maxLen = -1.0f;
+	if (ok && !_bricked)
+		BrickFile::computeMagnitudeRange(_dataType, _dataDim, &buffer[0],
+			size / _voxelSize, &minLen, &maxLen);
+
+	lock.lock();
+	if (!ok)
+	{
+		_entries.erase(key);
+		_resident -= size;
+		_loaded.notify_all();
+		return NULL;
+	}
+	// entries are never moved by the hash map
+	entry.data.swap(buffer);
+	entry.loading = false;
+	if (!_bricked)
+		getMagnitudes(timeStep)[index] = maxLen;
+	_loaded.notify_all();
+
+	return &entry.data[0];
+}
+
+
+void BrickCache::unpin(int timeStep, int index)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it = _entries.find(makeKey(timeStep, index));
+
+	if ((it == _entries.end()) || (it->second.pins <= 0))
+		return;
+
+	Entry &entry = it->second;
+	if (--entry.pins == 0)
+	{
+		entry.lru = _lru.insert(_lru.end(), it->first);
+		entry.inLRU = true;
+		// pinned bricks may have pushed the cache over its budget
+		if (_resident > _budget)
+			evict(0, NULL);
+	}
+}
+
+
+void BrickCache::evict(size_t size, std::vector<unsigned char> *reuse)
+{
+	while ((_resident + size > _budget) && !_lru.empty())
+	{
+		auto it = _entries.find(_lru.front());
+		_lru.pop_front();
+		if (it == _entries.end())
+			continue;
+
+		_resident -= it->second.data.size();
+		if (reuse && reuse->empty())
+			reuse->swap(it->second.data);
+		_entries.erase(it);
+		++_evictions;
+	}
+
+	if ((_resident + size > _budget) && !_overBudget)
+	{
+		fprintf(stderr, "BrickCache:  Pinned bricks exceed the budget of %.1f MB.\n",
+			_budget / (1024.0 * 1024.0));
+		_overBudget = true;
+	}
+}
+
+
+std::shared_ptr<BrickCache::Source> BrickCache::getSource(int timeStep)
+{
+	char rawFileName[255];
+
+	for (size_t i = 0; i < _sources.size(); ++i)
+	{
+		if (_sources[i]->timeStep == timeStep)
+		{
+			std::shared_ptr<Source> source = _sources[i];
+			_sources.erase(_sources.begin() + i);
+			_sources.push_back(source);
+			return source;
+		}
+	}
+
+	std::shared_ptr<Source> source(new Source);
+	source->timeStep = timeStep;
+	if (_bricked)
+	{
+		if (!_datFile->openBrickFile(timeStep, &source->bricks))
+			return std::shared_ptr<Source>();
+
+		// the brick table holds the magnitudes
+		std::vector<float> &magnitudes = getMagnitudes(timeStep);
+		for (int i = 0; i < source->bricks.getBrickCount(); ++i)
+			magnitudes[i] = source->bricks.getBrickInfo(i).maxMagnitude;
+	}
+	else
+	{
+		_datFile->getRawFileName(timeStep, rawFileName, sizeof(rawFileName));
+		if (! (source->raw = fopen(rawFileName, "rb")))
+		{
+			fprintf(stderr, "BrickCache:  Could not open RAW file \"%s\".\n",
+				rawFileName);
+			return std::shared_ptr<Source>();
+		}
+	}
+
+	// sources still in use stay open until they are released
+	_sources.push_back(source);
+	if (_sources.size() > BRICKCACHE_MAX_SOURCES)
+		_sources.pop_front();
+
+	return source;
+}
+
+
+std::vector<float>& BrickCache::getMagnitudes(int timeStep)
+{
+	std::vector<float> &magnitudes = _magnitudes[timeStep];
+
+	if (magnitudes.empty())
+		magnitudes.assign(getBrickCount(), -1.0f);
+	return magnitudes;
+}
+
+
+bool BrickCache::readBrick(Source &source, int index, unsigned char *dst)
+{
+	int origin[3], extent[3];
+	size_t rowSize;
+
+	if (_bricked)
+		return source.bricks.readBrick(index, dst);
+
+	getBrickBox(index, origin, extent);
+	rowSize = extent[0] * _voxelSize;
+
+	std::lock_guard<std::mutex> lock(source.mutex);
+	for (int z = 0; z < extent[2]; ++z)
+	{
+		// the rows of a slice are contiguous if the brick spans the volume
+		int rows = (extent[0] == _sizes[0]) ? extent[1] : 1;
+
+		for (int y = 0; y < extent[1]; y += rows)
+		{
+			uint64_t voxel = ((uint64_t)(origin[2] + z) * _sizes[1] + origin[1] + y)
+				* _sizes[0] + origin[0];
+			if ((seekFile(source.raw, voxel * _voxelSize) != 0)
+				|| (fread(dst, rowSize, rows, source.raw) != (size_t)rows))
+			{
+				fprintf(stderr, "BrickCache:  Reading brick %d of time step %d failed.\n",
+					index, source.timeStep);
+				return false;
+			}
+			dst += rows * rowSize;
+		}
+	}
+
+	return true;
+}
+
+
+float BrickCache::getMaxMagnitude(int timeStep)
+{
+	std::vector<int> unknown;
+	float maxLen = 0.0f;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (!_datFile)
+			return -1.0f;
+		// opening a bricked time step reads its magnitudes
+		if (_bricked && !getSource(timeStep))
+			return -1.0f;
+
+		std::vector<float> &magnitudes = getMagnitudes(timeStep);
+		for (int i = 0; i < getBrickCount(); ++i)
+		{
+			if (magnitudes[i] < 0.0f)
+				unknown.push_back(i);
+		}
+	}
+
+	// bricks which were never resident are read once
+	ThreadPool::getInstance().parallelForStealing(static_cast<int>(unknown.size()),
+		[&](int item, int)
+	{
+		if (pin(timeStep, unknown[item]))
+			unpin(timeStep, unknown[item]);
+	});
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	std::vector<float> &magnitudes = getMagnitudes(timeStep);
+	for (size_t i = 0; i < magnitudes.size(); ++i)
+	{
+		if (magnitudes[i] > maxLen)
+			maxLen = magnitudes[i];
+	}
+
+	return maxLen;
+}
+
+
+void BrickCache::printStatistics(const char *name)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	fprintf(stderr, "%s:  %u brick hits, %u misses, %u evictions, "
+		"resident %.1f MB (budget %.1f MB)\n", name, _hits, _misses, _evictions,
+		_resident / (1024.0 * 1024.0), _budget / (1024.0 * 1024.0));
+}
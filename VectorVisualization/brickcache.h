@@ -0,0 +1,140 @@
+#ifndef _BRICKCACHE_H_
+#define _BRICKCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "reader.h"
+#include "brickfile.h"
+
+
+// Out-of-core access to the time steps of a DatFile for volumes which do
+// not fit into memory. The volume is split into bricks of brickSize^3
+// voxels which are paged in on demand and kept in a least recently used
+// cache of limited size. Bricked data sets (see BrickFile) use the
+// bricks of their files, RAW files are read brick by brick.
+//
+// Consumers pin the bricks they work on, pinned bricks are never
+// evicted; the cache may exceed its budget as long as more bricks are
+// pinned than fit into it. All methods are thread-safe, bricks are read
+// by the threads which pin them.
+class BrickCache
+{
+public:
+	BrickCache(void);
+	~BrickCache(void);
+
+	// budget in bytes of resident bricks, brickSize is only used for RAW
+	// files
+	bool init(DatFile *datFile, size_t budget, int brickSize = BRICK_DEFAULT_SIZE);
+	// drop all bricks, nothing may be pinned anymore
+	void release(void);
+	bool isInitialized(void) { return _datFile != NULL; }
+
+	void setBudget(size_t budget);
+	size_t getBudget(void) { return _budget; }
+	size_t getResidentBytes(void);
+
+	int getBrickSize(void) { return _brickSize; }
+	// bricks along x, y and z
+	const int* getNumBricks(void) { return _numBricks; }
+	int getBrickCount(void) { return _numBricks[0] * _numBricks[1] * _numBricks[2]; }
+	// first voxel and number of voxels of a brick
+	void getBrickBox(int index, int origin[3], int extent[3]);
+
+	// voxels of getBrickBox() of a brick of timeStep x fastest, the brick
+	// is read if it is not resident
+	// the memory stays valid until unpin() was called as often as pin(),
+	// NULL if the brick could not be read
+	const void* pin(int timeStep, int index);
+	void unpin(int timeStep, int index);
+
+	// largest magnitude of timeStep, taken from the brick table of bricked
+	// data sets, otherwise the bricks not seen before are read
+	float getMaxMagnitude(int timeStep);
+
+	// print hits, misses and evictions to stderr
+	void printStatistics(const char *name);
+
+private:
+	BrickCache(const BrickCache&);
+	BrickCache& operator=(const BrickCache&);
+
+	struct Entry
+	{
+		Entry(void) : pins(0), loading(false), inLRU(false) {}
+
+		std::vector<unsigned char> data;
+		int pins;
+		bool loading;
+		// position in _lru while not pinned
+		bool inLRU;
+		std::list<uint64_t>::iterator lru;
+	};
+
+	// open brick or RAW file of a time step
+	struct Source
+	{
+		Source(void) : timeStep(0), raw(NULL) {}
+		~Source(void) { if (raw) fclose(raw); }
+
+		int timeStep;
+		BrickFile bricks;
+		FILE *raw;
+		// seek and read of the RAW file
+		std::mutex mutex;
+	};
+
+	static uint64_t makeKey(int timeStep, int index)
+	{
+		return ((uint64_t)(uint32_t)timeStep << 32) | (uint32_t)index;
+	}
+
+	size_t getBrickBytes(int index);
+	// called with _mutex held
+	std::shared_ptr<Source> getSource(int timeStep);
+	std::vector<float>& getMagnitudes(int timeStep);
+	bool readBrick(Source &source, int index, unsigned char *dst);
+	// evict unpinned bricks until size more bytes fit into the budget,
+	// the memory of the first evicted brick is moved into reuse
+	// called with _mutex held
+	void evict(size_t size, std::vector<unsigned char> *reuse);
+
+	DatFile *_datFile;
+	bool _bricked;
+	DataType _dataType;
+	int _dataDim;
+	size_t _voxelSize;
+	int _sizes[3];
+	int _brickSize;
+	int _numBricks[3];
+
+	size_t _budget;
+	size_t _resident;
+	std::unordered_map<uint64_t, Entry> _entries;
+	// unpinned bricks, least recently used first
+	std::list<uint64_t> _lru;
+	// recently used files, the last one is the newest
+	std::deque<std::shared_ptr<Source> > _sources;
+	// largest magnitude of every brick of a time step, -1 if unknown
+	std::map<int, std::vector<float> > _magnitudes;
+
+	std::mutex _mutex;
+	std::condition_variable _loaded;
+
+	unsigned int _hits;
+	unsigned int _misses;
+	unsigned int _evictions;
+	bool _overBudget;
+};
+
+#endif // _BRICKCACHE_H_
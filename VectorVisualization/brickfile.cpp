@@ -0,0 +1,611 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+
+#ifndef _WIN32
+#  include <sys/types.h>
+#endif
+
+#include "zlib.h"
+
+#include "brickfile.h"
+#include "bufferarena.h"
+#include "prefetch.h"
+#include "threadpool.h"
+#include "timer.h"
+
+
+#define BRICK_MAGIC          "VOLBRICK"
+#define BRICK_MAGIC_LEN      8
+#define BRICK_VERSION        1
+#define BRICK_HEADER_FIELDS  8
+// bytes of each value stored in separate planes
+#define BRICK_FLAG_SHUFFLE   1
+// time steps read ahead while a data set is converted
+#define BRICK_PREFETCH_DEPTH 2
+
+static_assert(sizeof(BrickFile::BrickInfo) == 24, "brick table entries have to be packed");
+
+
+static int seekFile(FILE *fp, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, static_cast<__int64>(offset), SEEK_SET);
+#else
+	return fseeko(fp, static_cast<off_t>(offset), SEEK_SET);
+#endif
+}
+
+
+// byte k of value i goes to plane k, n values of size bytes
+static void shuffleBytes(const unsigned char *src, unsigned char *dst, size_t n, int size)
+{
+	for (int k = 0; k < size; ++k)
+	{
+		unsigned char *plane = dst + k * n;
+		for (size_t i = 0; i < n; ++i)
+			plane[i] = src[i * size + k];
+	}
+}
+
+static void unshuffleBytes(const unsigned char *src, unsigned char *dst, size_t n, int size)
+{
+	for (int k = 0; k < size; ++k)
+	{
+		const unsigned char *plane = src + k * n;
+		for (size_t i = 0; i < n; ++i)
+			dst[i * size + k] = plane[i];
+	}
+}
+
+
+static inline float toMagnitudeValue(float v) { return v; }
+static inline float toMagnitudeValue(unsigned short v) { return v; }
+static inline float toMagnitudeValue(unsigned char v) { return v - 128.0f; }
+
+template<typename T>
+static void computeRange(const T *data, size_t count, int dataDim,
+	float *minLen, float *maxLen)
+{
+	float lo = FLT_MAX;
+	float hi = 0.0f;
+
+	for (size_t i = 0; i < count; ++i, data += dataDim)
+	{
+		float len = 0.0f;
+		for (int c = 0; c < dataDim; ++c)
+		{
+			float v = toMagnitudeValue(data[c]);
+			len += v * v;
+		}
+		lo = std::min(lo, len);
+		hi = std::max(hi, len);
+	}
+	*minLen = (count > 0) ? sqrtf(lo) : 0.0f;
+	*maxLen = sqrtf(hi);
+}
+
+
+BrickFile::BrickFile(void) : _fp(NULL), _dataType(DATRAW_NONE), _dataDim(0),
+	_brickSize(0), _flags(0)
+{
+	_sizes[0] = _sizes[1] = _sizes[2] = 0;
+	_numBricks[0] = _numBricks[1] = _numBricks[2] = 0;
+}
+
+
+BrickFile::~BrickFile(void)
+{
+	close();
+}
+
+
+bool BrickFile::isBrickFile(const char *fileName)
+{
+	char magic[BRICK_MAGIC_LEN];
+	FILE *fp = fopen(fileName, "rb");
+	bool ok;
+
+	if (!fp)
+		return false;
+	ok = (fread(magic, 1, BRICK_MAGIC_LEN, fp) == BRICK_MAGIC_LEN)
+		&& (memcmp(magic, BRICK_MAGIC, BRICK_MAGIC_LEN) == 0);
+	fclose(fp);
+
+	return ok;
+}
+
+
+bool BrickFile::open(const char *fileName)
+{
+	char magic[BRICK_MAGIC_LEN];
+	uint32_t header[BRICK_HEADER_FIELDS];
+	uint64_t fileSize;
+	size_t count;
+
+	close();
+	if (!DatFile::getFileSize(fileName, &fileSize) || !(_fp = fopen(fileName, "rb")))
+	{
+		fprintf(stderr, "BrickFile:  Could not open \"%s\".\n", fileName);
+		return false;
+	}
+	_fileName = fileName;
+
+	if ((fread(magic, 1, BRICK_MAGIC_LEN, _fp) != BRICK_MAGIC_LEN)
+		|| (memcmp(magic, BRICK_MAGIC, BRICK_MAGIC_LEN) != 0)
+		|| (fread(header, sizeof(uint32_t), BRICK_HEADER_FIELDS, _fp) != BRICK_HEADER_FIELDS))
+	{
+		fprintf(stderr, "BrickFile:  \"%s\" is no brick file.\n", fileName);
+		close();
+		return false;
+	}
+	if (header[0] != BRICK_VERSION)
+	{
+		fprintf(stderr, "BrickFile:  \"%s\" has unsupported version %u.\n",
+			fileName, header[0]);
+		close();
+		return false;
+	}
+
+	_dataType = static_cast<DataType>(header[1]);
+	_dataDim = static_cast<int>(header[2]);
+	for (int i = 0; i < 3; ++i)
+		_sizes[i] = static_cast<int>(header[3 + i]);
+	_brickSize = static_cast<int>(header[6]);
+	_flags = header[7];
+	if (((_dataType != DATRAW_UCHAR) && (_dataType != DATRAW_USHORT)
+			&& (_dataType != DATRAW_FLOAT))
+		|| (_dataDim < 1) || (_brickSize < 1)
+		|| (_sizes[0] < 1) || (_sizes[1] < 1) || (_sizes[2] < 1))
+	{
+		fprintf(stderr, "BrickFile:  Invalid header in \"%s\".\n", fileName);
+		close();
+		return false;
+	}
+
+	count = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		_numBricks[i] = (_sizes[i] + _brickSize - 1) / _brickSize;
+		count *= _numBricks[i];
+	}
+	_bricks.resize(count);
+	if (fread(&_bricks[0], sizeof(BrickInfo), count, _fp) != count)
+	{
+		fprintf(stderr, "BrickFile:  Brick table of \"%s\" is truncated.\n", fileName);
+		close();
+		return false;
+	}
+
+	// every brick has to lie inside the file and decode to its box
+	for (size_t i = 0; i < count; ++i)
+	{
+		const BrickInfo &info = _bricks[i];
+		int origin[3], extent[3];
+
+		getBrickBox(static_cast<int>(i), origin, extent);
+		if ((info.rawSize != getVoxelSize() * extent[0] * extent[1] * extent[2])
+			|| (info.compressedSize > info.rawSize)
+			|| (info.offset + info.compressedSize > fileSize))
+		{
+			fprintf(stderr, "BrickFile:  Brick %d of \"%s\" is corrupt.\n",
+				static_cast<int>(i), fileName);
+			close();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void BrickFile::close(void)
+{
+	if (_fp)
+		fclose(_fp);
+	_fp = NULL;
+	_bricks.clear();
+}
+
+
+void BrickFile::getBrickBox(int index, int origin[3], int extent[3])
+{
+	int b[3];
+
+	b[0] = index % _numBricks[0];
+	b[1] = (index / _numBricks[0]) % _numBricks[1];
+	b[2] = index / (_numBricks[0] * _numBricks[1]);
+	for (int i = 0; i < 3; ++i)
+	{
+		origin[i] = b[i] * _brickSize;
+		extent[i] = std::min(_brickSize, _sizes[i] - origin[i]);
+	}
+}
+
+
+uint64_t BrickFile::getCompressedSize(void)
+{
+	uint64_t size = 0;
+
+	for (size_t i = 0; i < _bricks.size(); ++i)
+		size += _bricks[i].compressedSize;
+	return size;
+}
+
+
+bool BrickFile::decode(int index, const unsigned char *src, unsigned char *dst)
+{
+	const BrickInfo &info = _bricks[index];
+	const int valueSize = getDataTypeSize(_dataType);
+	const bool shuffled = (_flags & BRICK_FLAG_SHUFFLE) && (valueSize > 1);
+	static thread_local std::vector<unsigned char> planes;
+	unsigned char *out = dst;
+	uLongf len = info.rawSize;
+
+	if (shuffled)
+	{
+		planes.resize(info.rawSize);
+		out = &planes[0];
+	}
+	if (info.compressedSize == info.rawSize)
+	{
+		memcpy(out, src, info.rawSize);
+	}
+	else if ((uncompress(out, &len, src, info.compressedSize) != Z_OK)
+		|| (len != info.rawSize))
+	{
+		fprintf(stderr, "BrickFile:  Decompressing brick %d of \"%s\" failed.\n",
+			index, _fileName.c_str());
+		return false;
+	}
+	if (shuffled)
+		unshuffleBytes(out, dst, info.rawSize / valueSize, valueSize);
+
+	return true;
+}
+
+
+bool BrickFile::readBrick(int index, void *buffer)
+{
+	std::vector<unsigned char> src;
+
+	if (!_fp || !buffer || (index < 0) || (index >= getBrickCount()))
+		return false;
+
+	src.resize(std::max(_bricks[index].compressedSize, 1u));
+	{
+		std::lock_guard<std::mutex> lock(_readMutex);
+		if ((seekFile(_fp, _bricks[index].offset) != 0)
+			|| (fread(&src[0], 1, _bricks[index].compressedSize, _fp)
+				!= _bricks[index].compressedSize))
+		{
+			fprintf(stderr, "BrickFile:  Reading brick %d of \"%s\" failed.\n",
+				index, _fileName.c_str());
+			return false;
+		}
+	}
+
+	return decode(index, &src[0], static_cast<unsigned char*>(buffer));
+}
+
+
+bool BrickFile::readVolume(void *buffer)
+{
+	std::vector<unsigned char> src;
+	uint64_t begin = UINT64_MAX;
+	uint64_t end = 0;
+	const size_t voxelSize = getVoxelSize();
+	int numThreads = ThreadPool::getInstance().getNumThreads();
+	std::vector<std::vector<unsigned char> > scratch(numThreads);
+	std::atomic<bool> ok(true);
+
+	if (!_fp || !buffer)
+		return false;
+
+	// the bricks are read with one request, decoding runs in parallel
+	for (size_t i = 0; i < _bricks.size(); ++i)
+	{
+		begin = std::min(begin, _bricks[i].offset);
+		end = std::max(end, _bricks[i].offset + _bricks[i].compressedSize);
+	}
+	src.resize(static_cast<size_t>(std::max<uint64_t>(end - begin, 1)));
+	{
+		std::lock_guard<std::mutex> lock(_readMutex);
+		if ((seekFile(_fp, begin) != 0) || (fread(&src[0], 1, src.size(), _fp) != src.size()))
+		{
+			fprintf(stderr, "BrickFile:  Reading \"%s\" failed.\n", _fileName.c_str());
+			return false;
+		}
+	}
+
+	ThreadPool::getInstance().parallelForStealing(getBrickCount(), [&](int index, int slot)
+	{
+		std::vector<unsigned char> &brick = scratch[slot];
+		unsigned char *dst = static_cast<unsigned char*>(buffer);
+		int origin[3], extent[3];
+		size_t rowSize;
+
+		if (!ok)
+			return;
+		brick.resize(_bricks[index].rawSize);
+		if (!decode(index, &src[_bricks[index].offset - begin], &brick[0]))
+		{
+			ok = false;
+			return;
+		}
+
+		getBrickBox(index, origin, extent);
+		rowSize = extent[0] * voxelSize;
+		for (int z = 0; z < extent[2]; ++z)
+		{
+			for (int y = 0; y < extent[1]; ++y)
+			{
+				size_t voxel = ((size_t)(origin[2] + z) * _sizes[1] + origin[1] + y)
+					* _sizes[0] + origin[0];
+				memcpy(dst + voxel * voxelSize,
+					&brick[((size_t)z * extent[1] + y) * rowSize], rowSize);
+			}
+		}
+	});
+
+	return ok;
+}
+
+
+void BrickFile::computeMagnitudeRange(DataType dataType, int dataDim, const void *data,
+	size_t count, float *minLen, float *maxLen)
+{
+	switch (dataType)
+	{
+	case DATRAW_UCHAR:
+		computeRange(static_cast<const unsigned char*>(data), count, dataDim,
+			minLen, maxLen);
+		break;
+	case DATRAW_USHORT:
+		computeRange(static_cast<const unsigned short*>(data), count, dataDim,
+			minLen, maxLen);
+		break;
+	default:
+		computeRange(static_cast<const float*>(data), count, dataDim, minLen, maxLen);
+		break;
+	}
+}
+
+
+bool BrickFile::write(const char *fileName, DataType dataType, int dataDim,
+	const int sizes[3], const void *data, int brickSize, int level)
+{
+	BrickFile layout;
+	const int valueSize = getDataTypeSize(dataType);
+	const size_t voxelSize = valueSize * (size_t)dataDim;
+	int numThreads = ThreadPool::getInstance().getNumThreads();
+	std::vector<std::vector<unsigned char> > gathered(numThreads);
+	std::vector<std::vector<unsigned char> > planes(numThreads);
+	std::vector<std::vector<unsigned char> > compressed;
+	uint32_t header[BRICK_HEADER_FIELDS];
+	uint64_t offset;
+	FILE *fp;
+	bool ok = true;
+
+	if ((valueSize == 0) || (dataDim < 1) || (brickSize < 1) || !data)
+		return false;
+	// the brick table stores 32 bit sizes
+	if ((double)brickSize * brickSize * brickSize * voxelSize >= 2147483648.0)
+	{
+		fprintf(stderr, "BrickFile:  Brick size %d is too large.\n", brickSize);
+		return false;
+	}
+
+	// the brick layout is the one of a file opened for reading
+	layout._dataType = dataType;
+	layout._dataDim = dataDim;
+	layout._brickSize = brickSize;
+	layout._flags = (valueSize > 1) ? BRICK_FLAG_SHUFFLE : 0;
+	size_t count = 1;
+	for (int i = 0; i < 3; ++i)
+	{
+		layout._sizes[i] = sizes[i];
+		layout._numBricks[i] = (sizes[i] + brickSize - 1) / brickSize;
+		count *= layout._numBricks[i];
+	}
+	layout._bricks.resize(count);
+	compressed.resize(count);
+
+	ThreadPool::getInstance().parallelForStealing(static_cast<int>(count), [&](int index, int slot)
+	{
+		BrickInfo &info = layout._bricks[index];
+		std::vector<unsigned char> &brick = gathered[slot];
+		const unsigned char *src = static_cast<const unsigned char*>(data);
+		const unsigned char *raw;
+		int origin[3], extent[3];
+		size_t rowSize, numValues;
+		uLongf len;
+
+		layout.getBrickBox(index, origin, extent);
+		rowSize = extent[0] * voxelSize;
+		info.rawSize = static_cast<uint32_t>(rowSize * extent[1] * extent[2]);
+		brick.resize(info.rawSize);
+		for (int z = 0; z < extent[2]; ++z)
+		{
+			for (int y = 0; y < extent[1]; ++y)
+			{
+				size_t voxel = ((size_t)(origin[2] + z) * sizes[1] + origin[1] + y)
+					* sizes[0] + origin[0];
+				memcpy(&brick[((size_t)z * extent[1] + y) * rowSize],
+					src + voxel * voxelSize, rowSize);
+			}
+		}
+
+		numValues = info.rawSize / valueSize;
+		computeMagnitudeRange(dataType, dataDim, &brick[0], numValues / dataDim,
+			&info.minMagnitude, &info.maxMagnitude);
+
+		raw = &brick[0];
+		if (layout._flags & BRICK_FLAG_SHUFFLE)
+		{
+			planes[slot].resize(info.rawSize);
+			shuffleBytes(raw, &planes[slot][0], numValues, valueSize);
+			raw = &planes[slot][0];
+		}
+
+		// incompressible bricks are stored as they are
+		len = compressBound(info.rawSize);
+		compressed[index].resize(len);
+		if ((compress2(&compressed[index][0], &len, raw, info.rawSize, level) != Z_OK)
+			|| (len >= info.rawSize))
+		{
+			compressed[index].assign(raw, raw + info.rawSize);
+			len = info.rawSize;
+		}
+		compressed[index].resize(len);
+		info.compressedSize = static_cast<uint32_t>(len);
+	});
+
+	offset = BRICK_MAGIC_LEN + sizeof(header) + count * sizeof(BrickInfo);
+	for (size_t i = 0; i < count; ++i)
+	{
+		layout._bricks[i].offset = offset;
+		offset += layout._bricks[i].compressedSize;
+	}
+
+	header[0] = BRICK_VERSION;
+	header[1] = static_cast<uint32_t>(dataType);
+	header[2] = static_cast<uint32_t>(dataDim);
+	for (int i = 0; i < 3; ++i)
+		header[3 + i] = static_cast<uint32_t>(sizes[i]);
+	header[6] = static_cast<uint32_t>(brickSize);
+	header[7] = layout._flags;
+
+	if (! (fp = fopen(fileName, "wb")))
+	{
+		fprintf(stderr, "BrickFile:  Could not create \"%s\".\n", fileName);
+		return false;
+	}
+	ok = (fwrite(BRICK_MAGIC, 1, BRICK_MAGIC_LEN, fp) == BRICK_MAGIC_LEN)
+		&& (fwrite(header, sizeof(uint32_t), BRICK_HEADER_FIELDS, fp) == BRICK_HEADER_FIELDS)
+		&& (fwrite(&layout._bricks[0], sizeof(BrickInfo), count, fp) == count);
+	for (size_t i = 0; ok && (i < count); ++i)
+		ok = (fwrite(&compressed[i][0], 1, compressed[i].size(), fp) == compressed[i].size());
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok)
+		fprintf(stderr, "BrickFile:  Writing \"%s\" failed.\n", fileName);
+
+	return ok;
+}
+
+
+// --------------------------------------------------
+
+bool writeBrickedDataSet(const char *datFileName, const char *outDatFileName,
+	int brickSize, int level)
+{
+	DatFile datFile;
+	TimeStepPrefetcher prefetcher;
+	BufferArena arena;
+	std::vector<char> name(datFileName, datFileName + strlen(datFileName) + 1);
+	std::string base(outDatFileName);
+	std::string pattern;
+	std::string objectPattern;
+	const char *format;
+	char brickFileName[255];
+	uint64_t rawSize = 0;
+	uint64_t brickedSize = 0;
+	size_t pos;
+	double start = timer();
+	int numSteps;
+	FILE *fp;
+	bool ok = true;
+
+	if (!datFile.parseDatFile(&name[0], false))
+		return false;
+
+	switch (datFile.getDataType())
+	{
+	case DATRAW_UCHAR:
+		format = "UCHAR";
+		break;
+	case DATRAW_USHORT:
+		format = "USHORT";
+		break;
+	default:
+		format = "FLOAT";
+		break;
+	}
+
+	// brick files are named like the DAT file, numbered by time step
+	pos = base.rfind('.');
+	if ((pos != std::string::npos) && (base.find_first_of("/\\", pos) == std::string::npos))
+		base.erase(pos);
+	numSteps = datFile.getTimeStepEnd() - datFile.getTimeStepBegin() + 1;
+	pattern = base + ((numSteps > 1) ? "_%d.brk" : ".brk");
+	pos = pattern.find_last_of("/\\");
+	objectPattern = (pos == std::string::npos) ? pattern : pattern.substr(pos + 1);
+
+	prefetcher.start(&datFile, datFile.getTimeStepBegin(), BRICK_PREFETCH_DEPTH,
+		false, &arena);
+
+	for (int i = 0; ok && (i < numSteps); ++i)
+	{
+		int t = datFile.getTimeStepBegin() + i;
+		void *data = NULL;
+		MappedRawData map;
+		uint64_t size;
+
+		if (!prefetcher.pop(t, data, map))
+		{
+			fprintf(stderr, "writeBrickedDataSet:  Reading time step %d of \"%s\" "
+				"failed.\n", t, datFileName);
+			ok = false;
+			break;
+		}
+
+		snprintf(brickFileName, sizeof(brickFileName), pattern.c_str(), t);
+		ok = BrickFile::write(brickFileName, datFile.getDataType(),
+			datFile.getDataDimension(), datFile.getDataSizes(), data, brickSize, level)
+			&& DatFile::getFileSize(brickFileName, &size);
+		arena.release(data);
+		if (ok)
+		{
+			rawSize += datFile.getRawDataSize();
+			brickedSize += size;
+		}
+
+		fprintf(stdout, "\rwriteBrickedDataSet:  time step %d of %d", i + 1, numSteps);
+		fflush(stdout);
+	}
+	fprintf(stdout, "\n");
+	prefetcher.stop();
+	if (!ok)
+		return false;
+
+	if (! (fp = fopen(outDatFileName, "w")))
+	{
+		fprintf(stderr, "writeBrickedDataSet:  Could not create DAT file \"%s\".\n",
+			outDatFileName);
+		return false;
+	}
+	fprintf(fp, "ObjectFileName: %s\n", objectPattern.c_str());
+	fprintf(fp, "Resolution: %d %d %d\n", datFile.getDataSizes()[0],
+		datFile.getDataSizes()[1], datFile.getDataSizes()[2]);
+	fprintf(fp, "SliceThickness: %g %g %g\n", datFile.getDataDists()[0],
+		datFile.getDataDists()[1], datFile.getDataDists()[2]);
+	if (datFile.getDataDimension() > 1)
+		fprintf(fp, "Format: %s%d\n", format, datFile.getDataDimension());
+	else
+		fprintf(fp, "Format: %s\n", format);
+	if (numSteps > 1)
+		fprintf(fp, "TimeDependent: %d %d\n", datFile.getTimeStepBegin(),
+			datFile.getTimeStepEnd());
+	if (fclose(fp) != 0)
+		return false;
+
+	fprintf(stdout, "writeBrickedDataSet:  \"%s\" written in %.1f ms, %.1f MB "
+		"instead of %.1f MB (%.1f%%)\n", outDatFileName, timer() - start,
+		brickedSize / 1048576.0, rawSize / 1048576.0,
+		rawSize ? 100.0 * brickedSize / rawSize : 0.0);
+
+	return true;
+}
@@ -0,0 +1,117 @@
+#ifndef _BRICKFILE_H_
+#define _BRICKFILE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "reader.h"
+
+
+#define BRICK_DEFAULT_SIZE  32
+
+
+// Bricked and compressed storage of one time step, used by DatFile
+// instead of a RAW file if the file starts with the magic "VOLBRICK".
+// The volume is split into bricks of brickSize^3 voxels (smaller at the
+// upper borders), the voxels of every brick are stored x fastest and
+// deflated separately. Multi-byte values are shuffled into byte planes
+// before compression, which packs the slowly changing exponents and
+// high bytes together.
+//
+// file layout, in the byte order of the machine like the RAW files:
+//   header       magic, version, data type, dimension, sizes,
+//                brick size, flags
+//   brick table  BrickInfo of every brick, x fastest
+//   bricks       compressed voxels
+class BrickFile
+{
+public:
+	struct BrickInfo
+	{
+		uint64_t offset;          // from the start of the file
+		uint32_t compressedSize;  // equal to rawSize if stored uncompressed
+		uint32_t rawSize;
+		// magnitude of the vectors (absolute value for scalars), unsigned
+		// char vectors are centered at 128 like for the textures
+		float minMagnitude;
+		float maxMagnitude;
+	};
+
+	BrickFile(void);
+	~BrickFile(void);
+
+	// true if fileName can be opened and starts with the magic
+	static bool isBrickFile(const char *fileName);
+
+	// read header and brick table, the file stays open
+	bool open(const char *fileName);
+	void close(void);
+
+	bool isOpen(void) { return _fp != NULL; }
+
+	DataType getDataType(void) { return _dataType; }
+	int getDataDimension(void) { return _dataDim; }
+	const int* getDataSizes(void) { return _sizes; }
+	int getBrickSize(void) { return _brickSize; }
+	// bricks along x, y and z
+	const int* getNumBricks(void) { return _numBricks; }
+	int getBrickCount(void) { return static_cast<int>(_bricks.size()); }
+	const BrickInfo& getBrickInfo(int index) { return _bricks[index]; }
+	// first voxel and number of voxels of a brick
+	void getBrickBox(int index, int origin[3], int extent[3]);
+	// bytes of one voxel
+	size_t getVoxelSize(void) { return getDataTypeSize(_dataType) * (size_t)_dataDim; }
+	// total size of the compressed bricks
+	uint64_t getCompressedSize(void);
+
+	// decode a single brick into buffer, which holds the voxels of
+	// getBrickBox() x fastest (at most brickSize^3 voxels)
+	// may be called by several threads at the same time
+	bool readBrick(int index, void *buffer);
+	// read all bricks at once and decode them on all threads of the
+	// ThreadPool into the dense volume
+	bool readVolume(void *buffer);
+
+	// smallest and largest magnitude of count voxels like in the brick table
+	static void computeMagnitudeRange(DataType dataType, int dataDim, const void *data,
+		size_t count, float *minLen, float *maxLen);
+
+	// compress the dense volume on all threads of the ThreadPool into a
+	// brick file, level is the zlib compression level (-1 for default)
+	static bool write(const char *fileName, DataType dataType, int dataDim,
+		const int sizes[3], const void *data, int brickSize = BRICK_DEFAULT_SIZE,
+		int level = -1);
+
+private:
+	BrickFile(const BrickFile&);
+	BrickFile& operator=(const BrickFile&);
+
+	bool decode(int index, const unsigned char *src, unsigned char *dst);
+
+	FILE *_fp;
+	std::string _fileName;
+
+	DataType _dataType;
+	int _dataDim;
+	int _sizes[3];
+	int _brickSize;
+	int _numBricks[3];
+	unsigned int _flags;
+	std::vector<BrickInfo> _bricks;
+
+	// serializes seek and read of readBrick()
+	std::mutex _readMutex;
+};
+
+
+// convert the DAT file datFileName with all of its time steps into a
+// bricked data set described by outDatFileName, the brick files are
+// stored next to it
+bool writeBrickedDataSet(const char *datFileName, const char *outDatFileName,
+	int brickSize = BRICK_DEFAULT_SIZE, int level = -1);
+
+#endif // _BRICKFILE_H_
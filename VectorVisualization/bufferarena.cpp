@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <new>
+
+#include "bufferarena.h"
+
+
+BufferArena::BufferArena(void) : _limit(0), _allocated(0), _inUse(0), _peak(0),
+	_allocations(0), _reuses(0), _failures(0)
+{
+}
+
+
+BufferArena::~BufferArena(void)
+{
+	for (size_t i = 0; i < _blocks.size(); ++i)
+	{
+		if (_blocks[i].inUse)
+			fprintf(stderr, "BufferArena:  Buffer of %lu bytes still in use.\n",
+				(unsigned long)_blocks[i].size);
+		delete[] _blocks[i].ptr;
+	}
+}
+
+
+void BufferArena::setLimit(size_t limit)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	_limit = limit;
+	if (_limit)
+		freeIdle(_limit);
+}
+
+
+void* BufferArena::acquire(size_t size)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (size == 0)
+		return NULL;
+
+	for (size_t i = 0; i < _blocks.size(); ++i)
+	{
+		if (!_blocks[i].inUse && (_blocks[i].size == size))
+		{
+			_blocks[i].inUse = true;
+			_inUse += size;
+			++_reuses;
+			return _blocks[i].ptr;
+		}
+	}
+
+	// make room by dropping idle buffers of other sizes
+	if (_limit && (_allocated + size > _limit) && (size <= _limit))
+		freeIdle(_limit - size);
+	if (_limit && (_allocated + size > _limit))
+	{
+		++_failures;
+		return NULL;
+	}
+
+	Block block;
+	block.ptr = new (std::nothrow) unsigned char[size];
+	block.size = size;
+	block.inUse = true;
+	if (!block.ptr)
+	{
+		++_failures;
+		return NULL;
+	}
+	_blocks.push_back(block);
+
+	_allocated += size;
+	_inUse += size;
+	if (_allocated > _peak)
+		_peak = _allocated;
+	++_allocations;
+
+	return block.ptr;
+}
+
+
+void BufferArena::release(void *buffer)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!buffer)
+		return;
+
+	for (size_t i = 0; i < _blocks.size(); ++i)
+	{
+		if (_blocks[i].ptr == buffer)
+		{
+			if (_blocks[i].inUse)
+			{
+				_blocks[i].inUse = false;
+				_inUse -= _blocks[i].size;
+			}
+			return;
+		}
+	}
+	fprintf(stderr, "BufferArena:  Released buffer does not belong to the arena.\n");
+}
+
+
+void BufferArena::trim(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	freeIdle(0);
+}
+
+
+void BufferArena::freeIdle(size_t maxAllocated)
+{
+	for (size_t i = 0; (i < _blocks.size()) && (_allocated > maxAllocated); )
+	{
+		if (_blocks[i].inUse)
+		{
+			++i;
+			continue;
+		}
+		_allocated -= _blocks[i].size;
+		delete[] _blocks[i].ptr;
+		_blocks.erase(_blocks.begin() + i);
+	}
+}
+
+
+size_t BufferArena::getAllocatedBytes(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _allocated;
+}
+
+
+size_t BufferArena::getBytesInUse(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _inUse;
+}
+
+
+size_t BufferArena::getPeakBytes(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _peak;
+}
+
+
+unsigned int BufferArena::getAllocationCount(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _allocations;
+}
+
+
+unsigned int BufferArena::getReuseCount(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _reuses;
+}
+
+
+unsigned int BufferArena::getFailureCount(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _failures;
+}
+
+
+void BufferArena::printStatistics(const char *name)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	fprintf(stderr, "%s:  %u allocations, %u reuses, %u failures, "
+		"peak %.1f MB", name, _allocations, _reuses, _failures,
+		_peak / (1024.0 * 1024.0));
+	if (_limit)
+		fprintf(stderr, " (limit %.1f MB)", _limit / (1024.0 * 1024.0));
+	fprintf(stderr, "\n");
+}
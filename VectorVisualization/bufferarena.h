@@ -0,0 +1,67 @@
+#ifndef _BUFFERARENA_H_
+#define _BUFFERARENA_H_
+
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+
+
+// Recycles the large buffers needed for every time step (key frames and
+// staging memory of texture uploads). Released buffers are kept and
+// handed out again for requests of the same size, so after the first
+// few frames no more memory is allocated. The total amount of memory
+// held by the arena can be limited. All methods are thread-safe.
+class BufferArena
+{
+public:
+	BufferArena(void);
+	~BufferArena(void);
+
+	// maximum number of bytes held by the arena, 0 means no limit
+	void setLimit(size_t limit);
+	size_t getLimit(void) { return _limit; }
+
+	// returns a buffer of size bytes, NULL if the limit would be exceeded
+	void* acquire(size_t size);
+	// give a buffer returned by acquire() back to the arena
+	void release(void *buffer);
+	// free all buffers which are not in use
+	void trim(void);
+
+	// counters
+	size_t getAllocatedBytes(void);  // in use and idle
+	size_t getBytesInUse(void);
+	size_t getPeakBytes(void);        // maximum of getAllocatedBytes()
+	unsigned int getAllocationCount(void);
+	unsigned int getReuseCount(void);
+	unsigned int getFailureCount(void);
+
+	// print the counters to stderr
+	void printStatistics(const char *name);
+
+protected:
+	// free idle buffers until at most maxAllocated bytes are held
+	void freeIdle(size_t maxAllocated);
+
+private:
+	struct Block
+	{
+		unsigned char *ptr;
+		size_t size;
+		bool inUse;
+	};
+
+	// only a handful of blocks, so linear search is fine
+	std::vector<Block> _blocks;
+	size_t _limit;
+	size_t _allocated;
+	size_t _inUse;
+	size_t _peak;
+	unsigned int _allocations;
+	unsigned int _reuses;
+	unsigned int _failures;
+
+	std::mutex _mutex;
+};
+
+#endif // _BUFFERARENA_H_
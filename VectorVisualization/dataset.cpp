@@ -11,6 +11,8 @@
 #include <string>
 #include <float.h>
 #include <assert.h>
+#include <algorithm>
+#include <atomic>
 
 #include "texture.h"
 #include "imageUtils.h"
@@ -18,6 +20,9 @@
 #include "mmath.h"
 #include "reader.h"
 #include "types.h"
+#include "vectorconvert.h"
+#include "preproccache.h"
+#include "threadpool.h"
 #include "dataSet.h"
 
 
@@ -45,7 +50,11 @@ VolumeData::~VolumeData(void)
 		}
 		d = NULL;
 	}
+	// mapped key frames belong to the mapping, never delete[] them
+	DatFile::unmapRawData(&dataMap);
+	DatFile::unmapRawData(&newDataMap);
 	data = NULL;
+	newData = NULL;
 }
 
 
@@ -83,6 +92,17 @@ void DataSet::setFileName(const char *fileName)
 VectorDataSet::VectorDataSet(void)
 {
 	_vd = new VolumeData();
+	_useMapping = false;
+	_prefetchDepth = 0;
+	_outOfCoreBudget = 0;
+	_outOfCoreBrickSize = BRICK_DEFAULT_SIZE;
+	_usePyramid = false;
+	_useMacroCells = false;
+	_keyFrameWeight = 0.0f;
+	_texWeight = 0.0f;
+	_keyFrameSwapPending = false;
+	_keyFrameFloatTex = false;
+	_uploadMapped = false;
 	interpIndex = 0;
 	InterpSize = 1;
 }
@@ -90,7 +110,17 @@ VectorDataSet::VectorDataSet(void)
 
 VectorDataSet::~VectorDataSet(void)
 {
+	_prefetcher.stop();
+	releaseKeyFrame(_vd->data, _vd->dataMap);
+	releaseKeyFrame(_vd->newData, _vd->newDataMap);
 	delete _vd;
+
+	_arena.printStatistics("VectorData");
+	if (_bricks.isInitialized())
+		_bricks.printStatistics("VectorData");
+
+	if (_tex2.id)
+		glDeleteTextures(1, &_tex2.id);
 }
 
 
@@ -108,8 +138,11 @@ bool VectorDataSet::loadData(const char *fileName)
 		return false;
 	}
 
-	delete[](unsigned char*)_vd->data;
-	_vd->data = NULL;
+	_prefetcher.stop();
+	releaseKeyFrame(_vd->data, _vd->dataMap);
+	releaseKeyFrame(_vd->newData, _vd->newDataMap);
+	_bricks.release();
+	_arena.trim();
 	_loaded = false;
 
 	if (!_datFile.parseDatFile(_fileName))
@@ -128,6 +161,14 @@ bool VectorDataSet::loadData(const char *fileName)
 	}
 	_vd->dataDim = 3; // 3D vector
 
+	if (_datFile.getManifest())
+	{
+		const TimeSeriesManifest *manifest = _datFile.getManifest();
+		fprintf(stdout, "VectorData:  Magnitude over all time steps min %g "
+			"max %g mean %g\n", manifest->getMinMagnitude(),
+			manifest->getMaxMagnitude(), manifest->getMeanMagnitude());
+	}
+
 					  // copy volume dimensions from DatFile to VolumeData
 	_vd->dataType = _datFile.getDataType();
 
@@ -194,18 +235,161 @@ int VectorDataSet::getCurTimeStep()
 	return _datFile.getCurTimeStep();
 }
 
+const TimeStepInfo* VectorDataSet::getTimeStepInfo(int timeStep)
+{
+	const TimeSeriesManifest *manifest = _datFile.getManifest();
+
+	return manifest ? manifest->getTimeStep(timeStep) : NULL;
+}
+
+float VectorDataSet::getStoredMaxMagnitude(int timeStep)
+{
+	const TimeStepInfo *info = getTimeStepInfo(timeStep);
+
+	return info ? info->maxMagnitude : -1.0f;
+}
+
 void* VectorDataSet::loadTimeStep(int timeStep)
 {
 	return _datFile.readRawData(timeStep);
 }
 
+void* VectorDataSet::loadKeyFrame(int timeStep, MappedRawData &map)
+{
+	if (!_useMapping)
+	{
+		void *data = _arena.acquire(_datFile.getRawDataSize());
+		if (!data)
+		{
+			fprintf(stderr, "VectorData:  Memory limit reached, time step %d "
+				"not loaded.\n", timeStep);
+			return NULL;
+		}
+		if (!_datFile.readRawData(timeStep, data))
+		{
+			_arena.release(data);
+			return NULL;
+		}
+		return data;
+	}
+
+	if (!_datFile.mapRawData(timeStep, &map))
+		return NULL;
+	// the view is read-only, none of the consumers writes to the key frames
+	return const_cast<void*>(map.data);
+}
+
+void VectorDataSet::releaseKeyFrame(void *&data, MappedRawData &map)
+{
+	if (map.data)
+		DatFile::unmapRawData(&map);
+	else
+		_arena.release(data);
+	data = NULL;
+}
+
+bool VectorDataSet::loadKeyFrames(int timeStep, int nextTimeStep)
+{
+	int depth = _prefetchDepth;
+
+	_prefetcher.stop();
+	releaseKeyFrame(_vd->data, _vd->dataMap);
+	releaseKeyFrame(_vd->newData, _vd->newDataMap);
+
+	// out of core the bricks are paged in while the textures are filled
+	if (_outOfCoreBudget > 0)
+	{
+		return _bricks.isInitialized()
+			|| _bricks.init(&_datFile, _outOfCoreBudget, _outOfCoreBrickSize);
+	}
+
+	_vd->data = loadKeyFrame(timeStep, _vd->dataMap);
+	_vd->newData = loadKeyFrame(nextTimeStep, _vd->newDataMap);
+
+	// both key frames and the prefetched ones have to fit into the arena
+	if (!_useMapping && _arena.getLimit() && (depth > 0))
+	{
+		int maxDepth = static_cast<int>(_arena.getLimit() / _datFile.getRawDataSize()) - 2;
+		if (maxDepth < 0)
+			maxDepth = 0;
+		if (depth > maxDepth)
+		{
+			fprintf(stderr, "VectorData:  Memory limit allows to prefetch only "
+				"%d time steps.\n", maxDepth);
+			depth = maxDepth;
+		}
+	}
+
+	// everything after the two key frames is loaded in the background
+	if (depth > 0)
+		_prefetcher.start(&_datFile, _datFile.getFollowingTimeStep(nextTimeStep),
+			depth, _useMapping, &_arena);
+	else
+		_prefetcher.stop();
+
+	return (_vd->data != NULL) && (_vd->newData != NULL);
+}
+
+bool VectorDataSet::isKeyFrameReady(void)
+{
+	if (!_prefetcher.isRunning() || (interpIndex + 1 < InterpSize))
+		return true;
+
+	return _prefetcher.isReady(_datFile.getFollowingTimeStep(NextTimeStep()));
+}
+
+bool VectorDataSet::setTimeStep(int timeStep)
+{
+	if (!_datFile.setCurTimeStep(timeStep))
+		return false;
+
+	interpIndex = 0;
+	if (!loadKeyFrames(timeStep, NextTimeStep()))
+		return false;
+
+	// key frame textures are replaced, the interpolated texture is
+	// updated by the next createTextureIterp()
+	if (_tex2.id)
+	{
+		updateMacroCells(MACROCELL_SHADER, true, _keyFrameFloatTex ? 0.5f : 128.0f / 255.0f);
+		uploadKeyFrame(&_tex, _vd->data, timeStep);
+		uploadKeyFrame(&_tex2, _vd->newData, NextTimeStep());
+		_keyFrameWeight = 0.0f;
+		_texWeight = 0.0f;
+		_keyFrameSwapPending = false;
+	}
+
+	return true;
+}
+
 void VectorDataSet::checkInterpolateStage()
 {
 	if (interpIndex >= InterpSize)
 	{
-		_vd->data = loadTimeStep(getNextTimeStep());
-		_vd->newData = loadTimeStep(NextTimeStep());
+		getNextTimeStep();
+
+		// the previous next key frame becomes the current one,
+		// so only one time step has to be read
+		// out of core its bricks are still in the cache
+		if (!isOutOfCore())
+		{
+			releaseKeyFrame(_vd->data, _vd->dataMap);
+			_vd->data = _vd->newData;
+			_vd->dataMap = _vd->newDataMap;
+			_vd->newData = NULL;
+			_vd->newDataMap = MappedRawData();
+
+			if (_prefetcher.isRunning())
+				_prefetcher.pop(NextTimeStep(), _vd->newData, _vd->newDataMap);
+			else
+				_vd->newData = loadKeyFrame(NextTimeStep(), _vd->newDataMap);
+		}
 		interpIndex = 0;
+
+		// textures are switched with the next frame, the current frame
+		// still shows the end of the previous interval
+		if (_tex2.id)
+			_keyFrameSwapPending = true;
 	}
 }
 
@@ -214,30 +398,11 @@ void VectorDataSet::createTexture(const char *texName,
 	GLuint texUnit,
 	bool floatTex)
 {
-	GLuint texId;
 	void *paddedData = NULL;
 
 	if (!_loaded)
 		return;
 
-	// create a texture id
-	if (_tex.id == 0)
-	{
-		glGenTextures(1, &texId);
-		_tex.setTex(GL_TEXTURE_3D, texId, texName);
-	}
-	else
-	{
-		glDeleteTextures(1, &(_tex.id));
-		glGenTextures(1, &texId);
-		_tex.setTex(GL_TEXTURE_3D, texId, texName);
-	}
-	_tex.texUnit = texUnit;
-	_tex.width = _vd->texSize[0];
-	_tex.height = _vd->texSize[1];
-	_tex.depth = _vd->texSize[2];
-
-
 #if FORCE_POWER_OF_TWO_TEXTURE == 1
 	if ((_vd->texSize[0] != _vd->size[0])
 		|| (_vd->texSize[1] != _vd->size[1])
@@ -247,74 +412,45 @@ void VectorDataSet::createTexture(const char *texName,
 	}
 #endif
 
+	setTexFormat(floatTex);
+	prepareTexture(&_tex, texName, texUnit);
 	if (floatTex)
-	{
-		_texSrcFmt = GL_FLOAT;
-		_texIntFmt = GL_RGBA16F_ARB;
-
-		paddedData = fillTexDataFloat();
-	}
+		updateMacroCells(MACROCELL_SINGLE, false, (_vd->dataType == DATRAW_UCHAR) ? 0.005f : 0.5f);
 	else
-	{
-		_texSrcFmt = GL_UNSIGNED_BYTE;
-		_texIntFmt = GL_RGBA;
+		updateMacroCells(MACROCELL_SINGLE, true, 128.0f / 255.0f);
 
-		paddedData = fillTexDataChar();
+	if (isOutOfCore())
+	{
+		// same scaling as fillTexDataFloat() and fillTexDataChar()
+		if (floatTex)
+			uploadBricks(&_tex, getCurTimeStep(), -1, 0.0f, 0.0f,
+				(_vd->dataType == DATRAW_UCHAR) ? 0.005f : 0.5f);
+		else
+			uploadBricks(&_tex, getCurTimeStep(), -1, 0.0f,
+				getBrickMaxMagnitude(getCurTimeStep()), 0.0f);
+		return;
 	}
-	_tex.format = _texIntFmt;
-
-	glBindTexture(GL_TEXTURE_3D, _tex.id);
-	glTexImage3D(GL_TEXTURE_3D, 0, _texIntFmt, _vd->texSize[0],
-		_vd->texSize[1], _vd->texSize[2], 0, GL_RGBA,
-		_texSrcFmt, paddedData);
-
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	CHECK_FOR_OGL_ERROR();
 
+	paddedData = beginTexUpload();
+	if (!paddedData)
+		return;
 	if (floatTex)
-		delete[](float*)paddedData;
+		fillTexDataFloat(static_cast<float*>(paddedData));
 	else
-		delete[](unsigned char*)paddedData;
-	paddedData = NULL;
+		fillTexDataChar(static_cast<unsigned char*>(paddedData));
+	endTexUpload(&_tex, paddedData);
 }
 
 void VectorDataSet::createTextureIterp(const char *texName,
 	GLuint texUnit,
-	bool floatTex)
+	bool floatTex,
+	bool useCache)
 {
-	GLuint texId;
 	void *paddedData = NULL;
 
 	if (!_loaded)
 		return;
 
-	// create a texture id
-	if (_tex.id == 0)
-	{
-		glGenTextures(1, &texId);
-		_tex.setTex(GL_TEXTURE_3D, texId, texName);
-	}
-	else
-	{
-		glDeleteTextures(1, &(_tex.id));
-		glGenTextures(1, &texId);
-		_tex.setTex(GL_TEXTURE_3D, texId, texName);
-	}
-	_tex.texUnit = texUnit;
-	_tex.width = _vd->texSize[0];
-	_tex.height = _vd->texSize[1];
-	_tex.depth = _vd->texSize[2];
-
-
 #if FORCE_POWER_OF_TWO_TEXTURE == 1
 	if ((_vd->texSize[0] != _vd->size[0])
 		|| (_vd->texSize[1] != _vd->size[1])
@@ -324,75 +460,55 @@ void VectorDataSet::createTextureIterp(const char *texName,
 	}
 #endif
 
-	if (floatTex)
-	{
-		_texSrcFmt = GL_FLOAT;
-		_texIntFmt = GL_RGBA16F_ARB;
+	// the texture is only created once, afterwards the
+	// interpolated data is streamed into the existing storage
+	setTexFormat(floatTex);
+	prepareTexture(&_tex, texName, texUnit);
+	updateMacroCells(MACROCELL_LERP, true, floatTex ? 0.5f : 128.0f / 255.0f);
+	_texWeight = (float)interpIndex / InterpSize;
 
-		paddedData = fillTexDataFloatInterp();
-	}
-	else
+	if (isOutOfCore())
 	{
-		_texSrcFmt = GL_UNSIGNED_BYTE;
-		_texIntFmt = GL_RGBA;
-
-		paddedData = fillTexDataCharInterp();
+		uploadBricks(&_tex, getCurTimeStep(), NextTimeStep(),
+			(float)interpIndex / InterpSize, -1.0f, floatTex ? 0.5f : 0.0f);
+		interpIndex++;
+		return;
 	}
 
-	_tex.format = _texIntFmt;
-
-	glBindTexture(GL_TEXTURE_3D, _tex.id);
-	glTexImage3D(GL_TEXTURE_3D, 0, _texIntFmt, _vd->texSize[0],
-		_vd->texSize[1], _vd->texSize[2], 0, GL_RGBA,
-		_texSrcFmt, paddedData);
-
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-
-	CHECK_FOR_OGL_ERROR();
-
-	if (floatTex)
-		delete[](float*)paddedData;
+	paddedData = beginTexUpload();
+	if (!paddedData)
+		return;
+	if (useCache)
+	{
+		fillTexDataLerpCached(_vd->data, _vd->newData,
+			(float)interpIndex / InterpSize, paddedData);
+		interpIndex++;
+	}
+	else if (floatTex)
+		fillTexDataFloatInterp(static_cast<float*>(paddedData));
 	else
-		delete[](unsigned char*)paddedData;
-	paddedData = NULL;
+		fillTexDataCharInterp(static_cast<unsigned char*>(paddedData));
+	endTexUpload(&_tex, paddedData);
 }
 
 void VectorDataSet::createTextures(const char *texName, int datasize,
 	GLuint texUnit,
 	bool floatTex)
 {
+	if (!_loaded)
+		return;
+
+	setTexFormat(floatTex);
+
 	for (int i = 0; i < datasize; i++)
 	{
-		GLuint texId;
 		void *paddedData = NULL;
 
-		if (!_loaded)
-			return;
-
 		Texture tex;
 		char texSetName[100];
 		strcpy(texSetName, texName);
 		strcat(texSetName, std::to_string(i).c_str());
 
-		// create a texture id
-		if (tex.id == 0)
-		{
-			glGenTextures(1, &texId);
-			tex.setTex(GL_TEXTURE_3D, texId, texSetName);
-		}
-		tex.texUnit = texUnit;
-		tex.width = _vd->texSize[0];
-		tex.height = _vd->texSize[1];
-		tex.depth = _vd->texSize[2];
-
 #if FORCE_POWER_OF_TWO_TEXTURE == 1
 		if ((_vd->texSize[0] != _vd->size[0])
 			|| (_vd->texSize[1] != _vd->size[1])
@@ -401,425 +517,588 @@ void VectorDataSet::createTextures(const char *texName, int datasize,
 			fprintf(stderr, "VectorData:  Dimensions are not 2^n.\n");
 		}
 #endif
-		if (floatTex)
-		{
-			_texSrcFmt = GL_FLOAT;
-			_texIntFmt = GL_RGBA16F_ARB;
+		prepareTexture(&tex, texSetName, texUnit);
 
-			paddedData = fillTexDataFloat();
+		if (isOutOfCore())
+		{
+			if (floatTex)
+				uploadBricks(&tex, getCurTimeStep(), -1, 0.0f, 0.0f,
+					(_vd->dataType == DATRAW_UCHAR) ? 0.005f : 0.5f);
+			else
+				uploadBricks(&tex, getCurTimeStep(), -1, 0.0f,
+					getBrickMaxMagnitude(getCurTimeStep()), 0.0f);
+			_texSet.push_back(tex);
+			continue;
 		}
+
+		paddedData = beginTexUpload();
+		if (!paddedData)
+			return;
+		if (floatTex)
+			fillTexDataFloat(static_cast<float*>(paddedData));
 		else
-		{
-			_texSrcFmt = GL_UNSIGNED_BYTE;
-			_texIntFmt = GL_RGBA;
+			fillTexDataChar(static_cast<unsigned char*>(paddedData));
+		endTexUpload(&tex, paddedData);
 
-			paddedData = fillTexDataChar();
-		}
+		_texSet.push_back(tex);
+	}
+}
 
-		tex.format = _texIntFmt;
+void VectorDataSet::createKeyFrameTextures(const char *texName,
+	GLuint texUnit,
+	GLuint texUnit2,
+	bool floatTex)
+{
+	std::string texName2 = std::string(texName) + "2";
 
-		glBindTexture(GL_TEXTURE_3D, tex.id);
-		glTexImage3D(GL_TEXTURE_3D, 0, _texIntFmt, _vd->texSize[0],
-			_vd->texSize[1], _vd->texSize[2], 0, GL_RGBA,
-			_texSrcFmt, paddedData);
+	if (!_loaded)
+		return;
 
-		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-		//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	_keyFrameFloatTex = floatTex;
+	setTexFormat(floatTex);
+	prepareTexture(&_tex, texName, texUnit);
+	prepareTexture(&_tex2, texName2.c_str(), texUnit2);
+	updateMacroCells(MACROCELL_SHADER, true, floatTex ? 0.5f : 128.0f / 255.0f);
 
-		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	uploadKeyFrame(&_tex, _vd->data, getCurTimeStep(), true);
+	uploadKeyFrame(&_tex2, _vd->newData, NextTimeStep(), true);
 
-		CHECK_FOR_OGL_ERROR();
+	_keyFrameWeight = 0.0f;
+	_texWeight = 0.0f;
+	_keyFrameSwapPending = false;
+}
 
-		if (floatTex)
-			delete[](float*)paddedData;
-		else
-			delete[](unsigned char*)paddedData;
-		paddedData = NULL;
+void VectorDataSet::updateKeyFrameTextures(void)
+{
+	if (!_tex2.id)
+		return;
 
-		_texSet.push_back(tex);
+	if (_keyFrameSwapPending)
+	{
+		// the texture of the old next key frame holds the current one now
+		// so only the new next key frame has to be uploaded
+		GLuint id = _tex.id;
+		_tex.id = _tex2.id;
+		_tex2.id = id;
+
+		updateMacroCells(MACROCELL_SHADER, true, _keyFrameFloatTex ? 0.5f : 128.0f / 255.0f);
+		uploadKeyFrame(&_tex2, _vd->newData, NextTimeStep());
+		_keyFrameSwapPending = false;
 	}
+
+	_keyFrameWeight = (float)interpIndex / InterpSize;
+	_texWeight = _keyFrameWeight;
+	interpIndex++;
 }
 
-void* VectorDataSet::fillTexDataFloat(void)
+void VectorDataSet::uploadKeyFrame(Texture *tex, const void *data, int timeStep,
+	bool useCache)
 {
-	int size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
-	int adr;
-	int adrPacked;
-	float len;
-	float maxLen = -1.0;
+	void *paddedData = NULL;
+	float maxLen = getStoredMaxMagnitude(timeStep);
 
-	unsigned char *dataU = (unsigned char*)_vd->data;
-	float *dataF = (float*)_vd->data;
-	float *padded = new float[4 * size];
+	if (isOutOfCore())
+	{
+		uploadBricks(tex, timeStep, -1, 0.0f, getBrickMaxMagnitude(timeStep),
+			_keyFrameFloatTex ? 0.5f : 0.0f);
+		return;
+	}
 
-	memset(padded, 0, 4 * size * sizeof(float));
+	if (!data)
+	{
+		fprintf(stderr, "VectorData:  Key frame not loaded.\n");
+		return;
+	}
 
-	// determine maximum length in the vector field
-	// and normalize the direction
-	// the original magnitude is stored in the forth channel
-	for (int z = 0; z<_vd->size[2]; ++z)
+	// normalize the key frame on its own
+	paddedData = beginTexUpload();
+	if (!paddedData)
+		return;
+	if (useCache)
+		fillTexDataLerpCached(data, NULL, 0.0f, paddedData, maxLen);
+	else if (_keyFrameFloatTex)
+		fillTexDataFloatLerp(data, NULL, 0.0f, static_cast<float*>(paddedData), maxLen);
+	else
+		fillTexDataCharLerp(data, NULL, 0.0f, static_cast<unsigned char*>(paddedData),
+			maxLen);
+	endTexUpload(tex, paddedData);
+}
+
+void VectorDataSet::uploadBricks(Texture *tex, int timeStep, int nextTimeStep, float t,
+	float maxLen, float zeroDir)
+{
+	const int brickSize = _bricks.getBrickSize();
+	const int layerCount = _bricks.getNumBricks()[0] * _bricks.getNumBricks()[1];
+	const bool floatTex = (_texSrcFmt == GL_FLOAT);
+	const size_t voxelSize = 4 * (floatTex ? sizeof(float) : sizeof(unsigned char));
+	const size_t rowStride = _vd->texSize[0];
+	const size_t sliceStride = rowStride * _vd->texSize[1];
+	const size_t sliceSize = sliceStride * voxelSize;
+	std::atomic<bool> ok(true);
+	unsigned char *slab;
+	bool cells[2] = { false, false };
+
+	if (t <= 0.0f)
+		nextTimeStep = -1;
+	// statistics of time steps the macro cells do not know yet
+	if (_useMacroCells && _macroCells.isInitialized())
 	{
-		for (int y = 0; y<_vd->size[1]; ++y)
+		cells[0] = !_macroCells.hasTimeStep(timeStep);
+		cells[1] = (nextTimeStep >= 0) && !_macroCells.hasTimeStep(nextTimeStep);
+		if (cells[0])
+			_macroCells.beginTimeStep(timeStep);
+		if (cells[1])
+			_macroCells.beginTimeStep(nextTimeStep);
+	}
+	// bound of the interpolated magnitudes, the bricks are only read once
+	if (maxLen < 0.0f)
+	{
+		maxLen = getBrickMaxMagnitude(timeStep);
+		if (nextTimeStep >= 0)
+			maxLen = std::max(maxLen, getBrickMaxMagnitude(nextTimeStep));
+	}
+
+	// only one layer of bricks of the padded texture is held in memory
+	slab = static_cast<unsigned char*>(_arena.acquire(sliceSize * brickSize));
+	if (!slab)
+	{
+		fprintf(stderr, "VectorData:  Memory limit reached, texture not updated.\n");
+		return;
+	}
+	memset(slab, 0, sliceSize * brickSize);
+
+	glBindTexture(GL_TEXTURE_3D, tex->id);
+	for (int z = 0; ok && (z < _vd->texSize[2]); z += brickSize)
+	{
+		int depth = std::min(brickSize, _vd->texSize[2] - z);
+		int valid = std::max(0, std::min(depth, _vd->size[2] - z));
+		int layer = z / brickSize;
+
+		if (valid > 0)
 		{
-			for (int x = 0; x<_vd->size[0]; ++x)
+			// the bricks of both key frames are pinned while they are converted
+			ThreadPool::getInstance().parallelForStealing(layerCount, [&](int item, int)
 			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
+				int index = layer * layerCount + item;
+				int origin[3], extent[3];
+				const void *data = _bricks.pin(timeStep, index);
+				const void *next = (nextTimeStep >= 0) ? _bricks.pin(nextTimeStep, index) : NULL;
 
-				if (_vd->dataType == DATRAW_UCHAR)
+				if (data && ((nextTimeStep < 0) || next))
 				{
-					len = sqrt((float)SQR(dataU[3 * adr] - 128) + (float)SQR(dataU[3 * adr + 1] - 128) + (float)SQR(dataU[3 * adr + 2] - 128));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 0.005f;
-						padded[4 * adrPacked + 1] = 0.005f;
-						padded[4 * adrPacked + 2] = 0.005f;
-					}
+					VectorSource src = { data, next, t, _vd->dataType };
+					size_t offset;
+
+					_bricks.getBrickBox(index, origin, extent);
+					if (cells[0])
+						_macroCells.addBrick(timeStep, data, _vd->dataType, origin, extent);
+					if (cells[1])
+						_macroCells.addBrick(nextTimeStep, next, _vd->dataType, origin, extent);
+					offset = (size_t)origin[1] * rowStride + origin[0];
+					if (floatTex)
+						convertBrickFloat(src, extent, maxLen, zeroDir,
+							reinterpret_cast<float*>(slab) + 4 * offset, rowStride, sliceStride);
 					else
-					{
-						padded[4 * adrPacked] = 0.5f*(dataU[3 * adr] - 128) / len + 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f*(dataU[3 * adr + 1] - 128) / len + 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f*(dataU[3 * adr + 2] - 128) / len + 0.5f;
-					}
+						convertBrickChar(src, extent, maxLen, slab + 4 * offset,
+							rowStride, sliceStride);
 				}
 				else
-				{
-					len = sqrt(SQR(dataF[3 * adr]) + SQR(dataF[3 * adr + 1]) + SQR(dataF[3 * adr + 2]));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f;
-					}
-					else
-					{
-						padded[4 * adrPacked] = 0.5f*dataF[3 * adr] / len + 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f*dataF[3 * adr + 1] / len + 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f*dataF[3 * adr + 2] / len + 0.5f;
-					}
-				}
+					ok = false;
 
-				if (len > maxLen)
-					maxLen = len;
-
-				// store magnitude as float for higher precision
-				padded[4 * adrPacked + 3] = len;
-			}
+				if (data)
+					_bricks.unpin(timeStep, index);
+				if (next)
+					_bricks.unpin(nextTimeStep, index);
+			});
 		}
+		// slices behind the data belong to the padding
+		if (valid < depth)
+			memset(slab + valid * sliceSize, 0, (depth - valid) * sliceSize);
+
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, z, _vd->texSize[0], _vd->texSize[1],
+			depth, GL_RGBA, _texSrcFmt, slab);
+		uploadPyramid(tex, slab, z, depth);
+	}
+	CHECK_FOR_OGL_ERROR();
+
+	_arena.release(slab);
+	if (!ok)
+	{
+		fprintf(stderr, "VectorData:  Reading the bricks of time step %d failed.\n",
+			timeStep);
+		return;
 	}
+	if (cells[0])
+		_macroCells.endTimeStep(timeStep);
+	if (cells[1])
+		_macroCells.endTimeStep(nextTimeStep);
+}
 
-	// adapt the range of the magnitude to [0,1]
-	//for (int z = 0; z<_vd->size[2]; ++z)
-	//	for (int y = 0; y<_vd->size[1]; ++y)
-	//		for (int x = 0; x<_vd->size[0]; ++x)
-	//		{
-	//			adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-	//			len = padded[4 * adrPacked + 3] / maxLen;
-	//			padded[4 * adrPacked + 3] = (len > 1.0f) ? 1.0f : ((len < 0.0f) ? 0.0f : len);
-	//		}
+void VectorDataSet::updateMacroCells(MacroCellBlend blend, bool normalized, float zeroDir)
+{
+	int cellSize = MACROCELL_DEFAULT_SIZE;
+	const int *numCells = _macroCells.getNumCells();
 
-	return padded;
+	if (!_useMacroCells)
+		return;
+
+	// out of core the cells must not cross the bricks
+	if (isOutOfCore())
+	{
+		while (_bricks.getBrickSize() % cellSize)
+			--cellSize;
+	}
+	if (!_macroCells.isInitialized() || (_macroCells.getCellSize() != cellSize)
+		|| (numCells[0] != (_vd->texSize[0] + cellSize - 1) / cellSize)
+		|| (numCells[1] != (_vd->texSize[1] + cellSize - 1) / cellSize)
+		|| (numCells[2] != (_vd->texSize[2] + cellSize - 1) / cellSize))
+	{
+		_macroCells.init(_vd->size, _vd->texSize, cellSize);
+	}
+
+	_macroCells.setKeyFrames(getCurTimeStep(), NextTimeStep(), blend, normalized, zeroDir);
+	if (isOutOfCore())
+		return;
+
+	if (_vd->data && !_macroCells.hasTimeStep(getCurTimeStep()))
+		_macroCells.setTimeStep(getCurTimeStep(), _vd, _vd->data);
+	if ((blend != MACROCELL_SINGLE) && _vd->newData && !_macroCells.hasTimeStep(NextTimeStep()))
+		_macroCells.setTimeStep(NextTimeStep(), _vd, _vd->newData);
 }
 
-// make tecture data between two key frame
-// this is for creating texture data for animation
-void* VectorDataSet::fillTexDataFloatInterp()
+int VectorDataSet::getPyramidLevels(void)
 {
-	int size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
-	int adr;
-	int adrPacked;
-	float len;
-	float maxLen = -1.0;
+	int maxSize = std::max(_vd->texSize[0], std::max(_vd->texSize[1], _vd->texSize[2]));
+	int levels = 1;
 
-	unsigned char *dataU = (unsigned char*)_vd->data;
-	unsigned char *dataNextU = (unsigned char*)_vd->newData;
-	float *dataF = (float*)_vd->data;
-	float *dataNextF = (float*)_vd->newData;
-	float *padded = new float[4 * size];
+	if (!_usePyramid)
+		return 1;
 
-	memset(padded, 0, 4 * size * sizeof(float));
+	// down to a single voxel along the longest axis
+	while (maxSize >> levels)
+		++levels;
 
-	// determine maximum length in the vector field
-	// and normalize the direction
-	// the original magnitude is stored in the forth channel
-	for (int z = 0; z<_vd->size[2]; ++z)
+	// the levels of a layer of bricks have to start at whole voxels
+	if (isOutOfCore())
 	{
-		for (int y = 0; y<_vd->size[1]; ++y)
-		{
-			for (int x = 0; x<_vd->size[0]; ++x)
-			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
+		int brickLevels = 1;
+		while ((_bricks.getBrickSize() % (1 << brickLevels)) == 0)
+			++brickLevels;
+		levels = std::min(levels, brickLevels);
+	}
 
-				unsigned char tdataU[3];
-				float tdataF[3];
+	return levels;
+}
 
-				if (_vd->dataType == DATRAW_UCHAR)
-				{
-					for (int idx = 0; idx < 3; idx++)
-					{
-						dataU[3 * adr + idx] -= 128;
-						dataNextU[3 * adr + idx] -= 128;
-						tdataU[idx] = dataU[3 * adr + idx] + (float)interpIndex / InterpSize * (dataNextU[3 * adr + idx] - dataU[3 * adr + idx]);
-					}
-					len = sqrt((float)SQR(tdataU[0]) + (float)SQR(tdataU[1]) + (float)SQR(tdataU[2]));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f;
-					}
-					else
-					{
-						padded[4 * adrPacked] = 0.5f*(tdataU[0]) / len + 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f*(tdataU[1]) / len + 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f*(tdataU[2]) / len + 0.5f;
-					}
-				}
-				else
-				{/*
-					if (dataF[3 * adr] > 0 && interpIndex == 48)
-						std::cout << dataF[3 * adr] << " " << dataNextF[3 * adr] << std::endl;*/
-					for (int idx = 0; idx < 3; idx++)
-					{
-						tdataF[idx] = dataF[3 * adr + idx] + (float)interpIndex / InterpSize * (dataNextF[3 * adr + idx] - dataF[3 * adr + idx]);
-					}
-					len = sqrt(SQR(tdataF[0]) + SQR(tdataF[1]) + SQR(tdataF[2]));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f;
-					}
-					else
-					{
-						padded[4 * adrPacked] = 0.5f*tdataF[0] / len + 0.5f;
-						padded[4 * adrPacked + 1] = 0.5f*tdataF[1] / len + 0.5f;
-						padded[4 * adrPacked + 2] = 0.5f*tdataF[2] / len + 0.5f;
-						/*padded[4 * adrPacked] = tdataF[0] / len;
-						padded[4 * adrPacked + 1] = tdataF[1] / len;
-						padded[4 * adrPacked + 2] = tdataF[2] / len;*/
-					}
-				}
+void VectorDataSet::uploadPyramid(Texture *tex, const void *level0, int z, int depth)
+{
+	const int levels = getPyramidLevels();
+	const bool floatTex = (_texSrcFmt == GL_FLOAT);
+	const size_t voxelSize = 4 * (floatTex ? sizeof(float) : sizeof(unsigned char));
+	const unsigned char *src = static_cast<const unsigned char*>(level0);
+	int srcSize[3] = { _vd->texSize[0], _vd->texSize[1], depth };
+	int dstSize[3];
+	size_t total = 0;
+	unsigned char *buffer, *dst;
+
+	// slices of a level covered by depth slices of the previous level,
+	// false if none are left
+	auto getLevelSize = [&](int level, int prevDepth, int size[3])
+	{
+		size[0] = std::max(_vd->texSize[0] >> level, 1);
+		size[1] = std::max(_vd->texSize[1] >> level, 1);
+		size[2] = std::min(std::max(_vd->texSize[2] >> level, 1) - (z >> level),
+			(prevDepth + 1) / 2);
+		return size[2] > 0;
+	};
+
+	if (levels < 2)
+		return;
 
-				if (len > maxLen)
-					maxLen = len;
+	// all coarser levels are kept in one buffer, each one is computed
+	// from the previous one
+	for (int level = 1, prevDepth = depth; level < levels; ++level)
+	{
+		if (!getLevelSize(level, prevDepth, dstSize))
+			break;
+		total += voxelSize * dstSize[0] * dstSize[1] * dstSize[2];
+		prevDepth = dstSize[2];
+	}
 
-				// store magnitude as float for higher precision
-				padded[4 * adrPacked + 3] = len;
-			}
-		}
+	buffer = static_cast<unsigned char*>(_arena.acquire(total));
+	if (!buffer)
+	{
+		fprintf(stderr, "VectorData:  Memory limit reached, pyramid not updated.\n");
+		return;
 	}
 
-	// adapt the range of the magnitude to [0,1]
-	for (int z = 0; z<_vd->size[2]; ++z)
-		for (int y = 0; y<_vd->size[1]; ++y)
-			for (int x = 0; x<_vd->size[0]; ++x)
-			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				len = padded[4 * adrPacked + 3] / maxLen;
-				padded[4 * adrPacked + 3] = (len > 1.0f) ? 1.0f : ((len < 0.0f) ? 0.0f : len);
-			}
+	glBindTexture(GL_TEXTURE_3D, tex->id);
+	dst = buffer;
+	for (int level = 1; level < levels; ++level)
+	{
+		if (!getLevelSize(level, srcSize[2], dstSize))
+			break;
 
-	interpIndex++;
-	return padded;
+		if (floatTex)
+			downsampleVectorsFloat(reinterpret_cast<const float*>(src), srcSize,
+				reinterpret_cast<float*>(dst), dstSize);
+		else
+			downsampleVectorsChar(src, srcSize, dst, dstSize);
+		glTexSubImage3D(GL_TEXTURE_3D, level, 0, 0, z >> level, dstSize[0], dstSize[1],
+			dstSize[2], GL_RGBA, _texSrcFmt, dst);
+
+		src = dst;
+		dst += voxelSize * dstSize[0] * dstSize[1] * dstSize[2];
+		memcpy(srcSize, dstSize, sizeof(srcSize));
+	}
+	CHECK_FOR_OGL_ERROR();
+
+	_arena.release(buffer);
 }
 
-void* VectorDataSet::fillTexDataChar(void)
+float VectorDataSet::getBrickMaxMagnitude(int timeStep)
 {
-	int size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
-	int adr;
-	int adrPacked;
-	float len;
-	float maxLen = -1.0;
+	float maxLen = getStoredMaxMagnitude(timeStep);
 
-	float *magnitude = new float[size];
+	return (maxLen < 0.0f) ? _bricks.getMaxMagnitude(timeStep) : maxLen;
+}
 
-	unsigned char *dataU = (unsigned char*)_vd->data;
-	float *dataF = (float*)_vd->data;
-	unsigned char *padded = new unsigned char[4 * size];
+bool VectorDataSet::computeHistogram(int timeStep, int *histogram, int bins)
+{
+	const int numThreads = ThreadPool::getInstance().getNumThreads();
+	std::vector<std::vector<int> > local(numThreads, std::vector<int>(bins, 0));
+	std::atomic<bool> ok(true);
+	float maxLen;
 
-	memset(padded, 0, 4 * size * sizeof(char));
+	if (!isOutOfCore())
+		return false;
 
-	// determine maximum length in the vector field
-	// and normalize the direction
-	// the original magnitude is stored in the forth channel/in *magnitude
-	for (int z = 0; z<_vd->size[2]; ++z)
+	// every thread adds its bricks to its own histogram
+	maxLen = getBrickMaxMagnitude(timeStep);
+	ThreadPool::getInstance().parallelForStealing(_bricks.getBrickCount(), [&](int index, int slot)
 	{
-		for (int y = 0; y<_vd->size[1]; ++y)
+		int origin[3], extent[3];
+		const void *data = _bricks.pin(timeStep, index);
+
+		if (!data)
 		{
-			for (int x = 0; x<_vd->size[0]; ++x)
-			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
+			ok = false;
+			return;
+		}
+		VectorSource src = { data, NULL, 0.0f, _vd->dataType };
+		_bricks.getBrickBox(index, origin, extent);
+		accumulateMagnitudeHistogram(src, (size_t)extent[0] * extent[1] * extent[2],
+			maxLen, &local[slot][0], bins);
+		_bricks.unpin(timeStep, index);
+	});
+
+	memset(histogram, 0, bins * sizeof(int));
+	for (int i = 0; i < numThreads; ++i)
+	{
+		for (int j = 0; j < bins; ++j)
+			histogram[j] += local[i][j];
+	}
 
-				if (_vd->dataType == DATRAW_UCHAR)
-				{
-					len = sqrt((float)SQR(dataU[3 * adr] - 128) + (float)SQR(dataU[3 * adr + 1] - 128) + (float)SQR(dataU[3 * adr + 2] - 128));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 128;
-						padded[4 * adrPacked + 1] = 128;
-						padded[4 * adrPacked + 2] = 128;
-					}
-					else
-					{
-						padded[4 * adrPacked] = (unsigned char)((dataU[3 * adr] - 128) / len * 127.0f + 128.0f);
-						padded[4 * adrPacked + 1] = (unsigned char)((dataU[3 * adr + 1] - 128) / len * 127.0f + 128.0f);
-						padded[4 * adrPacked + 2] = (unsigned char)((dataU[3 * adr + 2] - 128) / len * 127.0f + 128.0f);
-					}
-				}
-				else
-				{
-					len = sqrt(SQR(dataF[3 * adr]) + SQR(dataF[3 * adr + 1]) + SQR(dataF[3 * adr + 2]));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 128;
-						padded[4 * adrPacked + 1] = 128;
-						padded[4 * adrPacked + 2] = 128;
-					}
-					else
-					{
-						padded[4 * adrPacked] = (unsigned char)(dataF[3 * adr] / len * 127.0 + 128.0);
-						padded[4 * adrPacked + 1] = (unsigned char)(dataF[3 * adr + 1] / len * 127.0 + 128.0);
-						padded[4 * adrPacked + 2] = (unsigned char)(dataF[3 * adr + 2] / len * 127.0 + 128.0);
-					}
-				}
+	return ok;
+}
+
+void VectorDataSet::setTexFormat(bool floatTex)
+{
+	if (floatTex)
+	{
+		_texSrcFmt = GL_FLOAT;
+		_texIntFmt = GL_RGBA16F_ARB;
+	}
+	else
+	{
+		_texSrcFmt = GL_UNSIGNED_BYTE;
+		_texIntFmt = GL_RGBA;
+	}
+}
+
+void VectorDataSet::prepareTexture(Texture *tex, const char *texName, GLuint texUnit)
+{
+	GLuint texId;
+	size_t bufferSize = 4 * (size_t)_vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2]
+		* ((_texSrcFmt == GL_FLOAT) ? sizeof(float) : sizeof(unsigned char));
+	int levels = getPyramidLevels();
+
+	tex->texUnit = texUnit;
+
+	// reuse the immutable storage as long as format and size match
+	if (!tex->id || (tex->format != _texIntFmt) || (tex->width != _vd->texSize[0])
+		|| (tex->height != _vd->texSize[1]) || (tex->depth != _vd->texSize[2])
+		|| (tex->levels != levels))
+	{
+		if (tex->id)
+			glDeleteTextures(1, &(tex->id));
+		glGenTextures(1, &texId);
+		tex->setTex(GL_TEXTURE_3D, texId, texName);
+
+		PixelBufferRing::createStorage3D(tex, _texIntFmt, _vd->texSize[0],
+			_vd->texSize[1], _vd->texSize[2], levels);
+
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		CHECK_FOR_OGL_ERROR();
+	}
+
+	// the pyramid is computed from a staging buffer, see beginTexUpload()
+	if ((levels == 1) && (_pbo.getBufferSize() != bufferSize))
+	{
+		if (!_pbo.init(bufferSize))
+			fprintf(stderr, "VectorData:  Pixel buffers not available, "
+				"uploading without.\n");
+	}
+}
+
+void* VectorDataSet::beginTexUpload(void)
+{
+	size_t size = 4 * (size_t)_vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2]
+		* ((_texSrcFmt == GL_FLOAT) ? sizeof(float) : sizeof(unsigned char));
+	void *padded = NULL;
+
+	// the coarser levels are computed from level 0, which is slow to read
+	// from write-combined pixel buffer memory
+	if (getPyramidLevels() == 1)
+		padded = _pbo.map();
+	_uploadMapped = (padded != NULL);
+	if (padded)
+		return padded;
+
+	// no pixel buffer available, fall back to a staging buffer
+	padded = _arena.acquire(size);
+	if (!padded)
+		fprintf(stderr, "VectorData:  Memory limit reached, texture not updated.\n");
+	return padded;
+}
+
+void VectorDataSet::endTexUpload(Texture *tex, void *padded)
+{
+	if (_uploadMapped)
+	{
+		_pbo.upload3D(tex, GL_RGBA, _texSrcFmt);
+		return;
+	}
+
+	glBindTexture(GL_TEXTURE_3D, tex->id);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, tex->width, tex->height,
+		tex->depth, GL_RGBA, _texSrcFmt, padded);
+	CHECK_FOR_OGL_ERROR();
+	uploadPyramid(tex, padded, 0, tex->depth);
+
+	_arena.release(padded);
+}
 
-				if (len > maxLen)
-					maxLen = len;
+void VectorDataSet::fillTexDataFloat(float *padded)
+{
+	VectorSource src = { _vd->data, NULL, 0.0f, _vd->dataType };
 
-				// store magnitude as float for higher precision
-				magnitude[adrPacked] = len;
-			}
-		}
-	}
+	// the magnitude is stored unscaled for higher precision
+	convertVectorsFloat(_vd, src, 0.0f,
+		(_vd->dataType == DATRAW_UCHAR) ? 0.005f : 0.5f, padded);
+}
 
-	// adapt the range of the magnitude to [0,255]
-	for (int z = 0; z<_vd->size[2]; ++z)
-		for (int y = 0; y<_vd->size[1]; ++y)
-			for (int x = 0; x<_vd->size[0]; ++x)
-			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				len = magnitude[adrPacked] / maxLen * UCHAR_MAX;
-				padded[4 * adrPacked + 3] = (unsigned char)((len > 255.0f) ? 255 : ((len < 0.0f) ? 0 : len));
-			}
+// make tecture data between two key frame
+// this is for creating texture data for animation
+void VectorDataSet::fillTexDataFloatInterp(float *padded)
+{
+	fillTexDataFloatLerp(_vd->data, _vd->newData,
+		(float)interpIndex / InterpSize, padded);
+	interpIndex++;
+}
 
-	delete[] magnitude;
+void VectorDataSet::fillTexDataFloatLerp(const void *data, const void *next, float t,
+	float *padded, float maxLen)
+{
+	VectorSource src = { data, next, t, _vd->dataType };
 
-	return padded;
+	// the range of the magnitude is adapted to [0,1]
+	if (maxLen < 0.0f)
+		maxLen = computeMaxMagnitude(_vd, src);
+	convertVectorsFloat(_vd, src, maxLen, 0.5f, padded);
 }
 
-void* VectorDataSet::fillTexDataCharInterp()
+void VectorDataSet::fillTexDataChar(unsigned char *padded)
 {
-	int size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
-	int adr;
-	int adrPacked;
-	float len;
-	float maxLen = -1.0;
+	VectorSource src = { _vd->data, NULL, 0.0f, _vd->dataType };
+	float maxLen = getStoredMaxMagnitude(getCurTimeStep());
 
-	float *magnitude = new float[size];
+	// the range of the magnitude is adapted to [0,255]
+	if (maxLen < 0.0f)
+		maxLen = computeMaxMagnitude(_vd, src);
+	convertVectorsChar(_vd, src, maxLen, padded);
+}
+
+void VectorDataSet::fillTexDataCharInterp(unsigned char *padded)
+{
+	fillTexDataCharLerp(_vd->data, _vd->newData,
+		(float)interpIndex / InterpSize, padded);
+	interpIndex++;
+}
 
-	unsigned char *dataU = (unsigned char*)_vd->data;
-	unsigned char *dataNextU = (unsigned char*)_vd->newData;
-	float *dataF = (float*)_vd->data;
-	float *dataNextF = (float*)_vd->newData;
-	unsigned char *padded = new unsigned char[4 * size];
+void VectorDataSet::fillTexDataCharLerp(const void *data, const void *next, float t,
+	unsigned char *padded, float maxLen)
+{
+	VectorSource src = { data, next, t, _vd->dataType };
 
-	memset(padded, 0, 4 * size * sizeof(char));
+	if (maxLen < 0.0f)
+		maxLen = computeMaxMagnitude(_vd, src);
+	convertVectorsChar(_vd, src, maxLen, padded);
+}
 
-	// determine maximum length in the vector field
-	// and normalize the direction
-	// the original magnitude is stored in the forth channel/in *magnitude
-	for (int z = 0; z<_vd->size[2]; ++z)
+void VectorDataSet::fillTexDataLerpCached(const void *data, const void *next, float t,
+	void *padded, float maxLen)
+{
+	PreprocCache &cache = PreprocCache::getInstance();
+	size_t rawSize = _datFile.getRawDataSize();
+	size_t size = 4 * (size_t)_vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2]
+		* ((_texSrcFmt == GL_FLOAT) ? sizeof(float) : sizeof(unsigned char));
+	void *converted = NULL;
+	PreprocKey key("vectex");
+
+	if (cache.isEnabled())
 	{
-		for (int y = 0; y<_vd->size[1]; ++y)
+		key.addContent(data, rawSize);
+		if (next)
 		{
-			for (int x = 0; x<_vd->size[0]; ++x)
-			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
-
-				unsigned char tdataU[3];
-				float tdataF[3];
-				if (_vd->dataType == DATRAW_UCHAR)
-				{
-					for (int idx = 0; idx < 3; idx++)
-					{
-						dataU[3 * adr + idx] -= 128;
-						dataNextU[3 * adr + idx] -= 128;
-						tdataU[idx] = dataU[3 * adr + idx] + (float)interpIndex / InterpSize * (dataNextU[3 * adr + idx] - dataU[3 * adr + idx]);
-					}
-					len = sqrt((float)SQR(tdataU[0]) + (float)SQR(tdataU[1]) + (float)SQR(tdataU[2]));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 128;
-						padded[4 * adrPacked + 1] = 128;
-						padded[4 * adrPacked + 2] = 128;
-					}
-					else
-					{
-						padded[4 * adrPacked] = (unsigned char)((tdataU[0]) / len * 127.0f + 128.0f);
-						padded[4 * adrPacked + 1] = (unsigned char)((tdataU[1]) / len * 127.0f + 128.0f);
-						padded[4 * adrPacked + 2] = (unsigned char)((tdataU[2]) / len * 127.0f + 128.0f);
-					}
-				}
-				else
-				{
-					for (int idx = 0; idx < 3; idx++)
-					{
-						tdataF[idx] = dataF[3 * adr + idx] + (float)interpIndex / InterpSize * (dataNextF[3 * adr + idx] - dataF[3 * adr + idx]);
-					}
-					len = sqrt(SQR(tdataF[0]) + SQR(tdataF[1]) + SQR(tdataF[2]));
-					if (len < EPS)
-					{
-						len = 0.0f;
-						padded[4 * adrPacked] = 128;
-						padded[4 * adrPacked + 1] = 128;
-						padded[4 * adrPacked + 2] = 128;
-					}
-					else
-					{
-						padded[4 * adrPacked] = (unsigned char)(tdataF[0] / len * 127.0 + 128.0);
-						padded[4 * adrPacked + 1] = (unsigned char)(tdataF[1] / len * 127.0 + 128.0);
-						padded[4 * adrPacked + 2] = (unsigned char)(tdataF[2] / len * 127.0 + 128.0);
-					}
-				}
+			key.addContent(next, rawSize);
+			key.add(t);
+		}
+		key.add(_vd->size, sizeof(_vd->size));
+		key.add(_vd->texSize, sizeof(_vd->texSize));
+		key.add(_vd->dataDim);
+		key.add(static_cast<int>(_vd->dataType));
+		key.add(static_cast<int>(_texSrcFmt));
 
-				if (len > maxLen)
-					maxLen = len;
+		if (cache.load(key, padded, size))
+			return;
 
-				// store magnitude as float for higher precision
-				magnitude[adrPacked] = len;
-			}
-		}
+		// padded may point into write-combined memory which is slow to read,
+		// so the entry is written from a staging buffer
+		converted = _arena.acquire(size);
 	}
 
-	// adapt the range of the magnitude to [0,255]
-	for (int z = 0; z<_vd->size[2]; ++z)
-		for (int y = 0; y<_vd->size[1]; ++y)
-			for (int x = 0; x<_vd->size[0]; ++x)
-			{
-				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-				len = magnitude[adrPacked] / maxLen * UCHAR_MAX;
-				padded[4 * adrPacked + 3] = (unsigned char)((len > 255.0f) ? 255 : ((len < 0.0f) ? 0 : len));
-			}
-
-	delete[] magnitude;
+	void *target = converted ? converted : padded;
+	if (_texSrcFmt == GL_FLOAT)
+		fillTexDataFloatLerp(data, next, t, static_cast<float*>(target), maxLen);
+	else
+		fillTexDataCharLerp(data, next, t, static_cast<unsigned char*>(target), maxLen);
 
-	return padded;
+	if (converted)
+	{
+		cache.store(key, converted, size);
+		memcpy(padded, converted, size);
+		_arena.release(converted);
+	}
 }
 
 
@@ -941,23 +1220,12 @@ void VolumeDataSet::createTexture(const char *texName,
 	int size;
 	int adr;
 	int adrPacked;
-	bool needPadding = false;
-	void *paddedData = _vd->data;
+	int voxelSize;
+	void *paddedData = NULL;
 
 	if (!_loaded)
 		return;
 
-	// create a texture id
-	if (_tex.id == 0)
-	{
-		glGenTextures(1, &texId);
-		_tex.setTex(GL_TEXTURE_3D, texId, texName);
-	}
-	_tex.texUnit = texUnit;
-	_tex.width = _vd->texSize[0];
-	_tex.height = _vd->texSize[1];
-	_tex.depth = _vd->texSize[2];
-
 	switch (_vd->dataType)
 	{
 	case DATRAW_UCHAR:
@@ -976,7 +1244,6 @@ void VolumeDataSet::createTexture(const char *texName,
 		|| (_vd->texSize[2] != _vd->size[2]))
 	{
 		fprintf(stderr, "VolumeData:  Dimensions are not 2^n.\n");
-		needPadding = true;
 	}
 #endif
 
@@ -985,68 +1252,60 @@ void VolumeDataSet::createTexture(const char *texName,
 	else
 		_texIntFmt = GL_LUMINANCE;
 
-	_tex.format = _texIntFmt;
-
-	size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
-
-
-	if (needPadding)
+	// create a texture with immutable storage, reuse it if possible
+	if (!_tex.id || (_tex.format != _texIntFmt) || (_tex.width != _vd->texSize[0])
+		|| (_tex.height != _vd->texSize[1]) || (_tex.depth != _vd->texSize[2]))
 	{
-		if (_vd->dataType == DATRAW_UCHAR)
-		{
-			paddedData = new unsigned char[size];
-
-			// perform padding of the original data
-			for (int z = 0; z<_vd->size[2]; ++z)
-				for (int y = 0; y<_vd->size[1]; ++y)
-					for (int x = 0; x<_vd->size[0]; ++x)
-					{
-						adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-						adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
-						((unsigned char*)paddedData)[adrPacked] =
-							((unsigned char*)_vd->data)[adr];
-					}
-		}
-		else
-		{
-			paddedData = new float[size];
+		if (_tex.id)
+			glDeleteTextures(1, &_tex.id);
+		glGenTextures(1, &texId);
+		_tex.setTex(GL_TEXTURE_3D, texId, texName);
 
-			// perform padding of the original data
-			for (int z = 0; z<_vd->size[2]; ++z)
-				for (int y = 0; y<_vd->size[1]; ++y)
-					for (int x = 0; x<_vd->size[0]; ++x)
-					{
-						adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-						adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
-						((float*)paddedData)[adrPacked] =
-							((float*)_vd->data)[adr];
-					}
-		}
-	}
+		PixelBufferRing::createStorage3D(&_tex, _texIntFmt, _vd->texSize[0],
+			_vd->texSize[1], _vd->texSize[2]);
 
-	glBindTexture(GL_TEXTURE_3D, _tex.id);
-	glTexImage3DEXT(GL_TEXTURE_3D, 0, _texIntFmt, _vd->texSize[0],
-		_vd->texSize[1], _vd->texSize[2], 0, GL_LUMINANCE,
-		_texSrcFmt, paddedData);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	_tex.texUnit = texUnit;
 
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
+	voxelSize = getDataTypeSize(_vd->dataType);
 
-	CHECK_FOR_OGL_ERROR();
+	if (_pbo.getBufferSize() != (size_t)size * voxelSize)
+		_pbo.init((size_t)size * voxelSize, 1);
 
-	if (needPadding)
+	// padding is written directly into the pixel buffer
+	paddedData = _pbo.map();
+	if (paddedData)
 	{
-		if (_vd->dataType == DATRAW_UCHAR)
-			delete[] static_cast<unsigned char*>(paddedData);
-		else
-			delete[] static_cast<float*>(paddedData);
-		paddedData = NULL;
+		memset(paddedData, 0, (size_t)size * voxelSize);
+		for (int z = 0; z<_vd->size[2]; ++z)
+			for (int y = 0; y<_vd->size[1]; ++y)
+			{
+				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0];
+				adr = (z*_vd->size[1] + y)*_vd->size[0];
+				memcpy(static_cast<char*>(paddedData) + adrPacked * voxelSize,
+					static_cast<char*>(_vd->data) + adr * voxelSize,
+					_vd->size[0] * voxelSize);
+			}
+		_pbo.upload3D(&_tex, GL_LUMINANCE, _texSrcFmt);
+	}
+	else
+	{
+		// no pixel buffers, upload the data set into the padded texture
+		glBindTexture(GL_TEXTURE_3D, _tex.id);
+		glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, _vd->size[0],
+			_vd->size[1], _vd->size[2], GL_LUMINANCE,
+			_texSrcFmt, _vd->data);
 	}
+
+	CHECK_FOR_OGL_ERROR();
 }
 
 
@@ -1071,45 +1330,21 @@ void VolumeDataSet::normalizeData(void)
 
 void VolumeDataSet::normalizeDataFloat(void)
 {
-	float min = ((float*)_vd->data)[0];
-	float max = -FLT_MAX;
-	float *data = (float*)_vd->data;
-
-	for (int i = 0; i<_vd->size[0] * _vd->size[1] * _vd->size[2]; ++i)
-	{
-		if (max < data[i])
-			max = data[i];
-		else if (min > data[i])
-			min = data[i];
-	}
-
-	for (int i = 0; i<_vd->size[0] * _vd->size[1] * _vd->size[2]; ++i)
-		data[i] = (data[i] - min) / (max - min);
+	normalizeScalarsFloat((float*)_vd->data,
+		(size_t)_vd->size[0] * _vd->size[1] * _vd->size[2]);
 }
 
 
 void VolumeDataSet::normalizeDataChar(void)
 {
-	unsigned char min = ((unsigned char*)_vd->data)[0];
-	unsigned char max = 0;
-	unsigned char *data = (unsigned char*)_vd->data;
-
-	for (int i = 0; i<_vd->size[0] * _vd->size[1] * _vd->size[2]; ++i)
-	{
-		if (max < data[i])
-			max = data[i];
-		else if (min > data[i])
-			min = data[i];
-	}
-
-	for (int i = 0; i<_vd->size[0] * _vd->size[1] * _vd->size[2]; ++i)
-		data[i] = (unsigned char)((data[i] - min) / (float)(max - min) * UCHAR_MAX);
+	normalizeScalarsChar((unsigned char*)_vd->data,
+		(size_t)_vd->size[0] * _vd->size[1] * _vd->size[2]);
 }
 
 
 // --------------------------------------------------
 
-NoiseDataSet::NoiseDataSet(void) : _useGradient(true)
+NoiseDataSet::NoiseDataSet(void) : _useGradient(true), _packedData(NULL)
 {
 	_vd = new VolumeData;
 }
@@ -1117,6 +1352,7 @@ NoiseDataSet::NoiseDataSet(void) : _useGradient(true)
 
 NoiseDataSet::~NoiseDataSet(void)
 {
+	releaseTextureData();
 	delete _vd;
 }
 
@@ -1134,6 +1370,7 @@ bool NoiseDataSet::loadData(const char *fileName)
 		//return false;
 	}
 
+	releaseTextureData();
 	delete[] static_cast<unsigned char*>(_vd->data);
 	_vd->data = NULL;
 	_loaded = false;
@@ -1173,6 +1410,131 @@ bool NoiseDataSet::loadData(const char *fileName)
 }
 
 
+bool NoiseDataSet::updateTexSize(void)
+{
+	bool needPadding = false;
+
+#if FORCE_POWER_OF_TWO_TEXTURE == 0
+	_vd->texSize[0] = _vd->size[0];
+	_vd->texSize[1] = _vd->size[1];
+	_vd->texSize[2] = _vd->size[2];
+#else
+	_vd->texSize[0] = nextPowerTwo(_vd->size[0]);
+	_vd->texSize[1] = nextPowerTwo(_vd->size[1]);
+	_vd->texSize[2] = nextPowerTwo(_vd->size[2]);
+
+	if ((_vd->texSize[0] != _vd->size[0])
+		|| (_vd->texSize[1] != _vd->size[1])
+		|| (_vd->texSize[2] != _vd->size[2]))
+	{
+		needPadding = true;
+	}
+#endif
+
+	return needPadding;
+}
+
+
+bool NoiseDataSet::computeTextureData(void)
+{
+	int size;
+	int adr, adrPacked;
+	float *gradients = NULL;
+	unsigned char *gradTmp = NULL;
+
+	if (!_loaded)
+		return false;
+	if (!_useGradient || _packedData || _packedView.data)
+		return true;
+
+	updateTexSize();
+	size = _vd->texSize[0] * _vd->texSize[1] * _vd->texSize[2];
+
+	// the packed texture depends only on the noise and the gradient filter
+	// white noise differs in every run and is not cached
+	PreprocKey key("noise");
+	if (_fileName)
+	{
+		key.addContent(_vd->data, (size_t)_vd->size[0] * _vd->size[1] * _vd->size[2]
+			* _vd->dataDim * getDataTypeSize(_vd->dataType));
+		key.add(_vd->size, sizeof(_vd->size));
+		key.add(_vd->texSize, sizeof(_vd->texSize));
+		key.add(GRAD_FILTER_SIZE);
+		key.add(SIGMA2);
+		key.add(SOBEL);
+	}
+	if (_fileName && PreprocCache::getInstance().map(key, 4 * (size_t)size, &_packedView))
+	{
+		fprintf(stdout, "NoiseData:  Using cached noise gradients.\n");
+		return true;
+	}
+
+	_packedData = new unsigned char[4 * size];
+	memset(_packedData, 0, 4 * size * sizeof(char));
+
+	// try to load precomputed gradients if volume was loaded earlier
+	gradTmp = (unsigned char*)loadGradients(_vd, _fileName, DATRAW_UCHAR);
+	if (!gradTmp) // gradients not loaded from file
+	{
+		// compute gradients
+		gradients = computeGradients(_vd);
+		if (!gradients)
+		{
+			fprintf(stderr, "NoiseData:  Error during gradient computation.\n");
+			releaseTextureData();
+			return false;
+		}
+		filterGradients(_vd, gradients);
+		// quantize gradients to 8bit
+		gradTmp = (unsigned char*)quantizeGradients(_vd, gradients, DATRAW_UCHAR);
+
+		// store gradients for the next time
+		// but don't save gradients of white noise
+		if (_fileName)
+			if (!saveGradients(_vd, _fileName, gradTmp, DATRAW_UCHAR))
+				fprintf(stderr, "NoiseData:  Saving gradients was "
+					"not sucessful.\n");
+
+	}
+	else
+	{
+		fprintf(stdout, "NoiseData:  Using stored gradients "
+			"from \"%s%s\".\n", _fileName, GRADIENTS_EXT);
+		// TODO: adapt to float noise?
+	}
+
+	// pack scalar noise and gradients
+	for (int z = 0; z<_vd->size[2]; ++z)
+		for (int y = 0; y<_vd->size[1]; ++y)
+			for (int x = 0; x<_vd->size[0]; ++x)
+			{
+				adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
+				adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
+				assert(adr == adrPacked);
+				_packedData[4 * adrPacked + 0] = gradTmp[3 * adr];
+				_packedData[4 * adrPacked + 1] = gradTmp[3 * adr + 1];
+				_packedData[4 * adrPacked + 2] = gradTmp[3 * adr + 2];
+				_packedData[4 * adrPacked + 3] = ((unsigned char*)_vd->data)[adr];
+			}
+
+	if (_fileName)
+		PreprocCache::getInstance().store(key, _packedData, 4 * (size_t)size);
+
+	delete[] gradients;
+	delete[] gradTmp;
+
+	return true;
+}
+
+
+void NoiseDataSet::releaseTextureData(void)
+{
+	delete[] _packedData;
+	_packedData = NULL;
+	PreprocCache::unmap(&_packedView);
+}
+
+
 void NoiseDataSet::createTexture(const char *texName,
 	GLuint texUnit,
 	bool floatTex)
@@ -1181,9 +1543,7 @@ void NoiseDataSet::createTexture(const char *texName,
 	int size;
 	int adr, adrPacked;
 	bool needPadding = false;
-	float *gradients = NULL;
 	unsigned char *packedData = NULL;
-	unsigned char *gradTmp = NULL;
 
 	CHECK_FOR_OGL_ERROR();
 
@@ -1202,24 +1562,7 @@ void NoiseDataSet::createTexture(const char *texName,
 		fprintf(stderr, "NoiseData:  Float textures are currently "
 			"not supported.\n");
 
-
-
-#if FORCE_POWER_OF_TWO_TEXTURE == 0
-	_vd->texSize[0] = _vd->size[0];
-	_vd->texSize[1] = _vd->size[1];
-	_vd->texSize[2] = _vd->size[2];
-#else
-	_vd->texSize[0] = nextPowerTwo(_vd->size[0]);
-	_vd->texSize[1] = nextPowerTwo(_vd->size[1]);
-	_vd->texSize[2] = nextPowerTwo(_vd->size[2]);
-
-	if ((_vd->texSize[0] != _vd->size[0])
-		|| (_vd->texSize[1] != _vd->size[1])
-		|| (_vd->texSize[2] != _vd->size[2]))
-	{
-		needPadding = true;
-	}
-#endif
+	needPadding = updateTexSize();
 
 	_tex.width = _vd->texSize[0];
 	_tex.height = _vd->texSize[1];
@@ -1232,61 +1575,17 @@ void NoiseDataSet::createTexture(const char *texName,
 		_texSrcFmt = GL_UNSIGNED_BYTE;
 		_texIntFmt = GL_RGBA; // because of noise+gradient
 
-		packedData = new unsigned char[4 * size];
-		memset(packedData, 0, 4 * size * sizeof(char));
-
-		// try to load precomputed gradients if volume was loaded earlier
-		if (_loaded)
-			gradTmp = (unsigned char*)loadGradients(_vd, _fileName, DATRAW_UCHAR);
-		if (!gradTmp) // gradients not loaded from file
-		{
-			// compute gradients
-			gradients = computeGradients(_vd);
-			if (!gradients)
-			{
-				fprintf(stderr, "NoiseData:  Error during gradient computation.\n");
-				return; // TODO: right?
-			}
-			filterGradients(_vd, gradients);
-			// quantize gradients to 8bit
-			gradTmp = (unsigned char*)quantizeGradients(_vd, gradients, DATRAW_UCHAR);
-
-			// store gradients for the next time
-			// but don't save gradients of white noise
-			if (_fileName)
-				if (!saveGradients(_vd, _fileName, gradTmp, DATRAW_UCHAR))
-					fprintf(stderr, "NoiseData:  Saving gradients was "
-						"not sucessful.\n");
-
-		}
-		else
-		{
-			fprintf(stdout, "NoiseData:  Using stored gradients "
-				"from \"%s%s\".\n", _fileName, GRADIENTS_EXT);
-			// TODO: adapt to float noise?
-		}
-
-		// pack scalar noise and gradients
-		for (int z = 0; z<_vd->size[2]; ++z)
-			for (int y = 0; y<_vd->size[1]; ++y)
-				for (int x = 0; x<_vd->size[0]; ++x)
-				{
-					adrPacked = (z*_vd->texSize[1] + y)*_vd->texSize[0] + x;
-					adr = (z*_vd->size[1] + y)*_vd->size[0] + x;
-					assert(adr == adrPacked);
-					packedData[4 * adrPacked + 0] = gradTmp[3 * adr];
-					packedData[4 * adrPacked + 1] = gradTmp[3 * adr + 1];
-					packedData[4 * adrPacked + 2] = gradTmp[3 * adr + 2];
-					packedData[4 * adrPacked + 3] = ((unsigned char*)_vd->data)[adr];
-				}
+		// gradients are computed here unless computeTextureData()
+		// was already called
+		if (!computeTextureData())
+			return; // TODO: right?
 
 		glBindTexture(GL_TEXTURE_3D, _tex.id);
 		glTexImage3D(GL_TEXTURE_3D, 0, _texIntFmt, _vd->texSize[0],
 			_vd->texSize[1], _vd->texSize[2], 0, GL_RGBA,
-			_texSrcFmt, packedData);
+			_texSrcFmt, _packedView.data ? _packedView.data : _packedData);
 
-		delete[] packedData;
-		packedData = NULL;
+		releaseTextureData();
 	}
 	else
 	{
@@ -1338,12 +1637,11 @@ void NoiseDataSet::createTexture(const char *texName,
 	//  glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
 	CHECK_FOR_OGL_ERROR();
-
-	delete[] gradients;
-	delete[] gradTmp;
 }
 
 
+
+
 bool NoiseDataSet::loadRawData(void)
 {
 	FILE *src = NULL;
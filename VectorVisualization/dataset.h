@@ -14,13 +14,20 @@
 #include "texture.h"
 #include "mmath.h"
 #include "reader.h"
+#include "prefetch.h"
+#include "bufferarena.h"
+#include "brickcache.h"
+#include "pixelbuffer.h"
+#include "preproccache.h"
+#include "manifest.h"
+#include "macrocells.h"
 #include "types.h"
 #include <vector>
 
 
 struct VolumeData
 {
-	VolumeData(void) : data(NULL), dataDim(1), dataType(DATRAW_NONE)
+	VolumeData(void) : data(NULL), newData(NULL), dataDim(1), dataType(DATRAW_NONE)
 	{
 		sliceDist[0] = sliceDist[1] = sliceDist[2] = 1.0f;
 		size[0] = size[1] = size[2] = 1;
@@ -35,6 +42,10 @@ struct VolumeData
 	void *data;
 	void *newData;
 	std::vector<void*> dataSets;
+	// set if data/newData point into a read-only mapping of the RAW file
+	// instead of heap memory, released by the destructor via unmapRawData
+	MappedRawData dataMap;
+	MappedRawData newDataMap;
 	unsigned char dataDim;
 	DataType dataType;
 
@@ -100,9 +111,64 @@ public:
 
 	VolumeData* getVolumeData(void) { return _vd; }
 
+	// memory map the RAW files of the key frames instead of copying them
+	void enableMemoryMapping(bool enable) { _useMapping = enable; }
+	bool isMemoryMappingEnabled(void) { return _useMapping; }
+
+	// load the two key frames _vd->data and _vd->newData used for
+	// interpolation, previously loaded key frames are released
+	bool loadKeyFrames(int timeStep, int nextTimeStep);
+
+	// limit the memory used for key frames and staging buffers,
+	// 0 means no limit
+	void setMemoryLimit(size_t bytes) { _arena.setLimit(bytes); }
+
+	// page the key frames in bricks through a cache of budget bytes
+	// instead of loading them completely, _vd->data and _vd->newData stay
+	// NULL and the textures are filled brick by brick
+	// brickSize is used for RAW files, 0 disables paging
+	// has to be called before loadKeyFrames()
+	void enableOutOfCore(size_t budget, int brickSize = BRICK_DEFAULT_SIZE)
+	{
+		_outOfCoreBudget = budget;
+		_outOfCoreBrickSize = brickSize;
+	}
+	bool isOutOfCore(void) { return _bricks.isInitialized(); }
+	BrickCache* getBrickCache(void) { return &_bricks; }
+	// histogram of the magnitudes of timeStep like
+	// TransferEdit::computeHistogram() from the bricks of the cache
+	bool computeHistogram(int timeStep, int *histogram, int bins);
+	BufferArena* getBufferArena(void) { return &_arena; }
+
+	// store coarser versions of the vector field in the mipmap levels of
+	// the textures, each level halves the resolution, see
+	// downsampleVectorsFloat()
+	// has to be called before the textures are created
+	void enablePyramid(bool enable) { _usePyramid = enable; }
+	bool isPyramidEnabled(void) { return _usePyramid; }
+	// levels of the textures including the full resolution, out of core
+	// limited by the number of times the brick size can be halved
+	int getPyramidLevels(void);
+
+	// keep the statistics of the key frames in the texture for empty
+	// space skipping up to date, see MacroCellGrid
+	// has to be called before the textures are created
+	void enableMacroCells(bool enable) { _useMacroCells = enable; }
+	bool isMacroCellsEnabled(void) { return _useMacroCells; }
+	MacroCellGrid* getMacroCells(void) { return _useMacroCells ? &_macroCells : NULL; }
+
+	// load up to depth key frames ahead in a background thread,
+	// 0 loads each key frame synchronously in checkInterpolateStage()
+	void enablePrefetch(int depth) { _prefetchDepth = depth; }
+	int getPrefetchReadyCount(void) { return _prefetcher.getReadyCount(); }
+	int getPrefetchPendingCount(void) { return _prefetcher.getPendingCount(); }
+	// false if the next call of checkInterpolateStage() would have to wait
+	// for a key frame which is still being loaded
+	bool isKeyFrameReady(void);
 
 	// updates data pointer of VolumeData
 	// the memory of the previous reference is not freed!
+	// key frames are managed by loadKeyFrames() and checkInterpolateStage()
 	void setDataPointer(void *dataPtr) { _vd->data = dataPtr; }
 
 	// data pointer has to be set before with setDataPointer()
@@ -110,38 +176,138 @@ public:
 		GLuint texUnit = GL_TEXTURE0_ARB,
 		bool floatTex = false);
 
+	// useCache takes the texture from the preprocessing cache if possible,
+	// meant for the first call at startup and not during the animation
 	void createTextureIterp(const char *texName,
 		GLuint texUnit = GL_TEXTURE0_ARB,
-		bool floatTex = false);
+		bool floatTex = false,
+		bool useCache = false);
 
 	void createTextures(const char *texName, int datasize,
 		GLuint texUnit = GL_TEXTURE0_ARB,
 		bool floatTex = false);
 
+	// keep both key frames resident on the GPU and blend them in the shader
+	// (TIME_DEPENDENT), the texture on texUnit holds _vd->data, the one on
+	// texUnit2 _vd->newData. Each key frame is uploaded only once.
+	void createKeyFrameTextures(const char *texName,
+		GLuint texUnit = GL_TEXTURE0_ARB,
+		GLuint texUnit2 = GL_TEXTURE1_ARB,
+		bool floatTex = false);
+	// advance the interpolation by one frame instead of createTextureIterp(),
+	// uploads the new key frame after checkInterpolateStage() switched them
+	void updateKeyFrameTextures(void);
+	bool hasKeyFrameTextures(void) { return _tex2.id != 0; }
+	Texture* getKeyFrameTextureRef(void) { return &_tex2; }
+	// blend weight between the two key frame textures
+	float getKeyFrameWeight(void) { return _keyFrameWeight; }
+	// weight of _vd->newData in the field shown by the textures, set by
+	// createTextureIterp() and updateKeyFrameTextures()
+	float getTextureWeight(void) { return _texWeight; }
+
 	const int getTimeStepBegin(void) { return _datFile.getTimeStepBegin(); }
 	const int getTimeStepEnd(void) { return _datFile.getTimeStepEnd(); }
 	int getNextTimeStep(void);
 	int NextTimeStep(void);
 	int getCurTimeStep(void);
+	// statistics of the manifest, NULL if there is none
+	const TimeStepInfo* getTimeStepInfo(int timeStep);
 
 	Texture* getTextureSetRef(int index) { return &(_texSet[index]); }
 
 	void checkInterpolateStage();
 	void setInterpolateSize(int size) { InterpSize = size; };
+	// continue the animation at timeStep, the key frames are reloaded and
+	// the interpolation starts over
+	bool setTimeStep(int timeStep);
 
 protected:
 private:
 	// fill a zero padded texture with normalized vector direction 
 	// in rgb and the magnitude in a 
-	void* fillTexDataFloat(void);
-	void* fillTexDataFloatInterp();
+	void fillTexDataFloat(float *padded);
+	void fillTexDataFloatInterp(float *padded);
 	// fill a zero padded texture with normalized vector direction 
 	// in rgb and the magnitude in a
-	void* fillTexDataChar(void);
-	void* fillTexDataCharInterp();
+	void fillTexDataChar(unsigned char *padded);
+	void fillTexDataCharInterp(unsigned char *padded);
+	// interpolate linearly between the vector fields data and next,
+	// next may be NULL to convert data only
+	// the magnitude is scaled by 1/maxLen, a negative maxLen is computed
+	void fillTexDataFloatLerp(const void *data, const void *next, float t,
+		float *padded, float maxLen = -1.0f);
+	void fillTexDataCharLerp(const void *data, const void *next, float t,
+		unsigned char *padded, float maxLen = -1.0f);
+
+	// data is the key frame of timeStep, its maximum magnitude is taken
+	// from the manifest if there is one
+	// with useCache the converted data is taken from or added to the
+	// preprocessing cache, only meant for the textures created at startup
+	void uploadKeyFrame(Texture *tex, const void *data, int timeStep,
+		bool useCache = false);
+	void fillTexDataLerpCached(const void *data, const void *next, float t,
+		void *padded, float maxLen = -1.0f);
+	// maximum magnitude of timeStep stored in the manifest, -1 if unknown
+	float getStoredMaxMagnitude(int timeStep);
+
+	void setTexFormat(bool floatTex);
+	// create tex with immutable storage, it is only re-created if the
+	// format or the size changed
+	void prepareTexture(Texture *tex, const char *texName, GLuint texUnit);
+	// memory for one padded texture which is filled by fillTexData*(),
+	// points directly into a mapped pixel buffer if possible
+	void* beginTexUpload(void);
+	void endTexUpload(Texture *tex, void *padded);
+
+	// convert the bricks of timeStep (interpolated with nextTimeStep by
+	// t if t > 0) into tex, one layer of bricks at a time
+	void uploadBricks(Texture *tex, int timeStep, int nextTimeStep, float t,
+		float maxLen, float zeroDir);
+	// maximum magnitude of timeStep from the manifest or the brick cache
+	float getBrickMaxMagnitude(int timeStep);
+	// compute and upload the coarser levels of the slices z to z + depth of
+	// level 0 (held in level0), z has to be a multiple of 2^(levels - 1)
+	void uploadPyramid(Texture *tex, const void *level0, int z, int depth);
+
+	// tell the macro cells which key frames the texture holds and how they
+	// are converted, the statistics of key frames in memory are computed
+	// here, out of core by uploadBricks()
+	void updateMacroCells(MacroCellBlend blend, bool normalized, float zeroDir);
+
+	// key frame is either read into a buffer of _arena or mapped into map
+	void* loadKeyFrame(int timeStep, MappedRawData &map);
+	void releaseKeyFrame(void *&data, MappedRawData &map);
 
 	VolumeData *_vd;
 	DatFile _datFile;
+	bool _useMapping;
+
+	// recycles key frames and staging buffers, has to outlive _prefetcher
+	BufferArena _arena;
+	TimeStepPrefetcher _prefetcher;
+	int _prefetchDepth;
+
+	// out-of-core paging of the key frames
+	BrickCache _bricks;
+	size_t _outOfCoreBudget;
+	int _outOfCoreBrickSize;
+
+	bool _usePyramid;
+
+	// empty space skipping
+	MacroCellGrid _macroCells;
+	bool _useMacroCells;
+
+	// second key frame texture for interpolation in the shader
+	Texture _tex2;
+	float _keyFrameWeight;
+	float _texWeight;
+	bool _keyFrameSwapPending;
+	bool _keyFrameFloatTex;
+
+	// streaming upload of the vector textures
+	PixelBufferRing _pbo;
+	bool _uploadMapped;
 
 	//preload sequence of texture
 	std::vector<Texture> _texSet;
@@ -175,6 +341,8 @@ private:
 
 	VolumeData *_vd;
 	DatFile _datFile;
+
+	PixelBufferRing _pbo;
 };
 
 
@@ -195,13 +363,25 @@ public:
 		GLuint texUnit = GL_TEXTURE0_ARB,
 		bool floatTex = false);
 
+	// compute the gradients and the packed texture data without any
+	// OpenGL calls, so this can run on any thread before createTexture()
+	bool computeTextureData(void);
+
 protected:
 	bool loadRawData(void);
+	// set the texture size, returns true if padding is needed
+	bool updateTexSize(void);
+	void releaseTextureData(void);
 
 private:
 	VolumeData *_vd;
 
 	bool _useGradient;
+
+	// result of computeTextureData(), either computed or mapped from
+	// the preprocessing cache
+	unsigned char *_packedData;
+	PreprocCacheView _packedView;
 };
 
 
@@ -0,0 +1,557 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "framecapture.h"
+#include "imageUtils.h"
+#include "types.h"
+
+
+// upper bound of frames in flight, capacity of the job queues
+#define FRAMECAPTURE_MAX_BUFFERS  16
+
+// maximum time to wait for the readback of a single frame (in ns)
+#define FRAMECAPTURE_FENCE_TIMEOUT  1000000000
+
+// idle encoders check the job queue at least this often (in ms)
+#define FRAMECAPTURE_IDLE_WAIT  10
+
+
+static inline float halfToFloat(unsigned short h)
+{
+	unsigned int sign = static_cast<unsigned int>(h & 0x8000) << 16;
+	unsigned int exponent = (h >> 10) & 0x1f;
+	unsigned int mantissa = h & 0x3ff;
+	unsigned int bits;
+	float f;
+
+	if (exponent == 0)
+	{
+		if (mantissa == 0)
+		{
+			bits = sign;
+		}
+		else
+		{
+			// denormalized half, normalized as float
+			exponent = 113;
+			while (!(mantissa & 0x400))
+			{
+				mantissa <<= 1;
+				--exponent;
+			}
+			bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+		}
+	}
+	else if (exponent == 31)
+	{
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	}
+	else
+	{
+		bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+	}
+	memcpy(&f, &bits, sizeof(f));
+
+	return f;
+}
+
+
+FrameCapture::FrameCapture(void) : _initialized(false), _usePBO(false),
+	_persistent(false), _jobs(FRAMECAPTURE_MAX_BUFFERS),
+	_done(FRAMECAPTURE_MAX_BUFFERS), _quit(false), _numWritten(0), _numFailed(0)
+{
+}
+
+
+FrameCapture::~FrameCapture(void)
+{
+	release();
+}
+
+
+bool FrameCapture::init(int numBuffers, int numEncoders)
+{
+	release();
+
+	numBuffers = std::min(std::max(numBuffers, 1), FRAMECAPTURE_MAX_BUFFERS);
+	if (numEncoders < 1)
+		numEncoders = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+	_usePBO = (GLEW_ARB_pixel_buffer_object != 0);
+	_persistent = _usePBO && GLEW_ARB_buffer_storage && GLEW_ARB_map_buffer_range
+		&& GLEW_ARB_sync;
+
+	_slots.resize(numBuffers);
+	for (size_t i = 0; i < _slots.size(); ++i)
+	{
+		Slot &slot = _slots[i];
+		slot.pbo = 0;
+		slot.bufferSize = 0;
+		slot.ptr = NULL;
+		slot.fence = NULL;
+		slot.state = SLOT_FREE;
+		slot.written = false;
+		slot.failed = false;
+	}
+
+	_quit = false;
+	for (int i = 0; i < numEncoders; ++i)
+		_encoders.push_back(std::thread(&FrameCapture::encoderLoop, this));
+
+	_initialized = true;
+	fprintf(stdout, "FrameCapture:  %d buffers, %d encoder threads, %s readback\n",
+		numBuffers, numEncoders, _persistent ? "persistent PBO"
+		: (_usePBO ? "PBO" : "synchronous"));
+
+	return true;
+}
+
+
+void FrameCapture::release(void)
+{
+	if (!_initialized)
+		return;
+
+	finish();
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+	for (size_t i = 0; i < _encoders.size(); ++i)
+		_encoders[i].join();
+	_encoders.clear();
+
+	for (size_t i = 0; i < _slots.size(); ++i)
+	{
+		Slot &slot = _slots[i];
+
+		if (slot.ptr)
+		{
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, slot.pbo);
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+			glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		}
+		if (slot.pbo)
+			glDeleteBuffersARB(1, &slot.pbo);
+	}
+	_slots.clear();
+
+	_initialized = false;
+}
+
+
+bool FrameCapture::capture(Texture *tex, const char *fileName, int channel,
+	int channelMask, float scale, bool report)
+{
+	int index;
+
+	if (!tex || !fileName || (channel < 1) || (channel > 4))
+		return false;
+
+	if ((index = acquireSlot()) < 0)
+		return false;
+
+	Slot &slot = _slots[index];
+	slot.fileName = fileName;
+	slot.sink = NULL;
+	slot.channel = channel;
+	slot.channelMask = channelMask;
+	slot.scale = scale;
+	slot.report = report;
+
+	return readback(index, tex);
+}
+
+
+bool FrameCapture::capture(Texture *tex, VideoSink *sink, int frameNumber)
+{
+	int index;
+
+	if (!tex || !sink || !sink->isOpen())
+		return false;
+
+	if ((index = acquireSlot()) < 0)
+		return false;
+
+	Slot &slot = _slots[index];
+	slot.fileName.clear();
+	slot.sink = sink;
+	slot.sinkSeq = sink->reserveFrame();
+	slot.frameNumber = frameNumber;
+	slot.channel = 4;
+	slot.channelMask = 7;
+	slot.scale = 255.0f;
+	slot.report = false;
+
+	if (!readback(index, tex))
+	{
+		// the sequence number has to be passed on anyway, but not before
+		// the frames still being read, so the slot is queued like the
+		// others and the encoders write the marker of the failed frame
+		slot.failed = true;
+		slot.fence = NULL;
+		slot.data.clear();
+		slot.state = SLOT_READING;
+		_reading.push_back(index);
+		return false;
+	}
+
+	return true;
+}
+
+
+int FrameCapture::acquireSlot(void)
+{
+	int index;
+
+	if (!_initialized && !init())
+		return -1;
+
+	poll();
+	while ((index = findFreeSlot()) < 0)
+		waitForSlot();
+
+	return index;
+}
+
+
+bool FrameCapture::readback(int index, Texture *tex)
+{
+	const GLenum srcChannels[] = { GL_RED, GL_LUMINANCE_ALPHA, GL_RGB, GL_RGBA };
+	Slot &slot = _slots[index];
+	const int channel = slot.channel;
+	GLint packAlignment;
+	size_t size;
+
+	// floating point textures are converted by the encoders, half floats
+	// are read as they are to halve the size of the copy
+	if ((tex->format == GL_RGBA16F_ARB) && GLEW_ARB_half_float_pixel)
+		slot.type = GL_HALF_FLOAT_ARB;
+	else if ((tex->format == GL_RGBA16F_ARB) || (tex->format == GL_RGBA32F_ARB))
+		slot.type = GL_FLOAT;
+	else
+		slot.type = GL_UNSIGNED_BYTE;
+
+	size = static_cast<size_t>(tex->width) * tex->height * channel
+		* ((slot.type == GL_FLOAT) ? 4 : ((slot.type == GL_HALF_FLOAT_ARB) ? 2 : 1));
+
+	slot.width = tex->width;
+	slot.height = tex->height;
+	slot.written = false;
+	slot.failed = false;
+
+	if (_usePBO && !resizeSlot(slot, size))
+		return false;
+
+	CHECK_FOR_OGL_ERROR();
+	glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	tex->bind();
+
+	if (_usePBO)
+	{
+		// the copy runs asynchronously into the buffer
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, slot.pbo);
+		glGetTexImage(tex->texTarget, 0, srcChannels[channel - 1], slot.type, NULL);
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+		if (GLEW_ARB_sync)
+			slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		slot.state = SLOT_READING;
+		_reading.push_back(index);
+	}
+	else
+	{
+		slot.data.resize(size);
+		glGetTexImage(tex->texTarget, 0, srcChannels[channel - 1], slot.type, &slot.data[0]);
+	}
+
+	tex->unbind();
+	glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+	CHECK_FOR_OGL_ERROR();
+
+	if (!_usePBO)
+		startEncoding(index);
+
+	return true;
+}
+
+
+void FrameCapture::poll(void)
+{
+	int index;
+
+	if (!_initialized)
+		return;
+
+	// readbacks which have arrived, without fences the mapping waits
+	while (!_reading.empty())
+	{
+		Slot &slot = _slots[_reading.front()];
+
+		if (slot.fence)
+		{
+			if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				break;
+			glDeleteSync(slot.fence);
+			slot.fence = NULL;
+		}
+		index = _reading.front();
+		_reading.pop_front();
+		startEncoding(index);
+	}
+
+	while (_done.pop(index))
+		_slots[index].state = SLOT_DONE;
+
+	// report and reuse frames in the order they were captured
+	while (!_encoding.empty() && (_slots[_encoding.front()].state == SLOT_DONE))
+	{
+		Slot &slot = _slots[_encoding.front()];
+
+		if (slot.written)
+		{
+			++_numWritten;
+			if (slot.report)
+				std::cout << "Screenshot written to \"" << slot.fileName
+					<< "\"." << std::endl;
+		}
+		else if (slot.sink)
+		{
+			++_numFailed;
+			fprintf(stderr, "FrameCapture:  Could not stream frame %d.\n", slot.frameNumber);
+		}
+		else
+		{
+			++_numFailed;
+			fprintf(stderr, "FrameCapture:  Could not write \"%s\".\n", slot.fileName.c_str());
+		}
+		slot.state = SLOT_FREE;
+		_encoding.pop_front();
+	}
+}
+
+
+void FrameCapture::finish(void)
+{
+	while (isBusy())
+		waitForSlot();
+}
+
+
+int FrameCapture::findFreeSlot(void)
+{
+	for (size_t i = 0; i < _slots.size(); ++i)
+	{
+		if (_slots[i].state == SLOT_FREE)
+			return static_cast<int>(i);
+	}
+	return -1;
+}
+
+
+bool FrameCapture::resizeSlot(Slot &slot, size_t size)
+{
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT
+		| GL_MAP_COHERENT_BIT;
+
+	if (slot.pbo && (slot.bufferSize >= size))
+		return true;
+
+	// storage of persistently mapped buffers is immutable
+	if (slot.ptr)
+	{
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, slot.pbo);
+		glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+		slot.ptr = NULL;
+	}
+	if (slot.pbo)
+		glDeleteBuffersARB(1, &slot.pbo);
+
+	glGenBuffersARB(1, &slot.pbo);
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, slot.pbo);
+	if (_persistent)
+	{
+		glBufferStorage(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, flags | GL_CLIENT_STORAGE_BIT);
+		slot.ptr = glMapBufferRange(GL_PIXEL_PACK_BUFFER_ARB, 0, size, flags);
+	}
+	else
+	{
+		glBufferDataARB(GL_PIXEL_PACK_BUFFER_ARB, size, NULL, GL_STREAM_READ_ARB);
+	}
+	glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+
+	if (_persistent && !slot.ptr)
+	{
+		fprintf(stderr, "FrameCapture:  Persistent mapping failed.\n");
+		glDeleteBuffersARB(1, &slot.pbo);
+		slot.pbo = 0;
+		slot.bufferSize = 0;
+		return false;
+	}
+	slot.bufferSize = size;
+
+	return true;
+}
+
+
+void FrameCapture::startEncoding(int index)
+{
+	Slot &slot = _slots[index];
+
+	// without persistent mapping the GL thread has to copy the pixels
+	if (_usePBO && !_persistent && !slot.failed)
+	{
+		size_t size = slot.bufferSize;
+		void *ptr;
+
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, slot.pbo);
+		ptr = glMapBufferARB(GL_PIXEL_PACK_BUFFER_ARB, GL_READ_ONLY_ARB);
+		if (ptr)
+		{
+			slot.data.resize(size);
+			memcpy(&slot.data[0], ptr, size);
+			glUnmapBufferARB(GL_PIXEL_PACK_BUFFER_ARB);
+		}
+		else
+		{
+			slot.data.clear();
+		}
+		glBindBufferARB(GL_PIXEL_PACK_BUFFER_ARB, 0);
+	}
+
+	slot.state = SLOT_ENCODING;
+	_encoding.push_back(index);
+
+	// cannot fail, the queue holds more entries than there are slots
+	_jobs.push(index);
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+	}
+	_wake.notify_one();
+}
+
+
+void FrameCapture::waitForSlot(void)
+{
+	if (!_reading.empty())
+	{
+		Slot &slot = _slots[_reading.front()];
+
+		if (slot.fence)
+			glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FRAMECAPTURE_FENCE_TIMEOUT);
+	}
+	else if (!_encoding.empty())
+	{
+		std::unique_lock<std::mutex> lock(_mutex);
+		_written.wait_for(lock, std::chrono::milliseconds(FRAMECAPTURE_IDLE_WAIT));
+	}
+	poll();
+}
+
+
+void FrameCapture::encoderLoop(void)
+{
+	int index;
+
+	for (;;)
+	{
+		if (_jobs.pop(index))
+		{
+			_slots[index].written = encode(_slots[index]);
+			_done.push(index);
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+			}
+			_written.notify_all();
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_mutex);
+		if (_quit)
+			break;
+		_wake.wait_for(lock, std::chrono::milliseconds(FRAMECAPTURE_IDLE_WAIT));
+	}
+}
+
+
+bool FrameCapture::encode(const Slot &slot)
+{
+	const unsigned char *src;
+	const size_t numPixels = static_cast<size_t>(slot.width) * slot.height;
+	const int channel = slot.channel;
+	Image img;
+	bool alpha;
+	bool succesful;
+	int v;
+
+	if (slot.failed)
+		return slot.sink && slot.sink->writeFrame(slot.sinkSeq, slot.frameNumber, NULL, true);
+	else if (slot.ptr)
+		src = static_cast<const unsigned char*>(slot.ptr);
+	else if (!slot.data.empty())
+		src = &slot.data[0];
+	else if (slot.sink)
+		return slot.sink->writeFrame(slot.sinkSeq, slot.frameNumber, NULL, true);
+	else
+		return false;
+
+	img.imgData = new unsigned char[channel*numPixels];
+	img.width = slot.width;
+	img.height = slot.height;
+	img.channel = channel;
+
+	// same conversion as Renderer::saveTexture
+	alpha = (((channel == 2) && !(slot.channelMask & 2))
+		|| ((channel == 4) && !(slot.channelMask & 8)));
+
+	if (slot.type == GL_UNSIGNED_BYTE)
+	{
+		memcpy(img.imgData, src, channel*numPixels);
+	}
+	else
+	{
+		const unsigned short *half = reinterpret_cast<const unsigned short*>(src);
+		const float *data = reinterpret_cast<const float*>(src);
+		float f;
+
+		for (size_t i = 0; i < numPixels; ++i)
+		{
+			for (int k = 0; k < channel - alpha; ++k)
+			{
+				if (!((1 << k) & slot.channelMask))
+				{
+					img.imgData[i*channel + k] = 0;
+					continue;
+				}
+				f = (slot.type == GL_HALF_FLOAT_ARB) ? halfToFloat(half[i*channel + k])
+					: data[i*channel + k];
+				v = (int)(slot.scale*f);
+				v = (v > 255) ? 255 : ((v < 0) ? 0 : v);
+
+				img.imgData[i*channel + k] = (unsigned char)v;
+			}
+		}
+	}
+
+	if (alpha)
+	{
+		for (size_t i = 0; i < numPixels; ++i)
+			img.imgData[i*channel + channel - 1] = 255;
+	}
+
+	if (slot.sink)
+		succesful = slot.sink->writeFrame(slot.sinkSeq, slot.frameNumber, &img, true);
+	else
+		succesful = imageWrite(slot.fileName.c_str(), &img, true);
+
+	delete[] img.imgData;
+	img.imgData = NULL;
+
+	return succesful;
+}
@@ -0,0 +1,140 @@
+#ifndef _FRAMECAPTURE_H_
+#define _FRAMECAPTURE_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "boundedqueue.h"
+#include "texture.h"
+#include "videosink.h"
+
+
+// Asynchronous screenshots and recordings. capture() only starts the
+// readback of the texture into a pixel pack buffer and returns, the
+// buffer is handed to a pool of encoder threads once its fence has
+// signaled in one of the following frames. The encoders convert the
+// pixels and write the PNG or QOI file (see imageWrite), finished
+// frames are reported and their buffers reused in the order of capture.
+// Frames of a VideoSink are converted by the encoders as well and
+// written in the order of capture.
+//
+// Without ARB_buffer_storage the buffers are mapped by the GL thread and
+// copied, without pixel buffer objects the texture is read synchronously.
+// All methods except the encoders have to be called from the GL thread.
+class FrameCapture
+{
+public:
+	FrameCapture(void);
+	~FrameCapture(void);
+
+	// numBuffers frames in flight, numEncoders threads (0: one per
+	// hardware thread), called by the first capture() if necessary
+	bool init(int numBuffers = 3, int numEncoders = 0);
+	// waits for all pending frames
+	void release(void);
+
+	// start the readback of tex, channel, channelMask and scale are those
+	// of Renderer::saveTexture
+	// if report is set, a message is printed when the file is written
+	bool capture(Texture *tex, const char *fileName, int channel = 4,
+		int channelMask = 15, float scale = 255.0f, bool report = true);
+	// start the readback of tex for the next frame of sink, the alpha
+	// channel is dropped, frameNumber is passed to VideoSink::writeFrame
+	bool capture(Texture *tex, VideoSink *sink, int frameNumber);
+
+	// hand finished readbacks to the encoders and release written frames,
+	// cheap if nothing is pending
+	void poll(void);
+	// wait until all captured frames are written
+	void finish(void);
+
+	bool isBusy(void) { return !_reading.empty() || !_encoding.empty(); }
+
+	int getNumWritten(void) { return _numWritten; }
+	int getNumFailed(void) { return _numFailed; }
+
+private:
+	FrameCapture(const FrameCapture&);
+	FrameCapture& operator=(const FrameCapture&);
+
+	enum SlotState
+	{
+		SLOT_FREE = 0,
+		SLOT_READING,
+		SLOT_ENCODING,
+		SLOT_DONE
+	};
+
+	struct Slot
+	{
+		GLuint pbo;
+		size_t bufferSize;
+		void *ptr;
+		GLsync fence;
+
+		// copy of the pixels if the buffer is not mapped persistently
+		std::vector<unsigned char> data;
+
+		// frame, fixed at capture
+		std::string fileName;
+		VideoSink *sink;
+		unsigned int sinkSeq;
+		int frameNumber;
+		int width;
+		int height;
+		int channel;
+		int channelMask;
+		float scale;
+		GLenum type;
+		bool report;
+
+		SlotState state;
+		bool written;
+		// readback failed, only the sequence number is passed on
+		bool failed;
+	};
+
+	// waits for a free slot, -1 if the capture is not available
+	int acquireSlot(void);
+	int findFreeSlot(void);
+	bool readback(int index, Texture *tex);
+	bool resizeSlot(Slot &slot, size_t size);
+	void startEncoding(int index);
+	// waits for the oldest pending frame
+	void waitForSlot(void);
+
+	void encoderLoop(void);
+	static bool encode(const Slot &slot);
+
+	bool _initialized;
+	bool _usePBO;
+	bool _persistent;
+	std::vector<Slot> _slots;
+
+	// slot indices in the order of capture
+	std::deque<int> _reading;
+	std::deque<int> _encoding;
+
+	// slot indices from the GL thread to the encoders and back
+	BoundedQueue<int> _jobs;
+	BoundedQueue<int> _done;
+
+	std::vector<std::thread> _encoders;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _written;
+	bool _quit;
+
+	int _numWritten;
+	int _numFailed;
+};
+
+#endif // _FRAMECAPTURE_H_
@@ -31,11 +31,19 @@
 #include <iostream>
 #include <fstream>
 #include <limits.h>
+#include <math.h>
+#include <string.h>
+#include <vector>
 #include "dataSet.h"
 #include "gradient.h"
+#include "threadpool.h"
 #include "types.h"
 
 
+// number of taps of the Gaussian which are actually used (-fw .. fw-2)
+#define GAUSS_TAPS  (2*(GRAD_FILTER_SIZE/2) - 1)
+
+
 float getVoxel(VolumeData *vd, int x, int y, int z);
 inline unsigned char getVoxel8(VolumeData *vd, int x, int y, int z);
 inline unsigned short getVoxel16(VolumeData *vd, int x, int y, int z);
@@ -187,275 +195,465 @@ bool saveGradients(VolumeData *vd, char *fileName,
 }
 
 
-float* computeGradients(VolumeData *vd)
+// convert the volume to float once instead of calling getVoxel() for
+// every sample, float volumes are used directly
+static float* getFloatVolume(VolumeData *vd)
+{
+    size_t sliceSize = (size_t)vd->size[0] * vd->size[1];
+    float *vol = NULL;
+
+    switch (vd->dataType) {
+    case DATRAW_FLOAT:
+        return (float*)vd->data;
+    case DATRAW_UCHAR:
+    case DATRAW_USHORT:
+        break;
+    default:
+        fprintf(stderr, "Calculating Gradients:  Unsupported data type.\n");
+        exit(1);
+        break;
+    }
+
+    vol = new float[sliceSize * vd->size[2]];
+
+    ThreadPool::getInstance().parallelFor(vd->size[2], [&](int zBegin, int zEnd)
+    {
+        size_t end = zEnd * sliceSize;
+
+        if (vd->dataType == DATRAW_UCHAR)
+        {
+            const unsigned char *data = (const unsigned char*)vd->data;
+            for (size_t i = zBegin * sliceSize; i < end; ++i)
+                vol[i] = (float)data[i];
+        }
+        else
+        {
+            const unsigned short *data = (const unsigned short*)vd->data;
+            for (size_t i = zBegin * sliceSize; i < end; ++i)
+                vol[i] = (float)data[i];
+        }
+    });
+
+    return vol;
+}
+
+
+static inline float volVoxel(VolumeData *vd, const float *vol, int x, int y, int z)
+{
+    return vol[((size_t)z*vd->size[1] + y)*vd->size[0] + x];
+}
+
+
+// gradient of a single voxel with one-sided differences,
+// used at the border of the volume
+static void borderGradient(VolumeData *vd, const float *vol,
+                           int idx, int idy, int idz, float *gp)
 {
 #if SOBEL == 1
-    int i, j, k, dir;
+    /* X-direction */
+    if (idx < 1)
+    {
+        gp[0] = (volVoxel(vd, vol, idx + 1, idy, idz) -
+                 volVoxel(vd, vol, idx, idy, idz))/
+            vd->sliceDist[0];
+    }
+    else 
+    {
+        gp[0] = (volVoxel(vd, vol, idx, idy, idz) -
+                 volVoxel(vd, vol, idx - 1, idy, idz))/
+            vd->sliceDist[0];
+    }
+
+    /* Y-direction */
+    if (idy < 1) 
+    {
+        gp[1] = (volVoxel(vd, vol, idx, idy + 1, idz) -
+                 volVoxel(vd, vol, idx, idy, idz))/
+            vd->sliceDist[1];
+    }
+    else
+    {
+        gp[1] = (volVoxel(vd, vol, idx, idy, idz) -
+                 volVoxel(vd, vol, idx, idy - 1, idz))/
+            vd->sliceDist[1];
+    }
+
+    /* Z-direction */
+    if (idz < 1) 
+    {
+        gp[2] = (volVoxel(vd, vol, idx, idy, idz + 1) -
+                 volVoxel(vd, vol, idx, idy, idz))/
+            vd->sliceDist[2];
+    }
+    else 
+    {
+        gp[2] = (volVoxel(vd, vol, idx, idy, idz) -
+                 volVoxel(vd, vol, idx, idy, idz - 1))/
+            vd->sliceDist[2];
+    }
+#else
+    /* X-direction */
+    if (idx < 1) 
+    {
+        gp[0] = (volVoxel(vd, vol, idx + 1, idy, idz) -
+                 volVoxel(vd, vol, idx, idy, idz))/
+            vd->sliceDist[0];
+    } 
+    else if (idx > vd->size[0] - 1) 
+    {
+        gp[0] = (volVoxel(vd, vol, idx, idy, idz) -
+                 volVoxel(vd, vol, idx - 1, idy, idz))/
+            vd->sliceDist[0];
+    }
+    else 
+    {
+        gp[0] = (volVoxel(vd, vol, idx + 1, idy, idz) -
+                 volVoxel(vd, vol, idx - 1, idy, idz))/
+            vd->sliceDist[0] * 0.5f;
+    }
+
+    /* Y-direction */
+    if (idy < 1) 
+    {
+        gp[1] = (volVoxel(vd, vol, idx, idy + 1, idz) -
+                 volVoxel(vd, vol, idx, idy, idz))/
+            vd->sliceDist[1];
+    }
+    else if (idy > vd->size[1] - 1)
+    {
+        gp[1] = (volVoxel(vd, vol, idx, idy, idz) -
+                 volVoxel(vd, vol, idx, idy - 1, idz))/
+            vd->sliceDist[1];
+    } 
+    else 
+    {
+        gp[1] = (volVoxel(vd, vol, idx, idy + 1, idz) -
+                 volVoxel(vd, vol, idx, idy - 1, idz))/
+            vd->sliceDist[1] * 0.5f;
+    }
+
+    /* Z-direction */
+    if (idz < 1)
+    {
+        gp[2] = (volVoxel(vd, vol, idx, idy, idz + 1) -
+                 volVoxel(vd, vol, idx, idy, idz))/
+            vd->sliceDist[2];
+    } 
+    else if (idz > vd->size[2] - 1) 
+    {
+        gp[2] = (volVoxel(vd, vol, idx, idy, idz) -
+                 volVoxel(vd, vol, idx, idy, idz - 1))/
+            vd->sliceDist[2];
+    } 
+    else 
+    {
+        gp[2] = (volVoxel(vd, vol, idx, idy, idz + 1) -
+                 volVoxel(vd, vol, idx, idy, idz - 1))/
+            vd->sliceDist[2] * 0.5f;
+    }
 #endif
-    int di, vdi;
-    float *gp = NULL;
-    float *gradients = NULL;
+}
 
-    static int weights[][3][3][3] = {
-        {{{-1, -3, -1},
-          {-3, -6, -3},
-          {-1, -3, -1}},
-         {{ 0,  0,  0},
-          { 0,  0,  0},
-          { 0,  0,  0}},
-         {{ 1,  3,  1},
-          { 3,  6,  3},
-          { 1,  3,  1}}},
-        {{{-1, -3, -1},
-          { 0,  0,  0},
-          { 1,  3,  1}},
-         {{-3, -6, -3},
-          { 0,  0,  0},
-          { 3,  6,  3}},
-         {{-1, -3, -1},
-          { 0,  0,  0},
-          { 1,  3,  1}}},
-        {{{-1,  0,  1},
-          {-3,  0,  3},
-          {-1,  0,  1}},
-         {{-3,  0,  3},
-          {-6,  0,  6},
-          {-3,  0,  3}},
-         {{-1,  0,  1},
-          {-3,  0,  3},
-          {-1,  0,  1}}}
-    };
 
-    fprintf(stderr, "Computing gradients ... may take a while\n");
+#if SOBEL == 1
+// The 3x3x3 Sobel kernel of direction d is the central difference along
+// d times the smoothing kernel W = (1 3 1)x(1 3 1) - 3*delta in the two
+// other directions. Per slice the 2D parts are computed once
+//   A = (1 3 1)_y * d/dx,  B = (1 3 1)_x * d/dy,  C = (1 3 1)_x (1 3 1)_y
+// for the interior voxels, the gradient of slice z then combines the
+// slices z-1, z, z+1 of a ring buffer:
+//   gx = A(z-1) + 3 A(z) + A(z+1) - 3 dx(z)
+//   gy = B(z-1) + 3 B(z) + B(z+1) - 3 dy(z)
+//   gz = C(z+1) - C(z-1) - 3 (v(z+1) - v(z-1))
+static void sobelPrefilter(VolumeData *vd, const float *v, float *dxTmp, float *sTmp,
+                           float *A, float *B, float *C)
+{
+    const int sx = vd->size[0];
+    const int sy = vd->size[1];
+
+    // 1D passes along x for all rows
+    for (int y = 0; y < sy; ++y)
+    {
+        const float *row = v + y*sx;
+        float *dx = dxTmp + y*sx;
+        float *s = sTmp + y*sx;
+        for (int x = 1; x < sx - 1; ++x)
+        {
+            dx[x] = row[x + 1] - row[x - 1];
+            s[x] = row[x - 1] + 3.0f*row[x] + row[x + 1];
+        }
+    }
+
+    // 1D passes along y for the interior rows
+    for (int y = 1; y < sy - 1; ++y)
+    {
+        const int i = y*sx;
+        for (int x = 1; x < sx - 1; ++x)
+        {
+            A[i + x] = dxTmp[i - sx + x] + 3.0f*dxTmp[i + x] + dxTmp[i + sx + x];
+            C[i + x] = sTmp[i - sx + x] + 3.0f*sTmp[i + x] + sTmp[i + sx + x];
+            B[i + x] = (v[i + sx + x - 1] - v[i - sx + x - 1])
+                + 3.0f*(v[i + sx + x] - v[i - sx + x])
+                + (v[i + sx + x + 1] - v[i - sx + x + 1]);
+        }
+    }
+}
 
-    gradients = new float[3*vd->size[0]*vd->size[1]*vd->size[2]];
-    gp = gradients;
 
-    di = 0;
-    vdi = 0;
-    for (int idz = 0; idz < vd->size[2]; ++idz)
+// Sobel gradients of the interior voxels of the slices [zBegin, zEnd)
+static void sobelSlab(VolumeData *vd, const float *vol, float *gradients,
+                      int zBegin, int zEnd)
+{
+    const int sx = vd->size[0];
+    const int sy = vd->size[1];
+    const size_t sliceSize = (size_t)sx*sy;
+    const float scale[3] = { 2.0f * vd->sliceDist[0],
+                             2.0f * vd->sliceDist[1],
+                             2.0f * vd->sliceDist[2] };
+    std::vector<float> buf(11*sliceSize);
+    float *dxTmp = &buf[0];
+    float *sTmp = dxTmp + sliceSize;
+    float *A[3], *B[3], *C[3];
+
+    for (int i = 0; i < 3; ++i)
     {
-        for (int idy = 0; idy < vd->size[1]; ++idy) 
+        A[i] = sTmp + (1 + 3*i)*sliceSize;
+        B[i] = A[i] + sliceSize;
+        C[i] = B[i] + sliceSize;
+    }
+
+    // ring buffer holds the slices z-1, z, and z+1 at index (z+1)%3
+    for (int z = zBegin - 1; z < zBegin + 1; ++z)
+        sobelPrefilter(vd, vol + z*sliceSize, dxTmp, sTmp,
+                       A[z%3], B[z%3], C[z%3]);
+
+    for (int z = zBegin; z < zEnd; ++z)
+    {
+        const int rm = (z - 1)%3, r0 = z%3, rp = (z + 1)%3;
+        const float *vm = vol + (z - 1)*sliceSize;
+        const float *v0 = vol + z*sliceSize;
+        const float *vp = vol + (z + 1)*sliceSize;
+
+        sobelPrefilter(vd, vp, dxTmp, sTmp, A[rp], B[rp], C[rp]);
+
+        for (int y = 1; y < sy - 1; ++y)
         {
-            for (int idx = 0; idx < vd->size[0]; ++idx) 
+            float *gp = gradients + 3*(z*sliceSize + y*sx);
+            for (int i = y*sx + 1; i < (y + 1)*sx - 1; ++i)
             {
-#if SOBEL == 1
-                if (idx > 0 && idx < vd->size[0] - 1 &&
-                    idy > 0 && idy < vd->size[1] - 1 &&
-                    idz > 0 && idz < vd->size[2] - 1) 
-                {
-                    for (dir = 0; dir < 3; ++dir) 
-                    {
-                        gp[dir] = 0.0f;
-                        for (i = -1; i < 2; i++) 
-                        {
-                            for (j = -1; j < 2; j++) 
-                            {
-                                for (k = -1; k < 2; k++) 
-                                {
-                                    gp[dir] += weights[dir][i + 1][j + 1][k + 1]
-                                        * getVoxel(vd, idx + i, idy + j, idz + k);
-                                }
-                            }
-                        }
-                        gp[dir] /= 2.0f * vd->sliceDist[dir];
-                    }
-                } 
-                else 
-                {
-                    /* X-direction */
-                    if (idx < 1)
-                    {
-                        gp[0] = (getVoxel(vd, idx + 1, idy, idz) -
-                                 getVoxel(vd, idx, idy, idz))/
-                            vd->sliceDist[0];
-                    }
-                    else 
-                    {
-                        gp[0] = (getVoxel(vd, idx, idy, idz) -
-                                 getVoxel(vd, idx - 1, idy, idz))/
-                            vd->sliceDist[0];
-                    }
+                gp[3*(i - y*sx)] = (A[rm][i] + 3.0f*A[r0][i] + A[rp][i]
+                                    - 3.0f*(v0[i + 1] - v0[i - 1])) / scale[0];
+                gp[3*(i - y*sx) + 1] = (B[rm][i] + 3.0f*B[r0][i] + B[rp][i]
+                                        - 3.0f*(v0[i + sx] - v0[i - sx])) / scale[1];
+                gp[3*(i - y*sx) + 2] = (C[rp][i] - C[rm][i]
+                                        - 3.0f*(vp[i] - vm[i])) / scale[2];
+            }
+        }
+    }
+}
+#endif
 
-                    /* Y-direction */
-                    if (idy < 1) 
-                    {
-                        gp[1] = (getVoxel(vd, idx, idy + 1, idz) -
-                                 getVoxel(vd, idx, idy, idz))/
-                            vd->sliceDist[1];
-                    }
-                    else
-                    {
-                        gp[1] = (getVoxel(vd, idx, idy, idz) -
-                                 getVoxel(vd, idx, idy - 1, idz))/
-                            vd->sliceDist[1];
-                    }
 
-                    /* Z-direction */
-                    if (idz < 1) 
-                    {
-                        gp[2] = (getVoxel(vd, idx, idy, idz + 1) -
-                                 getVoxel(vd, idx, idy, idz))/
-                            vd->sliceDist[2];
-                    }
-                    else 
-                    {
-                        gp[2] = (getVoxel(vd, idx, idy, idz) -
-                                 getVoxel(vd, idx, idy, idz - 1))/
-                            vd->sliceDist[2];
-                    }
-                }
-#else
-                /* X-direction */
-                if (idx < 1) 
-                {
-                    gp[0] = (getVoxel(vd, idx + 1, idy, idz) -
-                             getVoxel(vd, idx, idy, idz))/
-                        vd->sliceDist[0];
-                } 
-                else if (idx > vd->size[0] - 1) 
-                {
-                    gp[0] = (getVoxel(vd, idx, idy, idz) -
-                             getVoxel(vd, idx - 1, idy, idz))/
-                        vd->sliceDist[0];
-                }
-                else 
-                {
-                    gp[0] = (getVoxel(vd, idx + 1, idy, idz) -
-                             getVoxel(vd, idx - 1, idy, idz))/
-                        vd->sliceDist[0] * 0.5f;
-                }
+float* computeGradients(VolumeData *vd)
+{
+    const int sx = vd->size[0];
+    const int sy = vd->size[1];
+    const int sz = vd->size[2];
+    float *vol = NULL;
+    float *gradients = NULL;
 
-                /* Y-direction */
-                if (idy < 1) 
-                {
-                    gp[1] = (getVoxel(vd, idx, idy + 1, idz) -
-                             getVoxel(vd, idx, idy, idz))/
-                        vd->sliceDist[1];
-                }
-                else if (idy > vd->size[1] - 1)
-                {
-                    gp[1] = (getVoxel(vd, idx, idy, idz) -
-                             getVoxel(vd, idx, idy - 1, idz))/
-                        vd->sliceDist[1];
-                } 
-                else 
-                {
-                    gp[1] = (getVoxel(vd, idx, idy + 1, idz) -
-                             getVoxel(vd, idx, idy - 1, idz))/
-                        vd->sliceDist[1] * 0.5f;
-                }
+    fprintf(stderr, "Computing gradients ...\n");
 
-                /* Z-direction */
-                if (idz < 1)
-                {
-                    gp[2] = (getVoxel(vd, idx, idy, idz + 1) -
-                             getVoxel(vd, idx, idy, idz))/
-                        vd->sliceDist[2];
-                } 
-                else if (idz > vd->size[2] - 1) 
-                {
-                    gp[2] = (getVoxel(vd, idx, idy, idz) -
-                             getVoxel(vd, idx, idy, idz - 1))/
-                        vd->sliceDist[2];
-                } 
-                else 
+    vol = getFloatVolume(vd);
+    gradients = new float[3*(size_t)sx*sy*sz];
+
+    // z-slabs are processed in parallel
+    ThreadPool::getInstance().parallelFor(sz, [&](int zBegin, int zEnd)
+    {
+#if SOBEL == 1
+        // interior slices are done by the separable filter,
+        // only the border voxels are left
+        int zIn = MAX(zBegin, 1);
+        int zOut = MIN(zEnd, sz - 1);
+        if ((sx > 2) && (sy > 2) && (zIn < zOut))
+            sobelSlab(vd, vol, gradients, zIn, zOut);
+
+        for (int idz = zBegin; idz < zEnd; ++idz)
+        {
+            bool borderSlice = (idz < 1) || (idz >= sz - 1);
+            for (int idy = 0; idy < sy; ++idy)
+            {
+                bool borderRow = borderSlice || (idy < 1) || (idy >= sy - 1);
+                for (int idx = 0; idx < sx; ++idx)
                 {
-                    gp[2] = (getVoxel(vd, idx, idy, idz + 1) -
-                             getVoxel(vd, idx, idy, idz - 1))/
-                        vd->sliceDist[2] * 0.5f;
+                    if (!borderRow && (idx > 0) && (idx < sx - 1))
+                        idx = sx - 1;
+                    borderGradient(vd, vol, idx, idy, idz,
+                                   gradients + 3*(((size_t)idz*sy + idy)*sx + idx));
                 }
-#endif
-                gp += 3;
             }
         }
-    }
+#else
+        for (int idz = zBegin; idz < zEnd; ++idz)
+            for (int idy = 0; idy < sy; ++idy)
+                for (int idx = 0; idx < sx; ++idx)
+                    borderGradient(vd, vol, idx, idy, idz,
+                                   gradients + 3*(((size_t)idz*sy + idy)*sx + idx));
+#endif
+    });
+
+    if (vol != vd->data)
+        delete [] vol;
+
     return gradients;
 }
 
 
-void filterGradients(VolumeData *vd, float *gradients)
+// The Gaussian filter kernel is a product of 1D kernels, since
+// exp(-(i^2+j^2+k^2)/s) = exp(-i^2/s) exp(-j^2/s) exp(-k^2/s).
+// Only the taps -fw .. fw-2 are used.
+static void gaussianSlab(VolumeData *vd, const float *gradients, float *filteredGrad,
+                         const float *f, int zBegin, int zEnd)
 {
-    const int fSize = GRAD_FILTER_SIZE;
-    int fw = GRAD_FILTER_SIZE/2; // filter width
-    int gi, ogi;
-    int borderDist[3];
-    float sum;
-    float *filteredGrad = NULL;
-    float *filter = NULL; 
+    const int fw = GRAD_FILTER_SIZE/2;
+    const int sx = vd->size[0];
+    const int sy = vd->size[1];
+    const size_t rowSize = 3*(size_t)sx;
+    const size_t sliceSize = rowSize*sy;
+    // only voxels in [fw, size-fw) use the full kernel
+    const size_t xBegin = 3*fw, xEnd = 3*(size_t)(sx - fw);
+    std::vector<float> buf((GAUSS_TAPS + 1)*sliceSize);
+    float *xTmp = &buf[0];
+    float *ring[GAUSS_TAPS];
+
+    for (int t = 0; t < GAUSS_TAPS; ++t)
+        ring[t] = xTmp + (t + 1)*sliceSize;
+
+    // filter slice z along x and y into ring[z%GAUSS_TAPS]
+    auto prefilter = [&](int z)
+    {
+        const float *g = gradients + z*sliceSize;
+        float *p = ring[z%GAUSS_TAPS];
 
-    fprintf(stderr, "Filtering gradients ... may also take a while\n");
+        for (int y = 0; y < sy; ++y)
+        {
+            const float *row = g + y*rowSize;
+            float *out = xTmp + y*rowSize;
+            for (size_t i = xBegin; i < xEnd; ++i)
+            {
+                float sum = 0.0f;
+                for (int t = 0; t < GAUSS_TAPS; ++t)
+                    sum += f[t] * row[i + 3*(t - fw)];
+                out[i] = sum;
+            }
+        }
+        for (int y = fw; y < sy - fw; ++y)
+        {
+            float *out = p + y*rowSize;
+            for (size_t i = xBegin; i < xEnd; ++i)
+            {
+                float sum = 0.0f;
+                for (int t = 0; t < GAUSS_TAPS; ++t)
+                    sum += f[t] * xTmp[(y + t - fw)*rowSize + i];
+                out[i] = sum;
+            }
+        }
+    };
 
-    filteredGrad = new float[3*vd->size[0]*vd->size[1]*vd->size[2]];
-    // allocate memory for filter kernels
-    filter = new float[fSize*fSize*fSize];
+    for (int z = zBegin - fw; z < zBegin - fw + GAUSS_TAPS - 1; ++z)
+        prefilter(z);
 
-    // Compute the filter kernels
-    sum = 0.0f;
-    for (int k=-fw; k < fw-1; ++k)
+    for (int z = zBegin; z < zEnd; ++z)
     {
-        for (int j=-fw; j < fw-1; ++j)
+        const float *slices[GAUSS_TAPS];
+
+        prefilter(z - fw + GAUSS_TAPS - 1);
+        for (int t = 0; t < GAUSS_TAPS; ++t)
+            slices[t] = ring[(z + t - fw)%GAUSS_TAPS];
+
+        for (int y = fw; y < sy - fw; ++y)
         {
-            for (int i=-fw; i < fw-1; ++i) 
+            float *out = filteredGrad + z*sliceSize + y*rowSize;
+            for (size_t i = xBegin; i < xEnd; ++i)
             {
-                sum += filter[((fw+k)*fSize + fw+j)*fSize + fw+i]
-                    = exp(-(float)(SQR(i) + SQR(j) + SQR(k)) / SIGMA2);
+                float sum = 0.0f;
+                for (int t = 0; t < GAUSS_TAPS; ++t)
+                    sum += f[t] * slices[t][y*rowSize + i];
+                out[i] = sum;
             }
         }
     }
-    for (int k=-fw; k < fw-1; ++k)
-        for (int j=-fw; j < fw-1; ++j)
-            for (int i=-fw; i < fw-1; ++i) 
-                filter[((fw+k)*fSize + fw+j)*fSize + fw+i] /= sum;
-
-    gi = 0;
-    // Filter the gradients 
-    for (int z=0; z < vd->size[2]; ++z) 
+}
+
+
+void filterGradients(VolumeData *vd, float *gradients)
+{
+    const int fw = GRAD_FILTER_SIZE/2; // filter width
+    const int sx = vd->size[0];
+    const int sy = vd->size[1];
+    const int sz = vd->size[2];
+    float sum;
+    float f[GRAD_FILTER_SIZE];
+    float *filteredGrad = NULL;
+
+    fprintf(stderr, "Filtering gradients ...\n");
+
+    filteredGrad = new float[3*(size_t)sx*sy*sz];
+
+    // Compute the 1D filter kernel
+    sum = 0.0f;
+    for (int i=-fw; i < fw-1; ++i)
+        sum += f[fw+i] = exp(-(float)SQR(i) / SIGMA2);
+    for (int i=-fw; i < fw-1; ++i)
+        f[fw+i] /= sum;
+
+    ThreadPool::getInstance().parallelFor(sz, [&](int zBegin, int zEnd)
     {
-        for (int y=0; y < vd->size[1]; ++y) 
+        int zIn = MAX(zBegin, fw);
+        int zOut = MIN(zEnd, sz - fw);
+        if ((sx > 2*fw) && (sy > 2*fw) && (zIn < zOut))
+            gaussianSlab(vd, gradients, filteredGrad, f, zIn, zOut);
+
+        // a voxel with a distance b < fw to the border only uses the
+        // taps -b .. b-2, weighted with the kernel entries 0 .. 2b-2
+        for (int z = zBegin; z < zEnd; ++z)
         {
-            for (int x=0; x < vd->size[0]; ++x) 
+            for (int y = 0; y < sy; ++y)
             {
-                borderDist[0] = MIN(x, vd->size[0] - x - 1);
-                borderDist[1] = MIN(y, vd->size[1] - y - 1);
-                borderDist[2] = MIN(z, vd->size[2] - z - 1);
-
-                fw = MIN(GRAD_FILTER_SIZE/2,
-                         MIN(MIN(borderDist[0], 
-                                 borderDist[1]),
-                             borderDist[2]));
-
-                // for each dimension 
-                for (int n=0; n < 3; ++n)
+                for (int x = 0; x < sx; ++x)
                 {
-                    filteredGrad[gi] = 0.0f;
-                    for (int k=-fw; k < fw-1; ++k)
+                    int b = MIN(MIN(MIN(x, sx - x - 1), MIN(y, sy - y - 1)),
+                                MIN(z, sz - z - 1));
+                    if (b >= fw)
                     {
-                        for (int j=-fw; j < fw-1; ++j) 
-                        {
-                            for (int i=-fw; i < fw-1; ++i) 
+                        // the full kernel was applied by gaussianSlab()
+                        x = MAX(x, sx - fw - 1);
+                        continue;
+                    }
+
+                    float *out = filteredGrad + 3*(((size_t)z*sy + y)*sx + x);
+                    out[0] = out[1] = out[2] = 0.0f;
+                    for (int k=-b; k < b-1; ++k)
+                        for (int j=-b; j < b-1; ++j)
+                            for (int i=-b; i < b-1; ++i)
                             {
-                                ogi = 3*(((z + k)*vd->size[1] 
-                                          + (y + j))*vd->size[0] + (x + i)) + n;
-                                filteredGrad[gi] 
-                                    += filter[((fw+k)*fSize + fw+j)*fSize + fw+i] * gradients[ogi];
+                                float w = f[b+k] * f[b+j] * f[b+i];
+                                const float *g = gradients
+                                    + 3*(((size_t)(z + k)*sy + (y + j))*sx + (x + i));
+                                out[0] += w * g[0];
+                                out[1] += w * g[1];
+                                out[2] += w * g[2];
                             }
-                        }
-                    }
-                    ++gi;
                 }
             }
         }
-    }
+    });
 
     // Replace the orignal gradients by the filtered gradients 
     memcpy(gradients, filteredGrad, 
-           3*vd->size[0] * vd->size[1] * vd->size[2] * sizeof(float));
+           3*(size_t)sx*sy*sz * sizeof(float));
 
     delete [] filteredGrad;
-
-    // free memory used for filter
-    delete [] filter;
 }
 
 
@@ -500,7 +698,6 @@ void quantize16(float *grad, unsigned short *data)
 void* quantizeGradients(VolumeData *vd, float *gradIn,
                         DataType dataTypeOut)
 {
-    int di = 0;
     int size = vd->size[0]*vd->size[1]*vd->size[2];
     void *gradOut = NULL;
 
@@ -508,19 +705,19 @@ void* quantizeGradients(VolumeData *vd, float *gradIn,
     {
     case DATRAW_UCHAR:
         gradOut = new unsigned char[3*size];
-        for (int i=0; i<size; ++i)
+        ThreadPool::getInstance().parallelFor(size, [&](int begin, int end)
         {
-            quantize8(&gradIn[di], &((unsigned char*)gradOut)[di]);
-            di += 3;
-        }
+            for (int i=begin; i<end; ++i)
+                quantize8(&gradIn[3*i], &((unsigned char*)gradOut)[3*i]);
+        });
         break;
     case DATRAW_USHORT:
         gradOut = new unsigned short[3*size];
-        for (int i=0; i<size; ++i)
+        ThreadPool::getInstance().parallelFor(size, [&](int begin, int end)
         {
-            quantize16(&gradIn[di], &((unsigned short*)gradOut)[di]);
-            di += 3;
-        }
+            for (int i=begin; i<end; ++i)
+                quantize16(&gradIn[3*i], &((unsigned short*)gradOut)[3*i]);
+        });
         break;
     default:
         fprintf(stderr, "Gradients:  Unsupported data type for quantization.\n");
@@ -37,16 +37,21 @@
 #include "texture.h"
 #include "mmath.h"
 #include "imageUtils.h"
+#include "preproccache.h"
 #include "illumination.h"
 
 
-Illumination::Illumination(void) : _texWidth(256),_texHeight(256),_debug(false)
+Illumination::Illumination(void) : _texDataZoeckler(NULL),_texDataMallo(NULL),
+    _texWidth(256),_texHeight(256),_debug(false)
 {
 }
 
 
 Illumination::~Illumination(void)
 {
+    delete [] _texDataZoeckler;
+    delete [] _texDataMallo;
+
     if (_texZoeckler.id)    
         glDeleteTextures(1, &_texZoeckler.id);
     if (_texMalloDiffuse.id)    
@@ -56,6 +61,15 @@ Illumination::~Illumination(void)
 }
 
 
+void Illumination::computeIllumTables(bool zoeckler, bool mallo)
+{
+    if (zoeckler && !_texDataZoeckler)
+        _texDataZoeckler = computeIllumTexZoeckler();
+    if (mallo && !_texDataMallo)
+        _texDataMallo = computeIllumTexMallo();
+}
+
+
 void Illumination::createIllumTextures(bool zoeckler, bool mallo, bool floatTex)
 {
     GLuint texId;
@@ -96,82 +110,16 @@ void Illumination::createIllumTextures(bool zoeckler, bool mallo, bool floatTex)
 void Illumination::createIllumTexZoeckler(bool floatTex)
 {
     float *texData;
-    double invResX, invResY;
-    double t1, t2;
-    double lt, vt;
-    double dotproduct;
-    double diffuse;
-    double traditionalDiff;
-    double traditionalSpec;
-    int idx;
 
-    texData = new float[2*_texWidth*_texHeight];
+    computeIllumTables(true, false);
+    texData = _texDataZoeckler;
+    _texDataZoeckler = NULL;
+
     _texZoeckler.width = _texWidth;
     _texZoeckler.height = _texHeight;
 
     _texZoeckler.format = (floatTex ? GL_LUMINANCE_ALPHA16F_ARB : GL_LUMINANCE_ALPHA);
 
-    // illumination of lines according to Zoeckler et al. Vis96
-    idx = 0;
-    invResX = 1.0 / (double) (_texWidth - 1);
-    invResY = 1.0 / (double) (_texHeight - 1);
-    for (int y=0; y<_texHeight; ++y)
-    {
-        for (int x=0; x<_texWidth; ++x)
-        {
-            t1 = (double) x * invResX;
-            t2 = (double) y * invResY;
-
-            lt = 2.0*t1 - 1.0;
-            vt = 2.0*t2 - 1.0;
-            diffuse = sqrt(1.0 - lt*lt);
-            diffuse = pow(diffuse, (double)_lineMat.diffExp); // trick by Zoeckler et al.
-
-            dotproduct = lt*vt - sqrt(1.0 - lt*lt) * sqrt(1.0 - vt*vt);
-            dotproduct = (dotproduct < -1.0) ? -1.0 : 
-                ((dotproduct > 1.0) ? 1.0 : dotproduct);
-
-            // use four components
-            /*
-            for (i=0; i<4; ++i)
-            {
-                traditionalDiff = _lineMat.ambient[i] * _lineMat.lightColor[i]
-                    + diffuse * _lineMat.diffuse[i] * _lineMat.lightColor[i];
-
-                traditionalSpec = pow(fabs(dotproduct), _lineMat.specExp) 
-                    * _lineMat.specular[i] * _lineMat.lightColor[i];
-
-                color = traditionalDiff + traditionalSpec;
-
-                //        ic = (int) (127.0*color);
-                //        ic = (ic < 0) ? 0 : ((ic > 255) ? 255 : ic);
-                ic = 0.5*color;
-                ic = (ic < 0.0) ? 0.0 : ((ic > 1.0) ? 1.0 : ic);
-
-                illumTex[idx++] = ic;
-            }
-            */
-
-            // separate diffuse to red channel, specular to green channel
-            traditionalDiff = _lineMat.ambient[0] * _lineMat.lightColor[0]
-                + diffuse * _lineMat.diffuse[0] * _lineMat.lightColor[0];
-
-            traditionalSpec = pow(fabs(dotproduct), static_cast<double>(_lineMat.specExp)) 
-                * _lineMat.specular[0] * _lineMat.lightColor[0];
-
-            traditionalDiff *= 0.5;
-            traditionalDiff = (traditionalDiff < 0.0) ? 0.0 
-                : ((traditionalDiff > 1.0) ? 1.0 : traditionalDiff);
-
-            traditionalSpec *= 0.5;
-            traditionalSpec = (traditionalSpec < 0.0) ? 0.0 
-                : ((traditionalSpec > 1.0) ? 1.0 : traditionalSpec);
-
-            texData[idx++] = static_cast<float>(traditionalDiff);
-            texData[idx++] = static_cast<float>(traditionalSpec)*0.9f;
-        }
-    }
-
     createTex(_texZoeckler.id, texData, GL_LUMINANCE_ALPHA, _texZoeckler.format);
 
     if (_debug)
@@ -217,15 +165,11 @@ void Illumination::createIllumTexMallo(bool floatTex)
 {
     float *texDataDiff;
     float *texDataSpec;
-    double alpha, beta;
-    double lt;
-    double color;
-    double specular, diffuse;
-    double s, t;
-    int idx;
 
-    texDataDiff = new float[4*_texWidth*_texHeight];
-    texDataSpec = new float[4*_texWidth*_texHeight];
+    computeIllumTables(false, true);
+    texDataDiff = _texDataMallo;
+    texDataSpec = texDataDiff + 4*_texWidth*_texHeight;
+    _texDataMallo = NULL;
 
     _texMalloDiffuse.width = _texWidth;
     _texMalloDiffuse.height = _texHeight;
@@ -235,41 +179,6 @@ void Illumination::createIllumTexMallo(bool floatTex)
     _texMalloDiffuse.format = (floatTex ? GL_RGBA16F_ARB : GL_RGBA);
     _texMalloSpecular.format = (floatTex ? GL_RGBA16F_ARB : GL_RGBA);
 
-    idx = 0;
-    for (int y=0; y<_texHeight; ++y)
-    {
-        for (int x=0; x<_texWidth; ++x)
-        {
-            s = ((double) x + 0.5) / _texWidth;
-            t = ((double) y + 0.5) / _texHeight;
-
-            alpha = acos(2.0 * s - 1.0);
-            beta = acos(2.0 * t - 1.0);
-            lt = 2.0 * t - 1.0;
-
-            // diffuse texture  F_d(cos(alpha), L_T) = 
-            //     sqrt(1-L_T^2) * (sin(alpha) - (pi-alpha)cos(alpha) * 1/4)
-            diffuse = sqrt(1.0 - lt*lt)
-                * (sin(alpha) + (M_PI - alpha)*cos(alpha))*0.25;
-
-            // specular texture F_s(cos(alpha), sin(beta)) =
-            //     int_(alpha-pi/2)^(pi/2) cos^n(theta-beta) * cos(theta)*1/2 dtheta
-            specular = 3.5*computeSpecTermMallo(alpha, beta, _lineMat.specExp);
-
-            for (int i=0; i<4; ++i)
-            {
-                color = diffuse * _lineMat.diffuse[i] * _lineMat.lightColor[i];
-                color = (color < 0.0) ? 0.0 : ((color > 1.0) ? 1.0 : color);
-                texDataDiff[idx] = (float) color;
-
-                color = specular * _lineMat.specular[i] * _lineMat.lightColor[i];
-                color = (color < 0.0) ? 0.0 : ((color > 1.0) ? 1.0 : color);
-                texDataSpec[idx] = (float) color;
-                idx++;
-            }
-        }
-    }
-
     createTex(_texMalloDiffuse.id, texDataDiff, GL_RGBA, _texMalloDiffuse.format);
     createTex(_texMalloSpecular.id, texDataSpec, GL_RGBA, _texMalloSpecular.format);
 
@@ -329,7 +238,172 @@ void Illumination::createIllumTexMallo(bool floatTex)
 
     fprintf(stdout, "Mallo illumination textures created.\n");
     delete [] texDataDiff;
-    delete [] texDataSpec;
+}
+
+
+// table of createIllumTexZoeckler(), diffuse and specular term
+// for each texel
+float* Illumination::computeIllumTexZoeckler(void)
+{
+    float *texData;
+    double invResX, invResY;
+    double t1, t2;
+    double lt, vt;
+    double dotproduct;
+    double diffuse;
+    double traditionalDiff;
+    double traditionalSpec;
+    int idx;
+    bool cached;
+
+    texData = new float[2*_texWidth*_texHeight];
+
+    // the table only depends on the material and the resolution
+    PreprocKey key("illumz");
+    key.add(&_lineMat, sizeof(LineMat));
+    key.add(_texWidth);
+    key.add(_texHeight);
+    cached = PreprocCache::getInstance().load(key, texData,
+        2*_texWidth*_texHeight*sizeof(float));
+
+    if (!cached)
+    {
+        // illumination of lines according to Zoeckler et al. Vis96
+        idx = 0;
+        invResX = 1.0 / (double) (_texWidth - 1);
+        invResY = 1.0 / (double) (_texHeight - 1);
+        for (int y=0; y<_texHeight; ++y)
+        {
+            for (int x=0; x<_texWidth; ++x)
+            {
+                t1 = (double) x * invResX;
+                t2 = (double) y * invResY;
+
+                lt = 2.0*t1 - 1.0;
+                vt = 2.0*t2 - 1.0;
+                diffuse = sqrt(1.0 - lt*lt);
+                diffuse = pow(diffuse, (double)_lineMat.diffExp); // trick by Zoeckler et al.
+
+                dotproduct = lt*vt - sqrt(1.0 - lt*lt) * sqrt(1.0 - vt*vt);
+                dotproduct = (dotproduct < -1.0) ? -1.0 : 
+                    ((dotproduct > 1.0) ? 1.0 : dotproduct);
+
+                // use four components
+                /*
+                for (i=0; i<4; ++i)
+                {
+                    traditionalDiff = _lineMat.ambient[i] * _lineMat.lightColor[i]
+                        + diffuse * _lineMat.diffuse[i] * _lineMat.lightColor[i];
+
+                    traditionalSpec = pow(fabs(dotproduct), _lineMat.specExp) 
+                        * _lineMat.specular[i] * _lineMat.lightColor[i];
+
+                    color = traditionalDiff + traditionalSpec;
+
+                    //        ic = (int) (127.0*color);
+                    //        ic = (ic < 0) ? 0 : ((ic > 255) ? 255 : ic);
+                    ic = 0.5*color;
+                    ic = (ic < 0.0) ? 0.0 : ((ic > 1.0) ? 1.0 : ic);
+
+                    illumTex[idx++] = ic;
+                }
+                */
+
+                // separate diffuse to red channel, specular to green channel
+                traditionalDiff = _lineMat.ambient[0] * _lineMat.lightColor[0]
+                    + diffuse * _lineMat.diffuse[0] * _lineMat.lightColor[0];
+
+                traditionalSpec = pow(fabs(dotproduct), static_cast<double>(_lineMat.specExp)) 
+                    * _lineMat.specular[0] * _lineMat.lightColor[0];
+
+                traditionalDiff *= 0.5;
+                traditionalDiff = (traditionalDiff < 0.0) ? 0.0 
+                    : ((traditionalDiff > 1.0) ? 1.0 : traditionalDiff);
+
+                traditionalSpec *= 0.5;
+                traditionalSpec = (traditionalSpec < 0.0) ? 0.0 
+                    : ((traditionalSpec > 1.0) ? 1.0 : traditionalSpec);
+
+                texData[idx++] = static_cast<float>(traditionalDiff);
+                texData[idx++] = static_cast<float>(traditionalSpec)*0.9f;
+            }
+        }
+
+        PreprocCache::getInstance().store(key, texData,
+            2*_texWidth*_texHeight*sizeof(float));
+    }
+
+    return texData;
+}
+
+
+// tables of createIllumTexMallo(), the diffuse RGBA texels are
+// followed by the specular ones
+float* Illumination::computeIllumTexMallo(void)
+{
+    float *texDataDiff;
+    float *texDataSpec;
+    double alpha, beta;
+    double lt;
+    double color;
+    double specular, diffuse;
+    double s, t;
+    int idx;
+    bool cached;
+
+    // both tables in one block, so they are cached together
+    texDataDiff = new float[8*_texWidth*_texHeight];
+    texDataSpec = texDataDiff + 4*_texWidth*_texHeight;
+
+    PreprocKey key("illumm");
+    key.add(&_lineMat, sizeof(LineMat));
+    key.add(_texWidth);
+    key.add(_texHeight);
+    cached = PreprocCache::getInstance().load(key, texDataDiff,
+        8*_texWidth*_texHeight*sizeof(float));
+
+    if (!cached)
+    {
+        idx = 0;
+        for (int y=0; y<_texHeight; ++y)
+        {
+            for (int x=0; x<_texWidth; ++x)
+            {
+                s = ((double) x + 0.5) / _texWidth;
+                t = ((double) y + 0.5) / _texHeight;
+
+                alpha = acos(2.0 * s - 1.0);
+                beta = acos(2.0 * t - 1.0);
+                lt = 2.0 * t - 1.0;
+
+                // diffuse texture  F_d(cos(alpha), L_T) = 
+                //     sqrt(1-L_T^2) * (sin(alpha) - (pi-alpha)cos(alpha) * 1/4)
+                diffuse = sqrt(1.0 - lt*lt)
+                    * (sin(alpha) + (M_PI - alpha)*cos(alpha))*0.25;
+
+                // specular texture F_s(cos(alpha), sin(beta)) =
+                //     int_(alpha-pi/2)^(pi/2) cos^n(theta-beta) * cos(theta)*1/2 dtheta
+                specular = 3.5*computeSpecTermMallo(alpha, beta, _lineMat.specExp);
+
+                for (int i=0; i<4; ++i)
+                {
+                    color = diffuse * _lineMat.diffuse[i] * _lineMat.lightColor[i];
+                    color = (color < 0.0) ? 0.0 : ((color > 1.0) ? 1.0 : color);
+                    texDataDiff[idx] = (float) color;
+
+                    color = specular * _lineMat.specular[i] * _lineMat.lightColor[i];
+                    color = (color < 0.0) ? 0.0 : ((color > 1.0) ? 1.0 : color);
+                    texDataSpec[idx] = (float) color;
+                    idx++;
+                }
+            }
+        }
+
+        PreprocCache::getInstance().store(key, texDataDiff,
+            8*_texWidth*_texHeight*sizeof(float));
+    }
+
+    return texDataDiff;
 }
 
 
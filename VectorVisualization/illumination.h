@@ -87,6 +87,9 @@ public:
 
     // calculate illumination textures according to Zoeckler and Mallo
     void createIllumTextures(bool zoeckler=true, bool mallo=true, bool floatTex=false);
+    // compute the tables only, no OpenGL calls, so this can run on any
+    // thread before createIllumTextures() uploads them
+    void computeIllumTables(bool zoeckler=true, bool mallo=true);
 
     inline Texture* getTexZoeckler(void) { return &_texZoeckler; }
     inline Texture* getTexMalloDiffuse(void) { return &_texMalloDiffuse; }
@@ -108,12 +111,19 @@ protected:
 
     void createTex(const GLuint texId, float *texData, GLenum texFormat, GLint texIntFormat);
 
+    float* computeIllumTexZoeckler(void);
+    float* computeIllumTexMallo(void);
+
     double computeSpecTermMallo(double alpha, double beta, double n);
     double computeSpecTermIntegrandMallo(double beta, double n, double theta);
 
 private:
     LineMat _lineMat;
 
+    // tables computed by computeIllumTables() and not yet uploaded
+    float *_texDataZoeckler;
+    float *_texDataMallo;
+
     Texture _texZoeckler;
     Texture _texMalloDiffuse;
     Texture _texMalloSpecular;
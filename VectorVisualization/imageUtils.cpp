@@ -7,15 +7,53 @@
 #include <errno.h>
 //#include <setjmp.h>
 #include <png.h>
+#include <zlib.h>
 #include <assert.h>
+#include <algorithm>
+#include <vector>
 #include "imageUtils.h"
+#include "threadpool.h"
 
 #define PPM_MAGIC_NUMBER "P6"
 
-bool savePNGImage(const char *fileName, const Image *img, png_byte *rows[]);
+// bands of the parallel PNG encoder are at least this large (in bytes)
+#define PNG_MIN_BAND_SIZE   (64*1024)
+// maximum size of one IDAT chunk written by the parallel encoder
+#define PNG_MAX_IDAT_SIZE   (1024*1024)
+// window of deflate, the previous band is used as dictionary
+#define PNG_DICT_SIZE       32768
+
+#define QOI_MAGIC           "qoif"
+#define QOI_HEADER_SIZE     14
+#define QOI_OP_INDEX        0x00
+#define QOI_OP_DIFF         0x40
+#define QOI_OP_LUMA         0x80
+#define QOI_OP_RUN          0xc0
+#define QOI_OP_RGB          0xfe
+#define QOI_OP_RGBA         0xff
+#define QOI_MASK_2          0xc0
+
+static PNGOptions pngOptions;
+
+bool savePNGImage(const char *fileName, const Image *img, png_byte *rows[],
+	const PNGOptions &options);
+bool savePNGImageParallel(const char *fileName, const Image *img, png_byte *rows[],
+	const PNGOptions &options);
 void readToken(FILE *fp, char *token);
 
 
+void setPNGOptions(const PNGOptions &options)
+{
+	pngOptions = options;
+}
+
+
+const PNGOptions& getPNGOptions(void)
+{
+	return pngOptions;
+}
+
+
 bool pngRead(const char *fileName, Image *img)
 {
 	png_byte **pngImage = NULL;
@@ -115,6 +153,13 @@ bool pngRead(const char *fileName, Image *img)
 
 
 bool pngWrite(const char *fileName, const Image *img, bool invert)
+{
+	return pngWrite(fileName, img, invert, pngOptions);
+}
+
+
+bool pngWrite(const char *fileName, const Image *img, bool invert,
+	const PNGOptions &options)
 {
 	bool retVal;
 	int i;
@@ -134,7 +179,10 @@ bool pngWrite(const char *fileName, const Image *img, bool invert)
 		for (i = 0; i<img->height; ++i)
 			pngImage[i] = (png_byte *)(img->imgData + i*img->width * img->channel);
 
-	retVal = savePNGImage(fileName, img, pngImage);
+	if (options.numBands == 1)
+		retVal = savePNGImage(fileName, img, pngImage, options);
+	else
+		retVal = savePNGImageParallel(fileName, img, pngImage, options);
 
 	free(pngImage);
 	//delete [] pngImage;
@@ -248,8 +296,11 @@ bool ppmWrite(const char *fileName, const Image *img)
 }
 
 
-bool savePNGImage(const char *fileName, const Image *img, png_byte *rows[])
+bool savePNGImage(const char *fileName, const Image *img, png_byte *rows[],
+	const PNGOptions &options)
 {
+	const int filters[] = { PNG_FILTER_NONE, PNG_FILTER_SUB, PNG_FILTER_UP,
+		PNG_FILTER_AVG, PNG_FILTER_PAETH, PNG_ALL_FILTERS };
 	FILE *fp;
 	int imgType;
 	png_structp png;
@@ -303,6 +354,10 @@ bool savePNGImage(const char *fileName, const Image *img, png_byte *rows[])
 		PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_BASE,
 		PNG_FILTER_TYPE_BASE);
 	png_set_gAMA(png, info, img->gamma);
+	if (options.level >= 0)
+		png_set_compression_level(png, std::min(options.level, 9));
+	if (options.filter != PNGFILTER_ADAPTIVE)
+		png_set_filter(png, PNG_FILTER_TYPE_BASE, filters[options.filter]);
 	png_write_info(png, info);
 	png_write_image(png, (png_byte **)rows);
 	png_write_end(png, info);
@@ -313,6 +368,530 @@ bool savePNGImage(const char *fileName, const Image *img, png_byte *rows[])
 }
 
 
+static void putUint32(png_byte *p, png_uint_32 v)
+{
+	p[0] = (png_byte)(v >> 24);
+	p[1] = (png_byte)(v >> 16);
+	p[2] = (png_byte)(v >> 8);
+	p[3] = (png_byte)v;
+}
+
+
+static png_uint_32 getUint32(const png_byte *p)
+{
+	return ((png_uint_32)p[0] << 24) | ((png_uint_32)p[1] << 16)
+		| ((png_uint_32)p[2] << 8) | (png_uint_32)p[3];
+}
+
+
+static bool writeChunk(FILE *fp, const char *type, const png_byte *data, size_t len)
+{
+	png_byte header[8];
+	png_byte crc[4];
+	uLong c;
+
+	putUint32(header, (png_uint_32)len);
+	memcpy(header + 4, type, 4);
+	c = crc32(crc32(0L, Z_NULL, 0), header + 4, 4);
+	if (len > 0)
+		c = crc32(c, data, (uInt)len);
+	putUint32(crc, (png_uint_32)c);
+
+	return (fwrite(header, 1, 8, fp) == 8)
+		&& ((len == 0) || (fwrite(data, 1, len, fp) == len))
+		&& (fwrite(crc, 1, 4, fp) == 4);
+}
+
+
+static inline int paethPredictor(int a, int b, int c)
+{
+	int p = a + b - c;
+	int pa = abs(p - a);
+	int pb = abs(p - b);
+	int pc = abs(p - c);
+
+	if ((pa <= pb) && (pa <= pc))
+		return a;
+	return (pb <= pc) ? b : c;
+}
+
+
+// apply one of the PNG filters to row, prev is NULL for the first row
+static void filterRow(int filter, const png_byte *row, const png_byte *prev,
+	size_t rowBytes, int bpp, png_byte *out)
+{
+	size_t i;
+
+	switch (filter)
+	{
+	case PNGFILTER_SUB:
+		for (i = 0; i < rowBytes; ++i)
+			out[i] = (png_byte)(row[i] - ((i >= (size_t)bpp) ? row[i - bpp] : 0));
+		break;
+	case PNGFILTER_UP:
+		for (i = 0; i < rowBytes; ++i)
+			out[i] = (png_byte)(row[i] - (prev ? prev[i] : 0));
+		break;
+	case PNGFILTER_AVERAGE:
+		for (i = 0; i < rowBytes; ++i)
+		{
+			int a = (i >= (size_t)bpp) ? row[i - bpp] : 0;
+			int b = prev ? prev[i] : 0;
+			out[i] = (png_byte)(row[i] - ((a + b) >> 1));
+		}
+		break;
+	case PNGFILTER_PAETH:
+		for (i = 0; i < rowBytes; ++i)
+		{
+			int a = (i >= (size_t)bpp) ? row[i - bpp] : 0;
+			int b = prev ? prev[i] : 0;
+			int c = (prev && (i >= (size_t)bpp)) ? prev[i - bpp] : 0;
+			out[i] = (png_byte)(row[i] - paethPredictor(a, b, c));
+		}
+		break;
+	default:
+		memcpy(out, row, rowBytes);
+		break;
+	}
+}
+
+
+// filter with the smallest sum of absolute differences, like libpng
+static int filterRowAdaptive(const png_byte *row, const png_byte *prev,
+	size_t rowBytes, int bpp, png_byte *out, png_byte *scratch)
+{
+	unsigned long best = 0;
+	int bestFilter = -1;
+
+	for (int f = PNGFILTER_NONE; f <= PNGFILTER_PAETH; ++f)
+	{
+		unsigned long sum = 0;
+
+		filterRow(f, row, prev, rowBytes, bpp, scratch);
+		for (size_t i = 0; i < rowBytes; ++i)
+			sum += abs((signed char)scratch[i]);
+
+		if ((bestFilter < 0) || (sum < best))
+		{
+			best = sum;
+			bestFilter = f;
+			memcpy(out, scratch, rowBytes);
+		}
+	}
+
+	return bestFilter;
+}
+
+
+struct DeflateBand
+{
+	size_t begin;
+	size_t end;
+	std::vector<png_byte> out;
+	uLong adler;
+	bool ok;
+};
+
+
+// raw deflate of one band of the filtered image, the preceding 32 kB are
+// used as dictionary so the bands compress almost as well as one stream
+// all bands but the last end with a sync flush on a byte boundary, so
+// they can be concatenated
+static bool deflateBand(const std::vector<png_byte> &data, DeflateBand &band,
+	int level, int strategy, bool last)
+{
+	z_stream strm;
+	size_t dictSize = std::min(band.begin, (size_t)PNG_DICT_SIZE);
+	uInt len = (uInt)(band.end - band.begin);
+	bool ok;
+	int ret;
+
+	memset(&strm, 0, sizeof(strm));
+	if (deflateInit2(&strm, level, Z_DEFLATED, -15, 8, strategy) != Z_OK)
+		return false;
+	if (dictSize > 0)
+		deflateSetDictionary(&strm, &data[band.begin - dictSize], (uInt)dictSize);
+
+	band.out.resize(deflateBound(&strm, len) + 16);
+	strm.next_in = (Bytef*)&data[band.begin];
+	strm.avail_in = len;
+	strm.next_out = &band.out[0];
+	strm.avail_out = (uInt)band.out.size();
+
+	ret = deflate(&strm, last ? Z_FINISH : Z_SYNC_FLUSH);
+	ok = last ? (ret == Z_STREAM_END) : ((ret == Z_OK) && (strm.avail_in == 0));
+	band.out.resize(band.out.size() - strm.avail_out);
+	deflateEnd(&strm);
+
+	band.adler = adler32(adler32(0L, Z_NULL, 0), &data[band.begin], len);
+
+	return ok;
+}
+
+
+bool savePNGImageParallel(const char *fileName, const Image *img, png_byte *rows[],
+	const PNGOptions &options)
+{
+	static const png_byte signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+	const int bpp = img->channel;
+	const int height = img->height;
+	const size_t rowBytes = (size_t)img->width * bpp;
+	const size_t lineBytes = rowBytes + 1;
+	ThreadPool &pool = ThreadPool::getInstance();
+	std::vector<png_byte> filtered;
+	std::vector<DeflateBand> bands;
+	std::vector<png_byte> stream;
+	png_byte ihdr[13];
+	png_byte gama[4];
+	png_byte adler[4];
+	int level = (options.level < 0) ? Z_DEFAULT_COMPRESSION : std::min(options.level, 9);
+	int strategy = (options.filter == PNGFILTER_NONE) ? Z_DEFAULT_STRATEGY : Z_FILTERED;
+	int colorType;
+	int numBands;
+	int flags;
+	uLong checksum;
+	bool ok;
+	FILE *fp;
+
+	if ((img->width < 1) || (height < 1))
+		return false;
+
+	switch (img->channel)
+	{
+	case 1:
+		colorType = PNG_COLOR_TYPE_GRAY;
+		break;
+	case 2:
+		colorType = PNG_COLOR_TYPE_GRAY_ALPHA;
+		break;
+	case 3:
+		colorType = PNG_COLOR_TYPE_RGB;
+		break;
+	case 4:
+		colorType = PNG_COLOR_TYPE_RGBA;
+		break;
+	default:
+		return false;
+	}
+
+	// the filters only depend on the unfiltered rows
+	filtered.resize(lineBytes * height);
+	pool.parallelFor(height, [&](int begin, int end)
+	{
+		std::vector<png_byte> scratch(rowBytes);
+
+		for (int y = begin; y < end; ++y)
+		{
+			png_byte *out = &filtered[y * lineBytes];
+			const png_byte *prev = (y > 0) ? rows[y - 1] : NULL;
+
+			if (options.filter == PNGFILTER_ADAPTIVE)
+				out[0] = (png_byte)filterRowAdaptive(rows[y], prev, rowBytes, bpp,
+					out + 1, &scratch[0]);
+			else
+			{
+				out[0] = (png_byte)options.filter;
+				filterRow(options.filter, rows[y], prev, rowBytes, bpp, out + 1);
+			}
+		}
+	});
+
+	// bands of whole rows
+	numBands = (options.numBands > 0) ? options.numBands : pool.getNumThreads();
+	numBands = std::min(numBands, (int)std::max((size_t)1, filtered.size() / PNG_MIN_BAND_SIZE));
+	numBands = std::min(numBands, height);
+	bands.resize(numBands);
+	for (int i = 0; i < numBands; ++i)
+	{
+		bands[i].begin = (size_t)height * i / numBands * lineBytes;
+		bands[i].end = (size_t)height * (i + 1) / numBands * lineBytes;
+		bands[i].ok = false;
+	}
+
+	pool.parallelFor(numBands, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+			bands[i].ok = deflateBand(filtered, bands[i], level, strategy, i == numBands - 1);
+	});
+
+	// zlib stream: header, the bands and the combined Adler-32
+	if (level < 0)
+		level = 6;
+	flags = (level < 2) ? 0 : ((level < 6) ? 1 : ((level == 6) ? 2 : 3));
+	stream.push_back(0x78);
+	stream.push_back((png_byte)(flags << 6));
+	stream[1] += (png_byte)(31 - ((stream[0] << 8) + stream[1]) % 31);
+
+	checksum = bands[0].adler;
+	for (int i = 0; i < numBands; ++i)
+	{
+		if (!bands[i].ok)
+		{
+			fprintf(stderr, "pngWrite: compression of \"%s\" failed.\n", fileName);
+			return false;
+		}
+		if (i > 0)
+			checksum = adler32_combine(checksum, bands[i].adler,
+				(z_off_t)(bands[i].end - bands[i].begin));
+		stream.insert(stream.end(), bands[i].out.begin(), bands[i].out.end());
+	}
+	putUint32(adler, (png_uint_32)checksum);
+	stream.insert(stream.end(), adler, adler + 4);
+
+	fp = fopen(fileName, "wb");
+	if (!fp)
+		return false;
+
+	putUint32(ihdr, img->width);
+	putUint32(ihdr + 4, height);
+	ihdr[8] = 8;
+	ihdr[9] = (png_byte)colorType;
+	ihdr[10] = 0;  // deflate
+	ihdr[11] = 0;  // adaptive filtering
+	ihdr[12] = 0;  // no interlace
+	putUint32(gama, (png_uint_32)(img->gamma * 100000.0 + 0.5));
+
+	ok = (fwrite(signature, 1, 8, fp) == 8)
+		&& writeChunk(fp, "IHDR", ihdr, sizeof(ihdr))
+		&& writeChunk(fp, "gAMA", gama, sizeof(gama));
+	for (size_t pos = 0; ok && (pos < stream.size()); pos += PNG_MAX_IDAT_SIZE)
+		ok = writeChunk(fp, "IDAT", &stream[pos],
+			std::min(stream.size() - pos, (size_t)PNG_MAX_IDAT_SIZE));
+	ok = ok && writeChunk(fp, "IEND", NULL, 0);
+
+	fclose(fp);
+	return ok;
+}
+
+
+bool qoiRead(const char *fileName, Image *img)
+{
+	std::vector<unsigned char> data;
+	unsigned char index[64][4];
+	unsigned char px[4] = { 0, 0, 0, 255 };
+	size_t pos, end, numPixels;
+	long size;
+	int channel, run = 0;
+	FILE *fp;
+
+	assert(img);
+	img->imgData = NULL;
+	img->width = 0;
+	img->height = 0;
+
+	fp = fopen(fileName, "rb");
+	if (!fp)
+	{
+		fprintf(stderr, "Could not open QOI file %s.\n", fileName);
+		return false;
+	}
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	if (size > QOI_HEADER_SIZE + 8)
+	{
+		data.resize(size);
+		if (fread(&data[0], 1, size, fp) != (size_t)size)
+			data.clear();
+	}
+	fclose(fp);
+
+	if (data.empty() || memcmp(&data[0], QOI_MAGIC, 4))
+	{
+		fprintf(stderr, "qoiRead: \"%s\" is no QOI file.\n", fileName);
+		return false;
+	}
+	channel = data[12];
+	if ((channel != 3) && (channel != 4))
+	{
+		fprintf(stderr, "qoiRead: invalid number of channels.\n");
+		return false;
+	}
+
+	img->width = (int)getUint32(&data[4]);
+	img->height = (int)getUint32(&data[8]);
+	img->channel = channel;
+	img->gamma = 1.0;
+	numPixels = (size_t)img->width * img->height;
+	img->imgData = new unsigned char[channel * numPixels];
+
+	memset(index, 0, sizeof(index));
+	pos = QOI_HEADER_SIZE;
+	end = data.size() - 8;
+
+	for (size_t i = 0; i < numPixels; ++i)
+	{
+		if (run > 0)
+		{
+			--run;
+		}
+		else if (pos < end)
+		{
+			int b1 = data[pos++];
+
+			if (b1 == QOI_OP_RGB)
+			{
+				memcpy(px, &data[pos], 3);
+				pos += 3;
+			}
+			else if (b1 == QOI_OP_RGBA)
+			{
+				memcpy(px, &data[pos], 4);
+				pos += 4;
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_INDEX)
+			{
+				memcpy(px, index[b1], 4);
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_DIFF)
+			{
+				px[0] += ((b1 >> 4) & 0x03) - 2;
+				px[1] += ((b1 >> 2) & 0x03) - 2;
+				px[2] += (b1 & 0x03) - 2;
+			}
+			else if ((b1 & QOI_MASK_2) == QOI_OP_LUMA)
+			{
+				int b2 = data[pos++];
+				int vg = (b1 & 0x3f) - 32;
+				px[0] += vg - 8 + ((b2 >> 4) & 0x0f);
+				px[1] += vg;
+				px[2] += vg - 8 + (b2 & 0x0f);
+			}
+			else
+			{
+				run = b1 & 0x3f;
+			}
+			memcpy(index[(px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) % 64], px, 4);
+		}
+		memcpy(img->imgData + i*channel, px, channel);
+	}
+
+	return true;
+}
+
+
+bool qoiWrite(const char *fileName, const Image *img, bool invert)
+{
+	static const unsigned char padding[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+	const int channel = img->channel;
+	std::vector<unsigned char> out;
+	unsigned char index[64][4];
+	unsigned char px[4] = { 0, 0, 0, 255 };
+	unsigned char prev[4] = { 0, 0, 0, 255 };
+	int run = 0;
+	bool ok;
+	FILE *fp;
+
+	if (((channel != 3) && (channel != 4)) || (img->width < 1) || (img->height < 1))
+	{
+		fprintf(stderr, "qoiWrite: only RGB and RGBA images are supported.\n");
+		return false;
+	}
+
+	out.reserve(QOI_HEADER_SIZE + (size_t)img->width * img->height * (channel + 1) + 8);
+	out.resize(QOI_HEADER_SIZE);
+	memcpy(&out[0], QOI_MAGIC, 4);
+	putUint32(&out[4], img->width);
+	putUint32(&out[8], img->height);
+	out[12] = (unsigned char)channel;
+	out[13] = 0;  // sRGB with linear alpha
+
+	memset(index, 0, sizeof(index));
+	for (int y = 0; y < img->height; ++y)
+	{
+		const unsigned char *row = img->imgData
+			+ (size_t)(invert ? img->height - 1 - y : y) * img->width * channel;
+
+		for (int x = 0; x < img->width; ++x)
+		{
+			memcpy(px, row + x*channel, channel);
+
+			if (!memcmp(px, prev, 4))
+			{
+				if (++run == 62)
+				{
+					out.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+					run = 0;
+				}
+				continue;
+			}
+			if (run > 0)
+			{
+				out.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+				run = 0;
+			}
+
+			int hash = (px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) % 64;
+			if (!memcmp(index[hash], px, 4))
+			{
+				out.push_back((unsigned char)(QOI_OP_INDEX | hash));
+			}
+			else
+			{
+				memcpy(index[hash], px, 4);
+
+				if (px[3] == prev[3])
+				{
+					signed char vr = (signed char)(px[0] - prev[0]);
+					signed char vg = (signed char)(px[1] - prev[1]);
+					signed char vb = (signed char)(px[2] - prev[2]);
+					signed char vgr = (signed char)(vr - vg);
+					signed char vgb = (signed char)(vb - vg);
+
+					if ((vr > -3) && (vr < 2) && (vg > -3) && (vg < 2) && (vb > -3) && (vb < 2))
+					{
+						out.push_back((unsigned char)(QOI_OP_DIFF
+							| ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2)));
+					}
+					else if ((vgr > -9) && (vgr < 8) && (vg > -33) && (vg < 32)
+						&& (vgb > -9) && (vgb < 8))
+					{
+						out.push_back((unsigned char)(QOI_OP_LUMA | (vg + 32)));
+						out.push_back((unsigned char)(((vgr + 8) << 4) | (vgb + 8)));
+					}
+					else
+					{
+						out.push_back(QOI_OP_RGB);
+						out.insert(out.end(), px, px + 3);
+					}
+				}
+				else
+				{
+					out.push_back(QOI_OP_RGBA);
+					out.insert(out.end(), px, px + 4);
+				}
+			}
+			memcpy(prev, px, 4);
+		}
+	}
+	if (run > 0)
+		out.push_back((unsigned char)(QOI_OP_RUN | (run - 1)));
+	out.insert(out.end(), padding, padding + 8);
+
+	fp = fopen(fileName, "wb");
+	if (!fp)
+		return false;
+	ok = (fwrite(&out[0], 1, out.size(), fp) == out.size());
+	fclose(fp);
+
+	return ok;
+}
+
+
+bool imageWrite(const char *fileName, const Image *img, bool invert)
+{
+	size_t len = fileName ? strlen(fileName) : 0;
+
+	if ((len > 4) && (fileName[len - 4] == '.')
+		&& (tolower(fileName[len - 3]) == 'q') && (tolower(fileName[len - 2]) == 'o')
+		&& (tolower(fileName[len - 1]) == 'i'))
+	{
+		return qoiWrite(fileName, img, invert);
+	}
+
+	return pngWrite(fileName, img, invert);
+}
+
 void readToken(FILE *fp, char *token)
 {
 	int comment = 0;
@@ -50,8 +50,46 @@ struct Image
 	int maxVal;
 };
 
+// row filter of the PNG encoder, PNGFILTER_ADAPTIVE chooses the best
+// filter for every row
+enum PNGFilter
+{
+	PNGFILTER_NONE = 0,
+	PNGFILTER_SUB,
+	PNGFILTER_UP,
+	PNGFILTER_AVERAGE,
+	PNGFILTER_PAETH,
+	PNGFILTER_ADAPTIVE
+};
+
+struct PNGOptions
+{
+	PNGOptions(void) : level(-1), filter(PNGFILTER_ADAPTIVE), numBands(1) {}
+
+	// zlib compression level 0-9, -1 for the zlib default
+	int level;
+	PNGFilter filter;
+	// number of row bands filtered and deflated concurrently by the
+	// ThreadPool, 1 uses libpng, 0 one band per thread
+	int numBands;
+};
+
+// options used by pngWrite, the defaults are those of libpng
+void setPNGOptions(const PNGOptions &options);
+const PNGOptions& getPNGOptions(void);
+
 bool pngRead(const char *fileName, Image *img);
 bool pngWrite(const char *fileName, const Image *img, bool invert = false);
+bool pngWrite(const char *fileName, const Image *img, bool invert,
+	const PNGOptions &options);
+
+// "Quite OK Image" format, lossless and much faster than PNG, for
+// intermediate frames (3 or 4 channels)
+bool qoiRead(const char *fileName, Image *img);
+bool qoiWrite(const char *fileName, const Image *img, bool invert = false);
+
+// QOI if fileName ends with .qoi, PNG otherwise
+bool imageWrite(const char *fileName, const Image *img, bool invert = false);
 
 bool ppmRead(const char *filename, Image *img);
 bool ppmWrite(const char *filename, const Image *img);
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "licbricks.h"
+#include "dataset.h"
+#include "vectorconvert.h"
+#include "threadpool.h"
+
+
+// edge length of the blocks of the vector texture whose largest change
+// is kept
+#define LICBRICK_BLOCK_SIZE  4
+
+
+LICBrickGrid::LICBrickGrid(void) : _brickSize(LICBRICK_DEFAULT_SIZE),
+	_reach(0.0f), _level(0), _compareMagnitude(false)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		_size[i] = 0;
+		_numBricks[i] = 0;
+		_texSize[i] = 0;
+		_numBlocks[i] = 0;
+	}
+}
+
+
+LICBrickGrid::~LICBrickGrid(void)
+{
+}
+
+
+bool LICBrickGrid::init(const int size[3], int brickSize)
+{
+	if ((brickSize < 1) || (size[0] < 1) || (size[1] < 1) || (size[2] < 1))
+	{
+		fprintf(stderr, "LICBrickGrid:  Invalid brick size %d.\n", brickSize);
+		return false;
+	}
+
+	_brickSize = brickSize;
+	for (int i = 0; i < 3; ++i)
+	{
+		_size[i] = size[i];
+		_numBricks[i] = (size[i] + brickSize - 1) / brickSize;
+	}
+	_drift.assign(getBrickCount(), FLT_MAX);
+
+	return true;
+}
+
+
+void LICBrickGrid::setLICReach(float reach)
+{
+	if (reach == _reach)
+		return;
+
+	_reach = reach;
+	invalidate();
+}
+
+
+void LICBrickGrid::setLevel(int level)
+{
+	if (level == _level)
+		return;
+
+	_level = level;
+	invalidate();
+}
+
+
+void LICBrickGrid::setCompareMagnitude(bool enable)
+{
+	if (enable == _compareMagnitude)
+		return;
+
+	_compareMagnitude = enable;
+	invalidate();
+}
+
+
+void LICBrickGrid::setVectorField(const VolumeData *vd, const void *data,
+	const void *next, float t)
+{
+	VectorSource src = { data, next, t, vd->dataType };
+
+	if (!isInitialized())
+		return;
+
+	// the bricks of the cache are not kept in memory
+	if (!data || (vd->dataDim != 3))
+	{
+		invalidate();
+		return;
+	}
+
+	if ((vd->texSize[0] != _texSize[0]) || (vd->texSize[1] != _texSize[1])
+		|| (vd->texSize[2] != _texSize[2]))
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			_texSize[i] = vd->texSize[i];
+			_numBlocks[i] = (_texSize[i] + LICBRICK_BLOCK_SIZE - 1) / LICBRICK_BLOCK_SIZE;
+		}
+		_blockDelta.resize((size_t)_numBlocks[0] * _numBlocks[1] * _numBlocks[2]);
+		_prevField.clear();
+	}
+
+	// the magnitude is normalized like the vector textures if it is
+	// compared, otherwise it is stored unscaled and ignored
+	_field.resize(4 * (size_t)_texSize[0] * _texSize[1] * _texSize[2]);
+	convertVectorsChar(vd, src, _compareMagnitude ? computeMaxMagnitude(vd, src) : 0.0f,
+		&_field[0]);
+
+	if (_prevField.size() == _field.size())
+	{
+		computeBlockDeltas();
+		accumulateDrift(vd->scale);
+	}
+	else
+		std::fill(_drift.begin(), _drift.end(), FLT_MAX);
+
+	_field.swap(_prevField);
+}
+
+
+void LICBrickGrid::invalidate(void)
+{
+	std::fill(_drift.begin(), _drift.end(), FLT_MAX);
+	_prevField.clear();
+}
+
+
+int LICBrickGrid::getDirtyCount(void)
+{
+	int count = 0;
+
+	for (size_t i = 0; i < _drift.size(); ++i)
+	{
+		if (_drift[i] > LICBRICK_THRESHOLD)
+			++count;
+	}
+	return count;
+}
+
+
+void LICBrickGrid::clearDirty(void)
+{
+	for (size_t i = 0; i < _drift.size(); ++i)
+	{
+		if (_drift[i] > LICBRICK_THRESHOLD)
+			_drift[i] = 0.0f;
+	}
+}
+
+
+void LICBrickGrid::computeBlockDeltas(void)
+{
+	ThreadPool::getInstance().parallelFor(_numBlocks[2], [&](int zBegin, int zEnd)
+	{
+		for (int bz = zBegin; bz < zEnd; ++bz)
+		{
+			for (int by = 0; by < _numBlocks[1]; ++by)
+			{
+				for (int bx = 0; bx < _numBlocks[0]; ++bx)
+				{
+					const int b[3] = { bx, by, bz };
+					int begin[3], end[3];
+					int delta = 0;
+					int magDelta = 0;
+
+					for (int i = 0; i < 3; ++i)
+					{
+						begin[i] = b[i] * LICBRICK_BLOCK_SIZE;
+						end[i] = std::min(begin[i] + LICBRICK_BLOCK_SIZE, _texSize[i]);
+					}
+
+					for (int z = begin[2]; z < end[2]; ++z)
+					{
+						for (int y = begin[1]; y < end[1]; ++y)
+						{
+							size_t idx = 4 * (((size_t)z * _texSize[1] + y) * _texSize[0] + begin[0]);
+							const unsigned char *cur = &_field[idx];
+							const unsigned char *prev = &_prevField[idx];
+
+							for (int x = begin[0]; x < end[0]; ++x, cur += 4, prev += 4)
+							{
+								delta = std::max(delta, abs(cur[0] - prev[0]));
+								delta = std::max(delta, abs(cur[1] - prev[1]));
+								delta = std::max(delta, abs(cur[2] - prev[2]));
+								if (_compareMagnitude)
+									magDelta = std::max(magDelta, abs(cur[3] - prev[3]));
+							}
+						}
+					}
+					// the directions are stored as 127 * dir + 128 and the
+					// magnitude as 255 * len
+					_blockDelta[((size_t)bz * _numBlocks[1] + by) * _numBlocks[0] + bx] =
+						std::max(delta / 127.0f, magDelta / 255.0f);
+				}
+			}
+		}
+	});
+}
+
+
+void LICBrickGrid::accumulateDrift(const float scale[3])
+{
+	// texels around the lookups, the texels of coarser levels cover
+	// 2^level texels of the first level
+	const int margin = 2 << _level;
+
+	for (int bz = 0; bz < _numBricks[2]; ++bz)
+	{
+		for (int by = 0; by < _numBricks[1]; ++by)
+		{
+			for (int bx = 0; bx < _numBricks[0]; ++bx)
+			{
+				const int b[3] = { bx, by, bz };
+				int blockBegin[3], blockEnd[3];
+				float delta = 0.0f;
+
+				// blocks holding the texels read by the LIC of the brick
+				for (int i = 0; i < 3; ++i)
+				{
+					float lo = static_cast<float>(b[i] * _brickSize) / _size[i] * scale[i] - _reach;
+					float hi = static_cast<float>(std::min((b[i] + 1) * _brickSize, _size[i]))
+						/ _size[i] * scale[i] + _reach;
+					int texLo = static_cast<int>(floorf(lo * _texSize[i] - 0.5f)) - margin;
+					int texHi = static_cast<int>(floorf(hi * _texSize[i] - 0.5f)) + margin;
+
+					texLo = std::max(std::min(texLo, _texSize[i] - 1), 0);
+					texHi = std::max(std::min(texHi, _texSize[i] - 1), 0);
+					blockBegin[i] = texLo / LICBRICK_BLOCK_SIZE;
+					blockEnd[i] = texHi / LICBRICK_BLOCK_SIZE + 1;
+				}
+
+				for (int z = blockBegin[2]; z < blockEnd[2]; ++z)
+				{
+					for (int y = blockBegin[1]; y < blockEnd[1]; ++y)
+					{
+						const float *block = &_blockDelta[((size_t)z * _numBlocks[1] + y) * _numBlocks[0]];
+
+						for (int x = blockBegin[0]; x < blockEnd[0]; ++x)
+							delta = std::max(delta, block[x]);
+					}
+				}
+
+				// the changes of several frames add up, FLT_MAX stays
+				float &drift = _drift[getBrickIndex(bx, by, bz)];
+				drift = std::min(drift + delta, FLT_MAX);
+			}
+		}
+	}
+}
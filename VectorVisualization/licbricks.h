@@ -0,0 +1,102 @@
+#ifndef _LICBRICKS_H_
+#define _LICBRICKS_H_
+
+#include <vector>
+
+
+#define LICBRICK_DEFAULT_SIZE  32
+// change of a direction component (-1..1) or of the normalized magnitude
+// (0..1) below which the LIC of a brick is kept
+#define LICBRICK_THRESHOLD     (1.0f / 64.0f)
+
+struct VolumeData;
+
+
+// Bricks of the LIC volume which have to be computed again during the
+// animation. The LIC volume (Renderer::renderLICVolume()) is split into
+// bricks of brickSize^3 voxels. Every frame the directions of the vector
+// field are converted again on the CPU and compared with the ones of the
+// previous frame; the largest change of the directions is collected
+// in blocks of the vector texture. If the LIC is scaled by the speed
+// of flow, the change of the normalized magnitude is included as well.
+// A brick accumulates the changes read by its voxels, that is within
+// the reach of the LIC plus the trilinear footprint around the brick,
+// and becomes dirty once they exceed LICBRICK_THRESHOLD. The other
+// bricks keep the LIC of an earlier frame.
+class LICBrickGrid
+{
+public:
+	LICBrickGrid(void);
+	~LICBrickGrid(void);
+
+	// bricks of a LIC volume of size voxels, all of them are dirty
+	bool init(const int size[3], int brickSize = LICBRICK_DEFAULT_SIZE);
+	bool isInitialized(void) { return !_drift.empty(); }
+	int getBrickSize(void) { return _brickSize; }
+	const int* getNumBricks(void) { return _numBricks; }
+	int getBrickCount(void) { return _numBricks[0] * _numBricks[1] * _numBricks[2]; }
+
+	// distance in texture coordinates of the vector field from which the
+	// LIC gathers the directions, a new reach makes all bricks dirty
+	void setLICReach(float reach);
+	// mipmap level of the vector texture sampled by the LIC, a new level
+	// makes all bricks dirty
+	void setLevel(int level);
+	// the LIC steps are scaled by the magnitude (SPEED_OF_FLOW), changes
+	// of the magnitude make bricks dirty, a new setting makes all of them
+	// dirty
+	void setCompareMagnitude(bool enable);
+
+	// vector field interpolated between data and next with weight t like
+	// VectorDataSet::createTextureIterp(), the key frame textures blended
+	// in the shader follow the same directions
+	// the LIC volume voxel u (0..1) reads the field at u * scale of vd
+	// without data (out of core) or with a new layout all bricks are dirty
+	void setVectorField(const VolumeData *vd, const void *data, const void *next, float t);
+
+	// all bricks have to be computed, e.g. the LIC parameters changed,
+	// the next field is not compared with the previous one
+	void invalidate(void);
+	bool isDirty(int x, int y, int z)
+	{
+		return _drift[getBrickIndex(x, y, z)] > LICBRICK_THRESHOLD;
+	}
+	int getDirtyCount(void);
+	// the dirty bricks were computed
+	void clearDirty(void);
+
+private:
+	LICBrickGrid(const LICBrickGrid&);
+	LICBrickGrid& operator=(const LICBrickGrid&);
+
+	int getBrickIndex(int x, int y, int z)
+	{
+		return (z * _numBricks[1] + y) * _numBricks[0] + x;
+	}
+	// largest change of the directions (and the magnitude) in every
+	// block of the texture
+	void computeBlockDeltas(void);
+	// add the largest change read by every brick to its drift
+	void accumulateDrift(const float scale[3]);
+
+	int _size[3];
+	int _brickSize;
+	int _numBricks[3];
+	// changes since the brick was computed, above the threshold if dirty
+	std::vector<float> _drift;
+
+	float _reach;
+	int _level;
+	bool _compareMagnitude;
+
+	// directions of the current and the previous frame (8 bit like
+	// the RGBA8 vector textures), with the magnitude divided by the
+	// largest one if it is compared
+	int _texSize[3];
+	std::vector<unsigned char> _field;
+	std::vector<unsigned char> _prevField;
+	int _numBlocks[3];
+	std::vector<float> _blockDelta;
+};
+
+#endif // _LICBRICKS_H_
@@ -0,0 +1,371 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "mmath.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "texsample.h"
+#include "vectorconvert.h"
+#include "licengine.h"
+
+
+// the shader never assigns logEyeDist for the LIC volume, the step
+// width is scaled by (logEyeDist*0.5 + 0.3) with logEyeDist = 0
+#define LIC_STEP_SCALE     0.3f
+
+
+// texture size used for a data set, see NoiseDataSet::updateTexSize()
+static void getTexSize(const int size[3], int texSize[3])
+{
+	for (int i = 0; i < 3; ++i)
+	{
+#if FORCE_POWER_OF_TWO_TEXTURE == 1
+		texSize[i] = nextPowerTwo(size[i]);
+#else
+		texSize[i] = size[i];
+#endif
+	}
+}
+
+
+LICEngine::LICEngine(void) : _invFilterArea(1.0f), _lastTime(0.0)
+{
+	_scale[0] = _scale[1] = _scale[2] = 1.0f;
+	_noise.repeat = true;
+}
+
+
+LICEngine::~LICEngine(void)
+{
+}
+
+
+bool LICEngine::setVectorField(const VolumeData *vd, const void *data,
+	const void *next, float t)
+{
+	VectorSource src = { data, next, t, vd->dataType };
+
+	if (!data || (vd->dataDim != 3))
+	{
+		fprintf(stderr, "LICEngine:  No vector field given.\n");
+		return false;
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		_vectors.size[i] = vd->texSize[i];
+		_scale[i] = vd->scale[i];
+	}
+	_vectors.channels = 4;
+	_vectors.repeat = false;
+	_vectors.data.resize(4 * (size_t)_vectors.size[0] * _vectors.size[1] * _vectors.size[2]);
+
+	// same normalization as the float textures of VectorDataSet
+	convertVectorsFloat(vd, src, computeMaxMagnitude(vd, src), 0.5f, &_vectors.data[0]);
+
+	return true;
+}
+
+
+bool LICEngine::createScalarTexture(const VolumeData *vd, Texture3D *tex)
+{
+	if (!vd || !vd->data || (vd->dataDim != 1)
+		|| ((vd->dataType != DATRAW_UCHAR) && (vd->dataType != DATRAW_FLOAT)))
+	{
+		fprintf(stderr, "LICEngine:  Only UCHAR and FLOAT scalar volumes are supported.\n");
+		return false;
+	}
+
+	getTexSize(vd->size, tex->size);
+	tex->channels = 1;
+	tex->data.assign((size_t)tex->size[0] * tex->size[1] * tex->size[2], 0.0f);
+
+	// unsigned bytes are normalized to [0,1] by OpenGL
+	ThreadPool::getInstance().parallelFor(vd->size[1] * vd->size[2], [&](int begin, int end)
+	{
+		for (int row = begin; row < end; ++row)
+		{
+			int y = row % vd->size[1];
+			int z = row / vd->size[1];
+			size_t src = (size_t)row * vd->size[0];
+			float *dst = &tex->data[((size_t)z * tex->size[1] + y) * tex->size[0]];
+
+			if (vd->dataType == DATRAW_UCHAR)
+			{
+				const unsigned char *p = static_cast<const unsigned char*>(vd->data) + src;
+				for (int x = 0; x < vd->size[0]; ++x)
+					dst[x] = p[x] / 255.0f;
+			}
+			else
+			{
+				memcpy(dst, static_cast<const float*>(vd->data) + src,
+					vd->size[0] * sizeof(float));
+			}
+		}
+	});
+
+	return true;
+}
+
+
+bool LICEngine::setNoise(const VolumeData *noise)
+{
+	// the noise is stored in the alpha channel of the packed noise
+	// and gradient texture, only the noise itself is needed
+	if (!createScalarTexture(noise, &_noise))
+		return false;
+	_noise.repeat = true;
+	return true;
+}
+
+
+bool LICEngine::setScalarField(const VolumeData *scalar)
+{
+	if (!scalar)
+	{
+		_scalars = Texture3D();
+		return true;
+	}
+	if (!createScalarTexture(scalar, &_scalars))
+		return false;
+	_scalars.repeat = false;
+	return true;
+}
+
+
+bool LICEngine::setFilter(LICFilter *filter)
+{
+	if (!filter || !filter->getFilterData())
+	{
+		fprintf(stderr, "LICEngine:  No LIC filter given.\n");
+		return false;
+	}
+
+	_kernel.resize(filter->getFilterWidth());
+	for (int i = 0; i < filter->getFilterWidth(); ++i)
+		_kernel[i] = filter->getFilterData()[i] / 255.0f;
+	_invFilterArea = filter->getInverseFilterArea();
+
+	return true;
+}
+
+
+float LICEngine::sampleKernel(float s)
+{
+	int size = static_cast<int>(_kernel.size());
+	float u, f;
+	int i0;
+
+	// GL_CLAMP, texels outside of the kernel are the black border
+	s = (s < 0.0f) ? 0.0f : ((s > 1.0f) ? 1.0f : s);
+	u = s * size - 0.5f;
+	i0 = (int)floorf(u);
+	f = u - i0;
+
+	float v0 = (i0 >= 0) ? _kernel[i0] : 0.0f;
+	float v1 = (i0 + 1 < size) ? _kernel[i0 + 1] : 0.0f;
+	return v0 + f * (v1 - v0);
+}
+
+
+void LICEngine::sampleVectors(const float pos[3][LIC_PACKET_SIZE],
+	float out[4][LIC_PACKET_SIZE])
+{
+	float v[4];
+
+	for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+	{
+		sampleTrilinear<4>(&_vectors.data[0], _vectors.size, false,
+			pos[0][l], pos[1][l], pos[2][l], v);
+		out[0][l] = v[0];
+		out[1][l] = v[1];
+		out[2][l] = v[2];
+		out[3][l] = v[3];
+	}
+}
+
+
+void LICEngine::sampleNoise(const float pos[3][LIC_PACKET_SIZE],
+	float out[LIC_PACKET_SIZE])
+{
+	const float freqScale = _params.freqScale;
+	float s;
+
+	for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+	{
+		// freqSampling(): noise only inside the interval of the scalar volume
+		if (!_scalars.data.empty())
+		{
+			sampleTrilinear<1>(&_scalars.data[0], _scalars.size, false,
+				pos[0][l], pos[1][l], pos[2][l], &s);
+			if ((s <= _params.scalarMin) || (s >= _params.scalarMax))
+			{
+				out[l] = 0.0f;
+				continue;
+			}
+		}
+		sampleTrilinear<1>(&_noise.data[0], _noise.size, true,
+			pos[0][l] * freqScale, pos[1][l] * freqScale, pos[2][l] * freqScale,
+			&out[l]);
+	}
+}
+
+
+void LICEngine::computePacket(const float pos[3][LIC_PACKET_SIZE], int n, float *out)
+{
+	const float h = _params.stepSizeLIC * LIC_STEP_SCALE;
+	const int numSteps[2] = { _params.stepsBackward, _params.stepsForward };
+	const float kernelStep[2] = { -0.5f / _params.stepsBackward, 0.5f / _params.stepsForward };
+	const float dirSign[2] = { -1.0f, 1.0f };
+	float start[4][LIC_PACKET_SIZE];
+	float step[4][LIC_PACKET_SIZE];
+	float p[3][LIC_PACKET_SIZE];
+	float p2[3][LIC_PACKET_SIZE];
+	float licdir[3][LIC_PACKET_SIZE];
+	float noise[LIC_PACKET_SIZE];
+	float illum[LIC_PACKET_SIZE];
+
+	sampleVectors(pos, start);
+
+	// sample at the start weighted with the kernel at position 0
+	sampleNoise(pos, noise);
+	float weight = sampleKernel(0.5f);
+	for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+		illum[l] = noise[l] * weight;
+
+	// backward and forward streamline
+	for (int d = 0; d < 2; ++d)
+	{
+		const float dir = dirSign[d];
+		float kernelOffset = 0.5f;
+
+		memcpy(p, pos, sizeof(p));
+		memcpy(step, start, sizeof(step));
+
+		for (int i = 0; i < numSteps[d]; ++i)
+		{
+			kernelOffset += kernelStep[d];
+
+			// Heun step, see singleLICstep()
+			for (int c = 0; c < 3; ++c)
+				for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+				{
+					licdir[c][l] = dir * (2.0f * step[c][l] - 1.0f) * h;
+					p2[c][l] = p[c][l] + licdir[c][l];
+				}
+			sampleVectors(p2, step);
+			for (int c = 0; c < 3; ++c)
+				for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+				{
+					float licdir2 = (2.0f * step[c][l] - 1.0f) * dir * h;
+					p[c][l] += 0.5f * (licdir[c][l] + licdir2);
+				}
+			sampleVectors(p, step);
+
+			// the kernel offset is the same for all voxels
+			sampleNoise(p, noise);
+			weight = sampleKernel(kernelOffset);
+			for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+				illum[l] += noise[l] * weight;
+		}
+	}
+
+	// scale LIC intensity like lic3d_volume_fragment.glsl
+	const float intensity = _invFilterArea / (_params.stepsForward + _params.stepsBackward)
+		* _params.gradientScale;
+	for (int l = 0; l < n; ++l)
+		out[l] = illum[l] * intensity;
+}
+
+
+bool LICEngine::computeVolume(float *volume, int width, int height, int depth)
+{
+	double start = timer();
+
+	if (!volume || _vectors.data.empty() || _noise.data.empty() || _kernel.empty())
+	{
+		fprintf(stderr, "LICEngine:  Vector field, noise or filter missing.\n");
+		return false;
+	}
+	if ((_params.stepsForward < 1) || (_params.stepsBackward < 1))
+	{
+		fprintf(stderr, "LICEngine:  At least one LIC step in each direction is needed.\n");
+		return false;
+	}
+
+	// slices close to the boundary of the data cost less, so they are
+	// balanced by stealing
+	ThreadPool::getInstance().parallelForStealing(depth, [&](int z, int)
+	{
+		float pos[3][LIC_PACKET_SIZE];
+		float r = (z + 0.5f) / depth * _scale[2];
+
+		for (int y = 0; y < height; ++y)
+		{
+			float t = (y + 0.5f) / height * _scale[1];
+			float *row = volume + ((size_t)z * height + y) * width;
+
+			for (int x = 0; x < width; x += LIC_PACKET_SIZE)
+			{
+				int n = (width - x < LIC_PACKET_SIZE) ? width - x : LIC_PACKET_SIZE;
+
+				// unused lanes repeat the last voxel
+				for (int l = 0; l < LIC_PACKET_SIZE; ++l)
+				{
+					int xl = x + ((l < n) ? l : n - 1);
+					pos[0][l] = (xl + 0.5f) / width * _scale[0];
+					pos[1][l] = t;
+					pos[2][l] = r;
+				}
+				computePacket(pos, n, row + x);
+			}
+		}
+	});
+
+	_lastTime = timer() - start;
+	fprintf(stdout, "LICEngine:  %dx%dx%d voxels in %.1f ms (%.2f Mvoxels/s)\n",
+		width, height, depth, _lastTime,
+		(double)width * height * depth / (_lastTime * 1000.0));
+
+	return true;
+}
+
+
+// --------------------------------------------------
+
+bool computeLICVolume(std::vector<float> *volume, VectorDataSet *vd, NoiseDataSet *noise,
+	VolumeDataSet *scalar, LICFilter *filter, const LICParams *params, int size)
+{
+	LICEngine engine;
+	VolumeData *vectors = vd->getVolumeData();
+
+	if (!engine.setVectorField(vectors, vectors->data)
+		|| !engine.setNoise(noise->getVolumeData())
+		|| !engine.setScalarField((scalar && scalar->isLoaded()) ? scalar->getVolumeData() : NULL)
+		|| !engine.setFilter(filter))
+		return false;
+	engine.setParams(params);
+
+	volume->resize((size_t)size * size * size);
+	return engine.computeVolume(&(*volume)[0], size, size, size);
+}
+
+
+bool bakeLICVolume(const char *datFileName, VectorDataSet *vd, NoiseDataSet *noise,
+	VolumeDataSet *scalar, LICFilter *filter, const LICParams *params, int size)
+{
+	const int sizes[3] = { size, size, size };
+	const float dists[3] = { 1.0f, 1.0f, 1.0f };
+	std::vector<float> volume;
+	bool ok;
+
+	if (!computeLICVolume(&volume, vd, noise, scalar, filter, params, size))
+		return false;
+
+	ok = DatFile::writeDatFile(datFileName, DATRAW_FLOAT, 1, sizes, dists, &volume[0]);
+	if (ok)
+		fprintf(stdout, "LICEngine:  LIC volume written to \"%s\".\n", datFileName);
+
+	return ok;
+}
@@ -0,0 +1,102 @@
+#ifndef _LICENGINE_H_
+#define _LICENGINE_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "dataset.h"
+#include "types.h"
+
+
+// resolution of the LIC volume computed by Renderer::renderLICVolume()
+#define LIC_VOLUME_SIZE   512
+// neighbouring voxels of a row which are integrated together
+#define LIC_PACKET_SIZE   8
+
+
+// CPU implementation of the volumetric LIC of lic3d_volume_fragment.glsl
+// for machines without a GPU and as a reference for the shader. The
+// textures are sampled like OpenGL does (trilinear, clamp to edge for
+// the data, repeat for the noise), the streamlines are integrated with
+// the same Heun steps and weighted by the same LIC filter kernel.
+//
+// The volume is computed in z-slices distributed by the work stealing
+// scheduler of the ThreadPool, the voxels of a row are integrated in
+// packets of LIC_PACKET_SIZE so the arithmetic runs on all SIMD lanes.
+class LICEngine
+{
+public:
+	LICEngine(void);
+	~LICEngine(void);
+
+	// vector field interpolated between data and next (may be NULL) with
+	// weight t, converted like VectorDataSet::createTextureIterp()
+	bool setVectorField(const VolumeData *vd, const void *data,
+		const void *next = NULL, float t = 0.0f);
+	// scalar noise of a NoiseDataSet
+	bool setNoise(const VolumeData *noise);
+	// the shader integrates the noise only where the secondary scalar
+	// volume lies in (scalarMin, scalarMax), without scalar volume everywhere
+	bool setScalarField(const VolumeData *scalar);
+	bool setFilter(LICFilter *filter);
+	void setParams(const LICParams *params) { _params = *params; }
+
+	// compute the intensity of width x height x depth voxels, stored
+	// x fastest, like the red channel written by the shader
+	// returns false if a texture is missing
+	bool computeVolume(float *volume, int width, int height, int depth);
+
+	// duration of the last computeVolume() in ms
+	double getLastTime(void) { return _lastTime; }
+
+private:
+	// linearly filtered 3D texture of floats
+	struct Texture3D
+	{
+		Texture3D(void) : channels(0), repeat(false)
+		{
+			size[0] = size[1] = size[2] = 0;
+		}
+
+		std::vector<float> data;
+		int size[3];
+		int channels;
+		bool repeat;  // GL_REPEAT, otherwise GL_CLAMP_TO_EDGE
+	};
+
+	// copy the scalar data into a zero padded texture scaled to [0,1]
+	bool createScalarTexture(const VolumeData *vd, Texture3D *tex);
+
+	// sample all lanes of a packet
+	void sampleVectors(const float pos[3][LIC_PACKET_SIZE], float out[4][LIC_PACKET_SIZE]);
+	void sampleNoise(const float pos[3][LIC_PACKET_SIZE], float out[LIC_PACKET_SIZE]);
+	float sampleKernel(float s);
+
+	// integrate a packet starting at pos and write the intensity of the
+	// first n voxels to out
+	void computePacket(const float pos[3][LIC_PACKET_SIZE], int n, float *out);
+
+	Texture3D _vectors;
+	Texture3D _noise;
+	Texture3D _scalars;
+	std::vector<float> _kernel;
+	float _invFilterArea;
+	float _scale[3];
+
+	LICParams _params;
+	double _lastTime;
+};
+
+
+// compute the LIC volume of the data set on the CPU into size^3 floats
+// returns true if successful
+bool computeLICVolume(std::vector<float> *volume, VectorDataSet *vd, NoiseDataSet *noise,
+	VolumeDataSet *scalar, LICFilter *filter, const LICParams *params, int size);
+
+// compute the LIC volume of the data set on the CPU and store it as
+// single channel FLOAT volume in datFileName
+// returns true if successful
+bool bakeLICVolume(const char *datFileName, VectorDataSet *vd, NoiseDataSet *noise,
+	VolumeDataSet *scalar, LICFilter *filter, const LICParams *params, int size);
+
+#endif // _LICENGINE_H_
@@ -0,0 +1,633 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "mmath.h"
+#include "timer.h"
+#include "threadpool.h"
+#include "texsample.h"
+#include "vectorconvert.h"
+#include "imageUtils.h"
+#include "licengine.h"
+#include "licraycast.h"
+
+
+// the LIC intensity is scaled before the opacity lookup of illumLIC()
+#define RAYCAST_OPAC_SCALE   1.3f
+
+
+// index range [lo, hi] of the entries of a 1D texture of size entries
+// contributing to a linear lookup of any coordinate in [s0, s1]
+static inline void texelRange(float s0, float s1, int size, int &lo, int &hi)
+{
+	s0 = (s0 < 0.0f) ? 0.0f : ((s0 > 1.0f) ? 1.0f : s0);
+	s1 = (s1 < 0.0f) ? 0.0f : ((s1 > 1.0f) ? 1.0f : s1);
+
+	lo = (int)floorf(s0 * size - 0.5f);
+	hi = (int)floorf(s1 * size - 0.5f) + 1;
+	lo = (lo < 0) ? 0 : lo;
+	hi = (hi > size - 1) ? size - 1 : hi;
+}
+
+
+LICRaycaster::LICRaycaster(void) : _rangesValid(false), _fovy(35.0f),
+	_maxOpacity(RAYCAST_MAX_OPACITY), _skipEmpty(true), _lastTime(0.0),
+	_numSamples(0), _numSkipped(0)
+{
+	for (int i = 0; i < 3; ++i)
+	{
+		_extent[i] = 1.0f;
+		_scale[i] = 1.0f;
+		_cells[i] = 0;
+	}
+	for (int i = 0; i < 16; ++i)
+		_modelview[i] = (i % 5 == 0) ? 1.0f : 0.0f;
+
+	// the texture of the LIC volume repeats, see VolumeBuffer
+	_lic.repeat = true;
+}
+
+
+LICRaycaster::~LICRaycaster(void)
+{
+}
+
+
+bool LICRaycaster::setLICVolume(const VolumeData *lic)
+{
+	if (!lic || !lic->data || (lic->dataDim != 1)
+		|| ((lic->dataType != DATRAW_UCHAR) && (lic->dataType != DATRAW_FLOAT)))
+	{
+		fprintf(stderr, "LICRaycaster:  Only UCHAR and FLOAT LIC volumes are supported.\n");
+		return false;
+	}
+
+	for (int i = 0; i < 3; ++i)
+		_lic.size[i] = lic->size[i];
+	_lic.channels = 1;
+	_lic.repeat = true;
+	_lic.data.resize((size_t)_lic.size[0] * _lic.size[1] * _lic.size[2]);
+
+	if (lic->dataType == DATRAW_UCHAR)
+	{
+		const unsigned char *p = static_cast<const unsigned char*>(lic->data);
+		ThreadPool::getInstance().parallelFor(_lic.size[1] * _lic.size[2], [&](int begin, int end)
+		{
+			for (size_t i = (size_t)begin * _lic.size[0]; i < (size_t)end * _lic.size[0]; ++i)
+				_lic.data[i] = p[i] / 255.0f;
+		});
+	}
+	else
+	{
+		memcpy(&_lic.data[0], lic->data, _lic.data.size() * sizeof(float));
+	}
+
+	_rangesValid = false;
+	return true;
+}
+
+
+bool LICRaycaster::setVectorField(const VolumeData *vd, const void *data,
+	const void *next, float t)
+{
+	VectorSource src = { data, next, t, vd->dataType };
+
+	if (!data || (vd->dataDim != 3))
+	{
+		fprintf(stderr, "LICRaycaster:  No vector field given.\n");
+		return false;
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		_vectors.size[i] = vd->texSize[i];
+		_extent[i] = vd->extent[i];
+		_scale[i] = vd->scale[i];
+	}
+	_vectors.channels = 4;
+	_vectors.repeat = false;
+	_vectors.data.resize(4 * (size_t)_vectors.size[0] * _vectors.size[1] * _vectors.size[2]);
+
+	// same normalization as the float textures of VectorDataSet
+	convertVectorsFloat(vd, src, computeMaxMagnitude(vd, src), 0.5f, &_vectors.data[0]);
+
+	_rangesValid = false;
+	return true;
+}
+
+
+void LICRaycaster::setTransferFunction(TransferEdit *tf)
+{
+	const unsigned char *data = tf->getTFData();
+	int numEntries = tf->getNumEntries();
+
+	_tfRGBA.resize(4 * numEntries);
+	_tfOpac.resize(numEntries);
+	for (int i = 0; i < numEntries; ++i)
+	{
+		for (int c = 0; c < 4; ++c)
+			_tfRGBA[4 * i + c] = data[5 * i + c] / 255.0f;
+		_tfOpac[i] = data[5 * i + 4] / 255.0f;
+	}
+}
+
+
+void LICRaycaster::setCamera(Camera *cam)
+{
+	Vector3 axis = cam->getAxis();
+	Vector3 pos = cam->getPosition();
+	float angle = cam->getAngle();
+	float len = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+	float c = cosf(angle);
+	float s = sinf(angle);
+	float m[16];
+
+	// glRotatef() of Camera::setCamera()
+	if (len > 0.0f)
+	{
+		float x = axis.x / len, y = axis.y / len, z = axis.z / len;
+
+		m[0] = x * x * (1.0f - c) + c;
+		m[1] = y * x * (1.0f - c) + z * s;
+		m[2] = x * z * (1.0f - c) - y * s;
+		m[4] = x * y * (1.0f - c) - z * s;
+		m[5] = y * y * (1.0f - c) + c;
+		m[6] = y * z * (1.0f - c) + x * s;
+		m[8] = x * z * (1.0f - c) + y * s;
+		m[9] = y * z * (1.0f - c) - x * s;
+		m[10] = z * z * (1.0f - c) + c;
+	}
+	else
+	{
+		m[0] = m[5] = m[10] = 1.0f;
+		m[1] = m[2] = m[4] = m[6] = m[8] = m[9] = 0.0f;
+	}
+	m[3] = m[7] = m[11] = 0.0f;
+	m[15] = 1.0f;
+
+	// translation of the camera and to the volume center
+	for (int r = 0; r < 3; ++r)
+	{
+		m[12 + r] = -(m[r] * 0.5f * _extent[0] + m[4 + r] * 0.5f * _extent[1]
+			+ m[8 + r] * 0.5f * _extent[2]);
+	}
+	m[12] += pos.x;
+	m[13] += pos.y;
+	m[14] += pos.z - cam->getDistance();
+
+	setView(m, cam->getFovy());
+}
+
+
+void LICRaycaster::setView(const float modelview[16], float fovy)
+{
+	memcpy(_modelview, modelview, sizeof(_modelview));
+	_fovy = fovy;
+}
+
+
+void LICRaycaster::updateCellRanges(void)
+{
+	for (int i = 0; i < 3; ++i)
+		_cells[i] = (_lic.size[i] + RAYCAST_CELL_SIZE - 1) / RAYCAST_CELL_SIZE;
+	_cellRange.resize(4 * (size_t)_cells[0] * _cells[1] * _cells[2]);
+	_cellEmpty.assign((size_t)_cells[0] * _cells[1] * _cells[2], 0);
+
+	ThreadPool::getInstance().parallelFor(_cells[1] * _cells[2], [&](int begin, int end)
+	{
+		for (int row = begin; row < end; ++row)
+		{
+			int cy = row % _cells[1];
+			int cz = row / _cells[1];
+
+			for (int cx = 0; cx < _cells[0]; ++cx)
+			{
+				const int cell[3] = { cx, cy, cz };
+				int lo[3], hi[3];
+				float minLIC = FLT_MAX, maxLIC = -FLT_MAX;
+				float minDir = FLT_MAX, maxDir = -FLT_MAX;
+				float *range = &_cellRange[4 * ((size_t)row * _cells[0] + cx)];
+
+				// voxels of the LIC volume reached by the trilinear lookups
+				// of positions inside the cell, wrapped like GL_REPEAT
+				for (int i = 0; i < 3; ++i)
+				{
+					lo[i] = cell[i] * RAYCAST_CELL_SIZE - 1;
+					hi[i] = (cell[i] + 1) * RAYCAST_CELL_SIZE;
+				}
+				for (int z = lo[2]; z <= hi[2]; ++z)
+				{
+					int wz = (z + _lic.size[2]) % _lic.size[2];
+					for (int y = lo[1]; y <= hi[1]; ++y)
+					{
+						int wy = (y + _lic.size[1]) % _lic.size[1];
+						const float *p = &_lic.data[((size_t)wz * _lic.size[1] + wy) * _lic.size[0]];
+						for (int x = lo[0]; x <= hi[0]; ++x)
+						{
+							float v = p[(x + _lic.size[0]) % _lic.size[0]];
+							minLIC = (v < minLIC) ? v : minLIC;
+							maxLIC = (v > maxLIC) ? v : maxLIC;
+						}
+					}
+				}
+
+				// texels of the vector field, its z direction is the
+				// input of the transfer function
+				for (int i = 0; i < 3; ++i)
+				{
+					texelRange((float)cell[i] * RAYCAST_CELL_SIZE / _lic.size[i],
+						(float)(cell[i] + 1) * RAYCAST_CELL_SIZE / _lic.size[i],
+						_vectors.size[i], lo[i], hi[i]);
+				}
+				for (int z = lo[2]; z <= hi[2]; ++z)
+					for (int y = lo[1]; y <= hi[1]; ++y)
+					{
+						const float *p = &_vectors.data[4 * (((size_t)z * _vectors.size[1] + y)
+							* _vectors.size[0])];
+						for (int x = lo[0]; x <= hi[0]; ++x)
+						{
+							float v = p[4 * x + 2];
+							minDir = (v < minDir) ? v : minDir;
+							maxDir = (v > maxDir) ? v : maxDir;
+						}
+					}
+
+				range[0] = minLIC;
+				range[1] = maxLIC;
+				range[2] = minDir;
+				range[3] = maxDir;
+			}
+		}
+	});
+
+	_rangesValid = true;
+}
+
+
+void LICRaycaster::classifyCells(void)
+{
+	const int numEntries = static_cast<int>(_tfOpac.size());
+	std::vector<int> opacCount(numEntries + 1, 0);
+	std::vector<int> alphaCount(numEntries + 1, 0);
+
+	// number of entries with non-zero opacity and alpha below each entry,
+	// a range of entries is transparent if the counts are equal
+	for (int i = 0; i < numEntries; ++i)
+	{
+		opacCount[i + 1] = opacCount[i] + (_tfOpac[i] > 0.0f);
+		alphaCount[i + 1] = alphaCount[i] + (_tfRGBA[4 * i + 3] > 0.0f);
+	}
+
+	ThreadPool::getInstance().parallelFor(static_cast<int>(_cellEmpty.size()), [&](int begin, int end)
+	{
+		for (int c = begin; c < end; ++c)
+		{
+			const float *range = &_cellRange[4 * (size_t)c];
+			int opacLo, opacHi, alphaLo, alphaHi;
+
+			texelRange(range[0] * RAYCAST_OPAC_SCALE, range[1] * RAYCAST_OPAC_SCALE,
+				numEntries, opacLo, opacHi);
+			texelRange(range[2], range[3], numEntries, alphaLo, alphaHi);
+
+			_cellEmpty[c] = (opacCount[opacHi + 1] == opacCount[opacLo])
+				|| (alphaCount[alphaHi + 1] == alphaCount[alphaLo]);
+		}
+	});
+}
+
+
+void LICRaycaster::tracePacket(const int x[RAYCAST_PACKET_SIZE], const int y[RAYCAST_PACKET_SIZE],
+	int width, int height, float rgba[4][RAYCAST_PACKET_SIZE],
+	unsigned long long &numSamples, unsigned long long &numSkipped)
+{
+	const float *m = _modelview;
+	const float tanY = tanf(_fovy * 0.5f * (float)M_PI / 180.0f);
+	const float aspect = (float)width / height;
+	const int maxSteps = _params.numIterations * _params.numIterations;
+	const float alphaCorrection = _params.stepSizeVol * 128.0f;
+	const int numEntries = static_cast<int>(_tfOpac.size());
+	float texMax[3];
+	float start[3][RAYCAST_PACKET_SIZE];
+	float step[3][RAYCAST_PACKET_SIZE];
+	float pos[3][RAYCAST_PACKET_SIZE];
+	float src[4][RAYCAST_PACKET_SIZE];
+	int k[RAYCAST_PACKET_SIZE];
+	bool active[RAYCAST_PACKET_SIZE];
+	bool sample[RAYCAST_PACKET_SIZE];
+	int numActive = 0;
+
+	for (int i = 0; i < 3; ++i)
+		texMax[i] = _extent[i] * _scale[i];
+
+	// camera in object space, the modelview is a rigid transformation
+	float camera[3];
+	for (int i = 0; i < 3; ++i)
+		camera[i] = -(m[4 * i] * m[12] + m[4 * i + 1] * m[13] + m[4 * i + 2] * m[14]);
+
+	for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+	{
+		float eye[3], dir[3];
+		float tNear = 0.0f, tFar = FLT_MAX;
+		float len;
+
+		for (int c = 0; c < 4; ++c)
+			rgba[c][l] = 0.0f;
+		active[l] = false;
+		k[l] = 0;
+
+		// ray through the pixel center, rotated into object space
+		eye[0] = (2.0f * (x[l] + 0.5f) / width - 1.0f) * tanY * aspect;
+		eye[1] = (2.0f * (y[l] + 0.5f) / height - 1.0f) * tanY;
+		eye[2] = -1.0f;
+		for (int i = 0; i < 3; ++i)
+			dir[i] = m[4 * i] * eye[0] + m[4 * i + 1] * eye[1] + m[4 * i + 2] * eye[2];
+		len = sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+		for (int i = 0; i < 3; ++i)
+			dir[i] /= len;
+
+		// the shader starts at the front faces of the bounding box
+		for (int i = 0; i < 3; ++i)
+		{
+			if (fabsf(dir[i]) < 1e-12f)
+			{
+				if ((camera[i] < 0.0f) || (camera[i] > _extent[i]))
+					tNear = FLT_MAX;
+				continue;
+			}
+			float t0 = -camera[i] / dir[i];
+			float t1 = (_extent[i] - camera[i]) / dir[i];
+			if (t0 > t1)
+			{
+				float tmp = t0;
+				t0 = t1;
+				t1 = tmp;
+			}
+			tNear = (t0 > tNear) ? t0 : tNear;
+			tFar = (t1 < tFar) ? t1 : tFar;
+		}
+		if (tNear > tFar)
+			continue;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			start[i][l] = (camera[i] + tNear * dir[i]) * _scale[i];
+			step[i][l] = dir[i] * _scale[i] * _params.stepSizeVol;
+		}
+		active[l] = true;
+		++numActive;
+	}
+
+	while (numActive > 0)
+	{
+		// skip the transparent macro cells, the positions are computed
+		// from the step count so skipping does not move the samples
+		for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+		{
+			sample[l] = false;
+			if (!active[l])
+				continue;
+
+			for (int i = 0; i < 3; ++i)
+				pos[i][l] = start[i][l] + k[l] * step[i][l];
+			sample[l] = true;
+			if (!_skipEmpty)
+				continue;
+
+			// the textures wrap and clamp differently outside of [0,1],
+			// such samples are never skipped
+			int cell[3];
+			bool inside = true;
+			for (int i = 0; i < 3; ++i)
+			{
+				inside = inside && (pos[i][l] >= 0.0f) && (pos[i][l] <= 1.0f);
+				cell[i] = (int)(pos[i][l] * _lic.size[i]) / RAYCAST_CELL_SIZE;
+				cell[i] = (cell[i] > _cells[i] - 1) ? _cells[i] - 1 : cell[i];
+			}
+			if (!inside
+				|| !_cellEmpty[((size_t)cell[2] * _cells[1] + cell[1]) * _cells[0] + cell[0]])
+				continue;
+
+			// first step behind the cell
+			float tExit = FLT_MAX;
+			for (int i = 0; i < 3; ++i)
+			{
+				float bound;
+
+				if (step[i][l] > 0.0f)
+					bound = (float)(cell[i] + 1) * RAYCAST_CELL_SIZE / _lic.size[i];
+				else if (step[i][l] < 0.0f)
+					bound = (float)cell[i] * RAYCAST_CELL_SIZE / _lic.size[i];
+				else
+					continue;
+				float t = (bound - start[i][l]) / step[i][l];
+				tExit = (t < tExit) ? t : tExit;
+			}
+			int next = (tExit < (float)maxSteps) ? (int)floorf(tExit) + 1 : maxSteps;
+			next = (next <= k[l]) ? k[l] + 1 : next;
+
+			numSkipped += next - k[l];
+			k[l] = next;
+			sample[l] = false;
+		}
+
+		// illumLIC() of the samples
+		for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+		{
+			float vectorData[4], tfData[4], opac, illum;
+
+			for (int c = 0; c < 4; ++c)
+				src[c][l] = 0.0f;
+			if (!sample[l])
+				continue;
+
+			sampleTrilinear<4>(&_vectors.data[0], _vectors.size, false,
+				pos[0][l], pos[1][l], pos[2][l], vectorData);
+			sampleTrilinear<1>(&_lic.data[0], _lic.size, true,
+				pos[0][l], pos[1][l], pos[2][l], &illum);
+			sampleLinear<4>(&_tfRGBA[0], numEntries, vectorData[2], tfData);
+			sampleLinear<1>(&_tfOpac[0], numEntries, illum * RAYCAST_OPAC_SCALE, &opac);
+
+			for (int c = 0; c < 3; ++c)
+				src[c][l] = illum * tfData[c] * _params.illumScale;
+			src[3][l] = 1.0f - powf(1.0f - opac * tfData[3], alphaCorrection);
+
+			++k[l];
+			++numSamples;
+		}
+
+		// front to back compositing, skipped lanes add nothing
+		for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+		{
+			float a = src[3][l];
+			float t = 1.0f - rgba[3][l];
+
+			for (int c = 0; c < 3; ++c)
+			{
+				float v = t * src[c][l] * a + rgba[c][l];
+				rgba[c][l] = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
+			}
+			float v = t * a + rgba[3][l];
+			rgba[3][l] = (v < 0.0f) ? 0.0f : ((v > 1.0f) ? 1.0f : v);
+		}
+
+		// terminate rays leaving the volume or reaching the opacity
+		for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+		{
+			if (!active[l])
+				continue;
+
+			bool outside = (rgba[3][l] > _maxOpacity) || (k[l] >= maxSteps);
+			for (int i = 0; i < 3; ++i)
+			{
+				float p = start[i][l] + k[l] * step[i][l];
+				outside = outside || (p < 0.0f) || (p > texMax[i]);
+			}
+			if (outside)
+			{
+				active[l] = false;
+				--numActive;
+			}
+		}
+	}
+}
+
+
+bool LICRaycaster::render(unsigned char *image, int width, int height)
+{
+	ThreadPool &pool = ThreadPool::getInstance();
+	const int tilesX = (width + RAYCAST_TILE_SIZE - 1) / RAYCAST_TILE_SIZE;
+	const int tilesY = (height + RAYCAST_TILE_SIZE - 1) / RAYCAST_TILE_SIZE;
+	std::vector<unsigned long long> samples(pool.getNumThreads(), 0);
+	std::vector<unsigned long long> skipped(pool.getNumThreads(), 0);
+	double start = timer();
+
+	if (!image || _lic.data.empty() || _vectors.data.empty() || _tfOpac.empty())
+	{
+		fprintf(stderr, "LICRaycaster:  LIC volume, vector field or transfer function missing.\n");
+		return false;
+	}
+
+	if (!_rangesValid)
+		updateCellRanges();
+	classifyCells();
+
+	// tiles covering the volume cost more than empty ones, they are
+	// balanced by stealing
+	pool.parallelForStealing(tilesX * tilesY, [&](int tile, int slot)
+	{
+		const int x0 = (tile % tilesX) * RAYCAST_TILE_SIZE;
+		const int y0 = (tile / tilesX) * RAYCAST_TILE_SIZE;
+		int x[RAYCAST_PACKET_SIZE], y[RAYCAST_PACKET_SIZE];
+		float rgba[4][RAYCAST_PACKET_SIZE];
+
+		for (int py = y0; (py < y0 + RAYCAST_TILE_SIZE) && (py < height); py += 2)
+		{
+			for (int px = x0; (px < x0 + RAYCAST_TILE_SIZE) && (px < width);
+				px += RAYCAST_PACKET_WIDTH)
+			{
+				// pixels outside of the image repeat the last one
+				for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+				{
+					x[l] = px + l % RAYCAST_PACKET_WIDTH;
+					y[l] = py + l / RAYCAST_PACKET_WIDTH;
+					x[l] = (x[l] < width) ? x[l] : width - 1;
+					y[l] = (y[l] < height) ? y[l] : height - 1;
+				}
+
+				tracePacket(x, y, width, height, rgba, samples[slot], skipped[slot]);
+
+				for (int l = 0; l < RAYCAST_PACKET_SIZE; ++l)
+				{
+					unsigned char *p = image + 4 * ((size_t)y[l] * width + x[l]);
+					for (int c = 0; c < 4; ++c)
+						p[c] = (unsigned char)(rgba[c][l] * 255.0f + 0.5f);
+				}
+			}
+		}
+	});
+
+	_numSamples = 0;
+	_numSkipped = 0;
+	for (size_t i = 0; i < samples.size(); ++i)
+	{
+		_numSamples += samples[i];
+		_numSkipped += skipped[i];
+	}
+
+	_lastTime = timer() - start;
+	fprintf(stdout, "LICRaycaster:  %dx%d pixels in %.1f ms, %llu samples, "
+		"%llu skipped\n", width, height, _lastTime, _numSamples, _numSkipped);
+
+	return true;
+}
+
+
+// --------------------------------------------------
+
+bool renderLICPreview(const char *pngFileName, const char *licDatFileName,
+	VectorDataSet *vd, NoiseDataSet *noise, VolumeDataSet *scalar, LICFilter *filter,
+	TransferEdit *tf, Camera *cam, const LICParams *params, int width, int height,
+	int licSize)
+{
+	LICRaycaster raycaster;
+	VolumeData *vectors = vd->getVolumeData();
+	std::vector<unsigned char> rgba((size_t)4 * width * height);
+	Image img;
+	bool ok;
+
+	if (!raycaster.setVectorField(vectors, vectors->data))
+		return false;
+
+	if (licDatFileName)
+	{
+		VolumeDataSet lic;
+
+		if (!lic.loadData(licDatFileName) || !raycaster.setLICVolume(lic.getVolumeData()))
+			return false;
+	}
+	else
+	{
+		VolumeData lic;
+		std::vector<float> volume;
+
+		if (!computeLICVolume(&volume, vd, noise, scalar, filter, params, licSize))
+			return false;
+		lic.dataType = DATRAW_FLOAT;
+		lic.size[0] = lic.size[1] = lic.size[2] = licSize;
+		lic.data = &volume[0];
+		ok = raycaster.setLICVolume(&lic);
+		lic.data = NULL;
+		if (!ok)
+			return false;
+	}
+
+	raycaster.setTransferFunction(tf);
+	raycaster.setParams(params);
+	raycaster.setCamera(cam);
+	if (!raycaster.render(&rgba[0], width, height))
+		return false;
+
+	// premultiplied colors over the white background of the window
+	img.width = width;
+	img.height = height;
+	img.channel = 3;
+	img.imgData = new unsigned char[3 * (size_t)width * height];
+	for (size_t i = 0; i < (size_t)width * height; ++i)
+	{
+		for (int c = 0; c < 3; ++c)
+		{
+			int v = rgba[4 * i + c] + 255 - rgba[4 * i + 3];
+			img.imgData[3 * i + c] = (unsigned char)((v > 255) ? 255 : v);
+		}
+	}
+
+	ok = pngWrite(pngFileName, &img, true);
+	delete[] img.imgData;
+	if (ok)
+		fprintf(stdout, "LICRaycaster:  Image written to \"%s\".\n", pngFileName);
+	else
+		fprintf(stderr, "LICRaycaster:  Writing \"%s\" failed.\n", pngFileName);
+
+	return ok;
+}
@@ -0,0 +1,137 @@
+#ifndef _LICRAYCAST_H_
+#define _LICRAYCAST_H_
+
+#include <stddef.h>
+#include <vector>
+
+#include "dataset.h"
+#include "camera.h"
+#include "transferEdit.h"
+#include "types.h"
+
+
+// screen tiles distributed to the threads
+#define RAYCAST_TILE_SIZE      16
+// rays of a packet, a block of RAYCAST_PACKET_WIDTH x 2 pixels
+#define RAYCAST_PACKET_SIZE    8
+#define RAYCAST_PACKET_WIDTH   4
+// edge length of a macro cell in voxels of the LIC volume
+#define RAYCAST_CELL_SIZE      8
+// opacity at which raycast_lic3d_fragment.glsl stops a ray
+#define RAYCAST_MAX_OPACITY    0.95f
+
+
+// CPU implementation of raycast_lic3d_fragment.glsl, renders a LIC
+// volume computed by Renderer::renderLICVolume() or bakeLICVolume()
+// with the transfer function and the compositing of illumLIC() into
+// an RGBA image, e.g. for previews on machines without a GPU.
+//
+// The image is split into tiles distributed by the work stealing
+// scheduler of the ThreadPool, the rays of a tile are traced in packets
+// of RAYCAST_PACKET_SIZE. A ray stops once its opacity reaches the
+// termination opacity. Macro cells of RAYCAST_CELL_SIZE^3 voxels store
+// the range of the LIC intensity and of the transfer function lookup,
+// cells which are transparent for the current transfer function are
+// skipped without sampling.
+class LICRaycaster
+{
+public:
+	LICRaycaster(void);
+	~LICRaycaster(void);
+
+	// LIC intensity in the red channel like the LIC volume texture,
+	// a single channel UCHAR or FLOAT volume
+	bool setLICVolume(const VolumeData *lic);
+	// vector field interpolated between data and next (may be NULL) with
+	// weight t, the bounding box of the volume is taken from vd
+	bool setVectorField(const VolumeData *vd, const void *data,
+		const void *next = NULL, float t = 0.0f);
+	// copy the RGBA and LIC opacity channels of the transfer function
+	void setTransferFunction(TransferEdit *tf);
+	void setParams(const LICParams *params) { _params = *params; }
+
+	// view of the camera like Camera::setCamera() followed by the
+	// translation to the volume center in Renderer::render()
+	void setCamera(Camera *cam);
+	// modelview matrix (column major, rotation and translation only)
+	// and vertical field of view in degrees
+	void setView(const float modelview[16], float fovy);
+
+	// rays stop once their opacity exceeds this value
+	void setTerminationOpacity(float opacity) { _maxOpacity = opacity; }
+	void enableSpaceSkipping(bool enable) { _skipEmpty = enable; }
+
+	// render width x height pixels into image as premultiplied RGBA,
+	// the first row is the bottom one like in the framebuffer
+	// returns false if the LIC volume or the vector field is missing
+	bool render(unsigned char *image, int width, int height);
+
+	// duration of the last render() in ms
+	double getLastTime(void) { return _lastTime; }
+	// samples taken and skipped during the last render()
+	unsigned long long getSampleCount(void) { return _numSamples; }
+	unsigned long long getSkippedCount(void) { return _numSkipped; }
+
+private:
+	// linearly filtered 3D texture of floats
+	struct Texture3D
+	{
+		Texture3D(void) : channels(0), repeat(false)
+		{
+			size[0] = size[1] = size[2] = 0;
+		}
+
+		std::vector<float> data;
+		int size[3];
+		int channels;
+		bool repeat;  // GL_REPEAT, otherwise GL_CLAMP_TO_EDGE
+	};
+
+	// ranges of the macro cells, recomputed when the volumes change
+	void updateCellRanges(void);
+	// mark the cells which are transparent for the transfer function
+	void classifyCells(void);
+
+	// trace the rays of one packet, pixel l is at (x[l], y[l])
+	void tracePacket(const int x[RAYCAST_PACKET_SIZE], const int y[RAYCAST_PACKET_SIZE],
+		int width, int height, float rgba[4][RAYCAST_PACKET_SIZE],
+		unsigned long long &numSamples, unsigned long long &numSkipped);
+
+	Texture3D _lic;
+	Texture3D _vectors;
+	float _extent[3];
+	float _scale[3];
+
+	// RGBA and LIC opacity, 5 channels of TransferEdit scaled to [0,1]
+	std::vector<float> _tfRGBA;
+	std::vector<float> _tfOpac;
+
+	// per macro cell: min/max LIC intensity and transfer function input
+	int _cells[3];
+	std::vector<float> _cellRange;
+	std::vector<unsigned char> _cellEmpty;
+	bool _rangesValid;
+
+	float _modelview[16];
+	float _fovy;
+
+	LICParams _params;
+	float _maxOpacity;
+	bool _skipEmpty;
+
+	double _lastTime;
+	unsigned long long _numSamples;
+	unsigned long long _numSkipped;
+};
+
+
+// render the LIC volume of licDatFileName with the vector field, the
+// transfer function and the camera into a PNG composited over white,
+// without licDatFileName the LIC volume is computed with the LICEngine
+// returns true if successful
+bool renderLICPreview(const char *pngFileName, const char *licDatFileName,
+	VectorDataSet *vd, NoiseDataSet *noise, VolumeDataSet *scalar, LICFilter *filter,
+	TransferEdit *tf, Camera *cam, const LICParams *params, int width, int height,
+	int licSize);
+
+#endif // _LICRAYCAST_H_
@@ -0,0 +1,728 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+
+#include "macrocells.h"
+#include "dataset.h"
+#include "pixelbuffer.h"
+#include "threadpool.h"
+#include "mmath.h"
+#include "types.h"
+
+
+// tolerance of the texture coordinates, covers the 8 bit textures and
+// the precision of the texture filtering
+#define MACROCELL_MARGIN  (2.0f / 255.0f)
+
+
+static inline float toFloat(float v) { return v; }
+static inline float toFloat(unsigned char v) { return v - 128.0f; }
+
+// direction texture coordinate of the z component of a unit vector
+static inline float encodeDirection(float z) { return 0.5f * z + 0.5f; }
+
+
+// add the vectors of the voxels begin to end (exclusive) of a block of
+// dataSize vectors to a range
+template<class S>
+static void accumulateVectors(const S *data, const int dataSize[3],
+	const int begin[3], const int end[3], MacroCellRange &range)
+{
+	for (int z = begin[2]; z < end[2]; ++z)
+	{
+		for (int y = begin[1]; y < end[1]; ++y)
+		{
+			const S *p = data + 3 * (((size_t)z * dataSize[1] + y) * dataSize[0] + begin[0]);
+
+			for (int x = begin[0]; x < end[0]; ++x, p += 3)
+			{
+				float v[3] = { toFloat(p[0]), toFloat(p[1]), toFloat(p[2]) };
+				float len = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+
+				range.lenMin = std::min(range.lenMin, len);
+				range.lenMax = std::max(range.lenMax, len);
+				range.zMin = std::min(range.zMin, v[2]);
+				range.zMax = std::max(range.zMax, v[2]);
+				// zero vectors get the direction zeroDir
+				if (len >= EPS)
+				{
+					range.dirMin = std::min(range.dirMin, v[2] / len);
+					range.dirMax = std::max(range.dirMax, v[2] / len);
+				}
+			}
+		}
+	}
+}
+
+static void accumulateVectors(const void *data, DataType dataType, const int dataSize[3],
+	const int begin[3], const int end[3], MacroCellRange &range)
+{
+	if (dataType == DATRAW_UCHAR)
+		accumulateVectors(static_cast<const unsigned char*>(data), dataSize, begin, end, range);
+	else
+		accumulateVectors(static_cast<const float*>(data), dataSize, begin, end, range);
+}
+
+
+// replace every cell by the union of the cells within radius[i] along
+// axis i, merge(dst, src) adds src to dst
+template<class T, class Merge>
+static void dilateCells(std::vector<T> &cells, const int numCells[3], const int radius[3],
+	Merge merge)
+{
+	const int stride[3] = { 1, numCells[0], numCells[0] * numCells[1] };
+	std::vector<T> src;
+
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		int r = std::min(radius[axis], numCells[axis] - 1);
+		if (r <= 0)
+			continue;
+
+		src = cells;
+		ThreadPool::getInstance().parallelFor(static_cast<int>(cells.size()),
+			[&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+			{
+				int c = (i / stride[axis]) % numCells[axis];
+				int k0 = std::max(0, c - r);
+				int k1 = std::min(numCells[axis] - 1, c + r);
+
+				for (int k = k0; k <= k1; ++k)
+					merge(cells[i], src[i + (k - c) * stride[axis]]);
+			}
+		});
+	}
+}
+
+
+MacroCellGrid::MacroCellGrid(void) : _cellSize(MACROCELL_DEFAULT_SIZE),
+	_blend(MACROCELL_SINGLE), _normalized(false), _zeroDir(0.5f), _level(0),
+	_scalar(NULL), _scalarDirty(false), _licOpacity(0), _reach(-1.0f), _slabLength(0.0f),
+	_rangesDirty(true), _classDirty(true)
+{
+	for (int i = 0; i < 3; ++i)
+		_size[i] = _texSize[i] = _numCells[i] = 0;
+	_timeSteps[0] = _timeSteps[1] = -1;
+	_window[0] = 0.0f;
+	_window[1] = 1.0f;
+}
+
+
+MacroCellGrid::~MacroCellGrid(void)
+{
+	if (_tex.id)
+		glDeleteTextures(1, &_tex.id);
+}
+
+
+bool MacroCellGrid::init(const int size[3], const int texSize[3], int cellSize)
+{
+	if (cellSize < 1)
+		return false;
+
+	_cellSize = cellSize;
+	for (int i = 0; i < 3; ++i)
+	{
+		_size[i] = size[i];
+		_texSize[i] = texSize[i];
+		_numCells[i] = (texSize[i] + cellSize - 1) / cellSize;
+	}
+
+	// cells reaching beyond the data hold zero padding of the texture
+	_padded.assign(getCellCount(), 0);
+	for (int z = 0; z < _numCells[2]; ++z)
+		for (int y = 0; y < _numCells[1]; ++y)
+			for (int x = 0; x < _numCells[0]; ++x)
+			{
+				const int c[3] = { x, y, z };
+				for (int i = 0; i < 3; ++i)
+				{
+					if (std::min((c[i] + 1) * cellSize, _texSize[i]) > _size[i])
+						_padded[getCellIndex(x, y, z)] = 1;
+				}
+			}
+
+	_frames.clear();
+	_timeSteps[0] = _timeSteps[1] = -1;
+	_scalarDirty = true;
+	_flags.assign(2 * (size_t)getCellCount(), 255);
+	_uploaded.clear();
+	_rangesDirty = _classDirty = true;
+
+	return true;
+}
+
+
+void MacroCellGrid::getCellBox(int x, int y, int z, int begin[3], int end[3])
+{
+	const int c[3] = { x, y, z };
+
+	for (int i = 0; i < 3; ++i)
+	{
+		begin[i] = std::min(c[i] * _cellSize, _size[i]);
+		end[i] = std::min((c[i] + 1) * _cellSize, _size[i]);
+	}
+}
+
+
+void MacroCellGrid::setKeyFrames(int timeStep, int nextTimeStep, MacroCellBlend blend,
+	bool normalized, float zeroDir)
+{
+	if (blend == MACROCELL_SINGLE)
+		nextTimeStep = -1;
+
+	if ((timeStep != _timeSteps[0]) || (nextTimeStep != _timeSteps[1])
+		|| (blend != _blend) || (normalized != _normalized) || (zeroDir != _zeroDir))
+	{
+		_timeSteps[0] = timeStep;
+		_timeSteps[1] = nextTimeStep;
+		_blend = blend;
+		_normalized = normalized;
+		_zeroDir = zeroDir;
+		_rangesDirty = true;
+	}
+
+	for (auto it = _frames.begin(); it != _frames.end();)
+	{
+		if ((it->first != timeStep) && (it->first != nextTimeStep))
+			it = _frames.erase(it);
+		else
+			++it;
+	}
+}
+
+
+bool MacroCellGrid::hasTimeStep(int timeStep)
+{
+	auto it = _frames.find(timeStep);
+
+	return (it != _frames.end()) && it->second.complete;
+}
+
+
+void MacroCellGrid::setTimeStep(int timeStep, const VolumeData *vd, const void *data)
+{
+	if (!isInitialized() || !data)
+		return;
+
+	beginTimeStep(timeStep);
+	Frame &frame = _frames[timeStep];
+
+	ThreadPool::getInstance().parallelFor(_numCells[1] * _numCells[2], [&](int begin, int end)
+	{
+		int box[2][3];
+
+		for (int row = begin; row < end; ++row)
+		{
+			for (int x = 0; x < _numCells[0]; ++x)
+			{
+				int index = row * _numCells[0] + x;
+
+				getCellBox(x, row % _numCells[1], row / _numCells[1], box[0], box[1]);
+				accumulateVectors(data, vd->dataType, vd->size, box[0], box[1],
+					frame.cells[index]);
+			}
+		}
+	});
+
+	endTimeStep(timeStep);
+}
+
+
+void MacroCellGrid::beginTimeStep(int timeStep)
+{
+	Frame &frame = _frames[timeStep];
+	MacroCellRange empty = { FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX, FLT_MAX, -FLT_MAX };
+
+	frame.cells.assign(getCellCount(), empty);
+	frame.maxLen = 0.0f;
+	frame.complete = false;
+}
+
+
+void MacroCellGrid::addBrick(int timeStep, const void *data, DataType dataType,
+	const int origin[3], const int extent[3])
+{
+	auto it = _frames.find(timeStep);
+	int first[3], last[3], box[2][3];
+
+	if ((it == _frames.end()) || it->second.cells.empty() || !data)
+		return;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		first[i] = origin[i] / _cellSize;
+		last[i] = (origin[i] + extent[i] - 1) / _cellSize;
+	}
+
+	// the cells lie completely inside the brick
+	for (int z = first[2]; z <= last[2]; ++z)
+		for (int y = first[1]; y <= last[1]; ++y)
+			for (int x = first[0]; x <= last[0]; ++x)
+			{
+				getCellBox(x, y, z, box[0], box[1]);
+				for (int i = 0; i < 3; ++i)
+				{
+					box[0][i] = std::max(box[0][i], origin[i]) - origin[i];
+					box[1][i] = std::min(box[1][i], origin[i] + extent[i]) - origin[i];
+				}
+				accumulateVectors(data, dataType, extent, box[0], box[1],
+					it->second.cells[getCellIndex(x, y, z)]);
+			}
+}
+
+
+void MacroCellGrid::endTimeStep(int timeStep)
+{
+	auto it = _frames.find(timeStep);
+
+	if (it == _frames.end())
+		return;
+
+	Frame &frame = it->second;
+	frame.maxLen = 0.0f;
+	for (size_t i = 0; i < frame.cells.size(); ++i)
+		frame.maxLen = std::max(frame.maxLen, frame.cells[i].lenMax);
+	// same as computeMaxMagnitude()
+	if (frame.maxLen < EPS)
+		frame.maxLen = 0.0f;
+	frame.complete = true;
+
+	if ((timeStep == _timeSteps[0]) || (timeStep == _timeSteps[1]))
+		_rangesDirty = true;
+}
+
+
+void MacroCellGrid::setScalarField(const VolumeData *scalar)
+{
+	_scalar = (scalar && scalar->data) ? scalar : NULL;
+	_scalarDirty = true;
+	_classDirty = true;
+}
+
+
+void MacroCellGrid::computeScalarRanges(void)
+{
+	const VolumeData *scalar = _scalar;
+
+	_scalarDirty = false;
+	if (!scalar)
+	{
+		_scalarMin.clear();
+		_scalarMax.clear();
+		return;
+	}
+
+	_scalarMin.resize(getCellCount());
+	_scalarMax.resize(getCellCount());
+
+	ThreadPool::getInstance().parallelFor(_numCells[1] * _numCells[2], [&](int begin, int end)
+	{
+		int box[2][3];
+
+		for (int row = begin; row < end; ++row)
+		{
+			const int c[3] = { 0, row % _numCells[1], row / _numCells[1] };
+
+			// voxels read by trilinear filtering of the samples in the cell,
+			// the volumes may have different sizes
+			for (int i = 1; i < 3; ++i)
+			{
+				float t0 = (float)(c[i] * _cellSize) / _texSize[i];
+				float t1 = (float)std::min((c[i] + 1) * _cellSize, _texSize[i]) / _texSize[i];
+				box[0][i] = std::max(0, (int)floorf(t0 * scalar->texSize[i] - 0.5f));
+				box[1][i] = std::min(scalar->texSize[i] - 1,
+					(int)floorf(t1 * scalar->texSize[i] - 0.5f) + 1);
+			}
+
+			for (int x = 0; x < _numCells[0]; ++x)
+			{
+				float t0 = (float)(x * _cellSize) / _texSize[0];
+				float t1 = (float)std::min((x + 1) * _cellSize, _texSize[0]) / _texSize[0];
+				float lo = FLT_MAX, hi = -FLT_MAX;
+				bool padding = false;
+
+				box[0][0] = std::max(0, (int)floorf(t0 * scalar->texSize[0] - 0.5f));
+				box[1][0] = std::min(scalar->texSize[0] - 1,
+					(int)floorf(t1 * scalar->texSize[0] - 0.5f) + 1);
+
+				for (int i = 0; i < 3; ++i)
+				{
+					if (box[1][i] >= scalar->size[i])
+						padding = true;
+				}
+				for (int vz = box[0][2]; vz <= std::min(box[1][2], scalar->size[2] - 1); ++vz)
+					for (int vy = box[0][1]; vy <= std::min(box[1][1], scalar->size[1] - 1); ++vy)
+					{
+						size_t adr = ((size_t)vz * scalar->size[1] + vy) * scalar->size[0];
+						for (int vx = box[0][0]; vx <= std::min(box[1][0], scalar->size[0] - 1); ++vx)
+						{
+							float s = (scalar->dataType == DATRAW_UCHAR)
+								? static_cast<const unsigned char*>(scalar->data)[adr + vx] / 255.0f
+								: static_cast<const float*>(scalar->data)[adr + vx];
+							lo = std::min(lo, s);
+							hi = std::max(hi, s);
+						}
+					}
+				if (padding)
+				{
+					lo = std::min(lo, 0.0f);
+					hi = std::max(hi, 0.0f);
+				}
+				// 8 bit textures clamp float data to [0,1]
+				lo = std::min(lo, std::max(0.0f, std::min(lo, 1.0f)));
+				hi = std::max(hi, std::max(0.0f, std::min(hi, 1.0f)));
+
+				_scalarMin[row * _numCells[0] + x] = lo;
+				_scalarMax[row * _numCells[0] + x] = hi;
+			}
+		}
+	});
+}
+
+
+void MacroCellGrid::setTransferFunction(const unsigned char *tfData, int numEntries,
+	int texWidth)
+{
+	bool changed;
+
+	if (!tfData || (numEntries < 1))
+		return;
+	texWidth = std::max(texWidth, numEntries);
+
+	changed = (_tfAlpha.size() != (size_t)texWidth) || (_licOpacity != tfData[4]);
+	_tfAlpha.resize(texWidth, 0);
+	for (int i = 0; i < numEntries; ++i)
+	{
+		if (_tfAlpha[i] != tfData[5 * i + 3])
+		{
+			_tfAlpha[i] = tfData[5 * i + 3];
+			changed = true;
+		}
+	}
+	if (!changed)
+		return;
+
+	// LIC opacity of an intensity of zero, freqSampling() outside the
+	// scalar window
+	_licOpacity = tfData[4];
+	_opaqueCount.resize(texWidth + 1);
+	_opaqueCount[0] = 0;
+	for (int i = 0; i < texWidth; ++i)
+		_opaqueCount[i + 1] = _opaqueCount[i] + ((_tfAlpha[i] > 0) ? 1 : 0);
+	_classDirty = true;
+}
+
+
+void MacroCellGrid::setScalarWindow(float lo, float hi)
+{
+	if ((lo != _window[0]) || (hi != _window[1]))
+	{
+		_window[0] = lo;
+		_window[1] = hi;
+		_classDirty = true;
+	}
+}
+
+
+void MacroCellGrid::setLICReach(float reach)
+{
+	if (reach != _reach)
+	{
+		_reach = reach;
+		_classDirty = true;
+	}
+}
+
+
+void MacroCellGrid::setSlabLength(float length)
+{
+	if (length != _slabLength)
+	{
+		_slabLength = length;
+		_rangesDirty = true;
+	}
+}
+
+
+void MacroCellGrid::setLevel(int level)
+{
+	if (level != _level)
+	{
+		_level = level;
+		_rangesDirty = true;
+	}
+}
+
+
+void MacroCellGrid::computeTextureRanges(void)
+{
+	const int count = getCellCount();
+	int radius[3];
+	std::vector<MacroCellRange> cells[2];
+	float scale[2] = { 1.0f, 1.0f };
+	int numFrames = 0;
+	// interpolated directions are normalized again, the coarser levels
+	// average the vectors of a cell
+	bool convex = (_blend != MACROCELL_SINGLE) || (_level > 0);
+	// samples of coarser levels may read beyond the neighboring cells
+	bool known = ((2 << _level) <= _cellSize);
+
+	for (int f = 0; known && (f < 2); ++f)
+	{
+		if (_timeSteps[f] < 0)
+			continue;
+		if (!hasTimeStep(_timeSteps[f]))
+		{
+			known = false;
+			break;
+		}
+		Frame &frame = _frames[_timeSteps[f]];
+		cells[numFrames] = frame.cells;
+		if (_normalized && (frame.maxLen > 0.0f))
+			scale[numFrames] = 1.0f / frame.maxLen;
+		++numFrames;
+	}
+	if (numFrames == 0)
+		known = false;
+
+	_magRange.resize(2 * (size_t)count);
+	_dirRange.resize(2 * (size_t)count);
+
+	if (!known)
+	{
+		for (int i = 0; i < count; ++i)
+		{
+			_magRange[2 * i] = 0.0f;
+			_magRange[2 * i + 1] = FLT_MAX;
+			_dirRange[2 * i] = 0.0f;
+			_dirRange[2 * i + 1] = 1.0f;
+		}
+		return;
+	}
+
+	// trilinear filtering reads the neighboring cells, a pre-integrated
+	// sample also the ones of the previous sample
+	for (int i = 0; i < 3; ++i)
+		radius[i] = 1 + static_cast<int>(ceilf(_slabLength * _texSize[i] / _cellSize));
+	for (int f = 0; f < numFrames; ++f)
+	{
+		dilateCells(cells[f], _numCells, radius, [](MacroCellRange &dst, const MacroCellRange &src)
+		{
+			dst.lenMin = std::min(dst.lenMin, src.lenMin);
+			dst.lenMax = std::max(dst.lenMax, src.lenMax);
+			dst.zMin = std::min(dst.zMin, src.zMin);
+			dst.zMax = std::max(dst.zMax, src.zMax);
+			dst.dirMin = std::min(dst.dirMin, src.dirMin);
+			dst.dirMax = std::max(dst.dirMax, src.dirMax);
+		});
+	}
+	std::vector<unsigned char> padded = _padded;
+	dilateCells(padded, _numCells, radius, [](unsigned char &dst, unsigned char src)
+	{
+		dst |= src;
+	});
+
+	ThreadPool::getInstance().parallelFor(count, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			float magLo = FLT_MAX, magHi = -FLT_MAX;
+			float dirLo = FLT_MAX, dirHi = -FLT_MAX;
+			float zLo = FLT_MAX, zHi = -FLT_MAX, lenMax = 0.0f;
+			bool hasData = false;
+
+			for (int f = 0; f < numFrames; ++f)
+			{
+				const MacroCellRange &r = cells[f][i];
+				// the blended key frames are scaled on their own, the
+				// interpolated field only afterwards
+				float s = (_blend == MACROCELL_SHADER) ? scale[f] : 1.0f;
+
+				if (r.lenMax < 0.0f)
+					continue;
+				hasData = true;
+				magLo = std::min(magLo, r.lenMin * scale[f]);
+				magHi = std::max(magHi, r.lenMax * scale[f]);
+				zLo = std::min(zLo, r.zMin * s);
+				zHi = std::max(zHi, r.zMax * s);
+				lenMax = std::max(lenMax, r.lenMax * s);
+				dirLo = std::min(dirLo, encodeDirection(r.dirMin));
+				dirHi = std::max(dirHi, encodeDirection(r.dirMax));
+				if (r.lenMin < EPS)
+				{
+					dirLo = std::min(dirLo, _zeroDir);
+					dirHi = std::max(dirHi, _zeroDir);
+				}
+			}
+
+			if (hasData && (_blend == MACROCELL_LERP))
+			{
+				// normalized by the maximum of the interpolated field
+				magLo = 0.0f;
+				if (_normalized)
+					magHi = 1.0f;
+			}
+			// the direction of a sum of vectors: z / |v| is at least
+			// zLo / lenMax if all z are positive
+			if (hasData && convex)
+			{
+				dirLo = (zLo > EPS) ? encodeDirection(zLo / lenMax) : 0.0f;
+				dirHi = (zHi < -EPS) ? encodeDirection(zHi / lenMax) : 1.0f;
+			}
+			// zero padding of the texture
+			if (padded[i])
+			{
+				magLo = std::min(magLo, 0.0f);
+				magHi = std::max(magHi, 0.0f);
+				dirLo = std::min(dirLo, 0.0f);
+				dirHi = std::max(dirHi, 0.0f);
+			}
+
+			_magRange[2 * i] = magLo;
+			_magRange[2 * i + 1] = magHi;
+			_dirRange[2 * i] = dirLo;
+			_dirRange[2 * i + 1] = dirHi;
+		}
+	});
+}
+
+
+bool MacroCellGrid::isOpaque(float lo, float hi)
+{
+	const int width = static_cast<int>(_tfAlpha.size());
+
+	if (_opaqueCount.empty())
+		return true;
+	if (hi < lo)
+		return false;
+
+	// coordinates are clamped to the edge, linear filtering reads the
+	// neighboring texel
+	lo = std::max(0.0f, std::min(lo - MACROCELL_MARGIN, 1.0f));
+	hi = std::max(0.0f, std::min(hi + MACROCELL_MARGIN, 1.0f));
+	int first = std::max(0, (int)floorf(lo * width - 0.5f));
+	int last = std::min(width - 1, (int)floorf(hi * width - 0.5f) + 1);
+
+	return _opaqueCount[last + 1] > _opaqueCount[first];
+}
+
+
+void MacroCellGrid::classify(void)
+{
+	const int count = getCellCount();
+	std::vector<unsigned char> window;
+	bool useWindow;
+
+	if (_rangesDirty)
+	{
+		computeTextureRanges();
+		_rangesDirty = false;
+	}
+	if (_scalarDirty)
+		computeScalarRanges();
+	useWindow = !_scalarMin.empty() && (_reach >= 0.0f) && (_licOpacity == 0);
+
+	// cells from which the LIC may gather noise inside the scalar window
+	if (useWindow)
+	{
+		int radius[3];
+
+		window.resize(count);
+		for (int i = 0; i < count; ++i)
+			window[i] = ((_scalarMax[i] > _window[0] - MACROCELL_MARGIN)
+				&& (_scalarMin[i] < _window[1] + MACROCELL_MARGIN)) ? 1 : 0;
+		for (int i = 0; i < 3; ++i)
+			radius[i] = static_cast<int>(ceilf(_reach * _texSize[i] / _cellSize));
+		dilateCells(window, _numCells, radius, [](unsigned char &dst, unsigned char src)
+		{
+			dst |= src;
+		});
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		_flags[2 * i] = isOpaque(_magRange[2 * i], _magRange[2 * i + 1]) ? 255 : 0;
+		_flags[2 * i + 1] = (isOpaque(_dirRange[2 * i], _dirRange[2 * i + 1])
+			&& (!useWindow || window[i])) ? 255 : 0;
+	}
+}
+
+
+bool MacroCellGrid::update(void)
+{
+	GLuint texId;
+	size_t sliceSize = 2 * (size_t)_numCells[0] * _numCells[1];
+	int first = 0, last = _numCells[2] - 1;
+
+	if (!isInitialized())
+		return false;
+	if (!_rangesDirty && !_classDirty && !_uploaded.empty())
+		return false;
+
+	classify();
+	_classDirty = false;
+
+	if (!_tex.id || (_tex.width != _numCells[0]) || (_tex.height != _numCells[1])
+		|| (_tex.depth != _numCells[2]))
+	{
+		if (_tex.id)
+			glDeleteTextures(1, &_tex.id);
+		glGenTextures(1, &texId);
+		_tex.setTex(GL_TEXTURE_3D, texId, "MacroCell_Tex");
+		_tex.bind();
+		PixelBufferRing::createStorage3D(&_tex, GL_RG8, _numCells[0], _numCells[1],
+			_numCells[2]);
+
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		_uploaded.clear();
+	}
+
+	// only the slices of cells which changed are uploaded
+	if (!_uploaded.empty())
+	{
+		while ((first <= last)
+			&& (memcmp(&_flags[first * sliceSize], &_uploaded[first * sliceSize], sliceSize) == 0))
+			++first;
+		while ((last >= first)
+			&& (memcmp(&_flags[last * sliceSize], &_uploaded[last * sliceSize], sliceSize) == 0))
+			--last;
+		if (first > last)
+			return false;
+	}
+
+	_tex.bind();
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, first, _numCells[0], _numCells[1],
+		last - first + 1, GL_RG, GL_UNSIGNED_BYTE, &_flags[first * sliceSize]);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	CHECK_FOR_OGL_ERROR();
+
+	_uploaded = _flags;
+	return true;
+}
+
+
+float MacroCellGrid::getVisibleFraction(int channel)
+{
+	int count = getCellCount();
+	int visible = 0;
+
+	if (count == 0)
+		return 1.0f;
+	for (int i = 0; i < count; ++i)
+	{
+		if (_flags[2 * i + channel])
+			++visible;
+	}
+
+	return (float)visible / count;
+}
@@ -0,0 +1,183 @@
+#ifndef _MACROCELLS_H_
+#define _MACROCELLS_H_
+
+#include <map>
+#include <vector>
+
+#include "texture.h"
+#include "reader.h"
+
+
+#define MACROCELL_DEFAULT_SIZE  8
+
+struct VolumeData;
+
+
+// vector statistics of a macro cell in units of the data set
+struct MacroCellRange
+{
+	float lenMin, lenMax;
+	// z component of the vectors
+	float zMin, zMax;
+	// z component of the normalized non-zero vectors
+	float dirMin, dirMax;
+};
+
+
+// how the vector texture sampled by the shaders is built from the key
+// frames, decides which texture values the statistics of a cell allow
+enum MacroCellBlend
+{
+	// one time step converted on its own
+	MACROCELL_SINGLE,
+	// two key frames normalized on their own and blended in the shader
+	// (TIME_DEPENDENT)
+	MACROCELL_SHADER,
+	// interpolated on the CPU and normalized afterwards
+	MACROCELL_LERP
+};
+
+
+// Macro cells for empty space skipping in the raycasters. The texture of
+// the vector field is split into cells of cellSize^3 voxels. For every
+// cell the range of the magnitudes and directions of the key frames and
+// of the secondary scalar volume is kept; these statistics are only
+// computed again when the key frames change. Whenever the transfer
+// function, the scalar window of the LIC or the statistics change the
+// cells are classified again and a small 3D texture (GL_RG8, one texel
+// per cell) marks the cells in which a sample may become visible:
+//   r  vectorfield_fragment.glsl, transfer function of the magnitude
+//   g  the LIC raycasters, transfer function of the z direction times
+//      the scalar window of freqSampling() within the reach of the LIC
+// The classification is conservative, trilinear filtering and the
+// coarser levels of the vector texture are taken into account, so
+// skipping the empty cells does not change the image.
+class MacroCellGrid
+{
+public:
+	MacroCellGrid(void);
+	~MacroCellGrid(void);
+
+	// cells covering a texture of texSize voxels holding size voxels of
+	// data, previous statistics are dropped
+	bool init(const int size[3], const int texSize[3], int cellSize = MACROCELL_DEFAULT_SIZE);
+	bool isInitialized(void) { return !_padded.empty(); }
+	int getCellSize(void) { return _cellSize; }
+	const int* getNumCells(void) { return _numCells; }
+	int getCellCount(void) { return _numCells[0] * _numCells[1] * _numCells[2]; }
+
+	// time steps in the vector texture, the statistics of other time
+	// steps are dropped
+	// normalized is set if the magnitudes are divided by the maximum of
+	// the time step, zeroDir is stored for the direction of zero vectors
+	void setKeyFrames(int timeStep, int nextTimeStep, MacroCellBlend blend,
+		bool normalized, float zeroDir);
+	bool hasTimeStep(int timeStep);
+	// statistics of a complete time step with the layout of vd
+	void setTimeStep(int timeStep, const VolumeData *vd, const void *data);
+	// statistics of a time step brick by brick, origin has to be a
+	// multiple of the cell size
+	// addBrick() may be called by several threads for different bricks
+	void beginTimeStep(int timeStep);
+	void addBrick(int timeStep, const void *data, DataType dataType,
+		const int origin[3], const int extent[3]);
+	void endTimeStep(int timeStep);
+
+	// secondary scalar volume sampled by freqSampling(), NULL if there is
+	// none and the scalar window can not be used
+	// the data has to stay valid, its ranges are computed by update()
+	void setScalarField(const VolumeData *scalar);
+
+	// alpha channel of the transfer function (tfData of TransferEdit,
+	// numEntries entries in a texture of texWidth texels), only a changed
+	// function leads to a new classification
+	void setTransferFunction(const unsigned char *tfData, int numEntries,
+		int texWidth);
+	// the noise is integrated where the scalar volume lies in (lo, hi)
+	void setScalarWindow(float lo, float hi);
+	// distance in texture coordinates from which the LIC may gather noise,
+	// negative if the scalar window can not be used
+	void setLICReach(float reach);
+	// distance in texture coordinates to the previous sample which the
+	// pre-integrated transfer function reads, 0 without pre-integration
+	void setSlabLength(float length);
+	// mipmap level sampled by the shaders
+	void setLevel(int level);
+
+	// classify the cells again if anything changed and upload the
+	// changed slices of the texture, returns true if the texture changed
+	// needs a current OpenGL context
+	bool update(void);
+
+	Texture* getTextureRef(void) { return &_tex; }
+	void setTexUnit(GLuint texUnit) { _tex.texUnit = texUnit; }
+	// fraction of the cells marked in channel 0 (r) or 1 (g)
+	float getVisibleFraction(int channel);
+
+private:
+	MacroCellGrid(const MacroCellGrid&);
+	MacroCellGrid& operator=(const MacroCellGrid&);
+
+	struct Frame
+	{
+		Frame(void) : maxLen(0.0f), complete(false) {}
+
+		std::vector<MacroCellRange> cells;
+		float maxLen;
+		bool complete;
+	};
+
+	int getCellIndex(int x, int y, int z)
+	{
+		return (z * _numCells[1] + y) * _numCells[0] + x;
+	}
+	// voxels of a cell clipped to the data
+	void getCellBox(int x, int y, int z, int begin[3], int end[3]);
+	// extended range of the scalar volume in every cell
+	void computeScalarRanges(void);
+	// texture values of the vector field the shaders may see in each cell
+	void computeTextureRanges(void);
+	// transfer function entries read for the coordinates [lo, hi]
+	bool isOpaque(float lo, float hi);
+	void classify(void);
+
+	int _size[3];
+	int _texSize[3];
+	int _cellSize;
+	int _numCells[3];
+	// cells which contain padding of the texture
+	std::vector<unsigned char> _padded;
+
+	std::map<int, Frame> _frames;
+	int _timeSteps[2];
+	MacroCellBlend _blend;
+	bool _normalized;
+	float _zeroDir;
+	int _level;
+
+	const VolumeData *_scalar;
+	bool _scalarDirty;
+	// range of the scalar volume read by the samples of every cell
+	std::vector<float> _scalarMin;
+	std::vector<float> _scalarMax;
+
+	// range of the magnitude and direction texture coordinates per cell
+	std::vector<float> _magRange;
+	std::vector<float> _dirRange;
+
+	// number of entries with alpha > 0 before every texel
+	std::vector<int> _opaqueCount;
+	std::vector<unsigned char> _tfAlpha;
+	unsigned char _licOpacity;
+	float _window[2];
+	float _reach;
+	float _slabLength;
+
+	bool _rangesDirty;
+	bool _classDirty;
+	std::vector<unsigned char> _flags;
+	std::vector<unsigned char> _uploaded;
+	Texture _tex;
+};
+
+#endif // _MACROCELLS_H_
@@ -0,0 +1,349 @@
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+
+#include "timer.h"
+#include "prefetch.h"
+#include "bufferarena.h"
+#include "preproccache.h"
+#include "vectorconvert.h"
+#include "manifest.h"
+
+
+#define MANIFEST_VERSION         1
+// time steps read ahead while the manifest is written
+#define MANIFEST_PREFETCH_DEPTH  2
+#define MANIFEST_LINE_LEN        8192
+
+
+static const char* getDataTypeName(DataType dataType)
+{
+	switch (dataType)
+	{
+	case DATRAW_UCHAR:
+		return "UCHAR";
+	case DATRAW_USHORT:
+		return "USHORT";
+	case DATRAW_FLOAT:
+		return "FLOAT";
+	default:
+		return "NONE";
+	}
+}
+
+
+static DataType getDataTypeByName(const char *name)
+{
+	if (strcmp(name, "UCHAR") == 0)
+		return DATRAW_UCHAR;
+	if (strcmp(name, "USHORT") == 0)
+		return DATRAW_USHORT;
+	if (strcmp(name, "FLOAT") == 0)
+		return DATRAW_FLOAT;
+	return DATRAW_NONE;
+}
+
+
+// remove the line break at the end of line
+static void chomp(char *line)
+{
+	size_t len = strlen(line);
+
+	while ((len > 0) && ((line[len - 1] == '\n') || (line[len - 1] == '\r')))
+		line[--len] = '\0';
+}
+
+
+TimeSeriesManifest::TimeSeriesManifest(void) : _dataType(DATRAW_NONE),
+	_dataDim(0), _timeStepBeg(0), _minMagnitude(0.0f), _maxMagnitude(0.0f),
+	_meanMagnitude(0.0f)
+{
+	_sizes[0] = _sizes[1] = _sizes[2] = 0;
+}
+
+
+TimeSeriesManifest::~TimeSeriesManifest(void)
+{
+}
+
+
+std::string TimeSeriesManifest::getFileName(const char *datFileName)
+{
+	return std::string(datFileName) + MANIFEST_EXT;
+}
+
+
+bool TimeSeriesManifest::load(const char *fileName)
+{
+	std::vector<char> buffer(MANIFEST_LINE_LEN);
+	char *line = &buffer[0];
+	char name[16];
+	int version = 0;
+	int timeStepEnd = -1;
+	int numSteps;
+	FILE *fp;
+
+	_steps.clear();
+
+	if (!(fp = fopen(fileName, "rb")))
+		return false;
+
+	// header, terminated by the first time step
+	while (fgets(line, MANIFEST_LINE_LEN, fp))
+	{
+		if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+			continue;
+		if (strncmp(line, "Step:", 5) == 0)
+			break;
+
+		if (sscanf(line, "Version: %d", &version) == 1)
+			continue;
+		if (sscanf(line, "Format: %15s %d", name, &_dataDim) == 2)
+			_dataType = getDataTypeByName(name);
+		else if (sscanf(line, "Resolution: %d %d %d", &_sizes[0], &_sizes[1], &_sizes[2]) == 3)
+			;
+		else if (sscanf(line, "TimeDependent: %d %d", &_timeStepBeg, &timeStepEnd) == 2)
+			;
+		else if (sscanf(line, "Magnitude: %f %f %f", &_minMagnitude, &_maxMagnitude,
+				&_meanMagnitude) == 3)
+			;
+		else
+		{
+			fprintf(stderr, "TimeSeriesManifest:  Skipping line %s", line);
+		}
+	}
+
+	if ((version != MANIFEST_VERSION) || (_dataType == DATRAW_NONE)
+		|| (timeStepEnd < _timeStepBeg))
+	{
+		fprintf(stderr, "TimeSeriesManifest:  Invalid header in \"%s\".\n", fileName);
+		fclose(fp);
+		return false;
+	}
+
+	// one "Step:" line with its "Histogram:" line per time step
+	numSteps = timeStepEnd - _timeStepBeg + 1;
+	_steps.resize(numSteps);
+	for (int i = 0; i < numSteps; ++i)
+	{
+		TimeStepInfo &info = _steps[i];
+		unsigned long long size, checksum;
+		int t, offset = 0;
+		char *cp;
+
+		if ((i > 0) && !fgets(line, MANIFEST_LINE_LEN, fp))
+			break;
+		chomp(line);
+		if ((sscanf(line, "Step: %d %llu %llx %f %f %f %n", &t, &size, &checksum,
+				&info.minMagnitude, &info.maxMagnitude, &info.meanMagnitude, &offset) < 6)
+			|| (offset == 0) || (t != _timeStepBeg + i))
+			break;
+		info.size = size;
+		info.checksum = checksum;
+		info.path = line + offset;
+
+		if (!fgets(line, MANIFEST_LINE_LEN, fp) || (strncmp(line, "Histogram:", 10) != 0))
+			break;
+		cp = line + 10;
+		for (int b = 0; b < MANIFEST_HIST_BINS; ++b)
+		{
+			if (sscanf(cp, "%d%n", &info.histogram[b], &offset) != 1)
+			{
+				cp = NULL;
+				break;
+			}
+			cp += offset;
+		}
+		if (!cp)
+			break;
+
+		if (i == numSteps - 1)
+		{
+			fclose(fp);
+			return true;
+		}
+	}
+
+	fprintf(stderr, "TimeSeriesManifest:  \"%s\" is damaged.\n", fileName);
+	fclose(fp);
+	_steps.clear();
+	return false;
+}
+
+
+bool TimeSeriesManifest::save(const char *fileName)
+{
+	FILE *fp;
+	bool ok;
+
+	if (!(fp = fopen(fileName, "wb")))
+	{
+		fprintf(stderr, "TimeSeriesManifest:  Could not create \"%s\".\n", fileName);
+		return false;
+	}
+
+	fprintf(fp, "# time series manifest, written by VectorVisualization --manifest\n");
+	fprintf(fp, "Version: %d\n", MANIFEST_VERSION);
+	fprintf(fp, "Format: %s %d\n", getDataTypeName(_dataType), _dataDim);
+	fprintf(fp, "Resolution: %d %d %d\n", _sizes[0], _sizes[1], _sizes[2]);
+	fprintf(fp, "TimeDependent: %d %d\n", _timeStepBeg,
+		_timeStepBeg + getNumTimeSteps() - 1);
+	fprintf(fp, "Magnitude: %.9g %.9g %.9g\n", _minMagnitude, _maxMagnitude,
+		_meanMagnitude);
+
+	// Step: <t> <bytes> <checksum> <min> <max> <mean> <RAW file>
+	for (size_t i = 0; i < _steps.size(); ++i)
+	{
+		const TimeStepInfo &info = _steps[i];
+
+		fprintf(fp, "Step: %d %llu %016llx %.9g %.9g %.9g %s\n",
+			_timeStepBeg + (int)i, (unsigned long long)info.size,
+			(unsigned long long)info.checksum, info.minMagnitude,
+			info.maxMagnitude, info.meanMagnitude, info.path.c_str());
+		fprintf(fp, "Histogram:");
+		for (int b = 0; b < MANIFEST_HIST_BINS; ++b)
+			fprintf(fp, " %d", info.histogram[b]);
+		fprintf(fp, "\n");
+	}
+
+	ok = !ferror(fp);
+	ok = (fclose(fp) == 0) && ok;
+	if (!ok)
+		fprintf(stderr, "TimeSeriesManifest:  Writing \"%s\" failed.\n", fileName);
+
+	return ok;
+}
+
+
+bool TimeSeriesManifest::matches(DataType dataType, int dataDim, const int sizes[3],
+	int timeStepBeg, int timeStepEnd)
+{
+	return (dataType == _dataType) && (dataDim == _dataDim)
+		&& (sizes[0] == _sizes[0]) && (sizes[1] == _sizes[1])
+		&& (sizes[2] == _sizes[2]) && (timeStepBeg == _timeStepBeg)
+		&& (timeStepEnd - timeStepBeg + 1 == getNumTimeSteps());
+}
+
+
+const TimeStepInfo* TimeSeriesManifest::getTimeStep(int timeStep) const
+{
+	if ((timeStep < _timeStepBeg) || (timeStep >= _timeStepBeg + getNumTimeSteps()))
+		return NULL;
+	return &_steps[timeStep - _timeStepBeg];
+}
+
+
+void TimeSeriesManifest::updateGlobalStatistics(void)
+{
+	double sum = 0.0;
+
+	_minMagnitude = _steps.empty() ? 0.0f : FLT_MAX;
+	_maxMagnitude = 0.0f;
+	for (size_t i = 0; i < _steps.size(); ++i)
+	{
+		if (_steps[i].minMagnitude < _minMagnitude)
+			_minMagnitude = _steps[i].minMagnitude;
+		if (_steps[i].maxMagnitude > _maxMagnitude)
+			_maxMagnitude = _steps[i].maxMagnitude;
+		sum += _steps[i].meanMagnitude;
+	}
+	// all time steps have the same number of voxels
+	_meanMagnitude = _steps.empty() ? 0.0f : static_cast<float>(sum / _steps.size());
+}
+
+
+// --------------------------------------------------
+
+bool writeManifest(const char *datFileName)
+{
+	DatFile datFile;
+	TimeSeriesManifest manifest;
+	TimeStepPrefetcher prefetcher;
+	BufferArena arena;
+	VolumeData vd;
+	VectorSource src;
+	std::vector<char> name(datFileName, datFileName + strlen(datFileName) + 1);
+	std::string manifestName;
+	char rawFileName[255];
+	size_t rawDirLen;
+	double start = timer();
+	bool ok = true;
+
+	// the DAT file is checked completely, without any existing manifest
+	if (!datFile.parseDatFile(&name[0], false))
+		return false;
+	if ((datFile.getDataDimension() != 3) || (datFile.getDataType() == DATRAW_USHORT))
+	{
+		fprintf(stderr, "writeManifest:  Only UCHAR and FLOAT vector fields "
+			"are supported.\n");
+		return false;
+	}
+
+	manifest._dataType = datFile.getDataType();
+	manifest._dataDim = datFile.getDataDimension();
+	manifest._timeStepBeg = datFile.getTimeStepBegin();
+	for (int i = 0; i < 3; ++i)
+		manifest._sizes[i] = vd.size[i] = datFile.getDataSizes()[i];
+	manifest._steps.resize(datFile.getTimeStepEnd() - datFile.getTimeStepBegin() + 1);
+
+	vd.dataDim = 3;
+	vd.dataType = datFile.getDataType();
+	src.next = NULL;
+	src.t = 0.0f;
+	src.dataType = vd.dataType;
+
+	rawDirLen = strlen(datFile.getRawDirectory());
+	prefetcher.start(&datFile, manifest._timeStepBeg, MANIFEST_PREFETCH_DEPTH,
+		false, &arena);
+
+	for (int i = 0; ok && (i < manifest.getNumTimeSteps()); ++i)
+	{
+		TimeStepInfo &info = manifest._steps[i];
+		int t = manifest._timeStepBeg + i;
+		void *data = NULL;
+		MappedRawData map;
+
+		if (!prefetcher.pop(t, data, map))
+		{
+			ok = false;
+			break;
+		}
+
+		// store the name like it is given in the DAT file
+		datFile.getRawFileName(t, rawFileName, sizeof(rawFileName));
+		info.path = rawFileName + rawDirLen;
+		ok = DatFile::getFileSize(rawFileName, &info.size);
+
+		info.checksum = hashContent(data, datFile.getRawDataSize(), 0);
+		src.data = data;
+		info.maxMagnitude = computeMaxMagnitude(&vd, src);
+		computeMagnitudeStats(&vd, src, info.maxMagnitude, &info.minMagnitude,
+			&info.meanMagnitude, info.histogram, MANIFEST_HIST_BINS);
+		arena.release(data);
+
+		fprintf(stdout, "\rwriteManifest:  time step %d of %d", i + 1,
+			manifest.getNumTimeSteps());
+		fflush(stdout);
+	}
+	fprintf(stdout, "\n");
+	prefetcher.stop();
+
+	if (!ok)
+	{
+		fprintf(stderr, "writeManifest:  Reading the time steps of \"%s\" failed.\n",
+			datFileName);
+		return false;
+	}
+
+	manifest.updateGlobalStatistics();
+	manifestName = TimeSeriesManifest::getFileName(datFileName);
+	if (!manifest.save(manifestName.c_str()))
+		return false;
+
+	fprintf(stdout, "writeManifest:  \"%s\" written in %.1f ms, magnitude "
+		"min %g max %g mean %g\n", manifestName.c_str(), timer() - start,
+		manifest.getMinMagnitude(), manifest.getMaxMagnitude(),
+		manifest.getMeanMagnitude());
+
+	return true;
+}
@@ -0,0 +1,81 @@
+#ifndef _MANIFEST_H_
+#define _MANIFEST_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "reader.h"
+
+
+#define MANIFEST_EXT           ".manifest"
+#define MANIFEST_HIST_BINS     256
+
+
+// description of one time step stored in the manifest
+struct TimeStepInfo
+{
+	std::string path;      // RAW file, relative names like in the DAT file
+	uint64_t size;         // in bytes
+	uint64_t checksum;     // hashContent() of the file
+	// magnitude of the vectors
+	float minMagnitude;
+	float maxMagnitude;
+	float meanMagnitude;
+	// magnitudes scaled by maxMagnitude, like TransferEdit::computeHistogram()
+	int histogram[MANIFEST_HIST_BINS];
+};
+
+
+// Sidecar file "<file>.dat.manifest" of a time series. It is written once
+// by writeManifest() and lets DatFile skip opening every RAW file at
+// startup. The statistics replace passes over the voxel data.
+class TimeSeriesManifest
+{
+public:
+	TimeSeriesManifest(void);
+	~TimeSeriesManifest(void);
+
+	// read the manifest, returns false if it does not exist or is damaged
+	bool load(const char *fileName);
+	bool save(const char *fileName);
+
+	// true if the manifest describes the data set of the DAT file
+	bool matches(DataType dataType, int dataDim, const int sizes[3],
+		int timeStepBeg, int timeStepEnd);
+
+	// NULL if timeStep is not part of the series
+	const TimeStepInfo* getTimeStep(int timeStep) const;
+	int getTimeStepBegin(void) const { return _timeStepBeg; }
+	int getNumTimeSteps(void) const { return static_cast<int>(_steps.size()); }
+
+	// over all time steps
+	float getMinMagnitude(void) const { return _minMagnitude; }
+	float getMaxMagnitude(void) const { return _maxMagnitude; }
+	float getMeanMagnitude(void) const { return _meanMagnitude; }
+
+	// file name of the manifest belonging to a DAT file
+	static std::string getFileName(const char *datFileName);
+
+private:
+	friend bool writeManifest(const char *datFileName);
+
+	void updateGlobalStatistics(void);
+
+	DataType _dataType;
+	int _dataDim;
+	int _sizes[3];
+	int _timeStepBeg;
+	std::vector<TimeStepInfo> _steps;
+
+	float _minMagnitude;
+	float _maxMagnitude;
+	float _meanMagnitude;
+};
+
+
+// read all time steps of the DAT file and write its manifest
+// returns true if successful
+bool writeManifest(const char *datFileName);
+
+#endif // _MANIFEST_H_
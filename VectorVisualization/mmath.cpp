@@ -286,6 +286,42 @@ Vector3 Quaternion_multVector3(Quaternion q, Vector3 v)
 }
 
 
+Quaternion Quaternion_slerp(Quaternion p, Quaternion q, float t)
+{
+  Quaternion result;
+  double cosPhi = p.w * q.w + p.x * q.x + p.y * q.y + p.z * q.z;
+  double phi, s, sp, sq;
+
+  // q and -q describe the same rotation
+  if (cosPhi < 0.0) {
+    cosPhi = -cosPhi;
+    q.w = -q.w;
+    q.x = -q.x;
+    q.y = -q.y;
+    q.z = -q.z;
+  }
+
+  if (cosPhi > 1.0 - 1e-6) {
+    // nearly identical, linear interpolation is accurate enough
+    sp = 1.0 - t;
+    sq = t;
+  } else {
+    phi = acos(cosPhi);
+    s = 1.0 / sin(phi);
+    sp = sin((1.0 - t) * phi) * s;
+    sq = sin(t * phi) * s;
+  }
+
+  result.w = (float)(sp * p.w + sq * q.w);
+  result.x = (float)(sp * p.x + sq * q.x);
+  result.y = (float)(sp * p.y + sq * q.y);
+  result.z = (float)(sp * p.z + sq * q.z);
+  Quaternion_normalize(&result);
+
+  return result;
+}
+
+
 void Quaternion_stderr(char *s, Quaternion q)
 {
   fprintf(stderr, "%s (%f <%f, %f, %f>)\n", s, q.w, q.x, q.y, q.z);
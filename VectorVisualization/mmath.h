@@ -113,6 +113,10 @@ Quaternion Quaternion_inverse(Quaternion q);
 
 Vector3 Quaternion_multVector3(Quaternion q, Vector3 v);
 
+// spherical linear interpolation from p (t = 0) to q (t = 1) along the
+// shorter arc
+Quaternion Quaternion_slerp(Quaternion p, Quaternion q, float t);
+
 
 void Quaternion_stderr(char *s, Quaternion q);
 
@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#  include <windows.h>
+#endif
+
+#include <GL/glew.h>
+
+#ifndef _WIN32
+#  ifdef VOLIC_USE_OSMESA
+#    include <GL/osmesa.h>
+#  else
+#    include <EGL/egl.h>
+#    include <EGL/eglext.h>
+#  endif
+#endif
+
+#include "offscreen.h"
+
+
+#ifdef _WIN32
+#  define OFFSCREEN_WINDOW_CLASS  "volicOffscreen"
+#endif
+
+
+OffscreenContext::OffscreenContext(void) : _created(false), _display(NULL),
+	_surface(NULL), _context(NULL)
+{
+}
+
+
+OffscreenContext::~OffscreenContext(void)
+{
+	destroy();
+}
+
+
+bool OffscreenContext::create(int width, int height)
+{
+	destroy();
+
+#ifdef _WIN32
+	WNDCLASSA wc;
+	PIXELFORMATDESCRIPTOR pfd;
+	HINSTANCE instance = GetModuleHandleA(NULL);
+	HWND wnd;
+	HDC dc;
+	HGLRC rc;
+	int format;
+
+	memset(&wc, 0, sizeof(wc));
+	wc.style = CS_OWNDC;
+	wc.lpfnWndProc = DefWindowProcA;
+	wc.hInstance = instance;
+	wc.lpszClassName = OFFSCREEN_WINDOW_CLASS;
+	RegisterClassA(&wc);
+
+	// the window is never shown, the scene is rendered into the FBO
+	wnd = CreateWindowA(OFFSCREEN_WINDOW_CLASS, "volic", WS_OVERLAPPEDWINDOW,
+		0, 0, width, height, NULL, NULL, instance, NULL);
+	if (!wnd)
+	{
+		fprintf(stderr, "OffscreenContext:  Could not create the hidden window.\n");
+		return false;
+	}
+	dc = GetDC(wnd);
+
+	memset(&pfd, 0, sizeof(pfd));
+	pfd.nSize = sizeof(pfd);
+	pfd.nVersion = 1;
+	pfd.dwFlags = PFD_DRAW_TO_WINDOW | PFD_SUPPORT_OPENGL;
+	pfd.iPixelType = PFD_TYPE_RGBA;
+	pfd.cColorBits = 32;
+	pfd.cAlphaBits = 8;
+	pfd.cDepthBits = 24;
+	pfd.iLayerType = PFD_MAIN_PLANE;
+
+	format = ChoosePixelFormat(dc, &pfd);
+	if (!format || !SetPixelFormat(dc, format, &pfd)
+		|| !(rc = wglCreateContext(dc)) || !wglMakeCurrent(dc, rc))
+	{
+		fprintf(stderr, "OffscreenContext:  Could not create the OpenGL context.\n");
+		ReleaseDC(wnd, dc);
+		DestroyWindow(wnd);
+		return false;
+	}
+
+	_display = wnd;
+	_surface = dc;
+	_context = rc;
+
+#elif defined(VOLIC_USE_OSMESA)
+	OSMesaContext ctx = OSMesaCreateContextExt(OSMESA_RGBA, 24, 8, 0, NULL);
+
+	if (!ctx)
+	{
+		fprintf(stderr, "OffscreenContext:  Could not create the OSMesa context.\n");
+		return false;
+	}
+	_buffer.resize(4 * (size_t)width * height);
+	if (!OSMesaMakeCurrent(ctx, &_buffer[0], GL_UNSIGNED_BYTE, width, height))
+	{
+		fprintf(stderr, "OffscreenContext:  Could not activate the OSMesa context.\n");
+		OSMesaDestroyContext(ctx);
+		_buffer.clear();
+		return false;
+	}
+
+	_context = ctx;
+
+#else
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE };
+	const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLConfig config;
+	EGLSurface surface;
+	EGLContext context;
+	EGLint major, minor, numConfigs = 0;
+
+	// the surfaceless platform needs neither X11 nor a GPU device
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+	if (display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if ((display == EGL_NO_DISPLAY) || !eglInitialize(display, &major, &minor))
+	{
+		fprintf(stderr, "OffscreenContext:  No EGL display available.\n");
+		return false;
+	}
+
+	// the renderer uses the compatibility profile
+	if (!eglBindAPI(EGL_OPENGL_API)
+		|| !eglChooseConfig(display, configAttribs, &config, 1, &numConfigs)
+		|| (numConfigs < 1))
+	{
+		fprintf(stderr, "OffscreenContext:  No EGL config for desktop OpenGL pbuffers.\n");
+		eglTerminate(display);
+		return false;
+	}
+
+	surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+	if ((surface == EGL_NO_SURFACE) || (context == EGL_NO_CONTEXT)
+		|| !eglMakeCurrent(display, surface, surface, context))
+	{
+		fprintf(stderr, "OffscreenContext:  Could not create the EGL context (0x%x).\n",
+			eglGetError());
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		if (surface != EGL_NO_SURFACE)
+			eglDestroySurface(display, surface);
+		eglTerminate(display);
+		return false;
+	}
+
+	_display = display;
+	_surface = surface;
+	_context = context;
+#endif
+
+	_created = true;
+	fprintf(stdout, "OffscreenContext:  %dx%d, renderer \"%s\"\n", width, height,
+		getRendererName());
+
+	return true;
+}
+
+
+void OffscreenContext::destroy(void)
+{
+	if (!_created)
+		return;
+
+#ifdef _WIN32
+	wglMakeCurrent(NULL, NULL);
+	wglDeleteContext((HGLRC)_context);
+	ReleaseDC((HWND)_display, (HDC)_surface);
+	DestroyWindow((HWND)_display);
+#elif defined(VOLIC_USE_OSMESA)
+	OSMesaDestroyContext((OSMesaContext)_context);
+	_buffer.clear();
+#else
+	eglMakeCurrent((EGLDisplay)_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	eglDestroyContext((EGLDisplay)_display, (EGLContext)_context);
+	eglDestroySurface((EGLDisplay)_display, (EGLSurface)_surface);
+	eglTerminate((EGLDisplay)_display);
+#endif
+
+	_display = NULL;
+	_surface = NULL;
+	_context = NULL;
+	_created = false;
+}
+
+
+const char* OffscreenContext::getRendererName(void)
+{
+	const GLubyte *name = _created ? glGetString(GL_RENDERER) : NULL;
+
+	return name ? reinterpret_cast<const char*>(name) : "unknown";
+}
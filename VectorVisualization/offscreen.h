@@ -0,0 +1,48 @@
+#ifndef _OFFSCREEN_H_
+#define _OFFSCREEN_H_
+
+#include <stddef.h>
+#include <vector>
+
+
+// OpenGL context without a visible window for the --headless mode. The
+// scene is rendered into the FBO of the Renderer, the default
+// framebuffer only has to exist.
+//
+//   Windows:  context of a hidden window, never shown
+//   others:   EGL pbuffer on the surfaceless platform of Mesa (e.g.
+//             llvmpipe without display server), the default EGL
+//             display otherwise
+//             OSMesa if VOLIC_USE_OSMESA is defined
+class OffscreenContext
+{
+public:
+	OffscreenContext(void);
+	~OffscreenContext(void);
+
+	// create the context with a default framebuffer of width x height
+	// and make it current, returns false if no context is available
+	bool create(int width, int height);
+	void destroy(void);
+
+	bool isCreated(void) { return _created; }
+
+	// GL_RENDERER of the context, e.g. to log the software rasterizer
+	const char* getRendererName(void);
+
+private:
+	OffscreenContext(const OffscreenContext&);
+	OffscreenContext& operator=(const OffscreenContext&);
+
+	bool _created;
+
+	// platform handles
+	void *_display;
+	void *_surface;
+	void *_context;
+
+	// color buffer of OSMesa
+	std::vector<unsigned char> _buffer;
+};
+
+#endif // _OFFSCREEN_H_
@@ -22,8 +22,11 @@
  */
 
 #include <string.h>
+#include <stdio.h>
 #include <iostream>
 #include "parseArg.h"
+#include "brickfile.h"
+#include "types.h"
 
 
 ParseArguments::ParseArguments(int argc, char **argv, const char *progName) 
@@ -31,9 +34,26 @@ ParseArguments::ParseArguments(int argc, char **argv, const char *progName)
       _volFileName(NULL),
       _noiseFileName(NULL),_tfFileName(NULL),
       _licFilterFileName(NULL),_redirectFile(NULL),
-      _haltonFileName(NULL),_useGradients(false),
-      _useLambda2(false)
+      _haltonFileName(NULL),_cacheDir(NULL),
+      _cpuLicFileName(NULL),_cpuRenderFileName(NULL),
+      _licVolumeFileName(NULL),_outputPrefix(NULL),
+      _scriptFileName(NULL),_brickFileName(NULL),
+      _useGradients(false),
+      _useLambda2(false),_useMemoryMapping(false),
+      _prefetchDepth(0),_useKeyFrames(false),
+      _memoryLimit(0),_outOfCoreBudget(0),
+      _useLOD(false),_lodBias(0.0f),_useSkipping(true),
+      _usePreIntegration(true),_progressiveFrames(0),_useLICBricks(false),
+      _useLayeredLIC(true),_licBenchRuns(0),_licBenchSize(0),
+      _useCache(true),
+      _writeManifest(false),_licVolumeSize(0),
+      _headless(false),_numFrames(1),
+      _captureQOI(false),_videoFileName(NULL),
+      _rawVideo(false),_videoFps(25),
+      _brickSize(BRICK_DEFAULT_SIZE),_brickLevel(-1)
 {
+    // an empty window means none was given
+    _scalarWindow[0] = _scalarWindow[1] = 0.0f;
     setProgramName(progName);
 }
 
@@ -48,6 +68,14 @@ ParseArguments::~ParseArguments(void)
     delete [] _licFilterFileName;
     delete [] _redirectFile;
     delete [] _haltonFileName;
+    delete [] _cacheDir;
+    delete [] _cpuLicFileName;
+    delete [] _cpuRenderFileName;
+    delete [] _licVolumeFileName;
+    delete [] _outputPrefix;
+    delete [] _scriptFileName;
+    delete [] _videoFileName;
+    delete [] _brickFileName;
 }
 
 void ParseArguments::printUsage(void)
@@ -55,14 +83,32 @@ void ParseArguments::printUsage(void)
     std::cerr << "\nUsage:  "
               << (_progName ? _progName : (_argv ? _argv[0] : "executable"))
               << " <volfilename.dat> [-h | --help] "
-              << "[-g | --gradient] \n" /*[-l | --lambda2]*/
+              << "[-g | --gradient] [-m | --mmap] [-k | --keyframes]\n" /*[-l | --lambda2]*/
               << "\t\t\t\t[-f <file> | --filter=<file>]\n"
               << "\t\t\t\t[-n <file> | --noise=<file>]\n"
               << "\t\t\t\t[-t <file> | --transfer=<file>]\n"
+              << "\t\t\t\t[-p <n> | --prefetch=<n>]\n"
+              << "\t\t\t\t[-c <MB> | --memlimit=<MB>] [--outofcore=<MB>]\n"
+              << "\t\t\t\t[--lod [--lodbias=<f>]]\n"
+              << "\t\t\t\t[--noskip] [--scalarwindow=<lo>,<hi>] [--nopreint]\n"
+              << "\t\t\t\t[--progressive[=<n>]] [--licbricks] [--nolayered]\n"
+              << "\t\t\t\t[--benchlic[=<n>[,<size>]]]\n"
+              << "\t\t\t\t[-d <dir> | --cache=<dir>] [--nocache]\n"
+              << "\t\t\t\t[--manifest]\n"
+              << "\t\t\t\t[--brick=<file> [--bricksize=<n>] [--bricklevel=<0-9>]]\n"
+              << "\t\t\t\t[--cpulic=<file> [--licsize=<n>]]\n"
+              << "\t\t\t\t[--cpurender=<file> [--licvolume=<file>]]\n"
+              << "\t\t\t\t[--headless [--frames=<n>] [--output=<prefix>]]\n"
+              << "\t\t\t\t[--script=<file> [--output=<prefix>]]\n"
+              << "\t\t\t\t[--pnglevel=<0-9>] [--pngfilter=<filter>] [--pngthreads=<n>]\n"
+              << "\t\t\t\t[--capture=<png|qoi>]\n"
+              << "\t\t\t\t[--video=<file|-> [--videoformat=<y4m|rgb>] [--fps=<n>]]\n"
         //        << "\t\t\t\t[-r <file> | --redirect=<file>]\n"
         //        << "\t\t\t\t[-s <file> | --halton=<file>]\n\n"
               << "\t-h | --help \tShow usage\n"
               << "\t-g | --gradient\tUse noise gradients\n"
+              << "\t-m | --mmap \tMemory map the RAW files\n"
+              << "\t-k | --keyframes\tInterpolate key frames on the GPU\n"
         //        << "\t-l | --lambda2 \tLoad lambda2 volume\n"
               << "\t-f <png>\tFilter kernel stored in PNG file\n"
               << "\t--filter=<png>\n"
@@ -70,6 +116,47 @@ void ParseArguments::printUsage(void)
               << "\t--noise=<noisefile>\n"
               << "\t-t <png>\tTransfer function stored in PNG file\n"
               << "\t--transfer=<png>\n"
+              << "\t-p <n>\t\tLoad n time steps ahead in the background\n"
+              << "\t--prefetch=<n>\n"
+              << "\t-c <MB>\t\tLimit the memory for time steps to MB\n"
+              << "\t--memlimit=<MB>\n"
+              << "\t--outofcore=<MB>\tPage the vector field in bricks through a cache of MB\n"
+              << "\t--lod\t\tSample coarser levels of the vector field when zoomed out\n"
+              << "\t--lodbias=<f>\tAdded to the selected level, positive is coarser\n"
+              << "\t--noskip\tDo not skip empty space in the raycasters\n"
+              << "\t--scalarwindow=<lo>,<hi>\tScalar interval in which the noise is\n"
+              << "\t\t\tintegrated, default 0.1,0.3\n"
+              << "\t--nopreint\tSample the transfer function without pre-integration\n"
+              << "\t--progressive[=<n>]\tAverage n jittered frames while the view is still,\n"
+              << "\t\t\tdefault 16\n"
+              << "\t--licbricks\tKeep the LIC of unchanged bricks of the LIC volume (F4)\n"
+              << "\t\t\tduring the animation, approximate\n"
+              << "\t--nolayered\tAttach and draw every slice of the LIC volume on its own\n"
+              << "\t--benchlic[=<n>[,<size>]]\tTime n updates of the LIC volume of\n"
+              << "\t\t\tsize^3 voxels offscreen with and without layered\n"
+              << "\t\t\trendering and exit, default 10 updates of 512^3\n"
+              << "\t-d <dir>\tStore gradients, textures and tables in the\n"
+              << "\t--cache=<dir>\tpreprocessing cache in <dir>, off by default\n"
+              << "\t--nocache\tDisable the preprocessing cache even if <dir> is given\n"
+              << "\t--manifest\tWrite the manifest of the time series and exit\n"
+              << "\t--brick=<dat>\tConvert the data set into compressed bricks and exit\n"
+              << "\t--bricksize=<n>\tEdge length of the bricks, default 32\n"
+              << "\t--bricklevel=<n>\tzlib compression level of the bricks\n"
+              << "\t--cpulic=<dat>\tCompute the LIC volume on the CPU into a DAT file and exit\n"
+              << "\t--licsize=<n>\tResolution of the LIC volume computed on the CPU\n"
+              << "\t--cpurender=<png>\tRaycast the LIC volume on the CPU into a PNG file and exit\n"
+              << "\t--licvolume=<dat>\tLIC volume raycast by --cpurender, computed if not given\n"
+              << "\t--headless\tRender offscreen into PNG files and exit\n"
+              << "\t--frames=<n>\tNumber of frames rendered by --headless\n"
+              << "\t--output=<prefix>\tPrefix of the PNG files, default frame_\n"
+              << "\t--script=<file>\tRender the frames of a batch script offscreen and exit\n"
+              << "\t--pnglevel=<n>\tzlib compression level of PNG files\n"
+              << "\t--pngfilter=<filter>\tnone, sub, up, average, paeth or adaptive (default)\n"
+              << "\t--pngthreads=<n>\tRow bands compressed in parallel, 0 for all threads\n"
+              << "\t--capture=<png|qoi>\tFormat of screenshots, recordings and frames\n"
+              << "\t--video=<file>\tStream recordings and frames into file, - for stdout\n"
+              << "\t--videoformat=<fmt>\ty4m (default) or raw rgb24\n"
+              << "\t--fps=<n>\tFrame rate of the video, default 25\n"
         //        << "\t-r <file>\tRedirect output to file\n"
         //        << "\t--redirect=<file>\n"
         //        << "\t-s <file>\tHalton sequence for camera positions\n"
@@ -94,6 +181,17 @@ void ParseArguments::setProgramName(const char *progName)
 }
 
 
+bool ParseArguments::getScalarWindow(float *lo, float *hi)
+{
+    if (_scalarWindow[0] >= _scalarWindow[1])
+        return false;
+
+    *lo = _scalarWindow[0];
+    *hi = _scalarWindow[1];
+    return true;
+}
+
+
 bool ParseArguments::parse(void)
 {
     int idx = 1;   // index of current argument 
@@ -132,6 +230,57 @@ bool ParseArguments::parse(void)
             case 'l':
                 _useLambda2 = true;
                 break;
+            case 'm':
+                _useMemoryMapping = true;
+                break;
+            case 'k':
+                _useKeyFrames = true;
+                break;
+            case 'p':
+                if ((idx+1 < _argc) && (sscanf(_argv[idx+1], "%i", &_prefetchDepth) == 1))
+                {
+                    ++idx;
+                }
+                else
+                {
+                    std::cerr << "Missing number:  prefetch depth" << std::endl;
+                    return false;
+                }
+                break;
+            case 'c':
+                if ((idx+1 < _argc) && (sscanf(_argv[idx+1], "%i", &_memoryLimit) == 1))
+                {
+                    ++idx;
+                }
+                else
+                {
+                    std::cerr << "Missing number:  memory limit" << std::endl;
+                    return false;
+                }
+                break;
+            case 'd':
+                if (idx+1 < _argc)
+                {
+                    if (_argv[idx+1][0] != '-')
+                    {
+                        _cacheDir = new char[strlen(_argv[idx+1])+1];
+                        strcpy(_cacheDir, _argv[idx+1]);
+                        ++idx;
+                    }
+                    else
+                    {
+                        std::cerr << "Invalid argument: " << _argv[idx]
+                                  << std::endl;
+                        return false;
+                    }
+                }
+                else
+                {
+                    std::cerr << "Missing directory:  preprocessing cache" 
+                              << std::endl;
+                    return false;
+                }
+                break;
             case 'f':
                 if (idx+1 < _argc)
                 {
@@ -348,6 +497,297 @@ bool ParseArguments::parseLongArgs(int idx, int len)
             return false;
         }
     }
+    else if (strncmp(&_argv[idx][2], "cache", 5) == 0)
+    {
+        if ((len > 8) && (_argv[idx][7] == '='))
+        {
+            _cacheDir = new char[strlen(&_argv[idx][8])+1];
+            strcpy(_cacheDir, &_argv[idx][8]);
+        }
+        else
+        {
+            std::cerr << "Missing directory:  preprocessing cache" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "nocache", 7) == 0)
+    {
+        _useCache = false;
+    }
+    else if (strncmp(&_argv[idx][2], "cpulic", 6) == 0)
+    {
+        if ((len > 9) && (_argv[idx][8] == '='))
+        {
+            _cpuLicFileName = new char[strlen(&_argv[idx][9])+1];
+            strcpy(_cpuLicFileName, &_argv[idx][9]);
+        }
+        else
+        {
+            std::cerr << "Missing filename:  LIC volume (dat)" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "licsize", 7) == 0)
+    {
+        if ((len < 11) || (_argv[idx][9] != '=')
+            || (sscanf(&_argv[idx][10], "%i", &_licVolumeSize) != 1)
+            || (_licVolumeSize < 1))
+        {
+            std::cerr << "Missing number:  LIC volume size" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "cpurender", 9) == 0)
+    {
+        if ((len > 12) && (_argv[idx][11] == '='))
+        {
+            _cpuRenderFileName = new char[strlen(&_argv[idx][12])+1];
+            strcpy(_cpuRenderFileName, &_argv[idx][12]);
+        }
+        else
+        {
+            std::cerr << "Missing filename:  rendered image (png)" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "licvolume", 9) == 0)
+    {
+        if ((len > 12) && (_argv[idx][11] == '='))
+        {
+            _licVolumeFileName = new char[strlen(&_argv[idx][12])+1];
+            strcpy(_licVolumeFileName, &_argv[idx][12]);
+        }
+        else
+        {
+            std::cerr << "Missing filename:  LIC volume (dat)" << std::endl;
+            return false;
+        }
+    }
+    else if (strcmp(&_argv[idx][2], "headless") == 0)
+    {
+        _headless = true;
+    }
+    else if (strncmp(&_argv[idx][2], "frames", 6) == 0)
+    {
+        if ((len < 10) || (_argv[idx][8] != '=')
+            || (sscanf(&_argv[idx][9], "%i", &_numFrames) != 1)
+            || (_numFrames < 1))
+        {
+            std::cerr << "Missing number:  frames" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "script", 6) == 0)
+    {
+        if ((len > 9) && (_argv[idx][8] == '='))
+        {
+            _scriptFileName = new char[strlen(&_argv[idx][9])+1];
+            strcpy(_scriptFileName, &_argv[idx][9]);
+        }
+        else
+        {
+            std::cerr << "Missing filename:  batch script" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "output", 6) == 0)
+    {
+        if ((len > 9) && (_argv[idx][8] == '='))
+        {
+            _outputPrefix = new char[strlen(&_argv[idx][9])+1];
+            strcpy(_outputPrefix, &_argv[idx][9]);
+        }
+        else
+        {
+            std::cerr << "Missing prefix:  output files" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "pnglevel", 8) == 0)
+    {
+        if ((len < 12) || (_argv[idx][10] != '=')
+            || (sscanf(&_argv[idx][11], "%i", &_pngOptions.level) != 1)
+            || (_pngOptions.level < 0) || (_pngOptions.level > 9))
+        {
+            std::cerr << "Missing number:  PNG compression level (0-9)" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "pngfilter", 9) == 0)
+    {
+        const char *filters[] = { "none", "sub", "up", "average", "paeth", "adaptive" };
+        int i;
+
+        for (i = 0; (len > 12) && (_argv[idx][11] == '=') && (i < 6); ++i)
+        {
+            if (strcmp(&_argv[idx][12], filters[i]) == 0)
+                break;
+        }
+        if ((len <= 12) || (_argv[idx][11] != '=') || (i == 6))
+        {
+            std::cerr << "Missing filter:  none, sub, up, average, paeth or adaptive" << std::endl;
+            return false;
+        }
+        _pngOptions.filter = static_cast<PNGFilter>(i);
+    }
+    else if (strncmp(&_argv[idx][2], "pngthreads", 10) == 0)
+    {
+        if ((len < 14) || (_argv[idx][12] != '=')
+            || (sscanf(&_argv[idx][13], "%i", &_pngOptions.numBands) != 1)
+            || (_pngOptions.numBands < 0))
+        {
+            std::cerr << "Missing number:  PNG compression threads" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "capture", 7) == 0)
+    {
+        if ((len > 10) && (_argv[idx][9] == '=')
+            && ((strcmp(&_argv[idx][10], "png") == 0) || (strcmp(&_argv[idx][10], "qoi") == 0)))
+        {
+            _captureQOI = (strcmp(&_argv[idx][10], "qoi") == 0);
+        }
+        else
+        {
+            std::cerr << "Missing format:  png or qoi" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "videoformat", 11) == 0)
+    {
+        if ((len > 14) && (_argv[idx][13] == '=')
+            && ((strcmp(&_argv[idx][14], "y4m") == 0) || (strcmp(&_argv[idx][14], "rgb") == 0)))
+        {
+            _rawVideo = (strcmp(&_argv[idx][14], "rgb") == 0);
+        }
+        else
+        {
+            std::cerr << "Missing format:  y4m or rgb" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "video", 5) == 0)
+    {
+        if ((len > 8) && (_argv[idx][7] == '='))
+        {
+            _videoFileName = new char[strlen(&_argv[idx][8])+1];
+            strcpy(_videoFileName, &_argv[idx][8]);
+        }
+        else
+        {
+            std::cerr << "Missing filename:  video (y4m, rgb or -)" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "fps", 3) == 0)
+    {
+        if ((len < 7) || (_argv[idx][5] != '=')
+            || (sscanf(&_argv[idx][6], "%i", &_videoFps) != 1)
+            || (_videoFps < 1))
+        {
+            std::cerr << "Missing number:  frame rate" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "bricksize", 9) == 0)
+    {
+        if ((len < 13) || (_argv[idx][11] != '=')
+            || (sscanf(&_argv[idx][12], "%i", &_brickSize) != 1)
+            || (_brickSize < 1))
+        {
+            std::cerr << "Missing number:  brick size" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "bricklevel", 10) == 0)
+    {
+        if ((len < 14) || (_argv[idx][12] != '=')
+            || (sscanf(&_argv[idx][13], "%i", &_brickLevel) != 1)
+            || (_brickLevel < 0) || (_brickLevel > 9))
+        {
+            std::cerr << "Missing number:  brick compression level (0-9)" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "brick", 5) == 0)
+    {
+        if ((len > 8) && (_argv[idx][7] == '='))
+        {
+            _brickFileName = new char[strlen(&_argv[idx][8])+1];
+            strcpy(_brickFileName, &_argv[idx][8]);
+        }
+        else
+        {
+            std::cerr << "Missing filename:  bricked data set (dat)" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "lodbias", 7) == 0)
+    {
+        if ((len < 11) || (_argv[idx][9] != '=')
+            || (sscanf(&_argv[idx][10], "%f", &_lodBias) != 1))
+        {
+            std::cerr << "Missing number:  level of detail bias" << std::endl;
+            return false;
+        }
+    }
+    else if (strcmp(&_argv[idx][2], "lod") == 0)
+    {
+        _useLOD = true;
+    }
+    else if (strcmp(&_argv[idx][2], "noskip") == 0)
+    {
+        _useSkipping = false;
+    }
+    else if (strcmp(&_argv[idx][2], "nopreint") == 0)
+    {
+        _usePreIntegration = false;
+    }
+    else if (strncmp(&_argv[idx][2], "progressive", 11) == 0)
+    {
+        _progressiveFrames = PROGRESSIVE_DEFAULT_FRAMES;
+        if ((len > 13) && ((_argv[idx][13] != '=')
+            || (sscanf(&_argv[idx][14], "%i", &_progressiveFrames) != 1)
+            || (_progressiveFrames < 1)))
+        {
+            std::cerr << "Missing number:  frames of the progressive refinement" << std::endl;
+            return false;
+        }
+    }
+    else if (strcmp(&_argv[idx][2], "licbricks") == 0)
+    {
+        _useLICBricks = true;
+    }
+    else if (strcmp(&_argv[idx][2], "nolayered") == 0)
+    {
+        _useLayeredLIC = false;
+    }
+    else if (strncmp(&_argv[idx][2], "benchlic", 8) == 0)
+    {
+        _licBenchRuns = LIC_BENCH_DEFAULT_RUNS;
+        _licBenchSize = 0;
+        if ((len > 10) && ((_argv[idx][10] != '=')
+            || (sscanf(&_argv[idx][11], "%i,%i", &_licBenchRuns, &_licBenchSize) < 1)
+            || (_licBenchRuns < 1) || (_licBenchSize < 0)))
+        {
+            std::cerr << "Missing number:  updates of the LIC volume" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "scalarwindow", 12) == 0)
+    {
+        if ((len < 16) || (_argv[idx][14] != '=')
+            || (sscanf(&_argv[idx][15], "%f,%f", &_scalarWindow[0], &_scalarWindow[1]) != 2)
+            || (_scalarWindow[0] >= _scalarWindow[1]))
+        {
+            std::cerr << "Missing numbers:  scalar window <lo>,<hi>" << std::endl;
+            return false;
+        }
+    }
+    else if (strcmp(&_argv[idx][2], "manifest") == 0)
+    {
+        _writeManifest = true;
+    }
     else if (strncmp(&_argv[idx][2], "gradient", 8) == 0)
     {
         _useGradients = true;
@@ -356,6 +796,42 @@ bool ParseArguments::parseLongArgs(int idx, int len)
     {
         _useLambda2 = true;
     }
+    else if (strncmp(&_argv[idx][2], "mmap", 4) == 0)
+    {
+        _useMemoryMapping = true;
+    }
+    else if (strncmp(&_argv[idx][2], "keyframes", 9) == 0)
+    {
+        _useKeyFrames = true;
+    }
+    else if (strncmp(&_argv[idx][2], "prefetch", 8) == 0)
+    {
+        if ((len < 12) || (_argv[idx][10] != '=')
+            || (sscanf(&_argv[idx][11], "%i", &_prefetchDepth) != 1))
+        {
+            std::cerr << "Missing number:  prefetch depth" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "memlimit", 8) == 0)
+    {
+        if ((len < 12) || (_argv[idx][10] != '=')
+            || (sscanf(&_argv[idx][11], "%i", &_memoryLimit) != 1))
+        {
+            std::cerr << "Missing number:  memory limit" << std::endl;
+            return false;
+        }
+    }
+    else if (strncmp(&_argv[idx][2], "outofcore", 9) == 0)
+    {
+        if ((len < 13) || (_argv[idx][11] != '=')
+            || (sscanf(&_argv[idx][12], "%i", &_outOfCoreBudget) != 1)
+            || (_outOfCoreBudget < 1))
+        {
+            std::cerr << "Missing number:  brick cache size" << std::endl;
+            return false;
+        }
+    }
     else
     {
         return false;
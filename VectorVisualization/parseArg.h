@@ -23,6 +23,8 @@
 #ifndef _PARSEARG_H_
 #define _PARSEARG_H_
 
+#include "imageUtils.h"
+
 class ParseArguments
 {
 public:
@@ -49,6 +51,71 @@ public:
 
     const bool getGradientsFlag(void) { return _useGradients; }
     const bool getLambda2Flag(void) { return _useLambda2; }
+    const bool getMemoryMappingFlag(void) { return _useMemoryMapping; }
+    const int getPrefetchDepth(void) { return _prefetchDepth; }
+    const bool getKeyFrameFlag(void) { return _useKeyFrames; }
+    // memory limit for time steps in MB, 0 if unlimited
+    const int getMemoryLimit(void) { return _memoryLimit; }
+    // budget of the brick cache in MB, 0 if the key frames are loaded
+    // completely
+    const int getOutOfCoreBudget(void) { return _outOfCoreBudget; }
+    // store a pyramid of the vector field and select its level per frame
+    const bool getLODFlag(void) { return _useLOD; }
+    const float getLODBias(void) { return _lodBias; }
+    // skip empty macro cells in the raycasters
+    const bool getSkipFlag(void) { return _useSkipping; }
+    // pre-integrated transfer function in the raycasters
+    const bool getPreIntFlag(void) { return _usePreIntegration; }
+    // frames averaged by the progressive refinement, 0 if it is off
+    const int getProgressiveFrames(void) { return _progressiveFrames; }
+    // animate the LIC volume by computing only the bricks which changed
+    const bool getLICBricksFlag(void) { return _useLICBricks; }
+    // fill the LIC volume with layered rendering if the driver supports it
+    const bool getLayeredFlag(void) { return _useLayeredLIC; }
+    // time this many updates of the LIC volume and exit, 0 if not
+    const int getLICBenchRuns(void) { return _licBenchRuns; }
+    // edge length of the LIC volume of the benchmark, 0 for the default
+    const int getLICBenchSize(void) { return _licBenchSize; }
+    // interval of the scalar volume in which the noise is integrated,
+    // false if none was given
+    bool getScalarWindow(float *lo, float *hi);
+    // directory of the preprocessing cache, NULL if the cache is not used
+    const char* getCacheDirectory(void) { return _cacheDir; }
+    const bool getCacheFlag(void) { return _useCache; }
+    // write the manifest of the time series and exit
+    const bool getManifestFlag(void) { return _writeManifest; }
+    // convert the data set into bricks described by this DAT file and exit
+    const char* getBrickFileName(void) { return _brickFileName; }
+    const int getBrickSize(void) { return _brickSize; }
+    // zlib compression level of the bricks, -1 for the default
+    const int getBrickLevel(void) { return _brickLevel; }
+    // compute the LIC volume on the CPU into this DAT file and exit
+    const char* getCpuLicFileName(void) { return _cpuLicFileName; }
+    // 0 for the resolution of the renderer
+    const int getLicVolumeSize(void) { return _licVolumeSize; }
+    // raycast the LIC volume on the CPU into this PNG file and exit
+    const char* getCpuRenderFileName(void) { return _cpuRenderFileName; }
+    // precomputed LIC volume for the CPU raycaster, NULL to compute it
+    const char* getLicVolumeFileName(void) { return _licVolumeFileName; }
+    // render with an offscreen context into PNG files and exit
+    const bool getHeadlessFlag(void) { return _headless; }
+    // number of frames rendered in headless mode
+    const int getNumFrames(void) { return _numFrames; }
+    // prefix of the frames written in headless mode
+    const char* getOutputPrefix(void) { return _outputPrefix ? _outputPrefix : "frame_"; }
+    // batch script of camera key frames, time steps and LIC parameters
+    // rendered like --headless, NULL if none
+    const char* getScriptFileName(void) { return _scriptFileName; }
+    // compression of the PNG files written
+    const PNGOptions& getPNGOptions(void) { return _pngOptions; }
+    // file extension of screenshots, recordings and headless frames
+    const char* getCaptureFormat(void) { return _captureQOI ? "qoi" : "png"; }
+    // stream recordings and headless frames into this file, "-" for
+    // stdout, NULL for single images
+    const char* getVideoFileName(void) { return _videoFileName; }
+    // raw rgb24 instead of Y4M
+    const bool getRawVideoFlag(void) { return _rawVideo; }
+    const int getVideoFrameRate(void) { return _videoFps; }
 
     // parse the given command arguments
     // short arguments have the form of 
@@ -79,9 +146,43 @@ private:
     char *_licFilterFileName;
     char *_redirectFile;
     char *_haltonFileName;
+    char *_cacheDir;
+    char *_cpuLicFileName;
+    char *_cpuRenderFileName;
+    char *_licVolumeFileName;
+    char *_outputPrefix;
+    char *_scriptFileName;
+    char *_brickFileName;
 
     bool _useGradients;
     bool _useLambda2;
+    bool _useMemoryMapping;
+    int _prefetchDepth;
+    bool _useKeyFrames;
+    int _memoryLimit;
+    int _outOfCoreBudget;
+    bool _useLOD;
+    float _lodBias;
+    bool _useSkipping;
+    bool _usePreIntegration;
+    int _progressiveFrames;
+    bool _useLICBricks;
+    bool _useLayeredLIC;
+    int _licBenchRuns;
+    int _licBenchSize;
+    float _scalarWindow[2];
+    bool _useCache;
+    bool _writeManifest;
+    int _licVolumeSize;
+    bool _headless;
+    int _numFrames;
+    PNGOptions _pngOptions;
+    bool _captureQOI;
+    char *_videoFileName;
+    bool _rawVideo;
+    int _videoFps;
+    int _brickSize;
+    int _brickLevel;
 };
 
 #endif // _PARSEARG_H_
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <algorithm>
+
+#include "pixelbuffer.h"
+#include "types.h"
+
+
+// maximum time to wait for a single fence (in ns)
+#define PBO_FENCE_TIMEOUT 1000000000
+
+
+PixelBufferRing::PixelBufferRing(void) : _bufferSize(0), _current(0),
+	_persistent(false), _mapped(false)
+{
+}
+
+
+PixelBufferRing::~PixelBufferRing(void)
+{
+	release();
+}
+
+
+bool PixelBufferRing::init(size_t bufferSize, int numBuffers)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+		| GL_MAP_COHERENT_BIT;
+
+	release();
+
+	if (!GLEW_ARB_pixel_buffer_object || (numBuffers < 1) || (bufferSize == 0))
+		return false;
+
+	_persistent = GLEW_ARB_buffer_storage && GLEW_ARB_map_buffer_range && GLEW_ARB_sync;
+	_bufferSize = bufferSize;
+	_buffers.resize(numBuffers);
+
+	for (size_t i = 0; i < _buffers.size(); ++i)
+	{
+		glGenBuffersARB(1, &_buffers[i].id);
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, _buffers[i].id);
+		if (_persistent)
+		{
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, flags);
+			_buffers[i].ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER_ARB, 0, bufferSize, flags);
+			if (!_buffers[i].ptr)
+			{
+				fprintf(stderr, "PixelBuffer:  Persistent mapping failed.\n");
+				glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+				release();
+				return false;
+			}
+		}
+		else
+		{
+			glBufferDataARB(GL_PIXEL_UNPACK_BUFFER_ARB, bufferSize, NULL, GL_STREAM_DRAW_ARB);
+		}
+	}
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	_current = 0;
+	_mapped = false;
+
+	CHECK_FOR_OGL_ERROR();
+
+	return true;
+}
+
+
+void PixelBufferRing::release(void)
+{
+	for (size_t i = 0; i < _buffers.size(); ++i)
+	{
+		if (_buffers[i].fence)
+			glDeleteSync(_buffers[i].fence);
+		if (_buffers[i].ptr || (_mapped && ((int)i == _current)))
+		{
+			glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, _buffers[i].id);
+			glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		}
+		glDeleteBuffersARB(1, &_buffers[i].id);
+	}
+	if (!_buffers.empty())
+		glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+	_buffers.clear();
+	_bufferSize = 0;
+	_current = 0;
+	_mapped = false;
+}
+
+
+void* PixelBufferRing::map(void)
+{
+	if (_buffers.empty())
+		return NULL;
+
+	Buffer &buf = _buffers[_current];
+
+	// the GPU might still read from this buffer
+	waitForFence(buf);
+
+	if (_persistent)
+		return buf.ptr;
+
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, buf.id);
+	void *ptr = glMapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, GL_WRITE_ONLY_ARB);
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+	_mapped = (ptr != NULL);
+
+	return ptr;
+}
+
+
+void PixelBufferRing::upload3D(Texture *tex, GLenum srcFormat, GLenum srcType)
+{
+	if (_buffers.empty())
+		return;
+
+	Buffer &buf = _buffers[_current];
+
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, buf.id);
+	if (_mapped)
+	{
+		glUnmapBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB);
+		_mapped = false;
+	}
+
+	glBindTexture(GL_TEXTURE_3D, tex->id);
+	glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, tex->width, tex->height,
+		tex->depth, srcFormat, srcType, NULL);
+	glBindBufferARB(GL_PIXEL_UNPACK_BUFFER_ARB, 0);
+
+	if (GLEW_ARB_sync)
+		buf.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	_current = (_current + 1) % _buffers.size();
+
+	CHECK_FOR_OGL_ERROR();
+}
+
+
+void PixelBufferRing::createStorage3D(Texture *tex, GLint internalFormat,
+	int width, int height, int depth, int levels)
+{
+	GLint sizedFormat = internalFormat;
+
+	switch (internalFormat)
+	{
+	case GL_RGBA:
+		sizedFormat = GL_RGBA8;
+		break;
+	case GL_LUMINANCE:
+		sizedFormat = GL_LUMINANCE8;
+		break;
+	default:
+		break;
+	}
+
+	tex->format = internalFormat;
+	tex->width = width;
+	tex->height = height;
+	tex->depth = depth;
+	tex->levels = levels;
+
+	glBindTexture(GL_TEXTURE_3D, tex->id);
+	if (GLEW_ARB_texture_storage)
+		glTexStorage3D(GL_TEXTURE_3D, levels, sizedFormat, width, height, depth);
+	else
+	{
+		for (int i = 0; i < levels; ++i)
+			glTexImage3D(GL_TEXTURE_3D, i, internalFormat, std::max(width >> i, 1),
+				std::max(height >> i, 1), std::max(depth >> i, 1), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	}
+
+	CHECK_FOR_OGL_ERROR();
+}
+
+
+void PixelBufferRing::waitForFence(Buffer &buf)
+{
+	if (!buf.fence)
+		return;
+
+	GLenum res;
+	do
+	{
+		res = glClientWaitSync(buf.fence, GL_SYNC_FLUSH_COMMANDS_BIT, PBO_FENCE_TIMEOUT);
+	} while (res == GL_TIMEOUT_EXPIRED);
+
+	if (res == GL_WAIT_FAILED)
+		fprintf(stderr, "PixelBuffer:  Waiting for upload failed.\n");
+
+	glDeleteSync(buf.fence);
+	buf.fence = 0;
+}
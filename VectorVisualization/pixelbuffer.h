@@ -0,0 +1,59 @@
+#ifndef _PIXELBUFFER_H_
+#define _PIXELBUFFER_H_
+
+#include <GL/glew.h>
+#include <vector>
+#include "texture.h"
+
+
+// Ring of pixel unpack buffers used to stream volume data into 3D textures.
+// If ARB_buffer_storage is available the buffers are mapped persistently,
+// otherwise they are mapped for each upload. Each buffer is protected by a
+// fence, so the CPU only waits if it laps the GPU.
+class PixelBufferRing
+{
+public:
+	PixelBufferRing(void);
+	~PixelBufferRing(void);
+
+	// allocate numBuffers buffers of bufferSize bytes each
+	bool init(size_t bufferSize, int numBuffers = 2);
+	void release(void);
+
+	bool isInitialized(void) { return !_buffers.empty(); }
+	bool isPersistent(void) { return _persistent; }
+	size_t getBufferSize(void) { return _bufferSize; }
+
+	// returns the memory of the next buffer in the ring, NULL on failure
+	// the memory is write-only (possibly write-combined) and stays valid
+	// until upload3D() is called
+	void* map(void);
+	// copy the buffer returned by the last map() into the whole 3D texture
+	void upload3D(Texture *tex, GLenum srcFormat, GLenum srcType);
+
+	// allocate immutable storage for a 3D texture (if supported) with
+	// levels mipmap levels, unsized formats are mapped to their 8 bit
+	// sized counterparts
+	static void createStorage3D(Texture *tex, GLint internalFormat,
+		int width, int height, int depth, int levels = 1);
+
+private:
+	struct Buffer
+	{
+		Buffer(void) : id(0), ptr(NULL), fence(0) {}
+
+		GLuint id;
+		void *ptr;
+		GLsync fence;
+	};
+
+	void waitForFence(Buffer &buf);
+
+	std::vector<Buffer> _buffers;
+	size_t _bufferSize;
+	int _current;
+	bool _persistent;
+	bool _mapped;
+};
+
+#endif // _PIXELBUFFER_H_
@@ -0,0 +1,203 @@
+#include <stdio.h>
+
+#include "prefetch.h"
+
+
+TimeStepPrefetcher::TimeStepPrefetcher(void) : _datFile(NULL), _arena(NULL),
+	_useMapping(false), _head(0), _count(0), _nextStep(0), _generation(0), _quit(false)
+{
+}
+
+
+TimeStepPrefetcher::~TimeStepPrefetcher(void)
+{
+	stop();
+}
+
+
+bool TimeStepPrefetcher::start(DatFile *datFile, int timeStep, int depth, bool useMapping,
+	BufferArena *arena)
+{
+	stop();
+
+	if (!datFile || !arena || (depth < 1))
+		return false;
+
+	_datFile = datFile;
+	_arena = arena;
+	_useMapping = useMapping;
+	_ring.assign(depth, Slot());
+	_head = 0;
+	_count = 0;
+	_nextStep = timeStep;
+	_quit = false;
+
+	_thread = std::thread(&TimeStepPrefetcher::run, this);
+
+	return true;
+}
+
+
+void TimeStepPrefetcher::stop(void)
+{
+	if (_thread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_quit = true;
+		}
+		_notFull.notify_all();
+		_thread.join();
+	}
+
+	for (int i = 0; i < _count; ++i)
+		releaseSlot((_head + i) % _ring.size());
+	_head = 0;
+	_count = 0;
+}
+
+
+int TimeStepPrefetcher::getReadyCount(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return _count;
+}
+
+
+int TimeStepPrefetcher::getPendingCount(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return static_cast<int>(_ring.size()) - _count;
+}
+
+
+bool TimeStepPrefetcher::isReady(int timeStep)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return (_count > 0) && (_ring[_head].timeStep == timeStep);
+}
+
+
+bool TimeStepPrefetcher::pop(int timeStep, void *&data, MappedRawData &map)
+{
+	if (!isRunning())
+		return false;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	if ((_count > 0) && (_ring[_head].timeStep != timeStep))
+	{
+		// sequence was interrupted, drop everything and restart
+		fprintf(stderr, "Prefetch:  Restarting at time step %d.\n", timeStep);
+		for (int i = 0; i < _count; ++i)
+			releaseSlot((_head + i) % _ring.size());
+		_count = 0;
+		_nextStep = timeStep;
+		++_generation;
+		_notFull.notify_one();
+	}
+	else if ((_count == 0) && (_nextStep != timeStep))
+	{
+		// nothing loaded and the loader is not working on timeStep
+		_nextStep = timeStep;
+		++_generation;
+	}
+
+	// I/O could not keep up, wait for the loader
+	_notEmpty.wait(lock, [this] { return (_count > 0) || _quit; });
+	if (_quit)
+		return false;
+
+	Slot &slot = _ring[_head];
+	data = slot.data;
+	map = slot.map;
+	slot = Slot();
+
+	_head = (_head + 1) % _ring.size();
+	--_count;
+	_notFull.notify_one();
+
+	return data != NULL;
+}
+
+
+void TimeStepPrefetcher::run(void)
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+
+	while (!_quit)
+	{
+		// back-pressure: wait for a free slot
+		_notFull.wait(lock, [this] { return (_count < (int)_ring.size()) || _quit; });
+		if (_quit)
+			break;
+
+		int timeStep = _nextStep;
+		int generation = _generation;
+		Slot slot;
+		slot.timeStep = timeStep;
+
+		// load without holding the lock
+		lock.unlock();
+		if (_useMapping)
+		{
+			if (_datFile->mapRawData(timeStep, &slot.map))
+			{
+				slot.data = const_cast<void*>(slot.map.data);
+				// touch every page so the consumer does not fault them in
+				volatile unsigned char sum = 0;
+				const unsigned char *bytes = static_cast<const unsigned char*>(slot.map.data);
+				for (size_t i = 0; i < slot.map.size; i += 4096)
+					sum += bytes[i];
+			}
+		}
+		else
+		{
+			slot.data = _arena->acquire(_datFile->getRawDataSize());
+			if (!slot.data)
+			{
+				fprintf(stderr, "Prefetch:  Memory limit reached.\n");
+			}
+			else if (!_datFile->readRawData(timeStep, slot.data))
+			{
+				_arena->release(slot.data);
+				slot.data = NULL;
+			}
+		}
+		lock.lock();
+
+		if (!slot.data)
+			fprintf(stderr, "Prefetch:  Loading time step %d failed.\n", timeStep);
+
+		if (_quit || (generation != _generation))
+		{
+			// sequence was restarted while loading, discard the result
+			_ring[(_head + _count) % _ring.size()] = slot;
+			releaseSlot((_head + _count) % _ring.size());
+			continue;
+		}
+
+		_ring[(_head + _count) % _ring.size()] = slot;
+		++_count;
+		_nextStep = _datFile->getFollowingTimeStep(timeStep);
+		_notEmpty.notify_one();
+	}
+
+	_notEmpty.notify_all();
+}
+
+
+void TimeStepPrefetcher::releaseSlot(int index)
+{
+	Slot &slot = _ring[index];
+
+	if (slot.map.data)
+	{
+		DatFile::unmapRawData(&slot.map);
+	}
+	else if (slot.data)
+	{
+		_arena->release(slot.data);
+	}
+	slot = Slot();
+}
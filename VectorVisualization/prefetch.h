@@ -0,0 +1,78 @@
+#ifndef _PREFETCH_H_
+#define _PREFETCH_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "reader.h"
+#include "bufferarena.h"
+
+
+// Loads the time steps following the current key frame in a background
+// thread. The loaded steps are kept in a bounded ring buffer with a single
+// producer (the loader thread) and a single consumer (the GLUT thread).
+// The loader blocks as soon as the ring is full.
+class TimeStepPrefetcher
+{
+public:
+	TimeStepPrefetcher(void);
+	~TimeStepPrefetcher(void);
+
+	// start loading the sequence beginning with timeStep, the order of the
+	// time steps follows DatFile::getNextTimeStep()
+	// at most depth time steps are held in the ring buffer, the memory of
+	// time steps which are not mapped is taken from arena
+	bool start(DatFile *datFile, int timeStep, int depth, bool useMapping,
+		BufferArena *arena);
+	// stop the loader thread and release all time steps not yet taken
+	void stop(void);
+	bool isRunning(void) { return _thread.joinable(); }
+
+	// number of loaded time steps waiting in the ring buffer
+	int getReadyCount(void);
+	// number of time steps which still have to be loaded to fill the ring
+	int getPendingCount(void);
+	// true if the given time step is next in the ring and completely loaded
+	bool isReady(int timeStep);
+
+	// take the given time step out of the ring buffer, the ownership of
+	// data (or map, if the file is memory mapped) is passed to the caller,
+	// data has to be released to the arena
+	// blocks until the time step is loaded, if timeStep is not the next
+	// one in the sequence, the ring is flushed and loading restarts there
+	bool pop(int timeStep, void *&data, MappedRawData &map);
+
+protected:
+	void run(void);
+	void releaseSlot(int index);
+
+private:
+	struct Slot
+	{
+		Slot(void) : timeStep(-1), data(NULL) {}
+
+		int timeStep;
+		void *data;
+		MappedRawData map;
+	};
+
+	DatFile *_datFile;
+	BufferArena *_arena;
+	bool _useMapping;
+
+	std::vector<Slot> _ring;
+	int _head;        // next slot to be taken by the consumer
+	int _count;       // number of loaded slots
+	int _nextStep;    // next time step to be loaded by the producer
+	int _generation;  // incremented on every restart of the sequence
+	bool _quit;
+
+	std::thread _thread;
+	std::mutex _mutex;
+	std::condition_variable _notFull;
+	std::condition_variable _notEmpty;
+};
+
+#endif // _PREFETCH_H_
@@ -0,0 +1,92 @@
+#include <math.h>
+#include <vector>
+#include <algorithm>
+
+#include "preintegration.h"
+#include "threadpool.h"
+
+
+// opaque entries would have an infinite extinction
+#define PREINT_MAX_OPACITY  0.999
+
+
+// integral of the extinction -ln(1 - alpha) from one entry to the next
+// with alpha changing linearly from a0 to a1 (0..255)
+static double segmentExtinction(unsigned char a0, unsigned char a1)
+{
+	double u0 = 1.0 - std::min(a0 / 255.0, PREINT_MAX_OPACITY);
+	double u1 = 1.0 - std::min(a1 / 255.0, PREINT_MAX_OPACITY);
+
+	if (fabs(u1 - u0) < 1e-6)
+		return -log(0.5 * (u0 + u1));
+	// antiderivative of ln(u) is u ln(u) - u
+	return ((u1 * log(u1) - u1) - (u0 * log(u0) - u0)) / (u0 - u1);
+}
+
+
+static inline unsigned char toByte(double v)
+{
+	return static_cast<unsigned char>(std::max(0.0, std::min(v, 1.0)) * 255.0 + 0.5);
+}
+
+
+void computePreIntegrationTable(const unsigned char *tfData, int numEntries,
+	unsigned char *table)
+{
+	// integrals of the extinction and of the extinction weighted colors
+	// from the first entry to every entry, the opacity and the colors are
+	// linear between the entries like in the 1D textures
+	std::vector<double> intTau(numEntries);
+	std::vector<double> intColor(3 * (size_t)numEntries);
+
+	intTau[0] = 0.0;
+	for (int c = 0; c < 3; ++c)
+		intColor[c] = 0.0;
+	for (int i = 1; i < numEntries; ++i)
+	{
+		double segment = segmentExtinction(tfData[5 * (i - 1) + 3], tfData[5 * i + 3]);
+
+		intTau[i] = intTau[i - 1] + segment;
+		for (int c = 0; c < 3; ++c)
+		{
+			intColor[3 * i + c] = intColor[3 * (i - 1) + c]
+				+ 0.5 * segment * (tfData[5 * (i - 1) + c] + tfData[5 * i + c]) / 255.0;
+		}
+	}
+
+	// every entry only needs the differences of the integrals, O(n^2)
+	ThreadPool::getInstance().parallelFor(numEntries, [&](int begin, int end)
+	{
+		for (int back = begin; back < end; ++back)
+		{
+			unsigned char *dst = table + 4 * (size_t)back * numEntries;
+
+			for (int front = 0; front < numEntries; ++front, dst += 4)
+			{
+				if (front == back)
+				{
+					for (int c = 0; c < 4; ++c)
+						dst[c] = tfData[5 * front + c];
+					continue;
+				}
+
+				// mean extinction of a segment of the reference length,
+				// zero if all entries in between are transparent
+				double dTau = intTau[back] - intTau[front];
+				double len = back - front;
+
+				if (dTau * len > 0.0)
+				{
+					for (int c = 0; c < 3; ++c)
+						dst[c] = toByte((intColor[3 * back + c] - intColor[3 * front + c]) / dTau);
+				}
+				else
+				{
+					for (int c = 0; c < 3; ++c)
+						dst[c] = (tfData[5 * front + c] + tfData[5 * back + c] + 1) / 2;
+				}
+				dst[3] = toByte(1.0 - exp(-dTau / len));
+			}
+		}
+	});
+}
@@ -0,0 +1,23 @@
+#ifndef _PREINTEGRATION_H_
+#define _PREINTEGRATION_H_
+
+
+// Pre-integrated transfer function for the raycasters. The entry (f, b)
+// of the table holds the color and opacity of a ray segment of the
+// reference step (1/128, see alphaCorrection of the shaders) along which
+// the data value changes linearly from entry f to entry b of the
+// transfer function, so thin features of the transfer function between
+// two samples are not missed and larger steps can be taken.
+// The transfer function is the one of the 1D textures: the texel centers
+// are interpolated linearly and the ends are clamped.
+
+
+// numEntries x numEntries RGBA entries (front entry varies fastest) of
+// a transfer function of numEntries entries in the layout of
+// TransferEdit (5 channels: RGB, alpha and LIC opacity)
+// the colors are weighted by the extinction along the segment and not
+// premultiplied, the rows are computed on all threads of the ThreadPool
+void computePreIntegrationTable(const unsigned char *tfData, int numEntries,
+	unsigned char *table);
+
+#endif // _PREINTEGRATION_H_
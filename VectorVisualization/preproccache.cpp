@@ -0,0 +1,383 @@
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <direct.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/types.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+#include "threadpool.h"
+#include "preproccache.h"
+
+
+#define CACHE_MAGIC        "VVCACHE"
+#define CACHE_VERSION      1
+// input data is hashed in blocks of this size on all threads
+#define CACHE_HASH_BLOCK   (1 << 20)
+
+
+// layout of the first 64 bytes of every entry, the payload follows
+struct CacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t offset;     // of the payload from the start of the file
+	char kind[8];
+	uint64_t key;
+	uint64_t size;       // of the payload in bytes
+	uint64_t checksum;   // hash of the payload
+	unsigned char reserved[16];
+};
+
+static_assert(sizeof(CacheHeader) == 64, "cache header must be 64 bytes");
+
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mixWord(uint64_t h, uint64_t w)
+{
+	h ^= w * 0x9E3779B97F4A7C15ULL;
+	return rotl64(h, 31) * 0xBF58476D1CE4E5B9ULL;
+}
+
+static inline uint64_t finalize(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p = static_cast<const unsigned char*>(data);
+	uint64_t h = seed ^ (size * 0x87C37B91114253D5ULL);
+	uint64_t w;
+	size_t i;
+
+	for (i = 0; i + 8 <= size; i += 8)
+	{
+		memcpy(&w, p + i, 8);
+		h = mixWord(h, w);
+	}
+	if (i < size)
+	{
+		w = 0;
+		memcpy(&w, p + i, size - i);
+		h = mixWord(h, w);
+	}
+
+	return finalize(h);
+}
+
+
+uint64_t hashContent(const void *data, size_t size, uint64_t seed)
+{
+	const unsigned char *p = static_cast<const unsigned char*>(data);
+	int numBlocks = static_cast<int>((size + CACHE_HASH_BLOCK - 1) / CACHE_HASH_BLOCK);
+
+	if (numBlocks < 2)
+		return hashBytes(data, size, seed);
+
+	std::vector<uint64_t> blockHash(numBlocks);
+	ThreadPool::getInstance().parallelFor(numBlocks, [&](int begin, int end)
+	{
+		for (int b = begin; b < end; ++b)
+		{
+			size_t offset = (size_t)b * CACHE_HASH_BLOCK;
+			size_t len = (size - offset < CACHE_HASH_BLOCK) ? size - offset : CACHE_HASH_BLOCK;
+			blockHash[b] = hashBytes(p + offset, len, (uint64_t)b);
+		}
+	});
+
+	return hashBytes(&blockHash[0], blockHash.size() * sizeof(uint64_t),
+		seed ^ size);
+}
+
+
+// --------------------------------------------------
+
+PreprocKey::PreprocKey(const char *kind)
+{
+	memset(_kind, 0, sizeof(_kind));
+	strncpy(_kind, kind, sizeof(_kind) - 1);
+	_hash = hashBytes(_kind, sizeof(_kind), CACHE_VERSION);
+}
+
+
+void PreprocKey::add(const void *data, size_t size)
+{
+	_hash = hashBytes(data, size, _hash);
+}
+
+
+void PreprocKey::addContent(const void *data, size_t size)
+{
+	_hash = hashContent(data, size, _hash);
+}
+
+
+// --------------------------------------------------
+
+PreprocCache::PreprocCache(void) : _enabled(false), _hits(0), _misses(0),
+	_stores(0)
+{
+	// nothing is written until a directory is set and the cache enabled
+	_dir[0] = '\0';
+}
+
+
+PreprocCache& PreprocCache::getInstance(void)
+{
+	static PreprocCache cache;
+	return cache;
+}
+
+
+void PreprocCache::setDirectory(const char *dir)
+{
+	size_t len;
+
+	strncpy(_dir, dir, sizeof(_dir) - 1);
+	_dir[sizeof(_dir) - 1] = '\0';
+
+	// strip trailing separators
+	len = strlen(_dir);
+	while ((len > 1) && ((_dir[len - 1] == '/') || (_dir[len - 1] == '\\')))
+		_dir[--len] = '\0';
+}
+
+
+void PreprocCache::getFileName(const PreprocKey &key, char *fileName, size_t len)
+{
+	snprintf(fileName, len, "%s/%s-%016llx.bin", _dir, key.getKind(),
+		(unsigned long long)key.getHash());
+}
+
+
+bool PreprocCache::map(const PreprocKey &key, size_t size, PreprocCacheView *view)
+{
+	char fileName[320];
+	const CacheHeader *header;
+	const unsigned char *base;
+	size_t fileSize;
+
+	if (!view)
+		return false;
+	unmap(view);
+	if (!_enabled)
+		return false;
+
+	getFileName(key, fileName, sizeof(fileName));
+
+#ifdef _WIN32
+	LARGE_INTEGER largeSize;
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+	if (!GetFileSizeEx(file, &largeSize) || (largeSize.QuadPart < (LONGLONG)sizeof(CacheHeader)))
+	{
+		CloseHandle(file);
+		fprintf(stderr, "PreprocCache:  Entry \"%s\" is truncated.\n", fileName);
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+	fileSize = (size_t)largeSize.QuadPart;
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	void *data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (!data)
+	{
+		if (mapping)
+			CloseHandle(mapping);
+		CloseHandle(file);
+		fprintf(stderr, "PreprocCache:  Mapping \"%s\" failed.\n", fileName);
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+	view->_file = file;
+	view->_mapping = mapping;
+#else
+	struct stat st;
+	int fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+	if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(CacheHeader)))
+	{
+		close(fd);
+		fprintf(stderr, "PreprocCache:  Entry \"%s\" is truncated.\n", fileName);
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+	fileSize = (size_t)st.st_size;
+	void *data = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+	{
+		fprintf(stderr, "PreprocCache:  Mapping \"%s\" failed.\n", fileName);
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+	madvise(data, fileSize, MADV_WILLNEED);
+#endif
+
+	view->_base = data;
+	view->_mapSize = fileSize;
+
+	// validate the header before the payload is touched
+	base = static_cast<const unsigned char*>(data);
+	header = reinterpret_cast<const CacheHeader*>(base);
+	if ((memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) != 0)
+		|| (header->version != CACHE_VERSION)
+		|| (header->offset < sizeof(CacheHeader))
+		|| (memcmp(header->kind, key.getKind(), sizeof(header->kind)) != 0)
+		|| (header->key != key.getHash())
+		|| (header->size != size)
+		|| ((uint64_t)fileSize < (uint64_t)header->offset + header->size)
+		|| (hashContent(base + header->offset, size, 0) != header->checksum))
+	{
+		fprintf(stderr, "PreprocCache:  Entry \"%s\" is invalid, ignored.\n",
+			fileName);
+		unmap(view);
+		std::lock_guard<std::mutex> lock(_mutex);
+		++_misses;
+		return false;
+	}
+
+	view->data = base + header->offset;
+	view->size = size;
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	++_hits;
+	return true;
+}
+
+
+void PreprocCache::unmap(PreprocCacheView *view)
+{
+	if (!view || !view->_base)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(view->_base);
+	CloseHandle((HANDLE)view->_mapping);
+	CloseHandle((HANDLE)view->_file);
+#else
+	munmap(view->_base, view->_mapSize);
+#endif
+
+	view->data = NULL;
+	view->size = 0;
+	view->_base = NULL;
+	view->_mapSize = 0;
+	view->_file = NULL;
+	view->_mapping = NULL;
+}
+
+
+bool PreprocCache::load(const PreprocKey &key, void *buffer, size_t size)
+{
+	PreprocCacheView view;
+
+	if (!map(key, size, &view))
+		return false;
+	memcpy(buffer, view.data, size);
+	unmap(&view);
+
+	return true;
+}
+
+
+bool PreprocCache::store(const PreprocKey &key, const void *data, size_t size)
+{
+	char fileName[320];
+	char tmpName[340];
+	CacheHeader header;
+	FILE *fp;
+	bool ok;
+
+	if (!_enabled || !data)
+		return false;
+
+#ifdef _WIN32
+	_mkdir(_dir);
+#else
+	mkdir(_dir, 0755);
+#endif
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_VERSION;
+	header.offset = sizeof(CacheHeader);
+	memcpy(header.kind, key.getKind(), sizeof(header.kind));
+	header.key = key.getHash();
+	header.size = size;
+	header.checksum = hashContent(data, size, 0);
+
+	// write to a temporary file first so a crash never leaves a
+	// half-written entry under the final name
+	getFileName(key, fileName, sizeof(fileName));
+	snprintf(tmpName, sizeof(tmpName), "%s.tmp", fileName);
+
+	fp = fopen(tmpName, "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "PreprocCache:  Could not create \"%s\".\n", tmpName);
+		return false;
+	}
+	ok = (fwrite(&header, sizeof(header), 1, fp) == 1)
+		&& (fwrite(data, 1, size, fp) == size);
+	ok = (fclose(fp) == 0) && ok;
+
+#ifdef _WIN32
+	ok = ok && (MoveFileExA(tmpName, fileName, MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+	ok = ok && (rename(tmpName, fileName) == 0);
+#endif
+	if (!ok)
+	{
+		fprintf(stderr, "PreprocCache:  Writing \"%s\" failed.\n", fileName);
+		remove(tmpName);
+		return false;
+	}
+
+	std::lock_guard<std::mutex> lock(_mutex);
+	++_stores;
+	return true;
+}
+
+
+void PreprocCache::printStatistics(void)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	if (!_enabled)
+		return;
+	fprintf(stderr, "PreprocCache:  %u hits, %u misses, %u entries written "
+		"to \"%s\"\n", _hits, _misses, _stores, _dir);
+}
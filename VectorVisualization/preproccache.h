@@ -0,0 +1,115 @@
+#ifndef _PREPROCCACHE_H_
+#define _PREPROCCACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+
+
+// Content addressed on-disk cache for the results of preprocessing
+// (noise gradients, normalized vector textures, illumination tables,
+// histograms). An entry is identified by a 64 bit hash over the input
+// data and all parameters of the computation, so changed inputs never
+// hit a stale entry and renamed files still do.
+//
+// Each entry is a single file "<kind>-<key>.bin" in the cache directory
+// with a fixed size header followed by the payload at a 64 byte aligned
+// offset. The header is validated before the payload is used, so the
+// payload can be mapped directly into memory.
+
+
+// 64 bit hash of data, continued from seed
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed);
+// hash of large data, blocks of it are hashed on all threads
+uint64_t hashContent(const void *data, size_t size, uint64_t seed);
+
+
+// identifies a cache entry, parameters and input data are hashed in
+class PreprocKey
+{
+public:
+	// kind names the type of entry, at most 7 characters
+	explicit PreprocKey(const char *kind);
+
+	// small parameters (sizes, flags, material values)
+	void add(const void *data, size_t size);
+	void add(int value) { add(&value, sizeof(value)); }
+	void add(float value) { add(&value, sizeof(value)); }
+
+	// large input data (volumes), hashed on all threads
+	void addContent(const void *data, size_t size);
+
+	uint64_t getHash(void) const { return _hash; }
+	const char* getKind(void) const { return _kind; }
+
+private:
+	char _kind[8];
+	uint64_t _hash;
+};
+
+
+// read-only view of a cache entry, valid until PreprocCache::unmap()
+struct PreprocCacheView
+{
+	PreprocCacheView(void) : data(NULL), size(0), _base(NULL), _mapSize(0),
+		_file(NULL), _mapping(NULL) {}
+
+	const void *data;
+	size_t size;
+
+	// platform handles, only used by PreprocCache
+	void *_base;
+	size_t _mapSize;
+	void *_file;
+	void *_mapping;
+};
+
+
+class PreprocCache
+{
+public:
+	static PreprocCache& getInstance(void);
+
+	// directory holding the entries, created on the first store()
+	void setDirectory(const char *dir);
+	const char* getDirectory(void) { return _dir; }
+
+	// disabled by default
+	void enable(bool enable) { _enabled = enable; }
+	bool isEnabled(void) { return _enabled; }
+
+	// map the entry of key with a payload of exactly size bytes
+	// returns false if there is no valid entry
+	bool map(const PreprocKey &key, size_t size, PreprocCacheView *view);
+	static void unmap(PreprocCacheView *view);
+
+	// copy the entry of key into buffer, returns false if there is no valid entry
+	bool load(const PreprocKey &key, void *buffer, size_t size);
+	// write an entry, an existing entry of key is replaced
+	bool store(const PreprocKey &key, const void *data, size_t size);
+
+	unsigned int getHitCount(void) { return _hits; }
+	unsigned int getMissCount(void) { return _misses; }
+
+	// print the counters to stderr
+	void printStatistics(void);
+
+protected:
+	PreprocCache(void);
+
+	void getFileName(const PreprocKey &key, char *fileName, size_t len);
+
+private:
+	PreprocCache(const PreprocCache&);
+	PreprocCache& operator=(const PreprocCache&);
+
+	char _dir[256];
+	bool _enabled;
+	unsigned int _hits;
+	unsigned int _misses;
+	unsigned int _stores;
+
+	std::mutex _mutex;
+};
+
+#endif // _PREPROCCACHE_H_
@@ -32,7 +32,21 @@
 #include <stdlib.h>
 #include <iostream>
 #include <fstream>
+
+#ifdef _WIN32
+#  include <windows.h>
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
 #include "reader.h"
+#include "brickfile.h"
+#include "manifest.h"
 #include "types.h"
 
 
@@ -68,6 +82,9 @@ DatFile::DatFile(void)
     _sizes[0] = _sizes[1] = _sizes[2] = 0;
     _dists[0] = _dists[1] = _dists[2] = 1.0f;
 	_timestep = _timeStepBeg;
+
+    _bricked = false;
+    _manifest = NULL;
 }
 
 
@@ -75,10 +92,11 @@ DatFile::~DatFile(void)
 {
     delete [] _datFileName;
     delete [] _rawFileName;
+    delete _manifest;
 }
 
 
-bool DatFile::parseDatFile(char *datFileName)
+bool DatFile::parseDatFile(char *datFileName, bool useManifest)
 {
     char *cp, line[255], rawFileName[255];
     char tmp[10];
@@ -89,6 +107,11 @@ bool DatFile::parseDatFile(char *datFileName)
     delete [] _rawFileName;
     _datFileName = NULL;
     _rawFileName = NULL;
+    _rawDir.clear();
+    _bricked = false;
+    delete _manifest;
+    _manifest = NULL;
+    _checked.clear();
 
     if (!datFileName)
         return false;
@@ -231,6 +254,7 @@ bool DatFile::parseDatFile(char *datFileName)
             return false;
         }
         strcpy(cp + 1, _rawFileName);
+        _rawDir.assign(line, cp + 1 - line);
         delete [] _rawFileName;
         _rawFileName = new char[strlen(line)+1];
         strcpy(_rawFileName, line);
@@ -245,6 +269,39 @@ bool DatFile::parseDatFile(char *datFileName)
     }
     fclose(fp);
 
+    // brick files are recognized by their magic, all time steps have to be
+    // bricked then
+    if (BrickFile::isBrickFile(rawFileName))
+    {
+        BrickFile file;
+
+        _bricked = true;
+        if (!openBrickFile(_timeStepBeg, &file))
+            return false;
+        fprintf(stdout, "DatFile:  Bricked data set, %d^3 voxels per brick.\n",
+                file.getBrickSize());
+    }
+
+    // a manifest lists all time steps, they are checked on first access
+    if (useManifest)
+    {
+        std::string manifestName = TimeSeriesManifest::getFileName(_datFileName);
+        _manifest = new TimeSeriesManifest;
+        if (_manifest->load(manifestName.c_str())
+            && _manifest->matches(_dataType, _dataDim, _sizes, _timeStepBeg, _timeStepEnd))
+        {
+            fprintf(stdout, "DatFile:  Using manifest \"%s\" (%d time steps).\n",
+                    manifestName.c_str(), _manifest->getNumTimeSteps());
+            _checked.assign(_timeStepEnd - _timeStepBeg + 1, 0);
+            return true;
+        }
+        if (_manifest->getNumTimeSteps() > 0)
+            fprintf(stderr, "DatFile:  Manifest \"%s\" does not match the DAT file, "
+                    "ignored.\n", manifestName.c_str());
+        delete _manifest;
+        _manifest = NULL;
+    }
+
     // check for all timesteps except first
     for (int i=_timeStepBeg+1; i<=_timeStepEnd; ++i)
     {
@@ -263,13 +320,148 @@ bool DatFile::parseDatFile(char *datFileName)
 }
 
 
-void* DatFile::readRawData(int timeStep)
+void DatFile::getRawFileName(int timeStep, char *fileName, size_t len)
+{
+    const TimeStepInfo *info = _manifest ? _manifest->getTimeStep(timeStep) : NULL;
+
+    if (info)
+    {
+        // relative names are resolved like the one of the DAT file
+        if ((info->path[0] == DIR_SEP) || (info->path[0] == DIR_SEP_WIN)
+            || (info->path.find(':') != std::string::npos))
+            snprintf(fileName, len, "%s", info->path.c_str());
+        else
+            snprintf(fileName, len, "%s%s", _rawDir.c_str(), info->path.c_str());
+    }
+    else
+    {
+        snprintf(fileName, len, _rawFileName, timeStep);
+    }
+}
+
+
+bool DatFile::getFileSize(const char *fileName, uint64_t *size)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(fileName, &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(fileName, &st) != 0)
+        return false;
+#endif
+    *size = (uint64_t)st.st_size;
+    return true;
+}
+
+
+bool DatFile::writeDatFile(const char *datFileName, DataType dataType,
+                           int dataDim, const int sizes[3], const float dists[3],
+                           const void *data)
 {
+    std::string rawFileName(datFileName);
+    std::string objectFileName;
+    size_t pos;
     size_t size;
-    std::ifstream in;
-    int dataTypeSize;
-    char rawFileName[255];
-    void *data = NULL;
+    const char *format;
+    FILE *fp;
+    bool ok;
+
+    switch (dataType)
+    {
+    case DATRAW_UCHAR:
+        format = "UCHAR";
+        break;
+    case DATRAW_USHORT:
+        format = "USHORT";
+        break;
+    case DATRAW_FLOAT:
+        format = "FLOAT";
+        break;
+    default:
+        fprintf(stderr, "DatFile:  Unknown data type.\n");
+        return false;
+    }
+
+    pos = rawFileName.rfind('.');
+    if ((pos != std::string::npos)
+        && (rawFileName.find_first_of("/\\", pos) == std::string::npos))
+        rawFileName.erase(pos);
+    rawFileName += ".raw";
+
+    // the RAW file is stored next to the DAT file
+    pos = rawFileName.find_last_of("/\\");
+    objectFileName = (pos == std::string::npos) ? rawFileName : rawFileName.substr(pos + 1);
+
+    size = getDataTypeSize(dataType) * dataDim * (size_t)sizes[0] * sizes[1] * sizes[2];
+    if (! (fp = fopen(rawFileName.c_str(), "wb")))
+    {
+        fprintf(stderr, "DatFile:  Could not create RAW file \"%s\".\n",
+                rawFileName.c_str());
+        return false;
+    }
+    ok = (fwrite(data, 1, size, fp) == size);
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok)
+    {
+        fprintf(stderr, "DatFile:  Writing RAW file \"%s\" failed.\n",
+                rawFileName.c_str());
+        return false;
+    }
+
+    if (! (fp = fopen(datFileName, "w")))
+    {
+        fprintf(stderr, "DatFile:  Could not create DAT file \"%s\".\n", datFileName);
+        return false;
+    }
+    fprintf(fp, "ObjectFileName: %s\n", objectFileName.c_str());
+    fprintf(fp, "Resolution: %d %d %d\n", sizes[0], sizes[1], sizes[2]);
+    fprintf(fp, "SliceThickness: %g %g %g\n", dists[0], dists[1], dists[2]);
+    if (dataDim > 1)
+        fprintf(fp, "Format: %s%d\n", format, dataDim);
+    else
+        fprintf(fp, "Format: %s\n", format);
+
+    return (fclose(fp) == 0);
+}
+
+
+bool DatFile::checkRawFile(int timeStep, const char *fileName)
+{
+    const TimeStepInfo *info;
+    uint64_t size;
+
+    if (!_manifest)
+        return true;
+
+    std::lock_guard<std::mutex> lock(_checkMutex);
+    if (_checked[timeStep - _timeStepBeg])
+        return true;
+
+    info = _manifest->getTimeStep(timeStep);
+    if (!getFileSize(fileName, &size))
+    {
+        fprintf(stderr, "DatFile:  Could not open RAW file \"%s\" for timestep %d.\n",
+                fileName, timeStep);
+        return false;
+    }
+    if (info && (info->size != size))
+    {
+        fprintf(stderr, "DatFile:  RAW file \"%s\" does not match the manifest "
+                "(%llu instead of %llu bytes).\n", fileName,
+                (unsigned long long)size, (unsigned long long)info->size);
+        return false;
+    }
+    _checked[timeStep - _timeStepBeg] = 1;
+
+    return true;
+}
+
+
+void* DatFile::readRawData(int timeStep)
+{
+    char *data = NULL;
 
     // check for boundaries
     if ((timeStep < _timeStepBeg) || (timeStep > _timeStepEnd))
@@ -277,31 +469,226 @@ void* DatFile::readRawData(int timeStep)
         return NULL;
     }
 
-    snprintf(rawFileName, 255, _rawFileName, timeStep);
+    data = new char[getRawDataSize()];
+    if (!readRawData(timeStep, data))
+    {
+        delete [] data;
+        return NULL;
+    }
+
+    return data;
+}
+
+
+bool DatFile::readRawData(int timeStep, void *buffer)
+{
+    std::ifstream in;
+    char rawFileName[255];
+
+    // check for boundaries
+    if (!buffer || (timeStep < _timeStepBeg) || (timeStep > _timeStepEnd))
+    {
+        return false;
+    }
+
+    if (_bricked)
+    {
+        BrickFile file;
+        return openBrickFile(timeStep, &file) && file.readVolume(buffer);
+    }
+
+    getRawFileName(timeStep, rawFileName, 255);
+    if (!checkRawFile(timeStep, rawFileName))
+        return false;
 
     in.open(rawFileName, std::ios::in | std::ios::binary);
     if (!in.is_open())
     {
         fprintf(stderr, "Could not open RAW file. No file \"%s\".\n",
                 rawFileName);
-            return NULL;
+            return false;
     }
 
-    dataTypeSize = getDataTypeSize(_dataType);
-    size = _dataDim * _sizes[0] * _sizes[1] * _sizes[2];
-
-    data = new char[dataTypeSize * size];
-
-    in.read((char*)data, static_cast<std::streamsize>(dataTypeSize*size));
+    in.read((char*)buffer, static_cast<std::streamsize>(getRawDataSize()));
     if (in.fail())
     {
         fprintf(stderr, "Reading volume data \"%s\" failed.\n",
                 _rawFileName);
         in.clear();
+        in.close();
+        return false;
     }
     in.close();
 
-    return data;
+    return true;
+}
+
+
+bool DatFile::openBrickFile(int timeStep, BrickFile *file)
+{
+    char rawFileName[255];
+
+    if (!file || !_bricked || (timeStep < _timeStepBeg) || (timeStep > _timeStepEnd))
+        return false;
+
+    getRawFileName(timeStep, rawFileName, 255);
+    if (!checkRawFile(timeStep, rawFileName) || !file->open(rawFileName))
+        return false;
+
+    if ((file->getDataType() != _dataType) || (file->getDataDimension() != _dataDim)
+        || (file->getDataSizes()[0] != _sizes[0]) || (file->getDataSizes()[1] != _sizes[1])
+        || (file->getDataSizes()[2] != _sizes[2]))
+    {
+        fprintf(stderr, "DatFile:  Brick file \"%s\" does not match the DAT file.\n",
+                rawFileName);
+        file->close();
+        return false;
+    }
+
+    return true;
+}
+
+
+bool DatFile::readBrick(int timeStep, int index, void *buffer)
+{
+    BrickFile file;
+
+    return openBrickFile(timeStep, &file) && file.readBrick(index, buffer);
+}
+
+
+size_t DatFile::getRawDataSize(void)
+{
+    return getDataTypeSize(_dataType) * _dataDim
+        * (size_t)_sizes[0] * _sizes[1] * _sizes[2];
+}
+
+
+bool DatFile::mapRawData(int timeStep, MappedRawData *view)
+{
+    size_t size;
+    char rawFileName[255];
+
+    if (!view)
+        return false;
+    unmapRawData(view);
+
+    // check for boundaries
+    if ((timeStep < _timeStepBeg) || (timeStep > _timeStepEnd))
+    {
+        return false;
+    }
+
+    size = getRawDataSize();
+    if (_bricked)
+    {
+        view->_decoded = new char[size];
+        if (!readRawData(timeStep, view->_decoded))
+        {
+            delete [] view->_decoded;
+            view->_decoded = NULL;
+            return false;
+        }
+        view->data = view->_decoded;
+        view->size = size;
+        return true;
+    }
+
+    getRawFileName(timeStep, rawFileName, 255);
+    if (!checkRawFile(timeStep, rawFileName))
+        return false;
+
+#ifdef _WIN32
+    LARGE_INTEGER fileSize;
+    HANDLE file = CreateFileA(rawFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "Could not open RAW file. No file \"%s\".\n",
+                rawFileName);
+        return false;
+    }
+    if (!GetFileSizeEx(file, &fileSize) || ((size_t)fileSize.QuadPart < size))
+    {
+        fprintf(stderr, "DatFile:  RAW file \"%s\" is too small.\n", rawFileName);
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        fprintf(stderr, "DatFile:  Mapping RAW file \"%s\" failed.\n", rawFileName);
+        CloseHandle(file);
+        return false;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size);
+    if (!data)
+    {
+        fprintf(stderr, "DatFile:  Mapping RAW file \"%s\" failed.\n", rawFileName);
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    view->_file = file;
+    view->_mapping = mapping;
+#else
+    struct stat st;
+    int fd = open(rawFileName, O_RDONLY);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Could not open RAW file. No file \"%s\".\n",
+                rawFileName);
+        return false;
+    }
+    if ((fstat(fd, &st) != 0) || ((size_t)st.st_size < size))
+    {
+        fprintf(stderr, "DatFile:  RAW file \"%s\" is too small.\n", rawFileName);
+        close(fd);
+        return false;
+    }
+    void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        perror("DatFile:  mapping RAW file failed");
+        return false;
+    }
+    // the whole time step is streamed once front to back
+    madvise(data, size, MADV_SEQUENTIAL);
+    madvise(data, size, MADV_WILLNEED);
+#endif
+
+    view->data = data;
+    view->size = size;
+
+    return true;
+}
+
+
+void DatFile::unmapRawData(MappedRawData *view)
+{
+    if (!view || !view->data)
+        return;
+
+    if (view->_decoded)
+        delete [] view->_decoded;
+    else
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(view->data);
+        CloseHandle((HANDLE)view->_mapping);
+        CloseHandle((HANDLE)view->_file);
+#else
+        munmap(const_cast<void*>(view->data), view->size);
+#endif
+    }
+
+    view->data = NULL;
+    view->size = 0;
+    view->_file = NULL;
+    view->_mapping = NULL;
+    view->_decoded = NULL;
 }
 
 
@@ -332,5 +719,22 @@ int DatFile::getNextTimeStep()
 
 int DatFile::NextTimeStep()
 {
-	return (_timestep == _timeStepEnd) ? _timeStepBeg : _timestep + 1;
+	return getFollowingTimeStep(_timestep);
+}
+
+int DatFile::getFollowingTimeStep(int timeStep)
+{
+	return (timeStep >= _timeStepEnd) ? _timeStepBeg : timeStep + 1;
+}
+
+bool DatFile::setCurTimeStep(int timeStep)
+{
+	if ((timeStep < _timeStepBeg) || (timeStep > _timeStepEnd))
+	{
+		fprintf(stderr, "DatFile:  Time step %d is outside of %d-%d.\n",
+			timeStep, _timeStepBeg, _timeStepEnd);
+		return false;
+	}
+	_timestep = timeStep;
+	return true;
 }
\ No newline at end of file
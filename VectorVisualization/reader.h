@@ -29,11 +29,40 @@
 #ifndef _READER_H_
 #define _READER_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+
 enum DataType { DATRAW_NONE, DATRAW_UCHAR, DATRAW_USHORT, DATRAW_FLOAT };
 
 int getDataTypeSize(DataType t);
 
 
+// read-only view of a memory mapped RAW file
+// the view stays valid until DatFile::unmapRawData() is called,
+// the memory must never be freed with delete []
+struct MappedRawData
+{
+    MappedRawData(void) : data(NULL), size(0), _file(NULL), _mapping(NULL),
+        _decoded(NULL) {}
+
+    const void *data;
+    size_t size;
+
+    // platform handles (file handle and mapping object on Windows)
+    void *_file;
+    void *_mapping;
+    // brick files cannot be mapped, they are decoded into this buffer
+    char *_decoded;
+};
+
+
+class TimeSeriesManifest;
+class BrickFile;
+
+
 class DatFile
 {
 public:
@@ -41,12 +70,51 @@ public:
     DatFile(void);
     ~DatFile(void);
 
-    bool parseDatFile(char *datFileName);
+    // if useManifest is set and a matching manifest exists next to the DAT
+    // file, the RAW files are not checked until they are accessed
+    bool parseDatFile(char *datFileName, bool useManifest=true);
     
     void* readRawData(int timeStep=0);
+    // read the RAW file of the given time step into buffer, which has to
+    // hold at least getRawDataSize() bytes, return true if successful
+    bool readRawData(int timeStep, void *buffer);
+    // size of one time step in bytes
+    size_t getRawDataSize(void);
+
+    // map the RAW file of the given time step read-only into memory
+    // instead of copying it, return true if successful
+    // bricked time steps are decoded into memory owned by the view
+    bool mapRawData(int timeStep, MappedRawData *view);
+    static void unmapRawData(MappedRawData *view);
+
+    // true if the time steps are stored in brick files instead of RAW
+    // files (see BrickFile), readRawData() and mapRawData() decode them
+    bool isBricked(void) { return _bricked; }
+    // open the brick file of the given time step for random access to
+    // single bricks, return true if successful
+    bool openBrickFile(int timeStep, BrickFile *file);
+    // decode one brick of the given time step into buffer, which has to
+    // hold the voxels of BrickFile::getBrickBox()
+    bool readBrick(int timeStep, int index, void *buffer);
 
     const char* getDatFileName(void) { return _datFileName; }
     const char* getRawFileName(void) { return _rawFileName; }
+    // name of the RAW file of the given time step
+    void getRawFileName(int timeStep, char *fileName, size_t len);
+    // directory added to the RAW file names of the DAT file, may be empty
+    const char* getRawDirectory(void) { return _rawDir.c_str(); }
+    // NULL if no manifest is used
+    const TimeSeriesManifest* getManifest(void) { return _manifest; }
+
+    // size of a file in bytes, returns false if it does not exist
+    static bool getFileSize(const char *fileName, uint64_t *size);
+
+    // write a single volume as DAT file and RAW file, the RAW file gets
+    // the name of the DAT file with the extension ".raw"
+    // return true if successful
+    static bool writeDatFile(const char *datFileName, DataType dataType,
+                             int dataDim, const int sizes[3], const float dists[3],
+                             const void *data);
 
     DataType getDataType(void) { return _dataType; }
     const int* getDataSizes(void) { return _sizes; }
@@ -56,10 +124,16 @@ public:
     const int getTimeStepEnd(void) { return _timeStepEnd; }
 	int getNextTimeStep();
 	int NextTimeStep();
+	// time step after the given one, wraps around at the end
+	int getFollowingTimeStep(int timeStep);
 	int getCurTimeStep(void) { return _timestep; }
+	// returns false if timeStep is outside of the time series
+	bool setCurTimeStep(int timeStep);
 
 protected:
     void parseDataDim(char *line);
+    // with a manifest the RAW file is checked on its first access only
+    bool checkRawFile(int timeStep, const char *fileName);
 
 private:
 
@@ -73,6 +147,12 @@ private:
     int _timeStepBeg;
     int _timeStepEnd; // == timeStepBeg if only single timestep
 	int _timestep;
+
+    std::string _rawDir;
+    bool _bricked;
+    TimeSeriesManifest *_manifest;
+    std::vector<unsigned char> _checked;
+    std::mutex _checkMutex;
 };
 
 #endif // _READER_H_
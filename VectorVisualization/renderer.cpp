@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <math.h>
+#include <float.h>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -27,22 +28,83 @@
 #include "camera.h"
 #include "types.h"
 #include "renderer.h"
+#include "licengine.h"
+#include "timer.h"
+
+
+// edge length of the tile of blue noise in the offset texture
+#define BLUE_NOISE_SIZE  64
+
+
+// ranks of a tile of blue noise: starting with one pixel the pixel
+// farthest from all previous ones (lowest gaussian energy on the torus)
+// is added until the tile is full, the ranks are scaled to [0,1)
+static void createBlueNoise(int size, std::vector<float> &values)
+{
+	const double sigma = 1.5;
+	const int n = size * size;
+	std::vector<double> kernel(n);
+	std::vector<double> energy(n);
+	std::vector<bool> used(n, false);
+
+	for (int y = 0; y < size; ++y)
+	{
+		for (int x = 0; x < size; ++x)
+		{
+			int dx = MIN(x, size - x);
+			int dy = MIN(y, size - y);
+			kernel[y * size + x] = exp(-(dx * dx + dy * dy) / (2.0 * sigma * sigma));
+		}
+	}
+	// tiny offsets break the ties of the symmetric energy
+	for (int i = 0; i < n; ++i)
+		energy[i] = 1e-6 * ((i * 2654435761u) % 1024);
+
+	values.assign(n, 0.0f);
+	for (int rank = 0; rank < n; ++rank)
+	{
+		int p = -1;
+
+		for (int i = 0; i < n; ++i)
+		{
+			if (!used[i] && ((p < 0) || (energy[i] < energy[p])))
+				p = i;
+		}
+		used[p] = true;
+		values[p] = (rank + 0.5f) / n;
+
+		int px = p % size;
+		int py = p / size;
+		for (int y = 0; y < size; ++y)
+		{
+			const double *k = &kernel[((y - py + size) % size) * size];
+			for (int x = 0; x < size; ++x)
+				energy[y * size + x] += k[(x - px + size) % size];
+		}
+	}
+}
 
 
 Renderer::Renderer(void) : _framebuffer(0), _depthbuffer(0), _stencilbuffer(0),
 _winWidth(1), _winHeight(1), _useFBO(false),
 _renderMode(VOLIC_RAYCAST), _vd(NULL), _licFilter(NULL),
-_dataTex(NULL), _noiseTex(NULL), _licKernelTex(NULL), _scalarTex(NULL),
-_lambda2Tex(NULL), _tfRGBTex(NULL), _tfAlphaOpacTex(NULL),
+_licVolumeSize(LIC_VOLUME_SIZE), _useLICBricks(false), _layeredLIC(true), _layeredLICReady(false),
+_progressive(false), _maxAccumFrames(PROGRESSIVE_DEFAULT_FRAMES), _accumFrames(0),
+_dataTex(NULL), _dataTex2(NULL), _keyFrameWeight(0.0f), _keyFrameInterp(false),
+_dataLevels(1), _useLOD(true), _lodBias(0.0f), _lod(0),
+_macroCells(NULL), _useSkipping(true), _preIntegration(true), _licWindow(true),
+_noiseTex(NULL), _licKernelTex(NULL), _scalarTex(NULL),
+_lambda2Tex(NULL), _tfRGBTex(NULL), _tfAlphaOpacTex(NULL), _tfPreIntTex(NULL),
 _illumZoecklerTex(NULL), _illumMalloDiffTex(NULL),
 _illumMalloSpecTex(NULL), _quadric(NULL), _storeFrame(true),
-_lowRes(false), _wireframe(false), _screenShot(false), _recording(false), _licParams(NULL),
+_lowRes(false), _wireframe(false), _screenShot(false), _recording(false), _offscreen(false), _licParams(NULL),
 _debug(false), _isAnimationOn(false)
 
 {
 	_imgBufferTex0 = new Texture;
 	_imgBufferTex1 = new Texture;
 	_mcOffsetTex = new Texture;
+	_accumTex = new Texture;
 
 	_nearClipPlane.setActive(true);
 
@@ -54,6 +116,10 @@ _debug(false), _isAnimationOn(false)
 
 Renderer::~Renderer(void)
 {
+	// pending frames may still go into the video
+	_capture.release();
+	_video.close();
+
 	// unbind fbo
 	if (_framebuffer && _depthbuffer
 		&& glFramebufferTexture2DEXT && glBindFramebufferEXT
@@ -70,10 +136,13 @@ Renderer::~Renderer(void)
 	}
 	glDeleteTextures(1, &_imgBufferTex0->id);
 	glDeleteTextures(1, &_imgBufferTex1->id);
+	glDeleteTextures(1, &_accumTex->id);
+	glDeleteTextures(1, &_mcOffsetTex->id);
 
 	delete _imgBufferTex0;
 	delete _imgBufferTex1;
 	delete _mcOffsetTex;
+	delete _accumTex;
 
 	if (_quadric)
 		gluDeleteQuadric(_quadric);
@@ -94,7 +163,11 @@ void Renderer::init(char *defines)
 
 	//init volume buffer
 	// A 3D texture buffer to store LIC value according to the vectore field
-	_licvolumebuffer = new VolumeBuffer(GL_RGBA16F_ARB, 512, 512, 512, 2);
+	_licvolumebuffer = new VolumeBuffer(GL_RGBA16F_ARB, _licVolumeSize, _licVolumeSize,
+		_licVolumeSize, 2);
+	int licSize[3] = { _licvolumebuffer->getWidth(), _licvolumebuffer->getHeight(),
+		_licvolumebuffer->getDepth() };
+	_licBricks.init(licSize);
 
 	loadGLSLShader(defines);
 	CHECK_FOR_OGL_ERROR();
@@ -127,9 +200,14 @@ void Renderer::render(bool update)
 {
 	Vector3 dir = Vector3_new(0.0, 0.0, 1.0);
 	Quaternion q_camInv = Quaternion_inverse(_cam->getQuaternion());
+	bool progressive = isProgressiveActive();
+	bool refine;
 
 	CHECK_FOR_OGL_ERROR();
 
+	// encode the frames whose readback has finished meanwhile
+	_capture.poll();
+
 	_cam->setCamera();
 	CHECK_FOR_OGL_ERROR();
 
@@ -147,9 +225,21 @@ void Renderer::render(bool update)
 
 	CHECK_FOR_OGL_ERROR();
 
+	// distant views and low resolution rendering sample coarser levels
+	if (update && (_dataLevels > 1))
+		setLevelOfDetail(_useLOD ? selectLevelOfDetail() : 0);
+	if (update)
+		updateMacroCells();
+
+	// an update starts the average of the progressive refinement again,
+	// otherwise frames are added until the image is complete
+	if (update || !progressive)
+		_accumFrames = 0;
+	refine = progressive && !update && (_accumFrames < _maxAccumFrames);
+
 	// only redraw complete scene into FBO when necessary
 	// use previous result otherwise 
-	if (update)
+	if (update || refine)
 	{
 		// update viewport to render width and heigth
 		// when using low resolution rendering
@@ -224,6 +314,9 @@ void Renderer::render(bool update)
 			glDisable(_imgBufferTex0->texTarget);
 			CHECK_FOR_OGL_ERROR();
 		}
+
+		if (progressive)
+			accumulateFrame();
 	}
 	if (_useFBO || _storeFrame || _screenShot || _recording)
 		renderBackground();
@@ -337,6 +430,38 @@ bool Renderer::saveFrameBuffer(const char *fileName)
 }
 
 
+bool Renderer::saveFrame(const char *fileName)
+{
+	if (!_offscreen || !_useFBO)
+	{
+		std::cerr << "Renderer:  Frames are only kept in offscreen mode." << std::endl;
+		return false;
+	}
+
+	// the second FBO texture holds the image composited over the background
+	return _capture.capture(_imgBufferTex1, fileName, 3, 7, 255.0f, false);
+}
+
+
+bool Renderer::streamFrame(int frameNumber)
+{
+	if (!_offscreen || !_useFBO || !_video.isOpen())
+	{
+		std::cerr << "Renderer:  Frames are only streamed in offscreen mode." << std::endl;
+		return false;
+	}
+
+	return _capture.capture(_imgBufferTex1, &_video, frameNumber);
+}
+
+
+bool Renderer::finishCapture(void)
+{
+	_capture.finish();
+	return _capture.getNumFailed() == 0;
+}
+
+
 bool Renderer::saveTexture(const char *fileName, Texture *tex,
 	const int channel, const int channelMask,
 	const float scale)
@@ -535,23 +660,27 @@ void Renderer::enableLowRes(bool enable)
 
 void Renderer::createFBO(void)
 {
-	GLuint texId[2];
+	GLuint texId[3];
 
 	// framebuffer object already exists
 	if (_framebuffer)
 		return;
 
 	// create fbo with depth buffer
+#ifdef _WIN32
 	glGenFramebuffersEXT = (PFNGLGENFRAMEBUFFERSEXTPROC)wglGetProcAddress("glGenFramebuffersEXT");
+#endif
 	glGenFramebuffersEXT(1, &_framebuffer);
 	glGenRenderbuffersEXT(1, &_depthbuffer);
 
-	// create two render target textures
-	glGenTextures(2, texId);
+	// create two render target textures and the accumulation buffer
+	glGenTextures(3, texId);
 	_imgBufferTex0->setTex(GL_TEXTURE_RECTANGLE_ARB, texId[0], "FBO-Tex0");
 	_imgBufferTex0->texUnit = GL_TEXTURE1_ARB;
 	_imgBufferTex1->setTex(GL_TEXTURE_RECTANGLE_ARB, texId[1], "FBO-Tex1");
 	_imgBufferTex1->texUnit = GL_TEXTURE1_ARB;
+	_accumTex->setTex(GL_TEXTURE_RECTANGLE_ARB, texId[2], "FBO-Accum");
+	_accumTex->texUnit = GL_TEXTURE1_ARB;
 
 	CHECK_FOR_OGL_ERROR();
 }
@@ -566,6 +695,7 @@ void Renderer::updateFBO(void)
 	// unbind render target textures
 	_imgBufferTex0->unbind();
 	_imgBufferTex1->unbind();
+	_accumTex->unbind();
 
 	CHECK_FOR_OGL_ERROR();
 
@@ -607,6 +737,30 @@ void Renderer::updateFBO(void)
 		GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	CHECK_FOR_OGL_ERROR();
 
+	// accumulation buffer of the progressive refinement, 32 bit floats
+	// keep the average of many frames exact
+	glActiveTextureARB(_accumTex->texUnit);
+	glBindTexture(_accumTex->texTarget, _accumTex->id);
+	glTexImage2D(_accumTex->texTarget, 0, GL_RGBA32F_ARB,
+		_winWidth, _winHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+	_accumTex->width = _winWidth;
+	_accumTex->height = _winHeight;
+	_accumTex->format = GL_RGBA32F_ARB;
+
+	glTexParameteri(_accumTex->texTarget,
+		GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(_accumTex->texTarget,
+		GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(_accumTex->texTarget,
+		GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(_accumTex->texTarget,
+		GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(_accumTex->texTarget, 0);
+	_accumFrames = 0;
+	CHECK_FOR_OGL_ERROR();
+
+	updateMCOffsetTex(_winWidth, _winHeight);
+
 
 	// prepare fbo
 	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _framebuffer);
@@ -649,20 +803,28 @@ void Renderer::updateMCOffsetTex(int width, int height)
 	{
 		glGenTextures(1, &texId);
 		_mcOffsetTex->setTex(GL_TEXTURE_RECTANGLE_ARB, texId, "MC-OffsetTex");
-		_mcOffsetTex->texTarget = GL_TEXTURE2_ARB;
+		_mcOffsetTex->texUnit = GL_TEXTURE13_ARB;
 	}
 
 	_mcOffsetTex->width = width;
 	_mcOffsetTex->height = height;
 
+	// the tile is only computed once
+	if (_blueNoise.empty())
+		createBlueNoise(BLUE_NOISE_SIZE, _blueNoise);
+
 	noise = new float[width*height];
 
-	// fill offset texture with values in [0,1]
-	for (int i = 0; i<width*height; ++i)
+	// fill offset texture with values in [0,1), blue noise has no low
+	// frequencies which would show up as blotches in a few frames
+	for (int y = 0; y < height; ++y)
 	{
-		noise[i] = (float)rand() / (float)RAND_MAX;
+		const float *tile = &_blueNoise[(y % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE];
+		for (int x = 0; x < width; ++x)
+			noise[y*width + x] = tile[x % BLUE_NOISE_SIZE];
 	}
 
+	glActiveTextureARB(_mcOffsetTex->texUnit);
 	glBindTexture(GL_TEXTURE_RECTANGLE_ARB, _mcOffsetTex->id);
 
 	glTexImage2D(GL_TEXTURE_RECTANGLE_ARB, 0, GL_LUMINANCE16F_ARB,
@@ -672,6 +834,8 @@ void Renderer::updateMCOffsetTex(int width, int height)
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_RECTANGLE_ARB, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_RECTANGLE_ARB, 0);
 
 	CHECK_FOR_OGL_ERROR();
 
@@ -679,6 +843,102 @@ void Renderer::updateMCOffsetTex(int width, int height)
 }
 
 
+bool Renderer::isProgressiveActive(void)
+{
+	// slicing blends into the render targets itself
+	return _progressive && _useFBO && (_renderMode != VOLIC_SLICING);
+}
+
+
+bool Renderer::isRefining(void)
+{
+	return isProgressiveActive() && (_accumFrames < _maxAccumFrames);
+}
+
+
+Texture* Renderer::getImageTex(void)
+{
+	if (isProgressiveActive() && (_accumFrames > 0))
+		return _accumTex;
+	return _imgBufferTex0;
+}
+
+
+void Renderer::accumulateFrame(void)
+{
+	glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT
+		| GL_VIEWPORT_BIT);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glViewport(0, 0, _winWidth, _winHeight);
+
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _framebuffer);
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,
+		GL_COLOR_ATTACHMENT0_EXT,
+		_accumTex->texTarget,
+		_accumTex->id, 0);
+	CHECK_FRAMEBUFFER_STATUS();
+
+	// running average, frame n is weighted with 1/(n+1), the first frame
+	// replaces the previous image
+	if (_accumFrames > 0)
+	{
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+		glBlendColor(0.0f, 0.0f, 0.0f, 1.0f / (_accumFrames + 1));
+	}
+	else
+		glDisable(GL_BLEND);
+
+	_accumShader.enableShader();
+	if (_paramAccum.viewport > -1)
+		glUniform4fARB(_paramAccum.viewport,
+			static_cast<float>(_renderWidth) / _winWidth,
+			static_cast<float>(_renderHeight) / _winHeight,
+			0.0f, 0.0f);
+	if (_paramAccum.imageFBOSampler > -1)
+		glUniform1iARB(_paramAccum.imageFBOSampler,
+			_imgBufferTex0->texUnit - GL_TEXTURE0_ARB);
+	_imgBufferTex0->bind();
+
+	// quad covering the viewport
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glBegin(GL_QUADS);
+	{
+		glVertex2f(-1.0f, -1.0f);
+		glVertex2f(1.0f, -1.0f);
+		glVertex2f(1.0f, 1.0f);
+		glVertex2f(-1.0f, 1.0f);
+	}
+	glEnd();
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+
+	_imgBufferTex0->unbind();
+	GLSLShader::disableShader();
+
+	glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,
+		GL_COLOR_ATTACHMENT0_EXT,
+		GL_TEXTURE_RECTANGLE_ARB,
+		0, 0);
+	glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+
+	glPopAttrib();
+	CHECK_FOR_OGL_ERROR();
+
+	++_accumFrames;
+}
+
+
 void Renderer::drawCubeFaces(void)
 {
 	glBegin(GL_QUADS);
@@ -807,10 +1067,14 @@ void Renderer::disableClipPlanes(void)
 void Renderer::loadGLSLShader(char *defines)
 {
 	char *vertexShader[] = { "shader/volic_vertex.glsl" };
-	char *vectorFieldFragShader[] = { "shader/vectorfield_fragment.glsl" };
+	char *vectorFieldFragShader[] = { "shader/inc_header.glsl",
+		"shader/inc_macrocells.glsl",
+		"shader/vectorfield_fragment.glsl" };
 	char *bgFragShader[] = { "shader/background_fragment.glsl" };
+	char *accumFragShader[] = { "shader/accumulate_fragment.glsl" };
 
 	char *licRaycastFragShader[] = { "shader/inc_header.glsl",
+		"shader/inc_macrocells.glsl",
 		"shader/inc_lic.glsl",
 		"shader/inc_illum.glsl",
 		"shader/lic3d_fragment.glsl",
@@ -827,6 +1091,7 @@ void Renderer::loadGLSLShader(char *defines)
 		"shader/lic3d_slicingblend_fragment.glsl"
 	};
 
+	char *licVolumeVertexShader[] = { "shader/lic3d_volume_vertex.glsl" };
 	char *licVolumeFragShader[] = { "shader/inc_header.glsl",
 		"shader/inc_lic.glsl",
 		"shader/lic3d_volume_fragment.glsl",
@@ -834,14 +1099,36 @@ void Renderer::loadGLSLShader(char *defines)
 
 	char *raycastLICVolumeFragShader[] = { 
 		"shader/inc_header.glsl",
+		"shader/inc_macrocells.glsl",
 		"shader/inc_illum.glsl",
 		"shader/raycast_lic3d_fragment.glsl", };
 
 	char *phongVertexShader[] = { "shader/phong_vertex.glsl" };
 	char *phongFragmentShader[] = { "shader/phong_fragment.glsl" };
 
+	_shaderDefines = defines ? defines : "";
+
+	// blend the two key frames in the shader
+	std::string allDefines;
+	if (_keyFrameInterp)
+		allDefines = "#define TIME_DEPENDENT\n";
+	// segments between the samples of the raycasters
+	if (_preIntegration)
+		allDefines += "#define PRE_INTEGRATION\n";
+	if (defines)
+		allDefines += defines;
+	defines = allDefines.empty() ? NULL : const_cast<char*>(allDefines.c_str());
+
+	// noise gradients and the speed of flow are not limited by the
+	// scalar window and the reach of the LIC
+	_licWindow = (allDefines.find("SPEED_OF_FLOW") == std::string::npos)
+		&& (allDefines.find("USE_NOISE_GRADIENTS") == std::string::npos)
+		&& (allDefines.find("ILLUM_GRADIENT") == std::string::npos);
+	// the steps of the LIC follow the magnitude
+	_licBricks.setCompareMagnitude(allDefines.find("SPEED_OF_FLOW") != std::string::npos);
+
 	if (!_volumeShader.loadShader(1, reinterpret_cast<char**>(vertexShader),
-		1, reinterpret_cast<char**>(vectorFieldFragShader),
+		3, reinterpret_cast<char**>(vectorFieldFragShader),
 		defines))
 	{
 		std::cerr << "Renderer:  Error loading Vertex and Fragment Program "
@@ -861,8 +1148,18 @@ void Renderer::loadGLSLShader(char *defines)
 	_paramBackground.getMemoryLocations(_bgShader.getProgramObj(), _debug);
 
 
+	if (!_accumShader.loadShader(1, reinterpret_cast<char**>(vertexShader),
+		1, reinterpret_cast<char**>(accumFragShader),
+		defines))
+	{
+		std::cerr << "Renderer:  Error loading Vertex and Fragment Program "
+			<< "for Accumulation Shader." << std::endl;
+	}
+	_paramAccum.getMemoryLocations(_accumShader.getProgramObj(), _debug);
+
+
 	if (!_raycastShader.loadShader(1, reinterpret_cast<char**>(vertexShader),
-		4, reinterpret_cast<char**>(licRaycastFragShader),
+		5, reinterpret_cast<char**>(licRaycastFragShader),
 		defines))
 	{
 		std::cerr << "Renderer:  Error loading Vertex and Fragment Program "
@@ -908,8 +1205,27 @@ void Renderer::loadGLSLShader(char *defines)
 			<< "for volumeRenderShader Shader." << std::endl;
 	}
 	_paramLICVolume.getMemoryLocations(_volumeRenderShader.getProgramObj(), _debug);
+
+	// same fragment shader, the vertex shader selects the slices
+	_layeredLICReady = false;
+	if (VolumeBuffer::isLayeredSupported())
+	{
+		std::string layeredDefines = "#extension GL_ARB_draw_instanced : enable\n"
+			"#extension GL_AMD_vertex_shader_layer : enable\n" + allDefines;
+
+		_layeredLICReady = _volumeLayeredShader.loadShader(1,
+			reinterpret_cast<char**>(licVolumeVertexShader),
+			3, reinterpret_cast<char**>(licVolumeFragShader),
+			const_cast<char*>(layeredDefines.c_str()));
+		if (!_layeredLICReady)
+		{
+			std::cerr << "Renderer:  Error loading Vertex and Fragment Program "
+				<< "for layered volumeRenderShader Shader." << std::endl;
+		}
+		_paramLICVolumeLayered.getMemoryLocations(_volumeLayeredShader.getProgramObj(), _debug);
+	}
 	if (!_licRaycastShader.loadShader(1, reinterpret_cast<char**>(vertexShader),
-		3, reinterpret_cast<char**>(raycastLICVolumeFragShader),
+		4, reinterpret_cast<char**>(raycastLICVolumeFragShader),
 		defines))
 	{
 		std::cerr << "Renderer:  Error loading Vertex and Fragment Program "
@@ -922,6 +1238,137 @@ void Renderer::loadGLSLShader(char *defines)
 }
 
 
+void Renderer::reloadGLSLShader(void)
+{
+	std::string defines = _shaderDefines;
+
+	loadGLSLShader(defines.empty() ? NULL : &defines[0]);
+}
+
+
+int Renderer::selectLevelOfDetail(void)
+{
+	GLfloat modelview[16];
+	GLfloat projection[16];
+	float voxelSize = FLT_MAX;
+	float stepSize = FLT_MAX;
+	float radius, dist, pixelSize;
+	int level;
+
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview);
+	glGetFloatv(GL_PROJECTION_MATRIX, projection);
+
+	for (int i = 0; i < 3; ++i)
+		voxelSize = MIN(voxelSize, _vd->extent[i] / _vd->size[i]);
+	radius = 0.5f * sqrt(SQR(_vd->extent[0]) + SQR(_vd->extent[1]) + SQR(_vd->extent[2]));
+
+	// the front of the bounding sphere has the largest voxels on screen
+	dist = -(modelview[2] * _vd->center[0] + modelview[6] * _vd->center[1]
+		+ modelview[10] * _vd->center[2] + modelview[14]) - radius;
+	dist = MAX(dist, _cam->getNearClipPlane());
+	pixelSize = 2.0f * dist / (projection[5] * _renderHeight);
+
+	if (_licParams)
+		stepSize = (_lowRes ? 2.0f : 1.0f) * _licParams->stepSizeVol;
+
+	// a level may only average voxels that are not resolved anyway, i.e.
+	// smaller than a pixel and smaller than the distance of the samples
+	level = static_cast<int>(floor(log(MIN(pixelSize, stepSize) / voxelSize) / log(2.0)
+		+ _lodBias));
+
+	return MAX(0, MIN(level, _dataLevels - 1));
+}
+
+
+void Renderer::setLevelOfDetail(int level)
+{
+	Texture *textures[2] = { _dataTex, _dataTex2 };
+
+	_lod = level;
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!textures[i] || !textures[i]->id)
+			continue;
+		textures[i]->bind();
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL,
+			MIN(level, textures[i]->levels - 1));
+		textures[i]->unbind();
+	}
+	CHECK_FOR_OGL_ERROR();
+}
+
+
+float Renderer::getLICReach(void)
+{
+	// the LIC volume is computed for other positions than the ones it is
+	// sampled at (VolumeBuffer::drawSlice() ignores the scaling)
+	if (!_licParams || !_licWindow || (_renderMode == VOLIC_LICVOLUME))
+		return -1.0f;
+
+	// step width of singleLICstep() with logEyeDist = 0
+	return getLICLength(0.0f);
+}
+
+
+float Renderer::getLICLength(float logEyeDist)
+{
+	int steps;
+	float stepWidth;
+
+	if (!_licParams)
+		return 0.0f;
+
+	// same parameters as setRenderVolParams()
+	if (_lowRes)
+	{
+		steps = 15;
+		stepWidth = 1.0f / 64.0f;
+	}
+	else
+	{
+		steps = MAX(_licParams->stepsForward, _licParams->stepsBackward);
+		stepWidth = _licParams->stepSizeLIC;
+	}
+
+	// the directions read from the zero padding have a length of sqrt(3)
+	return steps * stepWidth * (0.5f * logEyeDist + 0.3f) * sqrtf(3.0f);
+}
+
+
+float Renderer::getSampleDistance(void)
+{
+	float scale = MAX(_vd->scale[0], MAX(_vd->scale[1], _vd->scale[2]));
+
+	if (!_licParams)
+		return 0.0f;
+
+	// the ray direction is scaled by scaleVol like in the shaders
+	return (_lowRes ? 2.0f : 1.0f) * _licParams->stepSizeVol * scale;
+}
+
+
+bool Renderer::isSkippingActive(void)
+{
+	return _useSkipping && _macroCells && _macroCells->isInitialized()
+		&& _macroCells->getTextureRef()->id;
+}
+
+
+void Renderer::updateMacroCells(void)
+{
+	if (!_useSkipping || !_macroCells || !_macroCells->isInitialized())
+		return;
+
+	_macroCells->setLevel(_lod);
+	if (_licParams)
+		_macroCells->setScalarWindow(_licParams->scalarMin, _licParams->scalarMax);
+	_macroCells->setLICReach(getLICReach());
+	_macroCells->setSlabLength(_preIntegration ? getSampleDistance() : 0.0f);
+	_macroCells->update();
+	CHECK_FOR_OGL_ERROR();
+}
+
+
 void Renderer::setRenderVolParams(GLSLParamsLIC *param)
 {
 	if (!_licParams)
@@ -992,6 +1439,39 @@ void Renderer::setRenderVolParams(GLSLParamsLIC *param)
 
 	if (param->numIterations > -1)
 		glUniform1iARB(param->numIterations, _licParams->numIterations);
+	if (param->timeStep > -1)
+		glUniform1fARB(param->timeStep, _keyFrameWeight);
+	if (param->scalarWindow > -1)
+		glUniform2fARB(param->scalarWindow, _licParams->scalarMin, _licParams->scalarMax);
+	CHECK_FOR_OGL_ERROR();
+
+	// cells per texture coordinate, w = 0 disables the skipping
+	if (isSkippingActive())
+	{
+		const int *numCells = _macroCells->getNumCells();
+		float cellSize = static_cast<float>(_macroCells->getCellSize());
+
+		if (param->macroCellScale > -1)
+			glUniform4fARB(param->macroCellScale, _vd->texSize[0] / cellSize,
+				_vd->texSize[1] / cellSize, _vd->texSize[2] / cellSize, 1.0f);
+		if (param->macroCellInvCount > -1)
+			glUniform3fARB(param->macroCellInvCount, 1.0f / numCells[0],
+				1.0f / numCells[1], 1.0f / numCells[2]);
+	}
+	else if (param->macroCellScale > -1)
+		glUniform4fARB(param->macroCellScale, 0.0f, 0.0f, 0.0f, 0.0f);
+	CHECK_FOR_OGL_ERROR();
+
+	// the offsets of a pixel are shifted by the golden ratio every frame
+	// of the progressive refinement, which spreads them evenly over a step
+	if (param->rayJitter > -1)
+	{
+		if (isProgressiveActive())
+			glUniform2fARB(param->rayJitter, 1.0f,
+				static_cast<float>(fmod(_accumFrames * 0.618033988749895, 1.0)));
+		else
+			glUniform2fARB(param->rayJitter, 0.0f, 0.0f);
+	}
 	CHECK_FOR_OGL_ERROR();
 }
 
@@ -1005,6 +1485,11 @@ void Renderer::setRenderVolTextures(GLSLParamsLIC *param)
 		glUniform1iARB(param->volumeSampler, _dataTex->texUnit - GL_TEXTURE0_ARB);
 		_dataTex->bind();
 	}
+	if ((param->volumeSampler2 > -1) && _dataTex2)
+	{
+		glUniform1iARB(param->volumeSampler2, _dataTex2->texUnit - GL_TEXTURE0_ARB);
+		_dataTex2->bind();
+	}
 	if (param->licVolumeSampler > -1)
 	{
 		glUniform1iARB(param->licVolumeSampler, _licvolumebuffer->getCurrentLayer()->texUnit - GL_TEXTURE0_ARB);
@@ -1039,6 +1524,11 @@ void Renderer::setRenderVolTextures(GLSLParamsLIC *param)
 		glUniform1iARB(param->transferAlphaOpacSampler, _tfAlphaOpacTex->texUnit - GL_TEXTURE0_ARB);
 		_tfAlphaOpacTex->bind();
 	}
+	if ((param->preIntSampler > -1) && _tfPreIntTex)
+	{
+		glUniform1iARB(param->preIntSampler, _tfPreIntTex->texUnit - GL_TEXTURE0_ARB);
+		_tfPreIntTex->bind();
+	}
 	if (param->licKernelSampler > -1)
 	{
 		glUniform1iARB(param->licKernelSampler, _licKernelTex->texUnit - GL_TEXTURE0_ARB);
@@ -1059,6 +1549,12 @@ void Renderer::setRenderVolTextures(GLSLParamsLIC *param)
 		glUniform1iARB(param->zoecklerSampler, _illumZoecklerTex->texUnit - GL_TEXTURE0_ARB);
 		_illumZoecklerTex->bind();
 	}
+	if ((param->macroCellSampler > -1) && isSkippingActive())
+	{
+		glUniform1iARB(param->macroCellSampler,
+			_macroCells->getTextureRef()->texUnit - GL_TEXTURE0_ARB);
+		_macroCells->getTextureRef()->bind();
+	}
 	CHECK_FOR_OGL_ERROR();
 }
 
@@ -1308,7 +1804,36 @@ void Renderer::drawClippedPolygon(void)
 	}
 }
 
-void Renderer::renderLICVolume(void)
+// parts of the slices of the LIC volume (width x height) covered by the
+// dirty bricks of layer bz, dirty bricks next to each other in a row are
+// merged into one rectangle, rects holds 4 values per rectangle
+static void getDirtyRects(LICBrickGrid &bricks, int bz, int width, int height,
+	std::vector<float> &rects)
+{
+	const int *numBricks = bricks.getNumBricks();
+	int brickSize = bricks.getBrickSize();
+
+	rects.clear();
+	for (int by = 0; by < numBricks[1]; ++by)
+	{
+		for (int bx = 0; bx < numBricks[0]; ++bx)
+		{
+			if (!bricks.isDirty(bx, by, bz))
+				continue;
+
+			int first = bx;
+			while ((bx + 1 < numBricks[0]) && bricks.isDirty(bx + 1, by, bz))
+				++bx;
+
+			rects.push_back(static_cast<float>(first * brickSize) / width);
+			rects.push_back(static_cast<float>(by * brickSize) / height);
+			rects.push_back(static_cast<float>(MIN((bx + 1) * brickSize, width)) / width);
+			rects.push_back(static_cast<float>(MIN((by + 1) * brickSize, height)) / height);
+		}
+	}
+}
+
+void Renderer::renderLICVolume(bool dirtyOnly)
 {
 	int oldViewport[4];
 	float color[4];
@@ -1340,23 +1865,70 @@ void Renderer::renderLICVolume(void)
 	glGetFloatv(GL_COLOR_CLEAR_VALUE, color);
 	glClearColor(0.0, 0.0, 0.0, 0.0);
 
-	_volumeRenderShader.enableShader();
+	bool layered = isLayeredLICActive();
+	GLSLShader *shader = layered ? &_volumeLayeredShader : &_volumeRenderShader;
+	GLSLParamsLIC *param = layered ? &_paramLICVolumeLayered : &_paramLICVolume;
+	const int *numBricks = _licBricks.getNumBricks();
+	int brickSize = _licBricks.getBrickSize();
+	std::vector<float> rects;
+
+	shader->enableShader();
 
-	setRenderVolParams(&_paramLICVolume);
-	setRenderVolTextures(&_paramLICVolume);
+	setRenderVolParams(param);
+	setRenderVolTextures(param);
 
-	if (_licvolumebuffer->isAnimation())
+	if (layered)
 	{
-		_licvolumebuffer->restoreOldLayer();
+		// one instance per slice, runs of dirty bricks in a row are drawn
+		// for all slices of the brick at once
+		_licvolumebuffer->attachLayered(0);
+		if (!dirtyOnly)
+		{
+			const float slice[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+
+			glUniform2fARB(param->layerRange, 0.0f, static_cast<float>(depth));
+			_licvolumebuffer->drawLayered(depth, slice);
+		}
+		else
+		{
+			for (int bz = 0; bz < numBricks[2]; ++bz)
+			{
+				getDirtyRects(_licBricks, bz, width, height, rects);
+				if (rects.empty())
+					continue;
+
+				glUniform2fARB(param->layerRange, static_cast<float>(bz * brickSize),
+					static_cast<float>(depth));
+				for (size_t i = 0; i < rects.size(); i += 4)
+					_licvolumebuffer->drawLayered(MIN(brickSize, depth - bz * brickSize), &rects[i]);
+			}
+		}
 	}
-	
-	for (int z = 0; z < depth; z++)
+	else
 	{
-		_licvolumebuffer->attachLayer(0, z);
-		//render volume to 3D Texture
-		_licvolumebuffer->drawSlice((z + 0.5f) / (float)depth);
+		for (int z = 0; z < depth; z++)
+		{
+			if (!dirtyOnly)
+			{
+				_licvolumebuffer->attachLayer(0, z);
+				//render volume to 3D Texture
+				_licvolumebuffer->drawSlice((z + 0.5f) / (float)depth);
+				continue;
+			}
+
+			// the clean bricks keep their slices in the layer, the runs of
+			// dirty bricks are the same for all slices of a brick layer
+			if (z % brickSize == 0)
+				getDirtyRects(_licBricks, z / brickSize, width, height, rects);
+			if (rects.empty())
+				continue;
+
+			_licvolumebuffer->attachLayer(0, z);
+			for (size_t i = 0; i < rects.size(); i += 4)
+				_licvolumebuffer->drawSlice((z + 0.5f) / (float)depth, &rects[i]);
+		}
 	}
-	_volumeRenderShader.disableShader();
+	shader->disableShader();
 	
 	// restore old clear color
 	glClearColor(color[0], color[1], color[2], color[3]);
@@ -1373,9 +1945,50 @@ void Renderer::renderLICVolume(void)
 	CHECK_FRAMEBUFFER_STATUS();
 }
 
+bool Renderer::isLayeredLICActive(void)
+{
+	return _layeredLIC && _layeredLICReady;
+}
+
 void Renderer::updateLICVolume(void)
 {
 	renderLICVolume();
+	// the next frame of the animation computes all bricks
+	_licBricks.invalidate();
+}
+
+void Renderer::updateLICVolume(float t)
+{
+	if (!_useLICBricks || !_vd || !_licBricks.isInitialized())
+	{
+		renderLICVolume();
+		return;
+	}
+
+	// the slices are drawn with the identity matrix, so the eye distance
+	// of the LIC is the z coordinate of the vector field
+	_licBricks.setLICReach(getLICLength(log2f(_vd->scale[2] + 1.0f)));
+	_licBricks.setLevel(_lod);
+	// converting and comparing the field on the CPU is the overhead of
+	// keeping bricks
+	double compareTime = timer();
+	_licBricks.setVectorField(_vd, _vd->data, _vd->newData, t);
+	compareTime = timer() - compareTime;
+
+	int dirty = _licBricks.getDirtyCount();
+
+	if (dirty == _licBricks.getBrickCount())
+		renderLICVolume();
+	else if (dirty > 0)
+		renderLICVolume(true);
+	if (_debug)
+	{
+		std::cout << "LIC volume: " << dirty << " of "
+			<< _licBricks.getBrickCount() << " bricks computed, comparison "
+			<< static_cast<int>(10.0 * compareTime + 0.5) / 10.0 << " ms"
+			<< std::endl;
+	}
+	_licBricks.clearDirty();
 }
 
 void Renderer::raycastLICVolume(void)
@@ -1409,6 +2022,9 @@ void Renderer::renderBackground(void)
 	int viewport[4] = { 0, 0, _winWidth, _winHeight };
 	double x, y, z;
 	double modelview[16], projection[16], vertizes[4][3];
+	// the accumulation buffer always has the size of the window
+	Texture *image = getImageTex();
+	bool fullRes = (image == _accumTex);
 
 	// draw a quad showing the previous image
 	glDepthMask(GL_FALSE);
@@ -1421,7 +2037,7 @@ void Renderer::renderBackground(void)
 	_bgShader.enableShader();
 
 
-	if (_screenShot || _recording)
+	if (_screenShot || _recording || _offscreen)
 	{
 		// render into second fbo texture
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, _framebuffer);
@@ -1436,18 +2052,18 @@ void Renderer::renderBackground(void)
 	// set params
 	if (_paramBackground.viewport > -1)
 		glUniform4fARB(_paramBackground.viewport,
-			static_cast<float>(_renderWidth) / _winWidth,
-			static_cast<float>(_renderHeight) / _winHeight,
+			fullRes ? 1.0f : static_cast<float>(_renderWidth) / _winWidth,
+			fullRes ? 1.0f : static_cast<float>(_renderHeight) / _winHeight,
 			0.0f, 0.0f);
 	CHECK_FOR_OGL_ERROR();
 
 	if (_paramBackground.imageFBOSampler > -1)
 		glUniform1iARB(_paramBackground.imageFBOSampler,
-			_imgBufferTex0->texUnit - GL_TEXTURE0_ARB);
+			image->texUnit - GL_TEXTURE0_ARB);
 
 	CHECK_FOR_OGL_ERROR();
 
-	_imgBufferTex0->bind();
+	image->bind();
 
 
 	glGetDoublev(GL_MODELVIEW_MATRIX, modelview);
@@ -1472,10 +2088,10 @@ void Renderer::renderBackground(void)
 	}
 	glEnd();
 
-	_imgBufferTex0->unbind();
+	image->unbind();
 	GLSLShader::disableShader();
 
-	if (_screenShot || _recording)
+	if (_screenShot || _recording || _offscreen)
 	{
 		// disable fbo texture
 		glFramebufferTexture2DEXT(GL_FRAMEBUFFER_EXT,
@@ -1483,7 +2099,16 @@ void Renderer::renderBackground(void)
 			GL_TEXTURE_RECTANGLE_ARB,
 			0, 0);
 		glBindFramebufferEXT(GL_FRAMEBUFFER_EXT, 0);
+	}
+
+	// recordings go into the video stream if one is open, composited over
+	// the background
+	const bool stream = _recording && _video.isOpen();
+	if (stream)
+		_capture.capture(_imgBufferTex1, &_video, frames);
 
+	if (_screenShot || (_recording && !stream))
+	{
 		std::string animationFile = "snapshotOut\\";
 		auto t = std::time(nullptr);
 		auto tm = *std::localtime(&t);
@@ -1497,15 +2122,15 @@ void Renderer::renderBackground(void)
 		auto str = ss.str();
 
 		// TODO: screenshot filename
-		saveTexture(str.c_str(), _imgBufferTex0, 4, 15, 255.0);
-		std::cout << "Screenshot written to \"" << str
-			<< "\"." << std::endl;
+		// only the readback is started here, the message is printed by
+		// _capture once the file is written
+		_capture.capture(image, str.c_str(), 4, 15, 255.0f);
 
 		if(_screenShot)
 			_screenShot = false;
-		if (_recording)
-			frames++;
 	}
+	if (_recording)
+		frames++;
 
 	glDepthMask(GL_TRUE);
 	CHECK_FOR_OGL_ERROR();
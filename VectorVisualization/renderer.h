@@ -21,7 +21,12 @@
 #include "camera.h"
 #include "types.h"
 #include "VolumeBuffer.h"
+#include "framecapture.h"
+#include "videosink.h"
+#include "macrocells.h"
+#include "licbricks.h"
 #include <string>
+#include <vector>
 
 
 
@@ -37,6 +42,14 @@ public:
 	void render(bool update = true);
 
 	bool saveFrameBuffer(const char *fileName);
+	// save the last frame composited in offscreen mode, the file is
+	// written asynchronously, see finishCapture()
+	bool saveFrame(const char *fileName);
+	// append the last frame composited in offscreen mode to the video
+	bool streamFrame(int frameNumber);
+	// wait until all screenshots and recorded frames are written,
+	// returns false if any of them failed
+	bool finishCapture(void);
 	static bool saveTexture(const char *fileName, Texture *tex,
 		const int channel = 4, const int channelMask = 15,
 		const float scale = 1.0f);
@@ -77,6 +90,16 @@ public:
 	// enable FBO usage
 	void enableFBO(bool enable) { _useFBO = enable; }
 	bool isFBOenabled(void) { return _useFBO; }
+	// composite into the FBO instead of the default framebuffer (--headless),
+	// requires the FBO
+	void enableOffscreen(bool enable) { _offscreen = enable; }
+	bool isOffscreenEnabled(void) { return _offscreen; }
+	// file format of screenshots and recordings, "png" or "qoi"
+	void setSnapshotFormat(const char *ext) { _snapshotFileName = std::string("snapshot.") + ext; }
+	// recordings are streamed into fileName instead of single images
+	bool setVideoOutput(const char *fileName, VideoSink::Format format, int fps)
+		{ return _video.open(fileName, format, fps); }
+	bool isVideoOutputOpen(void) { return _video.isOpen(); }
 
 	// the rendering resolution is halved if enable == true
 	void enableLowRes(bool enable);
@@ -86,12 +109,54 @@ public:
 	bool isDebugModeEnabled(void) { return _debug; }
 
 	void setDataTex(Texture *tex) { _dataTex = tex; }
+	// second key frame, blended with _dataTex in the shader
+	void setDataTex2(Texture *tex) { _dataTex2 = tex; }
+	void setKeyFrameWeight(float weight) { _keyFrameWeight = weight; }
+	// mipmap levels of the vector textures (see VectorDataSet::enablePyramid()),
+	// each frame uses the coarsest level whose voxels are smaller than both
+	// a pixel and the sampling distance at the front of the volume
+	void setDataLevels(int levels) { _dataLevels = levels; }
+	void enableLevelOfDetail(bool enable) { _useLOD = enable; }
+	bool isLevelOfDetailEnabled(void) { return _useLOD; }
+	// added to the selected level before rounding down
+	void setLODBias(float bias) { _lodBias = bias; }
+	// level of the vector textures used by the last frame
+	int getLevelOfDetail(void) { return _lod; }
+	// adds TIME_DEPENDENT to the defines of the LIC shaders,
+	// takes effect with the next loadGLSLShader()
+	void enableKeyFrameInterpolation(bool enable) { _keyFrameInterp = enable; }
+	bool isKeyFrameInterpolationEnabled(void) { return _keyFrameInterp; }
+	// empty space skipping with the macro cells of the vector textures,
+	// they are classified again before each frame if anything changed
+	void setMacroCells(MacroCellGrid *cells) { _macroCells = cells; }
+	void enableEmptySpaceSkipping(bool enable) { _useSkipping = enable; }
+	bool isEmptySpaceSkippingEnabled(void) { return _useSkipping; }
+	// adds PRE_INTEGRATION to the defines of the raycasters, which then
+	// read the table of setTFPreIntTex() for the segment to the previous
+	// sample, takes effect with the next loadGLSLShader()
+	void enablePreIntegration(bool enable) { _preIntegration = enable; }
+	bool isPreIntegrationEnabled(void) { return _preIntegration; }
+	// progressive refinement: while render() is called without update
+	// the raycasters render the image again with the ray starts jittered
+	// by blue noise and the images are averaged in a float buffer until
+	// numFrames frames are accumulated, an update starts again with a
+	// single frame
+	// needs the FBO, slicing is not refined
+	void enableProgressive(bool enable) { _progressive = enable; _accumFrames = 0; }
+	bool isProgressiveEnabled(void) { return _progressive; }
+	void setProgressiveFrames(int numFrames) { _maxAccumFrames = MAX(numFrames, 1); }
+	int getProgressiveFrames(void) { return _maxAccumFrames; }
+	// true if the next render(false) adds a frame to the image
+	bool isRefining(void);
+	// frames averaged in the current image
+	int getAccumulatedFrames(void) { return _accumFrames; }
 	void setScalarTex(Texture *tex) { _scalarTex = tex; }
 	void setNoiseTex(Texture *tex) { _noiseTex = tex; }
 	void setLICFilterTex(Texture *tex) { _licKernelTex = tex; }
 	void setLambda2Tex(Texture *tex) { _lambda2Tex = tex; }
 	void setTFrgbTex(Texture *tex) { _tfRGBTex = tex; }
 	void setTFalphaOpacTex(Texture *tex) { _tfAlphaOpacTex = tex; }
+	void setTFPreIntTex(Texture *tex) { _tfPreIntTex = tex; }
 	void setIllumZoecklerTex(Texture *tex) { _illumZoecklerTex = tex; }
 	void setIllumMalloDiffTex(Texture *tex) { _illumMalloDiffTex = tex; }
 	void setIllumMalloSpecTex(Texture *tex) { _illumMalloSpecTex = tex; }
@@ -113,6 +178,8 @@ public:
 
 	// load glsl shader from files
 	void loadGLSLShader(char *defines = NULL);
+	// load the shaders again with the defines of the last loadGLSLShader()
+	void reloadGLSLShader(void);
 	void drawCubeFaces(void);
 	void drawXYZAixs(void);
 
@@ -121,6 +188,25 @@ public:
 
 	// update3D LIC Volume
 	void updateLICVolume(void);
+	// next frame of the animation, the vector textures show the key frames
+	// of the volume data interpolated with weight t: only the bricks of the
+	// LIC volume in which the directions changed noticeably are computed
+	// again (see LICBrickGrid), the others keep the LIC of earlier frames
+	void updateLICVolume(float t);
+	// with enable == false every frame computes the whole LIC volume
+	void enableLICBricks(bool enable) { _useLICBricks = enable; _licBricks.invalidate(); }
+	bool isLICBricksEnabled(void) { return _useLICBricks; }
+	// fill the LIC volume with one instanced draw call (one per run of
+	// dirty bricks) whose vertex shader selects the slices with gl_Layer
+	// instead of attaching and drawing every slice on its own, needs
+	// GL_ARB_draw_instanced and GL_AMD_vertex_shader_layer
+	void enableLayeredLIC(bool enable) { _layeredLIC = enable; }
+	bool isLayeredLICEnabled(void) { return _layeredLIC; }
+	// enabled and the shader could be loaded
+	bool isLayeredLICActive(void);
+	// edge length of the LIC volume, has to be set before init()
+	void setLICVolumeSize(int size) { _licVolumeSize = size; }
+	int getLICVolumeSize(void) { return _licVolumeSize; }
 
 	void setAnimationFlag(bool flag) { _isAnimationOn = flag; }
 protected:
@@ -128,9 +214,16 @@ protected:
 	// adapt framebuffer objects to new resolution
 	void updateFBO(void);
 
-	// adapt the offset texture to new resolution
+	// adapt the offset texture to new resolution, a tile of blue noise
+	// is repeated over the window
 	void updateMCOffsetTex(int width, int height);
 
+	bool isProgressiveActive(void);
+	// average the image of _imgBufferTex0 into _accumTex
+	void accumulateFrame(void);
+	// image shown by renderBackground()
+	Texture* getImageTex(void);
+
 
 	// draw the bounding box faces of the volume
 	// draw the bounding box of the volume
@@ -139,6 +232,21 @@ protected:
 	void enableClipPlanes(void);
 	void disableClipPlanes(void);
 
+	// level of the vector textures for the current camera
+	int selectLevelOfDetail(void);
+	void setLevelOfDetail(int level);
+
+	// distance from which the LIC of a sample may gather noise, negative
+	// if the scalar window can not limit it
+	float getLICReach(void);
+	// longest distance in texture coordinates the LIC of a sample walks,
+	// the step width of singleLICstep() grows with logEyeDist
+	float getLICLength(float logEyeDist);
+	// longest distance between two samples of a ray in texture coordinates
+	float getSampleDistance(void);
+	void updateMacroCells(void);
+	bool isSkippingActive(void);
+
 	void setRenderVolParams(GLSLParamsLIC *param);
 	void setRenderVolTextures(GLSLParamsLIC *param);
 
@@ -155,7 +263,8 @@ protected:
 	void drawClippedPolygon(void);
 
 	// Using FBO calculate 3D LIC value and store them into a 3D Texture
-	void renderLICVolume(void);
+	// with dirtyOnly == true only the dirty bricks of _licBricks
+	void renderLICVolume(bool dirtyOnly = false);
 
 	// Using Volume Rendering to render LIC 3D volume
 	void raycastLICVolume(void);
@@ -225,26 +334,35 @@ private:
 
 	// 3D LIC Volume Buffer
 	VolumeBuffer * _licvolumebuffer;
+	int _licVolumeSize;
+	LICBrickGrid _licBricks;
+	bool _useLICBricks;
+	bool _layeredLIC;
+	bool _layeredLICReady;
 
 	// GLSL shaders
 	GLSLShader _bgShader;
+	GLSLShader _accumShader;
 
 	GLSLShader _raycastShader;
 	GLSLShader _sliceShader;
 	GLSLShader _sliceBlendShader;
 	GLSLShader _volumeShader;
 	GLSLShader _volumeRenderShader;
+	GLSLShader _volumeLayeredShader;
 	GLSLShader _licRaycastShader;
 
 	GLSLShader _phongShader;
 
 	// memory locations of uniforms
 	GLSLParamsBackground _paramBackground;
+	GLSLParamsBackground _paramAccum;
 	GLSLParamsLIC _paramRaycast;
 	GLSLParamsLIC _paramSlice;
 	GLSLParamsLIC _paramSliceBlend;
 	GLSLParamsLIC _paramVolume;
 	GLSLParamsLIC _paramLICVolume;
+	GLSLParamsLIC _paramLICVolumeLayered;
 	GLSLParamsLIC _paramLicRaycast;
 
 
@@ -255,10 +373,32 @@ private:
 	// second rendertarget
 	Texture *_imgBufferTex1;
 
+	// ray start offsets in [0,1) per pixel
 	Texture *_mcOffsetTex;
+	std::vector<float> _blueNoise;
+
+	// average of the frames of the progressive refinement
+	Texture *_accumTex;
+	bool _progressive;
+	int _maxAccumFrames;
+	int _accumFrames;
 
 	// vector data
 	Texture *_dataTex;
+	Texture *_dataTex2;
+	float _keyFrameWeight;
+	bool _keyFrameInterp;
+	int _dataLevels;
+	bool _useLOD;
+	float _lodBias;
+	int _lod;
+	MacroCellGrid *_macroCells;
+	bool _useSkipping;
+	bool _preIntegration;
+	// defines given to the last loadGLSLShader()
+	std::string _shaderDefines;
+	// false if the defines of the shaders ignore the scalar window
+	bool _licWindow;
 	Texture *_scalarTex;
 	Texture *_noiseTex;
 	// LIC filter kernel
@@ -268,6 +408,7 @@ private:
 	// transfer function
 	Texture *_tfRGBTex;
 	Texture *_tfAlphaOpacTex;
+	Texture *_tfPreIntTex;
 	// illumination
 	Texture *_illumZoecklerTex;
 	Texture *_illumMalloDiffTex;
@@ -288,6 +429,10 @@ private:
 	bool _wireframe;
 	bool _screenShot;
 	bool _recording;
+	bool _offscreen;
+	// readback and encoding of screenshots and recordings
+	FrameCapture _capture;
+	VideoSink _video;
 	std::string _snapshotFileName;
 	bool _isAnimationOn;
 	int frames;
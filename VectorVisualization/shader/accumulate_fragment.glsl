@@ -0,0 +1,13 @@
+#extension GL_ARB_texture_rectangle : enable
+
+// progressive refinement: the image of the last frame is written into the
+// accumulation buffer, the blending computes the running average
+
+uniform vec4 viewport;
+uniform sampler2DRect imageFBOSampler;
+
+
+void main(void)
+{
+    gl_FragColor = texture2DRect(imageFBOSampler, gl_FragCoord.xy*viewport.xy);
+}
@@ -41,17 +41,32 @@ uniform vec3 licKernel;  // kernel step width forward (0.5/licParams.x),
 
 uniform float timeStep;
 
+// the noise is integrated where the scalar volume lies in (x, y)
+uniform vec2 scalarWindow;
+
 
 
 // textures (have to be uniform)
 uniform sampler3D volumeSampler;
+#ifdef TIME_DEPENDENT
+// next key frame, blended with volumeSampler by timeStep
+uniform sampler3D volumeSampler2;
+#endif
 uniform sampler3D scalarSampler;
 uniform sampler3D noiseSampler;
 
 uniform sampler2DRect mcOffsetSampler;
+// ray start offsets of the progressive refinement, x scales the offsets
+// of mcOffsetSampler (0 disables them), y is added every frame
+uniform vec2 rayJitter;
 
 uniform sampler1D transferRGBASampler;
 uniform sampler1D transferAlphaOpacSampler;
+#ifdef PRE_INTEGRATION
+// transfer function integrated from the previous (x) to the current (y)
+// sample of a ray, opacity of a segment of the reference step
+uniform sampler2D preIntSampler;
+#endif
 
 uniform sampler1D licKernelSampler;
 
@@ -61,3 +76,21 @@ uniform sampler2D malloSpecSampler;
 uniform sampler2D zoecklerSampler;
 
 uniform sampler2DRect imageFBOSampler;
+
+
+// vector field lookup, for time-dependent data the two key frames
+// are interpolated weighted by their magnitudes
+vec4 vectorFieldLookup(in vec3 pos)
+{
+#ifdef TIME_DEPENDENT
+    vec4 v0 = texture3D(volumeSampler, pos);
+    vec4 v1 = texture3D(volumeSampler2, pos);
+    vec3 dir = mix((2.0*v0.rgb - 1.0)*v0.a, (2.0*v1.rgb - 1.0)*v1.a, timeStep);
+    float len = length(dir);
+
+    dir = (len > 1e-5) ? 0.5*dir/len + 0.5 : vec3(0.5);
+    return vec4(dir, mix(v0.a, v1.a, timeStep));
+#else
+    return texture3D(volumeSampler, pos);
+#endif
+}
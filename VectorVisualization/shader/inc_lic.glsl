@@ -73,11 +73,14 @@ float freqSampling(in vec3 pos, out float logEyeDist)
     //vec3 objPos = pos * scaleVolInv.xyz;
 
 	//Use scalar data to decide noise range to be integrated
-	vec4 vectorData = texture3D(volumeSampler, pos);
+	vec4 vectorData = vectorFieldLookup(pos);
 	vec4 scalarData = texture3D(scalarSampler, pos); 
 	//float scala = length(vectorData.xyz);
 	
-	if (scalarData.r > 0.1  && scalarData.r < 0.3)
+	// the step width of the LIC assumes logEyeDist = 0
+	logEyeDist = 0.0;
+
+	if (scalarData.r > scalarWindow.x  && scalarData.r < scalarWindow.y)
 	//if (true)
 	//if (vectorData.a > 0.45  && vectorData.a < 1.6)
 	{
@@ -86,20 +89,20 @@ float freqSampling(in vec3 pos, out float logEyeDist)
 		//return noiseLookup(pos, gradient.z, logEyeDist);
 	}
 	else
-		return 0;
+		return 0.0;
 }
 
 
 #ifdef USE_NOISE_GRADIENTS
-vec4 singleLICstep(in vec3 licdir, in out vec3 newPos,
-                   in out vec4 step, in float kernelOffset,
-                   in out float logEyeDist, in float dir)
+vec4 singleLICstep(in vec3 licdir, inout vec3 newPos,
+                   inout vec4 step, in float kernelOffset,
+                   inout float logEyeDist, in float dir)
 {
     vec4 noise;
 #else
-float singleLICstep(in vec3 licdir, in out vec3 newPos,
-                   in out vec4 step, in float kernelOffset,
-                   in out float logEyeDist, in float dir)
+float singleLICstep(in vec3 licdir, inout vec3 newPos,
+                   inout vec4 step, in float kernelOffset,
+                   inout float logEyeDist, in float dir)
 {
     float noise;
 #endif
@@ -113,7 +116,7 @@ float singleLICstep(in vec3 licdir, in out vec3 newPos,
     // also correct length according to camera distance
     licdir *= licParams.z * (logEyeDist*0.5 + 0.3);
     vec3 Pos2 = newPos + licdir;
-	vec4 step2 = texture3D(volumeSampler, Pos2);
+	vec4 step2 = vectorFieldLookup(Pos2);
 	vec3 licdir2 = 2.0*step2.rgb - 1.0;
 	licdir2 *= dir;
 	//licdir2 = step2.rgb;
@@ -125,11 +128,7 @@ float singleLICstep(in vec3 licdir, in out vec3 newPos,
 	newPos += 0.5 * (licdir + licdir2);
 	//newPos += 0.3 * licdir;
 
-    step = texture3D(volumeSampler, newPos);
-#ifdef TIME_DEPENDENT
-    vectorFieldSample2 = texture3D(volumeSampler2, newPos);
-    step = mix(timeStep, step, vectorFieldSample2);
-#endif
+    step = vectorFieldLookup(newPos);
 
 #ifdef USE_NOISE_GRADIENTS
     noise = freqSamplingGrad(newPos, logEyeDist);
@@ -154,9 +153,6 @@ vec4 computeLIC(in vec3 pos, in vec4 vectorFieldSample)
     vec3 licdir;
     float logEyeDist;
     float kernelOffset = 0.5;
-#ifdef TIME_DEPENDENT
-    vec4 vectorFieldSample2;
-#endif
 
     // perform first lookup
 
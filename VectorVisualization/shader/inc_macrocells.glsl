@@ -0,0 +1,35 @@
+// empty space skipping, see MacroCellGrid
+
+// macro cells per texture coordinate in xyz, w = 0 disables skipping
+uniform vec4 macroCellScale;
+// inverse number of macro cells
+uniform vec3 macroCellInvCount;
+
+// one texel per macro cell, r: magnitude, g: LIC visible
+uniform sampler3D macroCellSampler;
+
+
+// number of steps of length stepWidth along dir which stay inside the
+// macro cell of pos if the cell is marked empty in channel (r = (1,0),
+// g = (0,1)), 0 if the sample may be visible
+int macroCellSkip(in vec3 pos, in vec3 dir, in float stepWidth, in vec2 channel)
+{
+    if (macroCellScale.w < 0.5)
+        return 0;
+
+    vec3 cellPos = pos * macroCellScale.xyz;
+    vec3 cell = floor(cellPos);
+    vec2 flags = texture3D(macroCellSampler, (cell + 0.5) * macroCellInvCount).rg;
+
+    if (dot(flags, channel) > 0.5)
+        return 0;
+
+    // ray parameter at which the ray leaves the cell
+    vec3 cellDir = dir * macroCellScale.xyz;
+    vec3 exitPos = cell + step(0.0, cellDir);
+    vec3 t = abs(exitPos - cellPos) / max(abs(cellDir), vec3(1e-6));
+    float tExit = min(t.x, min(t.y, t.z));
+
+    // the samples stay on the original positions along the ray
+    return max(int(ceil(tExit / stepWidth)), 1);
+}
@@ -26,12 +26,18 @@ void main(void)
     vec4 dest = vec4(0.0);
     vec4 src = vec4(0.0);
 
-
-    // TODO: MC offset
-#ifdef USE_MC_OFFSET
-    pos += dir * stepSize * texture2DRect(mcOffsetSampler, gl_FragCoord.xy).r;
+    // progressive refinement: the ray starts are moved by a fraction of a
+    // step, blue noise per pixel which is shifted every frame
+    pos += dir * (stepSize * rayJitter.x
+        * fract(texture2DRect(mcOffsetSampler, gl_FragCoord.xy).r + rayJitter.y));
+
+#ifdef PRE_INTEGRATION
+    // transfer function coordinate of the previous sample, negative if it
+    // was skipped
+    float front = vectorFieldLookup(pos).b;
 #endif
 
+
     // move one step forward
     //pos += dir * stepSize;
 #if 1
@@ -39,9 +45,25 @@ void main(void)
     {
         for (int i=0; i<numIterations; ++i)
         {
+            // skip the samples of an empty macro cell
+            int skip = macroCellSkip(pos, dir, stepSize, vec2(0.0, 1.0));
+            if (skip > 0)
+            {
+                pos += dir * (stepSize * float(skip));
+                i += skip - 1;
+                src = vec4(0.0);
+#ifdef PRE_INTEGRATION
+                front = -1.0;
+#endif
+
+                outside = any(bvec3(clamp(pos.xyz, vec3(0.0), texMax.xyz) - pos.xyz));
+                if (outside)
+                    break;
+                continue;
+            }
 
             // lookup scalar value
-            vectorData = texture3D(volumeSampler, pos);
+            vectorData = vectorFieldLookup(pos);
             /*
             // TODO: use lambda2 volume ...
             vectorData.a = texture3D(lambda2Sampler, pos).r;
@@ -51,7 +73,14 @@ void main(void)
 			// use secondary scalar data to map color value
 			vec4 scalarData = texture3D(scalarSampler, pos); 
             //tfData = texture1D(transferRGBASampler, scalarData.r);
+#ifdef PRE_INTEGRATION
+            if (front < 0.0)
+                front = vectorFieldLookup(pos - dir * stepSize).b;
+            tfData = texture2D(preIntSampler, vec2(front, vectorData.b));
+            front = vectorData.b;
+#else
             tfData = texture1D(transferRGBASampler, vectorData.b);
+#endif
 			//tfData = texture1D(transferRGBASampler, length(vectorData));
 			//tfData = texture1D(transferRGBASampler, vectorData.x);
 
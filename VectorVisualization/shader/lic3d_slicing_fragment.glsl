@@ -33,7 +33,7 @@ void main(void)
 #endif
 
         // lookup scalar value
-        vectorData = texture3D(volumeSampler, pos);
+        vectorData = vectorFieldLookup(pos);
         /*
         // TODO: use lambda2 volume ...
         vectorData.a = texture3D(lambda2Sampler, pos).r;
@@ -5,7 +5,7 @@ void main(void)
     vec3 pos = geomPos.xyz * scaleVol.xyz;
 	// lookup scalar value
 	vec4 scalarData = texture3D(scalarSampler, pos); 
-    vec4 vectorData = texture3D(volumeSampler, pos);
+    vec4 vectorData = vectorFieldLookup(pos);
 	vec4 illum = vec4(0.0, 0.0, 0.0, 1.0);
 	
 	//if(pos.x < 0.5 && pos.y > 0.5)
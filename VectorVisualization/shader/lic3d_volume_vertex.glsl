@@ -0,0 +1,16 @@
+// layered rendering of the LIC volume: one instance per slice, each
+// instance writes its slice with gl_Layer, so the whole 3D texture stays
+// attached to the framebuffer object and a single draw call fills it
+
+// first slice drawn, number of slices of the volume
+uniform vec2 layerRange;
+
+void main(void)
+{
+    float slice = layerRange.x + float(gl_InstanceIDARB);
+
+    // gl_Vertex.xy is the corner of the drawn rectangle in [0,1]
+    gl_TexCoord[0] = vec4(gl_Vertex.xy, (slice + 0.5) / layerRange.y, 1.0);
+    gl_Layer = int(slice);
+    gl_Position = vec4(2.0 * gl_Vertex.xy - 1.0, 0.0, 1.0);
+}
@@ -27,6 +27,17 @@ void main(void)
     vec4 dest = vec4(0.0);
     vec4 src;
 
+    // progressive refinement: the ray starts are moved by a fraction of a
+    // step, blue noise per pixel which is shifted every frame
+    pos += dir * (stepSize * rayJitter.x
+        * fract(texture2DRect(mcOffsetSampler, gl_FragCoord.xy).r + rayJitter.y));
+
+#ifdef PRE_INTEGRATION
+    // transfer function coordinate of the previous sample, negative if it
+    // was skipped
+    float front = vectorFieldLookup(pos).z;
+#endif
+
     //dest = texture3D(licVolumeSampler, pos);
 
     // move one step forward
@@ -37,14 +48,37 @@ void main(void)
 	//if(pos.x >= 0.5)
         for (int i=0; i<numIterations; ++i)
         {
+            // skip the samples of an empty macro cell
+            int skip = macroCellSkip(pos, dir, stepSize, vec2(0.0, 1.0));
+            if (skip > 0)
+            {
+                pos += dir * (stepSize * float(skip));
+                i += skip - 1;
+#ifdef PRE_INTEGRATION
+                front = -1.0;
+#endif
+
+                outside = any(bvec3(clamp(pos.xyz, vec3(0.0), texMax.xyz) - pos.xyz));
+                if (outside)
+                    break;
+                continue;
+            }
+
             // lookup scalar value
-            vectorData = texture3D(volumeSampler, pos);
+            vectorData = vectorFieldLookup(pos);
             volumeData = texture3D(licVolumeSampler, pos);
 			
             //noise = texture3D(noiseSampler, pos);
 
             // lookup in transfer function
+#ifdef PRE_INTEGRATION
+            if (front < 0.0)
+                front = vectorFieldLookup(pos - dir * stepSize).z;
+            tfData = texture2D(preIntSampler, vec2(front, vectorData.z));
+            front = vectorData.z;
+#else
             tfData = texture1D(transferRGBASampler, vectorData.z);
+#endif
 
             //src = vec4(tfData.xyz, volumeData.a);
             //src = vec4(noise.xyz, data.a);
@@ -1,39 +1,6 @@
-// program parameters
-
-// max texture coords for bounding box test
-uniform vec4 texMax;
-
-// scale factors of the volume
-uniform vec4 scaleVol;
-
-uniform float stepSize;
-uniform vec3 gradient; // scale, illum scale, frequency scale
-
-uniform int numIterations;
-
-uniform float alphaCorrection;
-
-uniform vec4 licParams;
-
-
-// textures (have to be uniform)
-
-uniform sampler3D volumeSampler;
-uniform sampler3D noiseSampler;
-
-uniform sampler2D mcOffsetSampler;
-
-uniform sampler1D transferRGBASampler;
-uniform sampler1D transferAlphaOpacSampler;
-
-uniform sampler1D licKernelSampler;
-
-
-uniform sampler2D malloDiffSampler;
-uniform sampler2D malloSpecSampler;
-uniform sampler2D zoecklerSampler;
-
-
+// raycaster of the vector field, the magnitude is classified by the
+// transfer function and the direction gives the color
+// uniforms and vectorFieldLookup() are declared in inc_header.glsl
 
 
 void main(void)
@@ -59,6 +26,16 @@ void main(void)
     vec4 dest = vec4(0.0);
     vec4 src;
 
+    // progressive refinement: the ray starts are moved by a fraction of a
+    // step, blue noise per pixel which is shifted every frame
+    pos += dir * (stepSize * rayJitter.x
+        * fract(texture2DRect(mcOffsetSampler, gl_FragCoord.xy).r + rayJitter.y));
+
+#ifdef PRE_INTEGRATION
+    // value of the previous sample, negative if it was skipped
+    float front = vectorFieldLookup(pos).a;
+#endif
+
     //dest = texture3D(volumeSampler, pos);
 
     // move one step forward
@@ -68,15 +45,39 @@ void main(void)
     {
         for (int i=0; i<numIterations; ++i)
         {
+            // skip the samples of an empty macro cell
+            int skip = macroCellSkip(pos, dir, stepSize, vec2(1.0, 0.0));
+            if (skip > 0)
+            {
+                pos += dir * (stepSize * float(skip));
+                i += skip - 1;
+#ifdef PRE_INTEGRATION
+                front = -1.0;
+#endif
+
+                outside = any(bvec3(clamp(pos.xyz, vec3(0.0), texMax.xyz) - pos.xyz));
+                if (outside)
+                    break;
+                continue;
+            }
+
             // lookup scalar value
-            vectorData = texture3D(volumeSampler, pos);
+            vectorData = vectorFieldLookup(pos);
             noise = texture3D(noiseSampler, pos);
             scalarData = vectorData.a;
 
             // lookup in transfer function
+#ifdef PRE_INTEGRATION
+            if (front < 0.0)
+                front = vectorFieldLookup(pos - dir * stepSize).a;
+            data = texture2D(preIntSampler, vec2(front, scalarData));
+            front = scalarData;
+#else
             data = texture1D(transferRGBASampler, scalarData);
+#endif
 
-            src = vec4(vectorData.xyz, data.a);
+            // opacity correction for the step size
+            src = vec4(vectorData.xyz, 1.0 - pow(1.0 - data.a, alphaCorrection));
             //src = vec4(noise.xyz, data.a);
 
             // perform blending
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <set>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "timer.h"
+#include "taskgraph.h"
+
+
+// worker threads even on machines with fewer cores
+#define TASKGRAPH_MIN_WORKERS  8
+
+
+TaskGraph::TaskGraph(void) : _totalTime(0.0)
+{
+}
+
+
+TaskGraph::~TaskGraph(void)
+{
+}
+
+
+int TaskGraph::addTask(const char *name, const std::function<bool(void)> &func,
+	bool needsContext)
+{
+	Task task;
+
+	task.name = name;
+	task.func = func;
+	task.needsContext = needsContext;
+	task.numDependencies = 0;
+	task.pending = 0;
+	task.state = TASK_WAITING;
+	task.start = 0.0;
+	task.duration = 0.0;
+	_tasks.push_back(task);
+
+	return static_cast<int>(_tasks.size()) - 1;
+}
+
+
+bool TaskGraph::addDependency(int task, int dependency)
+{
+	if ((task < 0) || (task >= (int)_tasks.size())
+		|| (dependency < 0) || (dependency >= task))
+	{
+		fprintf(stderr, "TaskGraph:  Invalid dependency %d -> %d.\n",
+			dependency, task);
+		return false;
+	}
+
+	_tasks[dependency].dependents.push_back(task);
+	++_tasks[task].numDependencies;
+	return true;
+}
+
+
+bool TaskGraph::run(void)
+{
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<int> cpuReady;
+	std::set<int> contextReady;   // ordered by id
+	std::vector<std::thread> workers;
+	int remaining = static_cast<int>(_tasks.size());
+	int numCpuTasks = 0;
+	int numWorkers;
+	bool success = true;
+	double start = timer();
+
+	// called with mutex locked
+	std::function<void(int)> makeReady = [&](int id)
+	{
+		if (_tasks[id].needsContext)
+			contextReady.insert(id);
+		else
+			cpuReady.push_back(id);
+	};
+	std::function<void(int, TaskState)> finish = [&](int id, TaskState state)
+	{
+		_tasks[id].state = state;
+		--remaining;
+		if (state != TASK_DONE)
+			success = false;
+
+		for (size_t i = 0; i < _tasks[id].dependents.size(); ++i)
+		{
+			int d = _tasks[id].dependents[i];
+
+			if (_tasks[d].state != TASK_WAITING)
+				continue;
+			if (state != TASK_DONE)
+			{
+				fprintf(stderr, "TaskGraph:  Skipping \"%s\", \"%s\" did not "
+					"succeed.\n", _tasks[d].name.c_str(), _tasks[id].name.c_str());
+				finish(d, TASK_SKIPPED);
+			}
+			else if (--_tasks[d].pending == 0)
+				makeReady(d);
+		}
+	};
+	// run one task which was taken from a ready queue, mutex is unlocked
+	auto execute = [&](int id)
+	{
+		double t = timer();
+		bool ok;
+
+		_tasks[id].start = t - start;
+		ok = _tasks[id].func();
+		_tasks[id].duration = timer() - t;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		finish(id, ok ? TASK_DONE : TASK_FAILED);
+		changed.notify_all();
+	};
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (size_t i = 0; i < _tasks.size(); ++i)
+		{
+			_tasks[i].pending = _tasks[i].numDependencies;
+			_tasks[i].state = TASK_WAITING;
+			_tasks[i].start = _tasks[i].duration = 0.0;
+			if (!_tasks[i].needsContext)
+				++numCpuTasks;
+		}
+		for (size_t i = 0; i < _tasks.size(); ++i)
+		{
+			if (_tasks[i].pending == 0)
+				makeReady(static_cast<int>(i));
+		}
+	}
+
+	// the stages are few and mostly wait for the disk, so each may get its
+	// own thread, heavy computations inside use the ThreadPool anyway
+	numWorkers = static_cast<int>(std::thread::hardware_concurrency());
+	if (numWorkers < TASKGRAPH_MIN_WORKERS)
+		numWorkers = TASKGRAPH_MIN_WORKERS;
+	if (numWorkers > numCpuTasks)
+		numWorkers = numCpuTasks;
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		workers.push_back(std::thread([&]
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			while (true)
+			{
+				changed.wait(lock, [&] { return !cpuReady.empty() || (remaining == 0); });
+				if (cpuReady.empty())
+					break;
+				int id = cpuReady.front();
+				cpuReady.pop_front();
+				_tasks[id].state = TASK_RUNNING;
+
+				lock.unlock();
+				execute(id);
+				lock.lock();
+			}
+		}));
+	}
+
+	// tasks needing the context run on this thread
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			changed.wait(lock, [&] { return !contextReady.empty() || (remaining == 0); });
+			if (contextReady.empty())
+				break;
+			int id = *contextReady.begin();
+			contextReady.erase(contextReady.begin());
+			_tasks[id].state = TASK_RUNNING;
+
+			lock.unlock();
+			execute(id);
+			lock.lock();
+		}
+	}
+
+	for (size_t i = 0; i < workers.size(); ++i)
+		workers[i].join();
+
+	_totalTime = timer() - start;
+	return success;
+}
+
+
+void TaskGraph::printTimings(const char *title)
+{
+	double sum = 0.0;
+
+	fprintf(stdout, "%s:\n", title);
+	fprintf(stdout, "  %-28s %-8s %10s %10s\n", "stage", "thread", "start ms", "time ms");
+	for (size_t i = 0; i < _tasks.size(); ++i)
+	{
+		const Task &task = _tasks[i];
+
+		if (task.state == TASK_SKIPPED)
+		{
+			fprintf(stdout, "  %-28s %-8s %10s %10s\n", task.name.c_str(),
+				task.needsContext ? "context" : "worker", "-", "skipped");
+			continue;
+		}
+		fprintf(stdout, "  %-28s %-8s %10.1f %10.1f%s\n", task.name.c_str(),
+			task.needsContext ? "context" : "worker", task.start, task.duration,
+			(task.state == TASK_FAILED) ? "  failed" : "");
+		sum += task.duration;
+	}
+	fprintf(stdout, "  total %.1f ms (%.1f ms if run in sequence)\n",
+		_totalTime, sum);
+}
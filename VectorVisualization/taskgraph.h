@@ -0,0 +1,62 @@
+#ifndef _TASKGRAPH_H_
+#define _TASKGRAPH_H_
+
+#include <vector>
+#include <string>
+#include <functional>
+
+
+// Runs a set of tasks with dependencies between them. Tasks which
+// only use the CPU run concurrently on worker threads, tasks which
+// need the OpenGL context run on the thread calling run(), in the
+// order they were added as soon as their dependencies are done.
+// The start and duration of every task is recorded.
+class TaskGraph
+{
+public:
+	TaskGraph(void);
+	~TaskGraph(void);
+
+	// func returns false if the task failed, tasks depending on it are skipped
+	// returns the id of the task
+	int addTask(const char *name, const std::function<bool(void)> &func,
+		bool needsContext = false);
+	// task is started after dependency finished successfully
+	// dependency has to be added before task, so there are no cycles
+	bool addDependency(int task, int dependency);
+
+	// run all tasks and wait for them
+	// returns false if a task failed or was skipped
+	bool run(void);
+
+	// print start and duration of each task of the last run() to stdout
+	void printTimings(const char *title);
+
+private:
+	enum TaskState
+	{
+		TASK_WAITING,
+		TASK_RUNNING,
+		TASK_DONE,
+		TASK_FAILED,
+		TASK_SKIPPED
+	};
+
+	struct Task
+	{
+		std::string name;
+		std::function<bool(void)> func;
+		bool needsContext;
+		std::vector<int> dependents;
+		int numDependencies;
+		int pending;
+		TaskState state;
+		double start;     // in ms since the start of run()
+		double duration;  // in ms
+	};
+
+	std::vector<Task> _tasks;
+	double _totalTime;
+};
+
+#endif // _TASKGRAPH_H_
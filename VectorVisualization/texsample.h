@@ -0,0 +1,89 @@
+#ifndef _TEXSAMPLE_H_
+#define _TEXSAMPLE_H_
+
+#include <stddef.h>
+#include <math.h>
+
+
+// Texture lookups of the CPU engines, filtered like OpenGL does for
+// GL_LINEAR with GL_CLAMP_TO_EDGE or GL_REPEAT.
+
+
+// texel index and weight of one coordinate for GL_LINEAR
+static inline void texelCoord(float s, int size, bool repeat, int &i0, int &i1, float &f)
+{
+	float u;
+
+	if (repeat)
+		s -= floorf(s);
+	else
+		s = (s < 0.0f) ? 0.0f : ((s > 1.0f) ? 1.0f : s);
+
+	u = s * size - 0.5f;
+	i0 = (int)floorf(u);
+	f = u - i0;
+	i1 = i0 + 1;
+
+	if (repeat)
+	{
+		if (i0 < 0)
+			i0 += size;
+		if (i1 >= size)
+			i1 -= size;
+	}
+	else
+	{
+		if (i0 < 0)
+			i0 = 0;
+		if (i1 > size - 1)
+			i1 = size - 1;
+	}
+}
+
+
+// trilinear lookup of C channels at texture coordinate (s, t, r)
+template<int C>
+static inline void sampleTrilinear(const float *data, const int size[3], bool repeat,
+	float s, float t, float r, float *out)
+{
+	int x0, x1, y0, y1, z0, z1;
+	float fx, fy, fz;
+
+	texelCoord(s, size[0], repeat, x0, x1, fx);
+	texelCoord(t, size[1], repeat, y0, y1, fy);
+	texelCoord(r, size[2], repeat, z0, z1, fz);
+
+	const size_t sx = C;
+	const size_t sy = (size_t)C * size[0];
+	const size_t sz = sy * size[1];
+	const float *p00 = data + z0 * sz + y0 * sy;
+	const float *p01 = data + z0 * sz + y1 * sy;
+	const float *p10 = data + z1 * sz + y0 * sy;
+	const float *p11 = data + z1 * sz + y1 * sy;
+
+	for (int c = 0; c < C; ++c)
+	{
+		float v00 = p00[x0 * sx + c] + fx * (p00[x1 * sx + c] - p00[x0 * sx + c]);
+		float v01 = p01[x0 * sx + c] + fx * (p01[x1 * sx + c] - p01[x0 * sx + c]);
+		float v10 = p10[x0 * sx + c] + fx * (p10[x1 * sx + c] - p10[x0 * sx + c]);
+		float v11 = p11[x0 * sx + c] + fx * (p11[x1 * sx + c] - p11[x0 * sx + c]);
+		float v0 = v00 + fy * (v01 - v00);
+		float v1 = v10 + fy * (v11 - v10);
+		out[c] = v0 + fz * (v1 - v0);
+	}
+}
+
+
+// linear lookup of C channels of a 1D texture (GL_CLAMP_TO_EDGE)
+template<int C>
+static inline void sampleLinear(const float *data, int size, float s, float *out)
+{
+	int i0, i1;
+	float f;
+
+	texelCoord(s, size, false, i0, i1, f);
+	for (int c = 0; c < C; ++c)
+		out[c] = data[i0 * C + c] + f * (data[i1 * C + c] - data[i0 * C + c]);
+}
+
+#endif // _TEXSAMPLE_H_
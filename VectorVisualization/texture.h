@@ -24,12 +24,12 @@ struct Texture
 {
     Texture(void) : texTarget(GL_TEXTURE_2D),format(0),id(0),
                     name(NULL),texUnit(GL_TEXTURE0_ARB),
-                    width(1),height(1),depth(1)
+                    width(1),height(1),depth(1),levels(1)
     {
     }
     Texture(const Texture &tex) : texTarget(GL_TEXTURE_2D),format(0),id(0),
                                   name(NULL),texUnit(GL_TEXTURE0_ARB),
-                                  width(1),height(1),depth(1)
+                                  width(1),height(1),depth(1),levels(1)
     {
         setTexName(tex.name);
     }
@@ -84,6 +84,8 @@ struct Texture
     int width;
     int height;
     int depth;
+    // mipmap levels of the storage
+    int levels;
 };
 
 #endif // _TEXTURE_H_
@@ -0,0 +1,205 @@
+#include <stdint.h>
+
+#include "threadpool.h"
+
+
+// set in worker threads and while a thread runs a job
+static thread_local bool inParallelFor = false;
+
+
+ThreadPool::ThreadPool(int numThreads) : _func(NULL), _count(0), _chunkSize(1),
+	_next(0), _busy(0), _generation(0), _quit(false)
+{
+	if (numThreads < 1)
+		numThreads = static_cast<int>(std::thread::hardware_concurrency());
+
+	for (int i = 1; i < numThreads; ++i)
+		_workers.push_back(std::thread(&ThreadPool::run, this));
+}
+
+
+ThreadPool::~ThreadPool(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_quit = true;
+	}
+	_wake.notify_all();
+
+	for (size_t i = 0; i < _workers.size(); ++i)
+		_workers[i].join();
+}
+
+
+ThreadPool& ThreadPool::getInstance(void)
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+
+void ThreadPool::parallelFor(int count, const std::function<void(int, int)> &func)
+{
+	if (count < 1)
+		return;
+
+	std::unique_lock<std::mutex> callLock(_callMutex, std::defer_lock);
+	if (_workers.empty() || (count == 1) || inParallelFor || !callLock.try_lock())
+	{
+		func(0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_func = &func;
+		_count = count;
+		// several chunks per thread to balance uneven work
+		_chunkSize = count / (4 * getNumThreads());
+		if (_chunkSize < 1)
+			_chunkSize = 1;
+		_next = 0;
+		_busy = static_cast<int>(_workers.size());
+		++_generation;
+	}
+	_wake.notify_all();
+
+	inParallelFor = true;
+	runChunks();
+	inParallelFor = false;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done.wait(lock, [this] { return _busy == 0; });
+	_func = NULL;
+}
+
+
+void ThreadPool::run(void)
+{
+	int generation = 0;
+
+	inParallelFor = true;
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	while (true)
+	{
+		_wake.wait(lock, [&] { return _quit || (_generation != generation); });
+		if (_quit)
+			break;
+		generation = _generation;
+
+		lock.unlock();
+		runChunks();
+		lock.lock();
+
+		if (--_busy == 0)
+			_done.notify_one();
+	}
+}
+
+
+void ThreadPool::runChunks(void)
+{
+	while (true)
+	{
+		int begin = _next.fetch_add(_chunkSize);
+		if (begin >= _count)
+			break;
+		int end = (begin + _chunkSize < _count) ? begin + _chunkSize : _count;
+		(*_func)(begin, end);
+	}
+}
+
+
+// part of the items of parallelForStealing() owned by one slot,
+// begin and end are packed into one word so both change atomically
+struct alignas(64) StealRange
+{
+	std::atomic<uint64_t> range;
+
+	static uint64_t pack(int begin, int end)
+	{
+		return ((uint64_t)(uint32_t)begin << 32) | (uint32_t)end;
+	}
+	static int getBegin(uint64_t r) { return (int)(r >> 32); }
+	static int getEnd(uint64_t r) { return (int)(r & 0xFFFFFFFFu); }
+
+	// take the first item, returns -1 if the range is empty
+	int pop(void)
+	{
+		uint64_t r = range.load();
+		while (getBegin(r) < getEnd(r))
+		{
+			if (range.compare_exchange_weak(r, pack(getBegin(r) + 1, getEnd(r))))
+				return getBegin(r);
+		}
+		return -1;
+	}
+
+	// take the upper half, returns false if the range is empty
+	bool steal(int &begin, int &end)
+	{
+		uint64_t r = range.load();
+		while (getBegin(r) < getEnd(r))
+		{
+			int mid = getBegin(r) + (getEnd(r) - getBegin(r)) / 2;
+			if (range.compare_exchange_weak(r, pack(getBegin(r), mid)))
+			{
+				begin = mid;
+				end = getEnd(r);
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+
+void ThreadPool::parallelForStealing(int count, const std::function<void(int, int)> &func)
+{
+	int numSlots = getNumThreads();
+
+	if (count < 1)
+		return;
+	if (numSlots > count)
+		numSlots = count;
+
+	std::vector<StealRange> ranges(numSlots);
+	for (int i = 0; i < numSlots; ++i)
+	{
+		ranges[i].range = StealRange::pack((int)((int64_t)count * i / numSlots),
+			(int)((int64_t)count * (i + 1) / numSlots));
+	}
+
+	// one chunk per slot, a thread finishing early may run a second slot
+	// whose items were mostly stolen already
+	parallelFor(numSlots, [&](int beginSlot, int endSlot)
+	{
+		for (int slot = beginSlot; slot < endSlot; ++slot)
+		{
+			StealRange &own = ranges[slot];
+
+			while (true)
+			{
+				int item = own.pop();
+				if (item >= 0)
+				{
+					func(item, slot);
+					continue;
+				}
+
+				// own part is done, look for work at the other slots
+				int begin = 0, end = 0;
+				bool stolen = false;
+				for (int i = 1; !stolen && (i < numSlots); ++i)
+					stolen = ranges[(slot + i) % numSlots].steal(begin, end);
+				if (!stolen)
+					break;
+
+				// the own range is empty, so no thief can change it meanwhile
+				own.range = StealRange::pack(begin + 1, end);
+				func(begin, slot);
+			}
+		}
+	});
+}
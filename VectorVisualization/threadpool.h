@@ -0,0 +1,61 @@
+#ifndef _THREADPOOL_H_
+#define _THREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+
+// Worker threads shared by the data processing kernels. One worker less
+// than hardware threads is started, the calling thread does the rest.
+class ThreadPool
+{
+public:
+	ThreadPool(int numThreads = 0);
+	~ThreadPool(void);
+
+	// pool used by the kernels, created on first use
+	static ThreadPool& getInstance(void);
+
+	// number of threads working on a parallelFor() including the caller
+	int getNumThreads(void) { return static_cast<int>(_workers.size()) + 1; }
+
+	// call func(begin, end) for disjoint ranges covering [0, count) and
+	// block until all of them are done
+	// nested calls and calls from several threads at once run serially
+	void parallelFor(int count, const std::function<void(int, int)> &func);
+
+	// call func(item, slot) for every item of [0, count), for items of very
+	// uneven cost
+	// every thread owns a contiguous part of the items and steals half of
+	// the remaining part of another thread once its own part is done
+	// slot < getNumThreads() is never used by two threads at the same time,
+	// so it may select per-thread scratch memory
+	void parallelForStealing(int count, const std::function<void(int, int)> &func);
+
+protected:
+	void run(void);
+	void runChunks(void);
+
+private:
+	std::vector<std::thread> _workers;
+
+	// current job, only changed while _mutex is locked
+	const std::function<void(int, int)> *_func;
+	int _count;
+	int _chunkSize;
+	std::atomic<int> _next;
+	int _busy;        // workers which did not finish the current job
+	int _generation;  // incremented for every job
+	bool _quit;
+
+	std::mutex _callMutex;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+};
+
+#endif // _THREADPOOL_H_
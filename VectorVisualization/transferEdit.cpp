@@ -47,6 +47,8 @@
 #include "mmath.h"
 #include "imageUtils.h"
 #include "dataSet.h"
+#include "preproccache.h"
+#include "preintegration.h"
 #include "transferEdit.h"
 
 
@@ -66,6 +68,7 @@ TransferEdit::TransferEdit(void) : _numEntries(256),_visible(false),
                                    _fileNameAlphaOpac(NULL)
 {
     _tfData = new unsigned char[5*_numEntries];
+    _texTFData = new unsigned char[5*_numEntries];
 //    _tfRGBA = new unsigned char[4*_numEntries];
 //    _tfAlphaOpac = new unsigned char[2*_numEntries];
     _histogram = new unsigned char[_numEntries];
@@ -80,6 +83,7 @@ TransferEdit::TransferEdit(void) : _numEntries(256),_visible(false),
         for (int ch=3; ch<5; ++ch)
             _tfData[5*i+ch] = (unsigned char) ((i<20) ? 0 : i-20);
     }
+    memcpy(_texTFData, _tfData, 5*_numEntries);
 
     // initialize histogram
     memset(_histogram, 0, sizeof(unsigned char)*_numEntries);
@@ -92,15 +96,18 @@ TransferEdit::TransferEdit(void) : _numEntries(256),_visible(false),
 
     _texRGB.texUnit = GL_TEXTURE7_ARB;
     _texAlphaOpac.texUnit = GL_TEXTURE8_ARB;
+    _texPreInt.texUnit = GL_TEXTURE12_ARB;
 
     _texRGB.format = GL_RGBA;
     _texAlphaOpac.format = GL_LUMINANCE_ALPHA;
+    _texPreInt.format = GL_RGBA;
 }
 
 
 TransferEdit::~TransferEdit(void)
 {
     delete [] _tfData;
+    delete [] _texTFData;
     //delete [] _tfRGBA;
     //delete [] _tfAlphaOpac;
     delete [] _histogram;
@@ -342,10 +349,19 @@ void TransferEdit::computeHistogram(VolumeData *vd)
     int *histogram;
     int v;
     int size;
-    int di;
     float maxLen = -1.0f;
     float *magnitude = NULL;
 
+    // the histogram only depends on the data
+    PreprocKey key("histo");
+    key.addContent(vd->data, (size_t)vd->size[0]*vd->size[1]*vd->size[2]
+        * vd->dataDim * getDataTypeSize(vd->dataType));
+    key.add(vd->dataDim);
+    key.add(static_cast<int>(vd->dataType));
+    key.add(_numEntries);
+    if (PreprocCache::getInstance().load(key, _histogram, _numEntries))
+        return;
+
     // initialize histogram
     histogram = new int[_numEntries];
     memset(histogram, 0, sizeof(int)*_numEntries);
@@ -428,6 +444,18 @@ void TransferEdit::computeHistogram(VolumeData *vd)
         break;
     }
 
+    setHistogram(histogram);
+
+    PreprocCache::getInstance().store(key, _histogram, _numEntries);
+
+    delete [] histogram;
+}
+
+
+void TransferEdit::setHistogram(const int *histogram)
+{
+    int di;
+
     // normalize histogram
     di = 0;
     // find maximum occurence
@@ -437,8 +465,6 @@ void TransferEdit::computeHistogram(VolumeData *vd)
     for (int i=0; i<256; ++i)
         _histogram[i] = (unsigned char)
             (log((float)histogram[i])*256.0f/log((float)histogram[di]));
-
-    delete [] histogram;
 }
 
 
@@ -494,6 +520,11 @@ void TransferEdit::updateTextures(void)
         glGenTextures(1, &texId);
         _texAlphaOpac.setTex(GL_TEXTURE_1D, texId, "TF_AlphaOpac");
     }
+    if (_texPreInt.id == 0)
+    {
+        glGenTextures(1, &texId);
+        _texPreInt.setTex(GL_TEXTURE_2D, texId, "TF_PreInt");
+    }
 
 #if FORCE_POWER_OF_TWO_TEXTURE == 1
     texSize = nextPowerTwo(_numEntries);
@@ -540,6 +571,30 @@ void TransferEdit::updateTextures(void)
     glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 
     delete [] paddedData;
+
+
+    // pre-integrated table, same texel centers as the 1D textures since
+    // _numEntries is a power of two
+    paddedData = new unsigned char[4*_numEntries*_numEntries];
+    computePreIntegrationTable(_tfData, _numEntries, paddedData);
+
+    _texPreInt.width = _numEntries;
+    _texPreInt.height = _numEntries;
+    glBindTexture(GL_TEXTURE_2D, _texPreInt.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, _numEntries, _numEntries,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, paddedData);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    delete [] paddedData;
+
+    memcpy(_texTFData, _tfData, 5*_numEntries);
 }
 
 
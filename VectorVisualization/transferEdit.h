@@ -64,6 +64,8 @@ public:
     bool loadTF(const char *fileName);
 
     void computeHistogram(VolumeData *vd);
+    // use precomputed counts of getNumEntries() bins, e.g. of a manifest
+    void setHistogram(const int *histogram);
 
     //void createTextures(void);
     void setTexUnits(GLuint rgbaTexUnit, 
@@ -76,6 +78,8 @@ public:
 
     Texture* getTextureRGB(void) { return &_texRGB; }
     Texture* getTextureAlphaOpac(void) { return &_texAlphaOpac; }
+    // 2D table of the pre-integrated transfer function (front, back)
+    Texture* getTexturePreInt(void) { return &_texPreInt; }
 
     void setVisible(bool visible) { _visible = visible; }
     bool isVisible(void) { return _visible; }
@@ -101,6 +105,11 @@ public:
     }
 
     int getNumEntries(void) { return _numEntries; }
+    // getNumEntries() entries of 5 channels: RGB, alpha and LIC opacity
+    const unsigned char* getTFData(void) { return _tfData; }
+    // entries of getTFData() held by the textures, i.e. copied by the
+    // last updateTextures()
+    const unsigned char* getTextureTFData(void) { return _texTFData; }
 
     // draw transfer editor and transfer function
     void draw(void);
@@ -127,6 +136,7 @@ private:
 
     // contains all channels of the transfer function
     unsigned char *_tfData;
+    unsigned char *_texTFData;
     // contains RGB and alpha
     //unsigned char *_tfRGBA;
     // contains alpha (duplicated) and the additional LIC opacity
@@ -151,6 +161,7 @@ private:
 
     Texture _texRGB;
     Texture _texAlphaOpac;
+    Texture _texPreInt;
 
     // when a filename is set, _fileNameRGBA contains the name of the
     // png file containing the RGBA channels of the transfer function
@@ -54,11 +54,14 @@ Transform::~Transform(void)
 void Transform::setQuaternion(Quaternion &q)
 {
     _q_internal.x = q.x;
-    _q_internal.x = q.y;
-    _q_internal.x = q.z;
-    _q_internal.x = q.w;
+    _q_internal.y = q.y;
+    _q_internal.z = q.z;
+    _q_internal.w = q.w;
+    Quaternion_normalize(&_q_internal);
 
     update();
+
+    Quaternion_getAngleAxis(_q, &_angle, &_axis);
 }
 
 
@@ -34,6 +34,10 @@
 //#define BACKGROUND_IMAGE         "backgrounds/chess.ppm"
 
 #define LOW_RES_TIMER_DELAY  0.5
+// frames averaged by the progressive refinement
+#define PROGRESSIVE_DEFAULT_FRAMES  16
+// updates of the LIC volume timed by --benchlic
+#define LIC_BENCH_DEFAULT_RUNS      10
 
 #define VOL_FILE_EXT        ".dat"
 #define SETTINGS_EXT        ".stg"
@@ -94,7 +98,8 @@ struct LICParams
 		illumScale(1.0f), freqScale(1.0f),
 		numIterations(255),
 		stepsForward(32), stepsBackward(32),
-		stepSizeLIC(0.01f)
+		stepSizeLIC(0.01f),
+		scalarMin(0.1f), scalarMax(0.3f)
 	{}
 
 	float stepSizeVol;
@@ -106,6 +111,11 @@ struct LICParams
 	int stepsForward;
 	int stepsBackward;
 	float stepSizeLIC;
+
+	// the noise is only integrated where the scalar volume lies in
+	// (scalarMin, scalarMax)
+	float scalarMin;
+	float scalarMax;
 };
 
 
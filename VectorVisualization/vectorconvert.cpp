@@ -0,0 +1,930 @@
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <stdint.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#if defined(__AVX2__)
+#  include <immintrin.h>
+#  define USE_AVX2
+#endif
+#if defined(USE_AVX2) || defined(__SSE2__) || defined(_M_X64) \
+	|| (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define USE_SSE2
+#endif
+
+#include "vectorconvert.h"
+#include "threadpool.h"
+#include "mmath.h"
+
+
+// number of scalars processed by one task of normalizeScalars*()
+#define SCALAR_BLOCK_SIZE  65536
+
+
+// ---- scalar helpers --------------------------------------------------
+
+static inline float toFloat(float v) { return v; }
+static inline float toFloat(unsigned char v) { return v - 128.0f; }
+
+template<class S>
+static inline void loadVector(const S *data, const S *next, float t, int i, float v[3])
+{
+	for (int c = 0; c < 3; ++c)
+	{
+		v[c] = toFloat(data[3 * i + c]);
+		if (next)
+			v[c] = v[c] + t * (toFloat(next[3 * i + c]) - v[c]);
+	}
+}
+
+
+#ifdef USE_SSE2
+// ---- SSE2 helpers ----------------------------------------------------
+
+// split 4 xyz vectors (m03 = x0 y0 z0 x1, m14 = y1 z1 x2 y2,
+// m25 = z2 x3 y3 z3) into their components
+static inline void deinterleave(__m128 m03, __m128 m14, __m128 m25,
+	__m128 &x, __m128 &y, __m128 &z)
+{
+	__m128 xy = _mm_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+	__m128 yz = _mm_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+	x = _mm_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+	z = _mm_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+static inline void load4(const float *p, __m128 &x, __m128 &y, __m128 &z)
+{
+	deinterleave(_mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), x, y, z);
+}
+
+static inline void load4(const unsigned char *p, __m128 &x, __m128 &y, __m128 &z)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128 bias = _mm_set1_ps(128.0f);
+	int tail;
+
+	// exactly 12 bytes are read
+	memcpy(&tail, p + 8, sizeof(int));
+	__m128i b = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i*)p), _mm_cvtsi32_si128(tail));
+	__m128i lo = _mm_unpacklo_epi8(b, zero);
+	__m128i hi = _mm_unpackhi_epi8(b, zero);
+
+	deinterleave(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), bias),
+		_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), bias),
+		_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), bias),
+		x, y, z);
+}
+
+template<class S>
+static inline void loadVectors4(const S *data, const S *next, __m128 t, int i,
+	__m128 &x, __m128 &y, __m128 &z)
+{
+	load4(data + 3 * i, x, y, z);
+	if (next)
+	{
+		__m128 nx, ny, nz;
+		load4(next + 3 * i, nx, ny, nz);
+		x = _mm_add_ps(x, _mm_mul_ps(t, _mm_sub_ps(nx, x)));
+		y = _mm_add_ps(y, _mm_mul_ps(t, _mm_sub_ps(ny, y)));
+		z = _mm_add_ps(z, _mm_mul_ps(t, _mm_sub_ps(nz, z)));
+	}
+}
+
+static inline __m128 select(__m128 mask, __m128 a, __m128 b)
+{
+	return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline float horizontalMax(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+
+static inline float horizontalMin(__m128 v)
+{
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+	v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+	return _mm_cvtss_f32(v);
+}
+
+// interleave and store 4 rgba voxels, dst has to be aligned if stream is set
+static inline void store4(float *dst, __m128 r, __m128 g, __m128 b, __m128 a, bool stream)
+{
+	_MM_TRANSPOSE4_PS(r, g, b, a);
+	if (stream)
+	{
+		// the target is usually write-combined pixel buffer memory
+		_mm_stream_ps(dst, r);
+		_mm_stream_ps(dst + 4, g);
+		_mm_stream_ps(dst + 8, b);
+		_mm_stream_ps(dst + 12, a);
+	}
+	else
+	{
+		_mm_storeu_ps(dst, r);
+		_mm_storeu_ps(dst + 4, g);
+		_mm_storeu_ps(dst + 8, b);
+		_mm_storeu_ps(dst + 12, a);
+	}
+}
+
+// values are truncated like a cast to unsigned char
+static inline void store4(unsigned char *dst, __m128 r, __m128 g, __m128 b, __m128 a, bool stream)
+{
+	_MM_TRANSPOSE4_PS(r, g, b, a);
+	__m128i rgba = _mm_packus_epi16(
+		_mm_packs_epi32(_mm_cvttps_epi32(r), _mm_cvttps_epi32(g)),
+		_mm_packs_epi32(_mm_cvttps_epi32(b), _mm_cvttps_epi32(a)));
+	if (stream)
+		_mm_stream_si128((__m128i*)dst, rgba);
+	else
+		_mm_storeu_si128((__m128i*)dst, rgba);
+}
+#endif // USE_SSE2
+
+
+#ifdef USE_AVX2
+// ---- AVX2 helpers ----------------------------------------------------
+
+// same as the SSE2 version, the lower lane holds the vectors 0-3
+// and the upper lane the vectors 4-7
+static inline void deinterleave(__m256 m03, __m256 m14, __m256 m25,
+	__m256 &x, __m256 &y, __m256 &z)
+{
+	__m256 xy = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+	__m256 yz = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+	x = _mm256_shuffle_ps(m03, xy, _MM_SHUFFLE(2, 0, 3, 0));
+	y = _mm256_shuffle_ps(yz, xy, _MM_SHUFFLE(3, 1, 2, 0));
+	z = _mm256_shuffle_ps(yz, m25, _MM_SHUFFLE(3, 0, 3, 1));
+}
+
+static inline void load8(const float *p, __m256 &x, __m256 &y, __m256 &z)
+{
+	__m256 m03 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(p + 12), 1);
+	__m256 m14 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 4)), _mm_loadu_ps(p + 16), 1);
+	__m256 m25 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p + 8)), _mm_loadu_ps(p + 20), 1);
+	deinterleave(m03, m14, m25, x, y, z);
+}
+
+static inline void load8(const unsigned char *p, __m256 &x, __m256 &y, __m256 &z)
+{
+	const __m256 bias = _mm256_set1_ps(128.0f);
+	__m256 a = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p))), bias);
+	__m256 b = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p + 8)))), bias);
+	__m256 c = _mm256_sub_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p + 16)))), bias);
+	deinterleave(_mm256_permute2f128_ps(a, b, 0x30), _mm256_permute2f128_ps(a, c, 0x21),
+		_mm256_permute2f128_ps(b, c, 0x30), x, y, z);
+}
+
+template<class S>
+static inline void loadVectors8(const S *data, const S *next, __m256 t, int i,
+	__m256 &x, __m256 &y, __m256 &z)
+{
+	load8(data + 3 * i, x, y, z);
+	if (next)
+	{
+		__m256 nx, ny, nz;
+		load8(next + 3 * i, nx, ny, nz);
+		x = _mm256_add_ps(x, _mm256_mul_ps(t, _mm256_sub_ps(nx, x)));
+		y = _mm256_add_ps(y, _mm256_mul_ps(t, _mm256_sub_ps(ny, y)));
+		z = _mm256_add_ps(z, _mm256_mul_ps(t, _mm256_sub_ps(nz, z)));
+	}
+}
+
+template<class T>
+static inline void store8(T *dst, __m256 r, __m256 g, __m256 b, __m256 a, bool stream)
+{
+	store4(dst, _mm256_castps256_ps128(r), _mm256_castps256_ps128(g),
+		_mm256_castps256_ps128(b), _mm256_castps256_ps128(a), stream);
+	store4(dst + 16, _mm256_extractf128_ps(r, 1), _mm256_extractf128_ps(g, 1),
+		_mm256_extractf128_ps(b, 1), _mm256_extractf128_ps(a, 1), stream);
+}
+#endif // USE_AVX2
+
+
+// ---- vector fields ---------------------------------------------------
+
+// squared length of the longest of n consecutive vectors
+template<class S>
+static float maxLength2(const S *data, const S *next, float t, int n)
+{
+	float maxLen2 = 0.0f;
+	float v[3];
+	int i = 0;
+
+#ifdef USE_AVX2
+	const __m256 t8 = _mm256_set1_ps(t);
+	__m256 max8 = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 x, y, z;
+		loadVectors8(data, next, t8, i, x, y, z);
+		max8 = _mm256_max_ps(max8, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x),
+			_mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+	}
+	maxLen2 = horizontalMax(_mm_max_ps(_mm256_castps256_ps128(max8), _mm256_extractf128_ps(max8, 1)));
+#endif
+#ifdef USE_SSE2
+	const __m128 t4 = _mm_set1_ps(t);
+	__m128 max4 = _mm_set1_ps(maxLen2);
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 x, y, z;
+		loadVectors4(data, next, t4, i, x, y, z);
+		max4 = _mm_max_ps(max4, _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x),
+			_mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+	}
+	maxLen2 = horizontalMax(max4);
+#endif
+	for (; i < n; ++i)
+	{
+		loadVector(data, next, t, i, v);
+		float len2 = SQR(v[0]) + SQR(v[1]) + SQR(v[2]);
+		if (len2 > maxLen2)
+			maxLen2 = len2;
+	}
+
+	return maxLen2;
+}
+
+// convert a row of n vectors into n rgba voxels
+template<class S>
+static void convertRow(const S *data, const S *next, float t, int n,
+	float maxLen, float zeroDir, float *dst)
+{
+	float v[3];
+	float len;
+	int i = 0;
+
+#ifdef USE_SSE2
+	bool stream = ((uintptr_t)dst & 15) == 0;
+#endif
+#ifdef USE_AVX2
+	{
+		const __m256 t8 = _mm256_set1_ps(t);
+		const __m256 half = _mm256_set1_ps(0.5f);
+		const __m256 eps = _mm256_set1_ps(EPS);
+		const __m256 zero = _mm256_set1_ps(zeroDir);
+		const __m256 maxLen8 = _mm256_set1_ps(maxLen);
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x, y, z;
+			loadVectors8(data, next, t8, i, x, y, z);
+			__m256 len8 = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x),
+				_mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+			__m256 isZero = _mm256_cmp_ps(len8, eps, _CMP_LT_OQ);
+			len8 = _mm256_andnot_ps(isZero, len8);
+
+			__m256 r = _mm256_blendv_ps(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(half, x), len8), half), zero, isZero);
+			__m256 g = _mm256_blendv_ps(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(half, y), len8), half), zero, isZero);
+			__m256 b = _mm256_blendv_ps(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(half, z), len8), half), zero, isZero);
+			__m256 a = len8;
+			if (maxLen > 0.0f)
+				a = _mm256_min_ps(_mm256_max_ps(_mm256_div_ps(len8, maxLen8),
+					_mm256_setzero_ps()), _mm256_set1_ps(1.0f));
+
+			store8(dst + 4 * i, r, g, b, a, stream);
+		}
+	}
+#endif
+#ifdef USE_SSE2
+	{
+		const __m128 t4 = _mm_set1_ps(t);
+		const __m128 half = _mm_set1_ps(0.5f);
+		const __m128 eps = _mm_set1_ps(EPS);
+		const __m128 zero = _mm_set1_ps(zeroDir);
+		const __m128 maxLen4 = _mm_set1_ps(maxLen);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 x, y, z;
+			loadVectors4(data, next, t4, i, x, y, z);
+			__m128 len4 = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x),
+				_mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+			__m128 isZero = _mm_cmplt_ps(len4, eps);
+			len4 = _mm_andnot_ps(isZero, len4);
+
+			__m128 r = select(isZero, zero, _mm_add_ps(_mm_div_ps(_mm_mul_ps(half, x), len4), half));
+			__m128 g = select(isZero, zero, _mm_add_ps(_mm_div_ps(_mm_mul_ps(half, y), len4), half));
+			__m128 b = select(isZero, zero, _mm_add_ps(_mm_div_ps(_mm_mul_ps(half, z), len4), half));
+			__m128 a = len4;
+			if (maxLen > 0.0f)
+				a = _mm_min_ps(_mm_max_ps(_mm_div_ps(len4, maxLen4), _mm_setzero_ps()),
+					_mm_set1_ps(1.0f));
+
+			store4(dst + 4 * i, r, g, b, a, stream);
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		float *voxel = dst + 4 * i;
+
+		loadVector(data, next, t, i, v);
+		len = sqrt(SQR(v[0]) + SQR(v[1]) + SQR(v[2]));
+		if (len < EPS)
+		{
+			len = 0.0f;
+			voxel[0] = voxel[1] = voxel[2] = zeroDir;
+		}
+		else
+		{
+			voxel[0] = 0.5f*v[0] / len + 0.5f;
+			voxel[1] = 0.5f*v[1] / len + 0.5f;
+			voxel[2] = 0.5f*v[2] / len + 0.5f;
+		}
+		if (maxLen > 0.0f)
+		{
+			len /= maxLen;
+			len = (len > 1.0f) ? 1.0f : ((len < 0.0f) ? 0.0f : len);
+		}
+		voxel[3] = len;
+	}
+}
+
+template<class S>
+static void convertRow(const S *data, const S *next, float t, int n,
+	float maxLen, float, unsigned char *dst)
+{
+	float v[3];
+	float len;
+	int i = 0;
+
+#ifdef USE_SSE2
+	bool stream = ((uintptr_t)dst & 15) == 0;
+#endif
+#ifdef USE_AVX2
+	{
+		const __m256 t8 = _mm256_set1_ps(t);
+		const __m256 scale = _mm256_set1_ps(127.0f);
+		const __m256 offset = _mm256_set1_ps(128.0f);
+		const __m256 eps = _mm256_set1_ps(EPS);
+		const __m256 maxLen8 = _mm256_set1_ps(maxLen);
+		const __m256 ucharMax = _mm256_set1_ps((float)UCHAR_MAX);
+		for (; i + 8 <= n; i += 8)
+		{
+			__m256 x, y, z;
+			loadVectors8(data, next, t8, i, x, y, z);
+			__m256 len8 = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x),
+				_mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+			__m256 isZero = _mm256_cmp_ps(len8, eps, _CMP_LT_OQ);
+			len8 = _mm256_andnot_ps(isZero, len8);
+
+			__m256 r = _mm256_blendv_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(x, len8), scale), offset), offset, isZero);
+			__m256 g = _mm256_blendv_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(y, len8), scale), offset), offset, isZero);
+			__m256 b = _mm256_blendv_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_div_ps(z, len8), scale), offset), offset, isZero);
+			__m256 a = _mm256_setzero_ps();
+			if (maxLen > 0.0f)
+				a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_div_ps(len8, maxLen8), ucharMax),
+					_mm256_setzero_ps()), ucharMax);
+
+			store8(dst + 4 * i, r, g, b, a, stream);
+		}
+	}
+#endif
+#ifdef USE_SSE2
+	{
+		const __m128 t4 = _mm_set1_ps(t);
+		const __m128 scale = _mm_set1_ps(127.0f);
+		const __m128 offset = _mm_set1_ps(128.0f);
+		const __m128 eps = _mm_set1_ps(EPS);
+		const __m128 maxLen4 = _mm_set1_ps(maxLen);
+		const __m128 ucharMax = _mm_set1_ps((float)UCHAR_MAX);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 x, y, z;
+			loadVectors4(data, next, t4, i, x, y, z);
+			__m128 len4 = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x),
+				_mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+			__m128 isZero = _mm_cmplt_ps(len4, eps);
+			len4 = _mm_andnot_ps(isZero, len4);
+
+			__m128 r = select(isZero, offset, _mm_add_ps(_mm_mul_ps(_mm_div_ps(x, len4), scale), offset));
+			__m128 g = select(isZero, offset, _mm_add_ps(_mm_mul_ps(_mm_div_ps(y, len4), scale), offset));
+			__m128 b = select(isZero, offset, _mm_add_ps(_mm_mul_ps(_mm_div_ps(z, len4), scale), offset));
+			__m128 a = _mm_setzero_ps();
+			if (maxLen > 0.0f)
+				a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_div_ps(len4, maxLen4), ucharMax),
+					_mm_setzero_ps()), ucharMax);
+
+			store4(dst + 4 * i, r, g, b, a, stream);
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		unsigned char *voxel = dst + 4 * i;
+
+		loadVector(data, next, t, i, v);
+		len = sqrt(SQR(v[0]) + SQR(v[1]) + SQR(v[2]));
+		if (len < EPS)
+		{
+			len = 0.0f;
+			voxel[0] = voxel[1] = voxel[2] = 128;
+		}
+		else
+		{
+			voxel[0] = (unsigned char)(v[0] / len * 127.0f + 128.0f);
+			voxel[1] = (unsigned char)(v[1] / len * 127.0f + 128.0f);
+			voxel[2] = (unsigned char)(v[2] / len * 127.0f + 128.0f);
+		}
+		len = (maxLen > 0.0f) ? len / maxLen * UCHAR_MAX : 0.0f;
+		voxel[3] = (unsigned char)((len > 255.0f) ? 255 : ((len < 0.0f) ? 0 : len));
+	}
+}
+
+
+template<class S>
+static float computeMaxMagnitude(const VolumeData *vd, const S *data, const S *next, float t)
+{
+	std::mutex mutex;
+	float maxLen2 = 0.0f;
+	const int rowSize = vd->size[0];
+
+	// the rows of the vector field are contiguous
+	ThreadPool::getInstance().parallelFor(vd->size[1] * vd->size[2],
+		[&](int begin, int end)
+	{
+		size_t adr = (size_t)begin * rowSize;
+		float len2 = maxLength2(data + 3 * adr, next ? next + 3 * adr : NULL,
+			t, (end - begin) * rowSize);
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (len2 > maxLen2)
+			maxLen2 = len2;
+	});
+
+	float maxLen = sqrt(maxLen2);
+	return (maxLen < EPS) ? 0.0f : maxLen;
+}
+
+// normalization, magnitude and padding in a single pass over the texture
+template<class S, class T>
+static void convertVectors(const VolumeData *vd, const S *data, const S *next,
+	float t, float maxLen, float zeroDir, T *padded)
+{
+	const int *size = vd->size;
+	const int *texSize = vd->texSize;
+	const size_t rowSize = 4 * (size_t)texSize[0];
+	const size_t sliceSize = rowSize * texSize[1];
+
+	ThreadPool::getInstance().parallelFor(texSize[2], [&](int zBegin, int zEnd)
+	{
+		for (int z = zBegin; z < zEnd; ++z)
+		{
+			T *slice = padded + z * sliceSize;
+
+			if (z >= size[2])
+			{
+				memset(slice, 0, sliceSize * sizeof(T));
+				continue;
+			}
+
+			for (int y = 0; y < size[1]; ++y)
+			{
+				size_t adr = ((size_t)z * size[1] + y) * size[0];
+				T *row = slice + y * rowSize;
+
+				convertRow(data + 3 * adr, next ? next + 3 * adr : NULL, t,
+					size[0], maxLen, zeroDir, row);
+				memset(row + 4 * size[0], 0, (rowSize - 4 * size[0]) * sizeof(T));
+			}
+			memset(slice + size[1] * rowSize, 0, (texSize[1] - size[1]) * rowSize * sizeof(T));
+		}
+#ifdef USE_SSE2
+		// make the streaming stores visible before the upload
+		_mm_sfence();
+#endif
+	});
+}
+
+
+float computeMaxMagnitude(const VolumeData *vd, const VectorSource &src)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		return computeMaxMagnitude(vd, static_cast<const unsigned char*>(src.data),
+			static_cast<const unsigned char*>(src.next), src.t);
+	return computeMaxMagnitude(vd, static_cast<const float*>(src.data),
+		static_cast<const float*>(src.next), src.t);
+}
+
+
+void convertVectorsFloat(const VolumeData *vd, const VectorSource &src,
+	float maxLen, float zeroDir, float *padded)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		convertVectors(vd, static_cast<const unsigned char*>(src.data),
+			static_cast<const unsigned char*>(src.next), src.t, maxLen, zeroDir, padded);
+	else
+		convertVectors(vd, static_cast<const float*>(src.data),
+			static_cast<const float*>(src.next), src.t, maxLen, zeroDir, padded);
+}
+
+
+void convertVectorsChar(const VolumeData *vd, const VectorSource &src,
+	float maxLen, unsigned char *padded)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		convertVectors(vd, static_cast<const unsigned char*>(src.data),
+			static_cast<const unsigned char*>(src.next), src.t, maxLen, 0.0f, padded);
+	else
+		convertVectors(vd, static_cast<const float*>(src.data),
+			static_cast<const float*>(src.next), src.t, maxLen, 0.0f, padded);
+}
+
+
+// convert one brick on the calling thread, rows are contiguous in data
+template<class S, class T>
+static void convertBrick(const S *data, const S *next, float t, const int extent[3],
+	float maxLen, float zeroDir, T *dst, size_t rowStride, size_t sliceStride)
+{
+	for (int z = 0; z < extent[2]; ++z)
+	{
+		for (int y = 0; y < extent[1]; ++y)
+		{
+			size_t adr = ((size_t)z * extent[1] + y) * extent[0];
+
+			convertRow(data + 3 * adr, next ? next + 3 * adr : NULL, t, extent[0],
+				maxLen, zeroDir, dst + 4 * (z * sliceStride + y * rowStride));
+		}
+	}
+#ifdef USE_SSE2
+	_mm_sfence();
+#endif
+}
+
+
+void convertBrickFloat(const VectorSource &src, const int extent[3], float maxLen,
+	float zeroDir, float *dst, size_t rowStride, size_t sliceStride)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		convertBrick(static_cast<const unsigned char*>(src.data),
+			static_cast<const unsigned char*>(src.next), src.t, extent, maxLen, zeroDir,
+			dst, rowStride, sliceStride);
+	else
+		convertBrick(static_cast<const float*>(src.data),
+			static_cast<const float*>(src.next), src.t, extent, maxLen, zeroDir,
+			dst, rowStride, sliceStride);
+}
+
+
+void convertBrickChar(const VectorSource &src, const int extent[3], float maxLen,
+	unsigned char *dst, size_t rowStride, size_t sliceStride)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		convertBrick(static_cast<const unsigned char*>(src.data),
+			static_cast<const unsigned char*>(src.next), src.t, extent, maxLen, 0.0f,
+			dst, rowStride, sliceStride);
+	else
+		convertBrick(static_cast<const float*>(src.data),
+			static_cast<const float*>(src.next), src.t, extent, maxLen, 0.0f,
+			dst, rowStride, sliceStride);
+}
+
+
+template<class S>
+static void accumulateMagnitudeHistogram(const S *p, size_t count, float maxLen,
+	int *histogram, int bins)
+{
+	for (size_t i = 0; i < count; ++i, p += 3)
+	{
+		// same arithmetic as computeMagnitudeStats()
+		float len = sqrt(SQR(toFloat(p[0])) + SQR(toFloat(p[1])) + SQR(toFloat(p[2])));
+		int v = (maxLen > 0.0f) ? (int)(len / maxLen * (bins - 1)) : 0;
+
+		++histogram[(v > bins - 1) ? bins - 1 : v];
+	}
+}
+
+
+void accumulateMagnitudeHistogram(const VectorSource &src, size_t count, float maxLen,
+	int *histogram, int bins)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		accumulateMagnitudeHistogram(static_cast<const unsigned char*>(src.data), count,
+			maxLen, histogram, bins);
+	else
+		accumulateMagnitudeHistogram(static_cast<const float*>(src.data), count,
+			maxLen, histogram, bins);
+}
+
+
+template<class S>
+static void computeMagnitudeStats(const VolumeData *vd, const S *data, float maxLen,
+	float *minLen, float *meanLen, int *histogram, int bins)
+{
+	std::mutex mutex;
+	const int rowSize = vd->size[0];
+	float minimum = FLT_MAX;
+	double sum = 0.0;
+
+	memset(histogram, 0, bins * sizeof(int));
+
+	ThreadPool::getInstance().parallelFor(vd->size[1] * vd->size[2],
+		[&](int begin, int end)
+	{
+		std::vector<int> localHist(bins, 0);
+		float localMin = FLT_MAX;
+		double localSum = 0.0;
+		const S *p = data + 3 * (size_t)begin * rowSize;
+		size_t n = (size_t)(end - begin) * rowSize;
+
+		for (size_t i = 0; i < n; ++i, p += 3)
+		{
+			// same arithmetic as TransferEdit::computeHistogram()
+			float len = sqrt(SQR(toFloat(p[0])) + SQR(toFloat(p[1])) + SQR(toFloat(p[2])));
+			int v = (maxLen > 0.0f) ? (int)(len / maxLen * (bins - 1)) : 0;
+
+			++localHist[(v > bins - 1) ? bins - 1 : v];
+			if (len < localMin)
+				localMin = len;
+			localSum += len;
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for (int i = 0; i < bins; ++i)
+			histogram[i] += localHist[i];
+		if (localMin < minimum)
+			minimum = localMin;
+		sum += localSum;
+	});
+
+	size_t count = (size_t)vd->size[0] * vd->size[1] * vd->size[2];
+	*minLen = count ? minimum : 0.0f;
+	*meanLen = count ? static_cast<float>(sum / count) : 0.0f;
+}
+
+
+void computeMagnitudeStats(const VolumeData *vd, const VectorSource &src, float maxLen,
+	float *minLen, float *meanLen, int *histogram, int bins)
+{
+	if (src.dataType == DATRAW_UCHAR)
+		computeMagnitudeStats(vd, static_cast<const unsigned char*>(src.data), maxLen,
+			minLen, meanLen, histogram, bins);
+	else
+		computeMagnitudeStats(vd, static_cast<const float*>(src.data), maxLen,
+			minLen, meanLen, histogram, bins);
+}
+
+
+// ---- level of detail -------------------------------------------------
+
+// direction in [-1,1] and magnitude of a texel written by convertRow()
+static inline float decodeDirection(float v) { return 2.0f * v - 1.0f; }
+static inline float decodeDirection(unsigned char v) { return (v - 128.0f) / 127.0f; }
+static inline float decodeMagnitude(float v) { return v; }
+static inline float decodeMagnitude(unsigned char v) { return v; }
+
+static inline void encodeMagnitude(float *dst, float len) { *dst = len; }
+static inline void encodeMagnitude(unsigned char *dst, float len)
+{
+	*dst = static_cast<unsigned char>(len + 0.5f);
+}
+
+static inline void encodeDirection(float *dst, const float v[3])
+{
+	dst[0] = 0.5f * v[0] + 0.5f;
+	dst[1] = 0.5f * v[1] + 0.5f;
+	dst[2] = 0.5f * v[2] + 0.5f;
+}
+
+static inline void encodeDirection(unsigned char *dst, const float v[3])
+{
+	for (int c = 0; c < 3; ++c)
+		dst[c] = static_cast<unsigned char>(v[c] * 127.0f + 128.5f);
+}
+
+template<class T>
+static void downsampleVectors(const T *src, const int srcSize[3], T *dst,
+	const int dstSize[3])
+{
+	const size_t srcRow = 4 * (size_t)srcSize[0];
+	const size_t srcSlice = srcRow * srcSize[1];
+
+	ThreadPool::getInstance().parallelFor(dstSize[2], [&](int zBegin, int zEnd)
+	{
+		for (int z = zBegin; z < zEnd; ++z)
+		{
+			// the last texel of odd sizes is repeated
+			int zs[2] = { 2 * z, std::min(2 * z + 1, srcSize[2] - 1) };
+
+			for (int y = 0; y < dstSize[1]; ++y)
+			{
+				int ys[2] = { 2 * y, std::min(2 * y + 1, srcSize[1] - 1) };
+				T *voxel = dst + 4 * (((size_t)z * dstSize[1] + y) * dstSize[0]);
+
+				for (int x = 0; x < dstSize[0]; ++x, voxel += 4)
+				{
+					int xs[2] = { 2 * x, std::min(2 * x + 1, srcSize[0] - 1) };
+					const T *strongest = NULL;
+					float maxLen = -1.0f;
+					float sum[3] = { 0.0f, 0.0f, 0.0f };
+					float lenSum = 0.0f;
+
+					// directions weighted by their magnitude, so zero
+					// vectors and weak flow do not bend the average
+					for (int i = 0; i < 8; ++i)
+					{
+						const T *p = src + zs[i >> 2] * srcSlice + ys[(i >> 1) & 1] * srcRow
+							+ 4 * xs[i & 1];
+						float len = decodeMagnitude(p[3]);
+
+						sum[0] += len * decodeDirection(p[0]);
+						sum[1] += len * decodeDirection(p[1]);
+						sum[2] += len * decodeDirection(p[2]);
+						lenSum += len;
+						if (len > maxLen)
+						{
+							maxLen = len;
+							strongest = p;
+						}
+					}
+
+					float norm = sqrt(SQR(sum[0]) + SQR(sum[1]) + SQR(sum[2]));
+					if (norm < EPS)
+					{
+						// cancelling or zero vectors keep the direction of
+						// the strongest one, i.e. the encoding of zero vectors
+						memcpy(voxel, strongest, 3 * sizeof(T));
+					}
+					else
+					{
+						sum[0] /= norm;
+						sum[1] /= norm;
+						sum[2] /= norm;
+						encodeDirection(voxel, sum);
+					}
+					encodeMagnitude(voxel + 3, lenSum / 8.0f);
+				}
+			}
+		}
+	});
+}
+
+
+void downsampleVectorsFloat(const float *src, const int srcSize[3], float *dst,
+	const int dstSize[3])
+{
+	downsampleVectors(src, srcSize, dst, dstSize);
+}
+
+
+void downsampleVectorsChar(const unsigned char *src, const int srcSize[3],
+	unsigned char *dst, const int dstSize[3])
+{
+	downsampleVectors(src, srcSize, dst, dstSize);
+}
+
+
+// ---- scalar volumes --------------------------------------------------
+
+void normalizeScalarsFloat(float *data, size_t count)
+{
+	std::mutex mutex;
+	float min = FLT_MAX;
+	float max = -FLT_MAX;
+	int numBlocks = static_cast<int>((count + SCALAR_BLOCK_SIZE - 1) / SCALAR_BLOCK_SIZE);
+
+	if (count == 0)
+		return;
+
+	ThreadPool::getInstance().parallelFor(numBlocks, [&](int begin, int end)
+	{
+		size_t i = (size_t)begin * SCALAR_BLOCK_SIZE;
+		size_t last = (size_t)end * SCALAR_BLOCK_SIZE;
+		float localMin = FLT_MAX;
+		float localMax = -FLT_MAX;
+
+		if (last > count)
+			last = count;
+#ifdef USE_SSE2
+		__m128 min4 = _mm_set1_ps(FLT_MAX);
+		__m128 max4 = _mm_set1_ps(-FLT_MAX);
+		for (; i + 4 <= last; i += 4)
+		{
+			__m128 v = _mm_loadu_ps(data + i);
+			min4 = _mm_min_ps(min4, v);
+			max4 = _mm_max_ps(max4, v);
+		}
+		localMin = horizontalMin(min4);
+		localMax = horizontalMax(max4);
+#endif
+		for (; i < last; ++i)
+		{
+			if (localMax < data[i])
+				localMax = data[i];
+			if (localMin > data[i])
+				localMin = data[i];
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (localMin < min)
+			min = localMin;
+		if (localMax > max)
+			max = localMax;
+	});
+
+	const float range = max - min;
+
+	ThreadPool::getInstance().parallelFor(numBlocks, [&](int begin, int end)
+	{
+		size_t i = (size_t)begin * SCALAR_BLOCK_SIZE;
+		size_t last = (size_t)end * SCALAR_BLOCK_SIZE;
+
+		if (last > count)
+			last = count;
+		if (range <= 0.0f)
+		{
+			memset(data + i, 0, (last - i) * sizeof(float));
+			return;
+		}
+#ifdef USE_SSE2
+		const __m128 min4 = _mm_set1_ps(min);
+		const __m128 range4 = _mm_set1_ps(range);
+		for (; i + 4 <= last; i += 4)
+			_mm_storeu_ps(data + i, _mm_div_ps(_mm_sub_ps(_mm_loadu_ps(data + i), min4), range4));
+#endif
+		for (; i < last; ++i)
+			data[i] = (data[i] - min) / range;
+	});
+}
+
+
+void normalizeScalarsChar(unsigned char *data, size_t count)
+{
+	std::mutex mutex;
+	unsigned char min = UCHAR_MAX;
+	unsigned char max = 0;
+	unsigned char lut[UCHAR_MAX + 1];
+	int numBlocks = static_cast<int>((count + SCALAR_BLOCK_SIZE - 1) / SCALAR_BLOCK_SIZE);
+
+	if (count == 0)
+		return;
+
+	ThreadPool::getInstance().parallelFor(numBlocks, [&](int begin, int end)
+	{
+		size_t i = (size_t)begin * SCALAR_BLOCK_SIZE;
+		size_t last = (size_t)end * SCALAR_BLOCK_SIZE;
+		unsigned char localMin = UCHAR_MAX;
+		unsigned char localMax = 0;
+
+		if (last > count)
+			last = count;
+#ifdef USE_SSE2
+		__m128i min16 = _mm_set1_epi8((char)UCHAR_MAX);
+		__m128i max16 = _mm_setzero_si128();
+		unsigned char lanes[16];
+		for (; i + 16 <= last; i += 16)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+			min16 = _mm_min_epu8(min16, v);
+			max16 = _mm_max_epu8(max16, v);
+		}
+		_mm_storeu_si128((__m128i*)lanes, min16);
+		for (int k = 0; k < 16; ++k)
+			localMin = (lanes[k] < localMin) ? lanes[k] : localMin;
+		_mm_storeu_si128((__m128i*)lanes, max16);
+		for (int k = 0; k < 16; ++k)
+			localMax = (lanes[k] > localMax) ? lanes[k] : localMax;
+#endif
+		for (; i < last; ++i)
+		{
+			if (localMax < data[i])
+				localMax = data[i];
+			if (localMin > data[i])
+				localMin = data[i];
+		}
+
+		std::lock_guard<std::mutex> lock(mutex);
+		if (localMin < min)
+			min = localMin;
+		if (localMax > max)
+			max = localMax;
+	});
+
+	// only 256 different results, so look them up
+	for (int v = 0; v <= UCHAR_MAX; ++v)
+	{
+		if ((max <= min) || (v < min) || (v > max))
+			lut[v] = 0;
+		else
+			lut[v] = (unsigned char)((v - min) / (float)(max - min) * UCHAR_MAX);
+	}
+
+	ThreadPool::getInstance().parallelFor(numBlocks, [&](int begin, int end)
+	{
+		size_t last = (size_t)end * SCALAR_BLOCK_SIZE;
+
+		if (last > count)
+			last = count;
+		for (size_t i = (size_t)begin * SCALAR_BLOCK_SIZE; i < last; ++i)
+			data[i] = lut[data[i]];
+	});
+}
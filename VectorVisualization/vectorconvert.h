@@ -0,0 +1,73 @@
+#ifndef _VECTORCONVERT_H_
+#define _VECTORCONVERT_H_
+
+#include <stddef.h>
+
+#include "dataset.h"
+#include "reader.h"
+
+
+// Conversion kernels for the texture data of VectorDataSet and
+// VolumeDataSet. They run on all threads of the ThreadPool and use
+// AVX2 or SSE2 if the compiler targets them.
+
+
+// vector field of a VolumeData, if next is not NULL the field is
+// interpolated linearly between data and next with weight t
+struct VectorSource
+{
+	const void *data;
+	const void *next;
+	float t;
+	DataType dataType;
+};
+
+
+// largest magnitude of the vector field, 0 if all vectors are zero
+float computeMaxMagnitude(const VolumeData *vd, const VectorSource &src);
+
+// write the normalized directions scaled to [0,1] into rgb and the
+// magnitude into a of the zero padded texture (texSize of vd)
+// the magnitude is divided by maxLen and clamped to [0,1], if maxLen is
+// not greater than 0 it is stored unchanged
+// zero vectors get zeroDir in all three components of the direction
+void convertVectorsFloat(const VolumeData *vd, const VectorSource &src,
+	float maxLen, float zeroDir, float *padded);
+// same as above with directions scaled to [1,255] and the magnitude
+// divided by maxLen scaled to [0,255]
+void convertVectorsChar(const VolumeData *vd, const VectorSource &src,
+	float maxLen, unsigned char *padded);
+
+// smallest and mean magnitude of the vector field (next is ignored) and a
+// histogram with bins entries of the magnitudes divided by maxLen
+void computeMagnitudeStats(const VolumeData *vd, const VectorSource &src, float maxLen,
+	float *minLen, float *meanLen, int *histogram, int bins);
+
+// convert a brick of extent[0] x extent[1] x extent[2] vectors (x fastest)
+// like convertVectorsFloat() and convertVectorsChar() on the calling
+// thread, dst is the first voxel of the brick in a texture of rowStride
+// voxels per row and sliceStride voxels per slice
+void convertBrickFloat(const VectorSource &src, const int extent[3], float maxLen,
+	float zeroDir, float *dst, size_t rowStride, size_t sliceStride);
+void convertBrickChar(const VectorSource &src, const int extent[3], float maxLen,
+	unsigned char *dst, size_t rowStride, size_t sliceStride);
+
+// add the magnitudes of count vectors (next is ignored) to a histogram of
+// bins entries like computeMagnitudeStats(), on the calling thread
+void accumulateMagnitudeHistogram(const VectorSource &src, size_t count, float maxLen,
+	int *histogram, int bins);
+
+// next coarser level of a texture filled by convertVectorsFloat() or
+// convertVectorsChar(), every texel of dst (dstSize, at most half of
+// srcSize) averages 2x2x2 texels of src: the directions are weighted by
+// their magnitudes, the magnitude is the mean
+void downsampleVectorsFloat(const float *src, const int srcSize[3], float *dst,
+	const int dstSize[3]);
+void downsampleVectorsChar(const unsigned char *src, const int srcSize[3],
+	unsigned char *dst, const int dstSize[3]);
+
+// scale the values linearly to [0,1] and [0,255] respectively
+void normalizeScalarsFloat(float *data, size_t count);
+void normalizeScalarsChar(unsigned char *data, size_t count);
+
+#endif // _VECTORCONVERT_H_
@@ -0,0 +1,362 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#ifdef _WIN32
+#  include <io.h>
+#  include <fcntl.h>
+#else
+#  include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define USE_SSE2
+#endif
+
+#include "videosink.h"
+#include "threadpool.h"
+
+
+// ---- RGB to YUV ------------------------------------------------------
+
+// BT.601 limited range in 8 bit fixed point, identical in the SSE2 path
+static inline unsigned char luma(int r, int g, int b)
+{
+	return (unsigned char)(((66*r + 129*g + 25*b + 128) >> 8) + 16);
+}
+
+static inline unsigned char chromaU(int r, int g, int b)
+{
+	return (unsigned char)(((-38*r - 74*g + 112*b + 128) >> 8) + 128);
+}
+
+static inline unsigned char chromaV(int r, int g, int b)
+{
+	return (unsigned char)(((112*r - 94*g - 18*b + 128) >> 8) + 128);
+}
+
+// rounds up like _mm_avg_epu8
+static inline int average(int a, int b)
+{
+	return (a + b + 1) >> 1;
+}
+
+
+#ifdef USE_SSE2
+// r, g and b of 8 RGBA pixels as 16 bit integers
+static inline void splitRGB(__m128i p0, __m128i p1, __m128i &r, __m128i &g, __m128i &b)
+{
+	const __m128i mask = _mm_set1_epi32(0xff);
+
+	r = _mm_packs_epi32(_mm_and_si128(p0, mask), _mm_and_si128(p1, mask));
+	g = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+		_mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+	b = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+		_mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+}
+#endif
+
+
+static void convertLumaRow(const unsigned char *src, int width, unsigned char *dst)
+{
+	int x = 0;
+
+#ifdef USE_SSE2
+	// the weighted sum stays below 2^16, so it is computed modulo 2^16
+	// and shifted as unsigned
+	const __m128i cr = _mm_set1_epi16(66);
+	const __m128i cg = _mm_set1_epi16(129);
+	const __m128i cb = _mm_set1_epi16(25);
+	const __m128i round = _mm_set1_epi16(128);
+	const __m128i offset = _mm_set1_epi16(16);
+	__m128i r, g, b, l;
+
+	for (; x + 8 <= width; x += 8)
+	{
+		splitRGB(_mm_loadu_si128((const __m128i*)(src + 4*x)),
+			_mm_loadu_si128((const __m128i*)(src + 4*x + 16)), r, g, b);
+		l = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, cr), _mm_mullo_epi16(g, cg)),
+			_mm_add_epi16(_mm_mullo_epi16(b, cb), round));
+		l = _mm_add_epi16(_mm_srli_epi16(l, 8), offset);
+		_mm_storel_epi64((__m128i*)(dst + x), _mm_packus_epi16(l, l));
+	}
+#endif
+
+	for (; x < width; ++x)
+		dst[x] = luma(src[4*x], src[4*x + 1], src[4*x + 2]);
+}
+
+
+// chroma of the rows src0 and src1 (may be the same row)
+static void convertChromaRow(const unsigned char *src0, const unsigned char *src1,
+	int width, unsigned char *u, unsigned char *v)
+{
+	const int chromaWidth = (width + 1) / 2;
+	int cx = 0;
+
+#ifdef USE_SSE2
+	const __m128i cur = _mm_set1_epi16(-38);
+	const __m128i cug = _mm_set1_epi16(-74);
+	const __m128i cub = _mm_set1_epi16(112);
+	const __m128i cvr = _mm_set1_epi16(112);
+	const __m128i cvg = _mm_set1_epi16(-94);
+	const __m128i cvb = _mm_set1_epi16(-18);
+	const __m128i round = _mm_set1_epi16(128);
+	__m128i a0, a1, r, g, b, cu, cvv;
+	int packed;
+
+	// 8 pixels of both rows give 4 chroma samples
+	for (; 2*cx + 8 <= width; cx += 4)
+	{
+		a0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + 8*cx)),
+			_mm_loadu_si128((const __m128i*)(src1 + 8*cx)));
+		a1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i*)(src0 + 8*cx + 16)),
+			_mm_loadu_si128((const __m128i*)(src1 + 8*cx + 16)));
+		// horizontal neighbors, the results are in the even pixels
+		a0 = _mm_avg_epu8(a0, _mm_srli_epi64(a0, 32));
+		a1 = _mm_avg_epu8(a1, _mm_srli_epi64(a1, 32));
+		a0 = _mm_unpacklo_epi64(_mm_shuffle_epi32(a0, _MM_SHUFFLE(3, 1, 2, 0)),
+			_mm_shuffle_epi32(a1, _MM_SHUFFLE(3, 1, 2, 0)));
+
+		splitRGB(a0, a0, r, g, b);
+		cu = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, cur), _mm_mullo_epi16(g, cug)),
+			_mm_add_epi16(_mm_mullo_epi16(b, cub), round));
+		cvv = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, cvr), _mm_mullo_epi16(g, cvg)),
+			_mm_add_epi16(_mm_mullo_epi16(b, cvb), round));
+		cu = _mm_add_epi16(_mm_srai_epi16(cu, 8), round);
+		cvv = _mm_add_epi16(_mm_srai_epi16(cvv, 8), round);
+
+		packed = _mm_cvtsi128_si32(_mm_packus_epi16(cu, cu));
+		memcpy(u + cx, &packed, 4);
+		packed = _mm_cvtsi128_si32(_mm_packus_epi16(cvv, cvv));
+		memcpy(v + cx, &packed, 4);
+	}
+#endif
+
+	for (; cx < chromaWidth; ++cx)
+	{
+		int x0 = 4 * (2*cx);
+		int x1 = 4 * std::min(2*cx + 1, width - 1);
+		int rgb[3];
+
+		for (int c = 0; c < 3; ++c)
+			rgb[c] = average(average(src0[x0 + c], src1[x0 + c]),
+				average(src0[x1 + c], src1[x1 + c]));
+		u[cx] = chromaU(rgb[0], rgb[1], rgb[2]);
+		v[cx] = chromaV(rgb[0], rgb[1], rgb[2]);
+	}
+}
+
+
+void convertRGBAToYUV420(const unsigned char *rgba, int width, int height,
+	bool invert, unsigned char *y, unsigned char *u, unsigned char *v)
+{
+	const int chromaWidth = (width + 1) / 2;
+	const size_t rowSize = 4 * (size_t)width;
+
+	// one task per pair of rows
+	ThreadPool::getInstance().parallelFor((height + 1) / 2, [&](int begin, int end)
+	{
+		for (int j = begin; j < end; ++j)
+		{
+			int row0 = 2 * j;
+			int row1 = std::min(row0 + 1, height - 1);
+			const unsigned char *src0 = rgba + (invert ? height - 1 - row0 : row0) * rowSize;
+			const unsigned char *src1 = rgba + (invert ? height - 1 - row1 : row1) * rowSize;
+
+			convertLumaRow(src0, width, y + (size_t)row0 * width);
+			if (row1 != row0)
+				convertLumaRow(src1, width, y + (size_t)row1 * width);
+			convertChromaRow(src0, src1, width, u + (size_t)j * chromaWidth,
+				v + (size_t)j * chromaWidth);
+		}
+	});
+}
+
+
+// ---- VideoSink -------------------------------------------------------
+
+VideoSink::VideoSink(void) : _fp(NULL), _stdout(false), _format(VIDEO_Y4M),
+	_fps(25), _width(0), _height(0), _lastFrameNumber(-1), _numReserved(0),
+	_nextSeq(0), _numWritten(0)
+{
+}
+
+
+VideoSink::~VideoSink(void)
+{
+	close();
+}
+
+
+bool VideoSink::open(const char *fileName, Format format, int fps)
+{
+	close();
+
+	if (!fileName || (fps < 1))
+		return false;
+
+	_stdout = (strcmp(fileName, "-") == 0);
+	if (_stdout)
+	{
+		// the stream gets its own descriptor of stdout, the messages of
+		// the program go to stderr from now on
+		fflush(stdout);
+#ifdef _WIN32
+		int fd = _dup(_fileno(stdout));
+		if (fd >= 0)
+		{
+			_setmode(fd, _O_BINARY);
+			_fp = _fdopen(fd, "wb");
+			_dup2(_fileno(stderr), _fileno(stdout));
+		}
+#else
+		int fd = dup(STDOUT_FILENO);
+		if (fd >= 0)
+		{
+			_fp = fdopen(fd, "wb");
+			dup2(STDERR_FILENO, STDOUT_FILENO);
+		}
+#endif
+	}
+	else
+	{
+		_fp = fopen(fileName, "wb");
+	}
+
+	if (!_fp)
+	{
+		fprintf(stderr, "VideoSink:  Could not open \"%s\".\n", fileName);
+		return false;
+	}
+
+	_fileName = _stdout ? "stdout" : fileName;
+	_format = format;
+	_fps = fps;
+	_width = _height = 0;
+	_lastFrameNumber = -1;
+	_numReserved = _nextSeq = 0;
+	_numWritten = 0;
+
+	return true;
+}
+
+
+void VideoSink::close(void)
+{
+	if (!_fp)
+		return;
+
+	fclose(_fp);
+	_fp = NULL;
+	fprintf(stdout, "VideoSink:  %d frames written to %s\n", _numWritten, _fileName.c_str());
+}
+
+
+bool VideoSink::writeFrame(unsigned int seq, int frameNumber, const Image *img, bool invert)
+{
+	static thread_local std::vector<unsigned char> rgba;
+	static thread_local std::vector<unsigned char> frame;
+	bool ok = img && img->imgData && ((img->channel == 3) || (img->channel == 4))
+		&& (img->width > 0) && (img->height > 0);
+
+	// convert before waiting for the turn, so the calling threads convert
+	// their frames at the same time
+	if (ok)
+	{
+		const size_t numPixels = (size_t)img->width * img->height;
+		const unsigned char *src = img->imgData;
+
+		if (img->channel == 3)
+		{
+			rgba.resize(4 * numPixels);
+			for (size_t i = 0; i < numPixels; ++i)
+			{
+				memcpy(&rgba[4*i], img->imgData + 3*i, 3);
+				rgba[4*i + 3] = 255;
+			}
+			src = &rgba[0];
+		}
+
+		if (_format == VIDEO_Y4M)
+		{
+			const size_t chromaSize = (size_t)((img->width + 1) / 2) * ((img->height + 1) / 2);
+
+			frame.resize(numPixels + 2 * chromaSize);
+			convertRGBAToYUV420(src, img->width, img->height, invert, &frame[0],
+				&frame[numPixels], &frame[numPixels + chromaSize]);
+		}
+		else
+		{
+			frame.resize(3 * numPixels);
+			for (int row = 0; row < img->height; ++row)
+			{
+				const unsigned char *s = src
+					+ 4 * (size_t)img->width * (invert ? img->height - 1 - row : row);
+				unsigned char *d = &frame[3 * (size_t)img->width * row];
+
+				for (int x = 0; x < img->width; ++x, s += 4, d += 3)
+				{
+					d[0] = s[0];
+					d[1] = s[1];
+					d[2] = s[2];
+				}
+			}
+		}
+	}
+
+	std::unique_lock<std::mutex> lock(_mutex);
+	_turn.wait(lock, [&] { return _nextSeq == seq; });
+
+	if (ok && _fp)
+	{
+		if (_width == 0)
+		{
+			_width = img->width;
+			_height = img->height;
+			if (_format == VIDEO_Y4M)
+				fprintf(_fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", _width, _height, _fps);
+			fprintf(stdout, "VideoSink:  %s %dx%d at %d fps\n",
+				(_format == VIDEO_Y4M) ? "y4m" : "rgb24", _width, _height, _fps);
+		}
+
+		if ((img->width != _width) || (img->height != _height))
+		{
+			fprintf(stderr, "VideoSink:  Frame %d has a different size, dropped.\n", frameNumber);
+			ok = false;
+		}
+		else
+		{
+			// a gap in the frame numbers is filled with this frame
+			int repeat = ((_lastFrameNumber >= 0) && (frameNumber > _lastFrameNumber))
+				? frameNumber - _lastFrameNumber : 1;
+
+			for (int i = 0; i < repeat; ++i)
+			{
+				if (_format == VIDEO_Y4M)
+					fputs("FRAME\n", _fp);
+				fwrite(&frame[0], 1, frame.size(), _fp);
+			}
+			_lastFrameNumber = frameNumber;
+			_numWritten += repeat;
+
+			if (ferror(_fp))
+			{
+				fprintf(stderr, "VideoSink:  Writing to %s failed.\n", _fileName.c_str());
+				ok = false;
+			}
+		}
+	}
+	else
+	{
+		ok = false;
+	}
+
+	++_nextSeq;
+	lock.unlock();
+	_turn.notify_all();
+
+	return ok;
+}
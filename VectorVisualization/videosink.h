@@ -0,0 +1,85 @@
+#ifndef _VIDEOSINK_H_
+#define _VIDEOSINK_H_
+
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include "imageUtils.h"
+
+
+// Uncompressed video stream for recordings, e.g. piped into an external
+// encoder instead of writing one PNG file per frame:
+//
+//   VIDEO_Y4M   YUV4MPEG2, 4:2:0 BT.601 limited range, chroma centered
+//   VIDEO_RGB   raw rgb24 frames without any header
+//
+// The size of the stream is that of the first frame, frames of another
+// size are dropped. Frames are converted by the calling threads at the
+// same time but written strictly in the order of their sequence
+// number, see reserveFrame(). The frame number (the animation frame
+// counter) is the time code: if numbers are skipped, the frame is
+// repeated so the stream keeps the timing.
+class VideoSink
+{
+public:
+	enum Format
+	{
+		VIDEO_Y4M = 0,
+		VIDEO_RGB
+	};
+
+	VideoSink(void);
+	~VideoSink(void);
+
+	// fileName "-" writes to stdout, all text printed on stdout is
+	// redirected to stderr afterwards
+	bool open(const char *fileName, Format format, int fps);
+	void close(void);
+
+	bool isOpen(void) { return _fp != NULL; }
+
+	// sequence number of the next frame, has to be called in the order
+	// of the frames and every number has to be passed to writeFrame()
+	unsigned int reserveFrame(void) { return _numReserved++; }
+
+	// img is RGB or RGBA, stored bottom-up if invert is set, NULL skips
+	// the sequence number
+	// blocks until all frames with smaller sequence numbers are written
+	bool writeFrame(unsigned int seq, int frameNumber, const Image *img, bool invert);
+
+	int getNumWritten(void) { return _numWritten; }
+
+private:
+	VideoSink(const VideoSink&);
+	VideoSink& operator=(const VideoSink&);
+
+	FILE *_fp;
+	std::string _fileName;
+	bool _stdout;
+	Format _format;
+	int _fps;
+
+	// set by the first frame
+	int _width;
+	int _height;
+	int _lastFrameNumber;
+
+	unsigned int _numReserved;
+	unsigned int _nextSeq;
+	int _numWritten;
+
+	std::mutex _mutex;
+	std::condition_variable _turn;
+};
+
+
+// BT.601 limited range 4:2:0, the chroma of every 2x2 block is computed
+// from its average color, rgba has 4 bytes per pixel
+// rows are read bottom-up if invert is set, u and v have
+// (width+1)/2 x (height+1)/2 samples
+void convertRGBAToYUV420(const unsigned char *rgba, int width, int height,
+	bool invert, unsigned char *y, unsigned char *u, unsigned char *v);
+
+#endif // _VIDEOSINK_H_